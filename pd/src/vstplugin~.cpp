@@ -369,7 +369,13 @@ SharedMutex gPresetMutex;
 
 static std::string gSettingsDir = userSettingsPath() + "/pd";
 
+// binary cache file, see PluginDictionary
 static std::string gCacheFileName = std::string("cache_")
+        + cpuArchToString(getHostCpuArchitecture()) + ".bin";
+
+// cache file in text format of older versions; it is imported
+// if there is no binary cache file yet.
+static std::string gLegacyCacheFileName = std::string("cache_")
         + cpuArchToString(getHostCpuArchitecture()) + ".ini";
 
 static Mutex gFileLock;
@@ -377,6 +383,9 @@ static Mutex gFileLock;
 static void readCacheFile(const std::string& dir, bool loud){
     std::lock_guard lock(gFileLock);
     auto path = dir + "/" + gCacheFileName;
+    if (!pathExists(path)){
+        path = dir + "/" + gLegacyCacheFileName;
+    }
     if (pathExists(path)){
         logpost(nullptr, PdDebug, "read cache file %s", path.c_str());
         try {
@@ -581,7 +590,8 @@ std::vector<t_symbol *> makePluginList(const std::vector<PluginDesc::const_ptr>&
     return result;
 }
 
-#define PROBE_FUTURES 8
+// print pending plugins after this many seconds without progress
+#define PROBE_WAIT_INTERVAL 4.0
 
 template<bool async>
 static void searchPlugins(const std::string& path, t_search_data *data){
@@ -601,6 +611,8 @@ static void searchPlugins(const std::string& path, t_search_data *data){
     };
 
     std::vector<std::pair<FactoryFuture, std::string>> futures;
+    // NB: only evaluate once per search, see getProbeConcurrency()
+    int maxNumFutures = parallel ? vst::getProbeConcurrency() : 1;
 
     auto last = std::chrono::system_clock::now();
 
@@ -634,15 +646,17 @@ static void searchPlugins(const std::string& path, t_search_data *data){
             } else {
                 using seconds = std::chrono::duration<double>;
                 auto elapsed = std::chrono::duration_cast<seconds>(now - last).count();
-                if (elapsed > 4.0){
+                if (elapsed > PROBE_WAIT_INTERVAL){
                     for (auto& x : futures){
                         PdLog<async>() << "waiting for '" << x.second << "'...";
                     }
                     // PdLog<async> log(PD_NORMAL, "...");
                     last = now;
+                } else {
+                    // wait for the next result (instead of polling)
+                    vst::waitProbes(PROBE_WAIT_INTERVAL - elapsed);
                 }
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(2));
         }
     };
 
@@ -681,7 +695,7 @@ static void searchPlugins(const std::string& path, t_search_data *data){
             // probe (will post results and add plugins)
             if (parallel){
                 futures.emplace_back(probePluginAsync<async>(pluginPath, timeout), pluginPath);
-                processFutures(PROBE_FUTURES);
+                processFutures(maxNumFutures);
             } else {
                 if (auto factory = probePlugin<async>(pluginPath, timeout)) {
                     int numPlugins = factory->numPlugins();
@@ -1471,6 +1485,10 @@ static void vstplugin_cache_clear(t_vstplugin *x, t_floatarg f){
     // unloading plugins might crash, so we first delete the cache file
     if (f != 0){
         removeFile(gSettingsDir + "/" + gCacheFileName);
+        auto legacyPath = gSettingsDir + "/" + gLegacyCacheFileName;
+        if (pathExists(legacyPath)) {
+            removeFile(legacyPath);
+        }
     }
     // clear the plugin description dictionary
     gPluginDict.clear();
@@ -2144,6 +2162,21 @@ static void vstplugin_transport_get(t_vstplugin *x){
     outlet_anything(x->x_messout, gensym("transport"), 1, &a);
 }
 
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~ DSP load ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// mean, max and 99th percentile of the process time (in microseconds)
+// + average percentage of the block duration
+static void vstplugin_cpu(t_vstplugin *x){
+    if (!x->check_plugin()) return;
+    auto stats = x->x_plugin->getProcessStats();
+    t_atom msg[4];
+    SETFLOAT(&msg[0], stats.mean);
+    SETFLOAT(&msg[1], stats.max);
+    SETFLOAT(&msg[2], stats.p99);
+    SETFLOAT(&msg[3], stats.load);
+    outlet_anything(x->x_messout, gensym("cpu"), 4, msg);
+}
+
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~ I/O info ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
 enum class t_direction {
@@ -4084,9 +4117,73 @@ static void vstplugin_dsp(t_vstplugin *x, t_signal **sp){
 
 /*-------------------------- global methods ----------------------------*/
 
+struct t_dsp_threads_data : t_command_data<t_dsp_threads_data> {
+    int numthreads;
+};
+
+// NB: resizes the thread pool if it is already running
 void vstplugin_dsp_threads(t_vstplugin *x, t_floatarg f) {
-    int numthreads = f > 0 ? f : 0;
-    setNumDSPThreads(numthreads);
+    auto data = new t_dsp_threads_data();
+    data->numthreads = f > 0 ? f : 0;
+    // resizing a running thread pool is not realtime safe, so we do it
+    // on the worker thread. NB: no owner, the resize must not be cancelled.
+    t_workqueue::get()->push(nullptr, data,
+        [](t_dsp_threads_data *x){
+            setNumDSPThreads(x->numthreads);
+        }, nullptr);
+}
+
+// list of CPUs for DSP helper threads (and bridge RT threads); no arguments = no pinning
+void vstplugin_dsp_affinity(t_vstplugin *x, t_symbol *s, int argc, t_atom *argv) {
+    std::vector<int> cpus;
+    for (int i = 0; i < argc; ++i){
+        int cpu = atom_getfloat(argv + i);
+        if (cpu >= 0){
+            cpus.push_back(cpu);
+        } else {
+            pd_error(x, "%s: bad CPU index %d", classname(x), cpu);
+            return;
+        }
+    }
+    setDSPThreadAffinity(cpus);
+}
+
+// realtime priority for DSP helper threads (and bridge RT threads); 0 = default
+void vstplugin_dsp_priority(t_vstplugin *x, t_floatarg f) {
+    int priority = f > 0 ? f : 0;
+    setDSPThreadPriority(priority);
+}
+
+// report the number and utilization of the DSP helper threads
+// + the actual placement of each thread
+void vstplugin_dsp_threads_info(t_vstplugin *x) {
+    int numthreads;
+    double utilization;
+    if (getDSPThreadPoolStatus(numthreads, utilization)){
+        t_atom msg[2];
+        SETFLOAT(&msg[0], numthreads);
+        SETFLOAT(&msg[1], utilization);
+        outlet_anything(x->x_messout, gensym("dsp_threads"), 2, msg);
+    }
+    // how often threaded plugins had to wait (immediate, spin, yield, block)
+    DSPWaitStats stats;
+    if (getDSPWaitStats(stats)){
+        t_atom msg[4];
+        SETFLOAT(&msg[0], stats.immediate);
+        SETFLOAT(&msg[1], stats.spin);
+        SETFLOAT(&msg[2], stats.yield);
+        SETFLOAT(&msg[3], stats.block);
+        outlet_anything(x->x_messout, gensym("dsp_wait"), 4, msg);
+    }
+    auto info = getDSPThreadInfo();
+    for (int i = 0; i < (int)info.size(); ++i){
+        t_atom msg[4];
+        SETFLOAT(&msg[0], i);
+        SETFLOAT(&msg[1], info[i].cpu);
+        SETFLOAT(&msg[2], info[i].affinity);
+        SETFLOAT(&msg[3], info[i].priority);
+        outlet_anything(x->x_messout, gensym("dsp_thread"), 4, msg);
+    }
 }
 
 /*-------------------------- private methods ---------------------------*/
@@ -4174,6 +4271,8 @@ EXPORT void vstplugin_tilde_setup(void) {
 #endif
     class_addmethod(vstplugin_class, (t_method)vstplugin_transport_set, gensym("transport_set"), A_FLOAT, A_NULL);
     class_addmethod(vstplugin_class, (t_method)vstplugin_transport_get, gensym("transport_get"), A_NULL);
+    // DSP load
+    class_addmethod(vstplugin_class, (t_method)vstplugin_cpu, gensym("cpu"), A_NULL);
     // inputs/outputs
     class_addmethod(vstplugin_class, (t_method)vstplugin_bus_info<t_direction::in>, gensym("input_info"), A_FLOAT, A_NULL);
     class_addmethod(vstplugin_class, (t_method)vstplugin_bus_list<t_direction::in>, gensym("input_list"), A_DEFSYM, A_NULL);
@@ -4225,6 +4324,9 @@ EXPORT void vstplugin_tilde_setup(void) {
     class_addmethod(vstplugin_class, (t_method)vstplugin_preset_write<BANK>, gensym("bank_write"), A_SYMBOL, A_DEFFLOAT, A_NULL);
     // global messages
     class_addmethod(vstplugin_class, (t_method)vstplugin_dsp_threads, gensym("dsp_threads"), A_DEFFLOAT, A_NULL);
+    class_addmethod(vstplugin_class, (t_method)vstplugin_dsp_affinity, gensym("dsp_affinity"), A_GIMME, A_NULL);
+    class_addmethod(vstplugin_class, (t_method)vstplugin_dsp_priority, gensym("dsp_priority"), A_DEFFLOAT, A_NULL);
+    class_addmethod(vstplugin_class, (t_method)vstplugin_dsp_threads_info, gensym("dsp_threads_info"), A_NULL);
     // private messages
     class_addmethod(vstplugin_class, (t_method)vstplugin_preset_change, gensym("preset_change"), A_SYMBOL, A_NULL);
     class_addmethod(vstplugin_class, (t_method)vstplugin_multichannel, gensym("multichannel"), A_NULL);
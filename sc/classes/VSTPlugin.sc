@@ -420,6 +420,24 @@ VSTPlugin : MultiOutUGen {
 	*initDSPThreadsMsg { arg numThreads;
 		^['/cmd', '/vst_dsp_threads', numThreads ?? 0 ];
 	}
+	*setDSPThreadAffinity { arg server, cpus;
+		server = server ?? Server.default;
+		server.listSendMsg(this.setDSPThreadAffinityMsg(cpus));
+	}
+	*setDSPThreadAffinityMsg { arg cpus;
+		^['/cmd', '/vst_dsp_affinity'] ++ (cpus ?? []).asArray.collect(_.asInteger);
+	}
+	*setDSPThreadPriority { arg server, priority;
+		server = server ?? Server.default;
+		server.listSendMsg(this.setDSPThreadPriorityMsg(priority));
+	}
+	*setDSPThreadPriorityMsg { arg priority;
+		^['/cmd', '/vst_dsp_priority', priority ?? 0 ];
+	}
+	*postDSPThreadInfo { arg server;
+		server = server ?? Server.default;
+		server.listSendMsg(['/cmd', '/vst_dsp_threads_info']);
+	}
 
 	// instance methods
 	init { arg id, info, blockSize, bypass, numIn, numOut, numParams ... args;
@@ -1086,6 +1086,16 @@ VSTPluginController {
 		this.sendMsg('/transport_get');
 	}
 
+	// DSP load
+	getCpu { arg action;
+		this.prCheckPlugin(thisMethod);
+		this.prMakeOscFunc({ arg msg;
+			// mean, max, p99 (in microseconds), load (in percent)
+			action.value(*msg[3..6]);
+		}, '/vst_cpu').oneShot;
+		this.sendMsg('/cpu');
+	}
+
 	// advanced
 	canDo { arg what, action;
 		this.prCheckPlugin(thisMethod);
@@ -207,7 +207,14 @@ static PluginDictionary gPluginDict;
 
 static std::string gSettingsDir = userSettingsPath() + "/sc";
 
+// binary cache file, see PluginDictionary
 static std::string gCacheFileName = std::string("cache_")
+        + cpuArchToString(getHostCpuArchitecture()) + ".bin";
+
+// cache file in text format. It is written alongside the binary cache file
+// because VSTPlugin.readPlugins parses it in the Client (without a Server).
+// It is only read if there is no binary cache file yet (e.g. older versions).
+static std::string gTextCacheFileName = std::string("cache_")
         + cpuArchToString(getHostCpuArchitecture()) + ".ini";
 
 static Mutex gFileLock;
@@ -215,6 +222,9 @@ static Mutex gFileLock;
 static void readCacheFile(const std::string& dir, bool loud) {
     std::lock_guard lock(gFileLock);
     auto path = dir + "/" + gCacheFileName;
+    if (!pathExists(path)){
+        path = dir + "/" + gTextCacheFileName;
+    }
     if (pathExists(path)){
         LOG_INFO("VSTPlugin: read cache file " << path);
         try {
@@ -233,11 +243,18 @@ static void readCacheFile(){
     readCacheFile(gSettingsDir, false);
 }
 
+// NB: called with gFileLock held
+static void doWriteCacheFile(const std::string& dir) {
+    gPluginDict.write(dir + "/" + gCacheFileName);
+    gPluginDict.write(dir + "/" + gTextCacheFileName,
+                      PluginDictionary::Format::Text);
+}
+
 static void writeCacheFile(const std::string& dir) {
     std::lock_guard lock(gFileLock);
     try {
         if (pathExists(dir)) {
-            gPluginDict.write(dir + "/" + gCacheFileName);
+            doWriteCacheFile(dir);
         } else {
             throw Error("directory " + dir + " does not exist");
         }
@@ -255,7 +272,7 @@ static void writeCacheFile() {
                 throw Error("couldn't create directory " + gSettingsDir);
             }
         }
-        gPluginDict.write(gSettingsDir + "/" + gCacheFileName);
+        doWriteCacheFile(gSettingsDir);
     } catch (const Error& e) {
         LOG_ERROR("VSTPlugin: couldn't write cache file: " << e.what());
     }
@@ -514,7 +531,8 @@ static const PluginDesc* queryPlugin(const std::string& path) {
     return desc.get();
 }
 
-#define PROBE_FUTURES 8
+// print pending plugins after this many seconds without progress
+#define PROBE_WAIT_INTERVAL 4.0
 
 #if WARN_VST3_PARAMETERS
 // HACK
@@ -536,6 +554,8 @@ std::vector<PluginDesc::const_ptr> searchPlugins(const std::string& path,
     };
 
     std::vector<std::pair<FactoryFuture, std::string>> futures;
+    // NB: only evaluate once per search, see getProbeConcurrency()
+    int maxNumFutures = parallel ? vst::getProbeConcurrency() : 1;
 
     auto last = std::chrono::system_clock::now();
 
@@ -569,14 +589,16 @@ std::vector<PluginDesc::const_ptr> searchPlugins(const std::string& path,
             } else {
                 using seconds = std::chrono::duration<double>;
                 auto elapsed = std::chrono::duration_cast<seconds>(now - last).count();
-                if (elapsed > 4.0){
+                if (elapsed > PROBE_WAIT_INTERVAL){
                     for (auto& x : futures){
                         LOG_INFO("Waiting for '" << x.second << "'...");
                     }
                     last = now;
+                } else {
+                    // wait for the next result (instead of polling)
+                    vst::waitProbes(PROBE_WAIT_INTERVAL - elapsed);
                 }
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(2));
         }
     };
 
@@ -617,7 +639,7 @@ std::vector<PluginDesc::const_ptr> searchPlugins(const std::string& path,
             // probe (will post results and add plugins)
             if (parallel){
                 futures.emplace_back(probePluginAsync(pluginPath, timeout, verbose), pluginPath);
-                processFutures(PROBE_FUTURES);
+                processFutures(maxNumFutures);
             } else {
                 if (auto factory = probePlugin(pluginPath, timeout, verbose)) {
                     int numPlugins = factory->numPlugins();
@@ -2546,6 +2568,20 @@ void VSTPluginDelegate::getTransportPos() {
     }
 }
 
+// DSP load
+
+void VSTPluginDelegate::getProcessStats() {
+    float data[4] = { 0 };
+    if (check()) {
+        auto stats = plugin_->getProcessStats();
+        data[0] = stats.mean;
+        data[1] = stats.max;
+        data[2] = stats.p99;
+        data[3] = stats.load;
+    }
+    sendMsg("/vst_cpu", 4, data);
+}
+
 // advanced
 
 void VSTPluginDelegate::canDo(const char *what) {
@@ -3067,6 +3103,10 @@ void vst_transport_get(VSTPlugin* unit, sc_msg_iter *args) {
     unit->delegate().getTransportPos();
 }
 
+void vst_cpu(VSTPlugin* unit, sc_msg_iter *args) {
+    unit->delegate().getProcessStats();
+}
+
 void vst_can_do(VSTPlugin* unit, sc_msg_iter *args) {
     const char* what = args->gets();
     if (what) {
@@ -3322,6 +3362,10 @@ void vst_clear(World* inWorld, void* inUserData, struct sc_msg_iter* args, void*
             if (flags & 1) {
                 // remove cache file
                 removeFile(gSettingsDir + "/" + gCacheFileName);
+                auto textPath = gSettingsDir + "/" + gTextCacheFileName;
+                if (pathExists(textPath)) {
+                    removeFile(textPath);
+                }
             }
             getPluginDict().clear();
             return false;
@@ -3443,7 +3487,65 @@ void vst_query(World *inWorld, void* inUserData, struct sc_msg_iter *args, void
 
 void vst_dsp_threads(World *inWorld, void* inUserData, struct sc_msg_iter *args, void *replyAddr) {
     int numThreads = args->geti();
-    setNumDSPThreads(numThreads);
+    // resizing a running thread pool is not realtime safe
+    DoAsynchronousCommand(inWorld, replyAddr, "vst_dsp_threads", (void *)(intptr_t)numThreads,
+        [](World*, void* data) {
+            setNumDSPThreads((intptr_t)data);
+            return false;
+        }, 0, 0, 0, 0, 0);
+}
+
+void vst_dsp_affinity(World *inWorld, void* inUserData, struct sc_msg_iter *args, void *replyAddr) {
+    struct AffinityCmdData {
+        int numCpus;
+        int cpus[64];
+    };
+
+    auto data = (AffinityCmdData *)RTAlloc(inWorld, sizeof(AffinityCmdData));
+    if (data) {
+        data->numCpus = 0;
+        while (args->remain() > 0 && data->numCpus < 64) {
+            data->cpus[data->numCpus++] = args->geti();
+        }
+        // setDSPThreadAffinity() is not realtime safe
+        DoAsynchronousCommand(inWorld, replyAddr, "vst_dsp_affinity", data, [](World*, void* data) {
+            auto cmd = static_cast<AffinityCmdData *>(data);
+            setDSPThreadAffinity(std::vector<int>(cmd->cpus, cmd->cpus + cmd->numCpus));
+            return false;
+        }, 0, 0, RTFree, 0, 0);
+    }
+}
+
+void vst_dsp_priority(World *inWorld, void* inUserData, struct sc_msg_iter *args, void *replyAddr) {
+    int priority = args->geti();
+    DoAsynchronousCommand(inWorld, replyAddr, "vst_dsp_priority", (void *)(intptr_t)priority,
+        [](World*, void* data) {
+            setDSPThreadPriority((intptr_t)data);
+            return false;
+        }, 0, 0, 0, 0, 0);
+}
+
+void vst_dsp_threads_info(World *inWorld, void* inUserData, struct sc_msg_iter *args, void *replyAddr) {
+    // post the actual placement of the DSP helper threads
+    DoAsynchronousCommand(inWorld, replyAddr, "vst_dsp_threads_info", nullptr, [](World*, void*) {
+        int numThreads;
+        double utilization;
+        if (getDSPThreadPoolStatus(numThreads, utilization)) {
+            LOG_INFO("DSP thread pool: " << numThreads << " threads, "
+                     << (utilization * 100.0) << "% utilization");
+        }
+        DSPWaitStats stats;
+        if (getDSPWaitStats(stats)) {
+            LOG_INFO("DSP thread wait stats: immediate = " << stats.immediate << ", spin = "
+                     << stats.spin << ", yield = " << stats.yield << ", block = " << stats.block);
+        }
+        auto info = getDSPThreadInfo();
+        for (int i = 0; i < (int)info.size(); ++i) {
+            LOG_INFO("DSP thread " << i << ": CPU " << info[i].cpu << ", affinity "
+                     << info[i].affinity << ", priority " << info[i].priority);
+        }
+        return false;
+    }, 0, 0, 0, 0, 0);
 }
 
 /*** plugin entry point ***/
@@ -3536,6 +3638,8 @@ PluginLoad(VSTPlugin) {
     UnitCmd(transport_set);
     UnitCmd(transport_get);
 
+    UnitCmd(cpu);
+
     UnitCmd(can_do);
     UnitCmd(vendor_method);
 
@@ -3546,6 +3650,9 @@ PluginLoad(VSTPlugin) {
     PluginCmd(vst_query);
 
     PluginCmd(vst_dsp_threads);
+    PluginCmd(vst_dsp_affinity);
+    PluginCmd(vst_dsp_priority);
+    PluginCmd(vst_dsp_threads_info);
 
     setLogFunction(SCLog);
 
@@ -127,6 +127,9 @@ public:
     void setTransportPos(float pos);
     void getTransportPos();
 
+    // DSP load
+    void getProcessStats();
+
     // advanced
     void canDo(const char* what);
     void vendorSpecific(int32 index, int32 value, size_t size,
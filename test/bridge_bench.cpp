@@ -0,0 +1,208 @@
+#include "Interface.h"
+#include "FileUtils.h"
+#include "Log.h"
+#include "MiscUtils.h"
+#include "PluginDesc.h"
+
+#include "plf_nanotimer/plf_nanotimer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// End-to-end benchmark for bridged plugins: the built-in dummy plugin
+// (see vst/DummyPlugin.h) is loaded into the actual host app in sandbox
+// mode and we measure the round trip of PluginClient::process().
+// NB: the executable must be located next to the host app!
+
+using namespace vst;
+
+#define TEST_REALTIME 1
+
+#define TEST_SAMPLERATE 48000
+#define TEST_WARMUP_COUNT 100
+#define TEST_COUNT 2000 // default number of measured blocks
+#define TEST_PIPELINED 1 // also test ThreadMode::Pipelined
+
+static const int gBlockSizes[] = { 32, 64, 256, 1024 };
+static const int gChannels[] = { 1, 2, 8, 32 };
+
+static plf::nanotimer gTimer;
+
+static bool gFailed = false;
+
+template<typename T>
+class AudioBuffer {
+ public:
+    AudioBuffer(int numChannels, int numSamples)
+        : data_(numChannels * numSamples), channels_(numChannels) {
+        for (int i = 0; i < numChannels; ++i){
+            channels_[i] = data_.data() + i * numSamples;
+        }
+        bus_.numChannels = numChannels;
+        bus_.channelData32 = (float **)channels_.data();
+    }
+
+    T* channel(int index) { return channels_[index]; }
+    AudioBus& bus() { return bus_; }
+ private:
+    std::vector<T> data_;
+    std::vector<T *> channels_;
+    AudioBus bus_;
+};
+
+// log2 histogram of the process times in microseconds
+static void print_histogram(const std::vector<double>& times){
+    const int numBins = 16;
+    int bins[numBins] = { 0 };
+    for (auto& t : times){
+        int bin = t >= 1.0 ? (int)std::log2(t) + 1 : 0;
+        bins[std::min(bin, numBins - 1)]++;
+    }
+    for (int i = 0; i < numBins; ++i){
+        if (bins[i] > 0){
+            LOG_INFO("    < " << (1 << i) << " us: " << bins[i]);
+        }
+    }
+}
+
+template<typename T>
+void benchmark(IPlugin& plugin, ProcessPrecision precision,
+               int blockSize, int numChannels, int count, bool verify){
+    plugin.suspend();
+    plugin.setupProcessing(TEST_SAMPLERATE, blockSize, precision, ProcessMode::Realtime);
+    plugin.setNumSpeakers(&numChannels, 1, &numChannels, 1);
+    plugin.resume();
+
+    AudioBuffer<T> input(numChannels, blockSize);
+    AudioBuffer<T> output(numChannels, blockSize);
+    for (int i = 0; i < numChannels; ++i){
+        for (int j = 0; j < blockSize; ++j){
+            input.channel(i)[j] = (T)(i * blockSize + j) / (numChannels * blockSize);
+        }
+    }
+
+    ProcessData data;
+    data.inputs = &input.bus();
+    data.numInputs = 1;
+    data.outputs = &output.bus();
+    data.numOutputs = 1;
+    data.numSamples = blockSize;
+    data.precision = precision;
+    data.mode = ProcessMode::Realtime;
+
+    for (int i = 0; i < TEST_WARMUP_COUNT; ++i){
+        plugin.process(data);
+    }
+
+    // the dummy plugin simply copies the input (unity gain).
+    // NB: with ThreadMode::Pipelined, a late block would output silence.
+    for (int i = 0; verify && i < numChannels; ++i){
+        if (!std::equal(input.channel(i), input.channel(i) + blockSize,
+                        output.channel(i))){
+            LOG_ERROR("ERROR: output doesn't match input (channel " << i << ")");
+            gFailed = true;
+            break;
+        }
+    }
+
+    std::vector<double> times(count);
+    auto t1 = gTimer.get_elapsed_us();
+    for (int i = 0; i < count; ++i){
+        auto t = gTimer.get_elapsed_us();
+        plugin.process(data);
+        times[i] = gTimer.get_elapsed_us() - t;
+    }
+    auto elapsed = gTimer.get_elapsed_us() - t1;
+
+    std::sort(times.begin(), times.end());
+    auto percentile = [&](double p){
+        return times[std::min<size_t>(p * times.size(), times.size() - 1)];
+    };
+    double blockDuration = (double)blockSize / TEST_SAMPLERATE * 1000000.0;
+    // throughput in (mega)samples per second over all channels
+    double throughput = (double)count * blockSize * numChannels / elapsed;
+
+    LOG_INFO((precision == ProcessPrecision::Double ? "double" : "single")
+             << ", " << blockSize << " samples, " << numChannels << " channels: "
+             << "median = " << percentile(0.5) << " us, p99 = " << percentile(0.99)
+             << " us, max = " << times.back() << " us, average = " << (elapsed / count)
+             << " us (" << (elapsed / count / blockDuration * 100.0) << "% of block), "
+             << "throughput = " << throughput << " MS/s");
+    print_histogram(times);
+}
+
+void run(const PluginDesc& desc, bool pipelined, int count){
+    LOG_INFO("---");
+    LOG_INFO((pipelined ? "sandbox (pipelined)" : "sandbox"));
+    LOG_INFO("---");
+
+    auto t1 = gTimer.get_elapsed_ms();
+    auto plugin = desc.create(false, pipelined, RunMode::Sandbox, ThreadMode::Pipelined);
+    auto t2 = gTimer.get_elapsed_ms();
+    LOG_INFO("create plugin: " << (t2 - t1) << " ms");
+
+    for (auto precision : { ProcessPrecision::Single, ProcessPrecision::Double }){
+        for (auto blockSize : gBlockSizes){
+            for (auto numChannels : gChannels){
+                if (precision == ProcessPrecision::Double){
+                    benchmark<double>(*plugin, precision, blockSize, numChannels, count, !pipelined);
+                } else {
+                    benchmark<float>(*plugin, precision, blockSize, numChannels, count, !pipelined);
+                }
+            }
+        }
+    }
+
+    auto t3 = gTimer.get_elapsed_ms();
+    plugin = nullptr;
+    auto t4 = gTimer.get_elapsed_ms();
+    LOG_INFO("destroy plugin: " << (t4 - t3) << " ms");
+}
+
+int main(int argc, const char *argv[]){
+    int count = TEST_COUNT;
+    if (argc > 1){
+        count = std::max<int>(std::stoi(argv[1]), 1);
+    }
+
+#if TEST_REALTIME
+    setThreadPriority(Priority::High);
+#endif
+
+    gTimer.start();
+
+    // IFactory::load() expects an existing file
+    auto path = getTmpDirectory() + "/vst_bridge_bench.dummy";
+    {
+        File file(path, File::WRITE);
+        if (!file.is_open()){
+            LOG_ERROR("couldn't create " << path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    try {
+        auto factory = IFactory::load(path);
+        factory->probe(nullptr, 0);
+        auto desc = factory->getPlugin(0);
+        if (!desc){
+            throw Error("couldn't probe dummy plugin");
+        }
+
+        run(*desc, false, count);
+    #if TEST_PIPELINED
+        run(*desc, true, count);
+    #endif
+    } catch (const Error& e){
+        LOG_ERROR("ERROR: " << e.what());
+        gFailed = true;
+    }
+
+    removeFile(path);
+
+    LOG_INFO("---");
+    LOG_INFO((gFailed ? "failed" : "done"));
+
+    return gFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,269 @@
+#include "Interface.h"
+#include "FileUtils.h"
+#include "Log.h"
+#include "MiscUtils.h"
+#include "PluginCache.h"
+#include "PluginDesc.h"
+#include "PluginDictionary.h"
+
+#include "plf_nanotimer/plf_nanotimer.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Tests the plugin cache file (binary and text format) and compares the time
+// it takes to read the cache file and to look up a single plugin.
+// The binary format itself is always tested with PluginCacheWriter/PluginCache;
+// the PluginDictionary tests need the built-in dummy plugin (see vst/DummyPlugin.h)
+// because reading a plugin from the cache file loads its factory.
+
+using namespace vst;
+
+#define TEST_COUNT 2000 // default number of plugins
+
+static plf::nanotimer gTimer;
+
+static bool gFailed = false;
+
+#define CHECK(x) \
+    if (!(x)) { \
+        LOG_ERROR("ERROR: check failed: " #x " (line " << __LINE__ << ")"); \
+        gFailed = true; \
+    }
+
+static std::string pluginPath(const std::string& dir, int index){
+    return dir + "/plugin" + std::to_string(index) + ".dummy";
+}
+
+static std::string pluginKey(int index){
+    return "plugin" + std::to_string(index);
+}
+
+// write the binary cache file without any plugin factory and
+// check the low-level format.
+static void testFormat(const std::string& path, const std::string& dir, size_t count){
+    const double timestamp = 1000.0;
+    const std::string data = "dummy plugin info";
+    {
+        PluginCacheWriter writer(timestamp);
+        // add in reverse order; the records must be sorted by the writer
+        for (int i = (int)count - 1; i >= 0; --i){
+            writer.addPlugin(pluginPath(dir, i), "Dummy", data, i % 2, timestamp,
+                             { pluginKey(i), pluginPath(dir, i) });
+        }
+        writer.addException(dir + "/bad.dummy");
+
+        auto t1 = gTimer.get_elapsed_ms();
+        writer.write(path);
+        auto t2 = gTimer.get_elapsed_ms();
+        LOG_INFO("write " << count << " plugin records: " << (t2 - t1) << " ms");
+    }
+
+    CHECK(PluginCache::isBinaryFile(path));
+
+    auto t1 = gTimer.get_elapsed_ms();
+    PluginCache cache(path);
+    auto t2 = gTimer.get_elapsed_ms();
+    LOG_INFO("format: read = " << (t2 - t1) << " ms");
+
+    auto& header = cache.header();
+    CHECK(header.format == PLUGIN_CACHE_FORMAT);
+    CHECK(header.versionMajor == VERSION_MAJOR);
+    CHECK(header.versionMinor == VERSION_MINOR);
+    CHECK(header.versionPatch == VERSION_PATCH);
+    CHECK(header.timestamp == timestamp);
+    CHECK((size_t)cache.numPlugins() == count);
+    CHECK(cache.numExceptions() == 1);
+    if (cache.numExceptions() == 1){
+        CHECK(cache.exception(0) == dir + "/bad.dummy");
+    }
+
+    auto check = [&](size_t index){
+        auto path = pluginPath(dir, index);
+        auto range = cache.findPath(path);
+        CHECK(range.second - range.first == 1);
+        if (range.second - range.first != 1){
+            return;
+        }
+        auto& record = cache.plugin(range.first);
+        CHECK(cache.string(record.path) == path);
+        CHECK(cache.string(record.name) == "Dummy");
+        CHECK(cache.string(record.data) == data);
+        CHECK(((record.flags & PluginRecord::Bridged) != 0) == (index % 2 != 0));
+        CHECK(record.numKeys == 2);
+        CHECK(record.versionMajor == VERSION_MAJOR);
+        CHECK(record.timestamp == timestamp);
+
+        auto keys = cache.findKey(pluginKey(index));
+        CHECK(keys.second - keys.first == 1);
+        if (keys.second - keys.first == 1){
+            CHECK(keys.first->plugin == (uint32_t)range.first);
+        }
+    };
+    check(0);
+    check(count / 2);
+    check(count - 1);
+    CHECK(cache.findPath("unknown").first == cache.findPath("unknown").second);
+    auto keys = cache.findKey("unknown");
+    CHECK(keys.first == keys.second);
+
+    // the records must stay valid after detaching from the file
+    cache.detach();
+    check(count / 2);
+
+    // a truncated file must be rejected
+    {
+        auto truncPath = path + ".trunc";
+        {
+            File in(path);
+            File out(truncPath, File::WRITE);
+            std::vector<char> buf(sizeof(CacheHeader) + sizeof(PluginRecord));
+            in.read(buf.data(), buf.size());
+            out.write(buf.data(), buf.size());
+        }
+        bool failed = false;
+        try {
+            PluginCache bad(truncPath);
+        } catch (const Error&){
+            failed = true;
+        }
+        CHECK(failed);
+        removeFile(truncPath);
+    }
+}
+
+#if USE_DUMMY_PLUGIN
+// read the cache file and look up a single plugin
+static std::unique_ptr<PluginDictionary> readCache(const std::string& path, const char *what,
+                                                   const std::string& dir, int index){
+    auto dict = std::make_unique<PluginDictionary>();
+    auto t1 = gTimer.get_elapsed_ms();
+    dict->read(path, false);
+    auto t2 = gTimer.get_elapsed_ms();
+    auto desc = dict->findPlugin(pluginKey(index));
+    auto t3 = gTimer.get_elapsed_ms();
+    LOG_INFO(what << ": read = " << (t2 - t1) << " ms, first lookup = " << (t3 - t2) << " ms");
+    CHECK(desc != nullptr);
+    if (desc){
+        CHECK(desc->path() == pluginPath(dir, index));
+        CHECK(desc->name == "Dummy");
+        // the factory must know about the plugin
+        CHECK(dict->findFactory(desc->path()) != nullptr);
+    }
+    return dict;
+}
+#endif
+
+int main(int argc, const char *argv[]){
+    size_t count = TEST_COUNT;
+    if (argc > 1){
+        count = std::max<int>(std::stoi(argv[1]), 2);
+    }
+
+    gTimer.start();
+
+    auto dir = getTmpDirectory() + "/vst_cache_test";
+    createDirectory(dir);
+    auto binaryPath = dir + "/cache.bin";
+    auto textPath = dir + "/cache.ini";
+
+    try {
+        testFormat(binaryPath, dir, count);
+    #if USE_DUMMY_PLUGIN
+        // probe plugins and fill the dictionary
+        {
+            PluginDictionary dict;
+            for (size_t i = 0; i < count; ++i){
+                auto path = pluginPath(dir, i);
+                {
+                    File file(path, File::WRITE);
+                    if (!file.is_open()){
+                        throw Error("couldn't create " + path);
+                    }
+                }
+                auto factory = IFactory::load(path);
+                factory->probe(nullptr, 0);
+                auto desc = factory->getPlugin(0);
+                if (!desc){
+                    throw Error("couldn't probe dummy plugin");
+                }
+                dict.addFactory(path, factory);
+                dict.addPlugin(pluginKey(i), desc);
+                dict.addPlugin(path, desc);
+            }
+            dict.addException(dir + "/bad.dummy");
+            {
+                File file(dir + "/bad.dummy", File::WRITE);
+            }
+
+            auto t1 = gTimer.get_elapsed_ms();
+            dict.write(binaryPath);
+            auto t2 = gTimer.get_elapsed_ms();
+            dict.write(textPath, PluginDictionary::Format::Text);
+            auto t3 = gTimer.get_elapsed_ms();
+            LOG_INFO("write " << count << " plugins: binary = " << (t2 - t1)
+                     << " ms, text = " << (t3 - t2) << " ms");
+        }
+
+        auto text = readCache(textPath, "text", dir, count / 2);
+        auto binary = readCache(binaryPath, "binary", dir, count / 2);
+
+        CHECK(binary->isException(dir + "/bad.dummy"));
+        CHECK(binary->findPlugin(pluginPath(dir, 0)) != nullptr);
+        CHECK(binary->findPlugin("unknown") == nullptr);
+        CHECK(binary->pluginList().size() == count);
+        CHECK(text->pluginList().size() == count);
+
+        // export text from a lazily read binary cache file
+        // (with pending plugins) and import it again.
+        {
+            auto dict = std::make_unique<PluginDictionary>();
+            dict->read(binaryPath, false);
+            CHECK(dict->findPlugin(pluginKey(1)) != nullptr);
+            dict->write(textPath, PluginDictionary::Format::Text);
+            dict = std::make_unique<PluginDictionary>();
+            dict->read(textPath, false);
+            CHECK(dict->pluginList().size() == count);
+            CHECK(dict->findPlugin(pluginKey(count - 1)) != nullptr);
+        }
+
+        // rewrite the binary cache file while it is mapped; a removed plugin
+        // must not be written again.
+        {
+            removeFile(pluginPath(dir, 0));
+            PluginDictionary dict;
+            dict.read(binaryPath, false);
+            CHECK(dict.findPlugin(pluginKey(0)) == nullptr);
+            dict.write(binaryPath);
+            // the old mapping must still be valid
+            CHECK(dict.findPlugin(pluginKey(count - 1)) != nullptr);
+
+            PluginDictionary dict2;
+            dict2.read(binaryPath, false);
+            CHECK(dict2.findPlugin(pluginKey(0)) == nullptr);
+            CHECK(dict2.pluginList().size() == count - 1);
+        }
+    #else
+        LOG_INFO("PluginDictionary tests require DUMMY_PLUGIN=ON");
+    #endif
+    } catch (const Error& e){
+        LOG_ERROR("ERROR: " << e.what());
+        gFailed = true;
+    }
+
+    // clean up
+    for (size_t i = 0; i < count; ++i){
+        removeFile(pluginPath(dir, i));
+    }
+    removeFile(dir + "/bad.dummy");
+    removeFile(binaryPath);
+    removeFile(textPath);
+    removeFile(dir);
+
+    LOG_INFO("---");
+    LOG_INFO((gFailed ? "failed" : "done"));
+
+    return gFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
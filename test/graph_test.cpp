@@ -0,0 +1,288 @@
+#include "Interface.h"
+#include "DummyPlugin.h"
+#include "FileUtils.h"
+#include "Log.h"
+#include "MiscUtils.h"
+#include "PluginDesc.h"
+#include "PluginGraph.h"
+#include "ThreadedPlugin.h"
+
+#include "plf_nanotimer/plf_nanotimer.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Tests PluginGraph with the built-in dummy plugin (see vst/DummyPlugin.h):
+// delay compensation (also for latency changes while processing) and
+// parallel processing of independent branches.
+
+using namespace vst;
+
+#define TEST_SAMPLERATE 48000
+#define TEST_BLOCKSIZE 64
+#define TEST_LATENCY 100 // must be larger than TEST_BLOCKSIZE
+#define TEST_BRANCHES 4
+#define TEST_COST 500 // processing cost per branch in microseconds
+#define TEST_COUNT 100 // default number of measured blocks
+
+static plf::nanotimer gTimer;
+
+static bool gFailed = false;
+
+#define CHECK(x) \
+    if (!(x)) { \
+        LOG_ERROR("ERROR: check failed: " #x " (line " << __LINE__ << ")"); \
+        gFailed = true; \
+    }
+
+class Listener : public IPluginListener {
+ public:
+    void parameterAutomated(int, float) override {}
+    void latencyChanged(int nsamples) override {
+        latency = nsamples;
+    }
+    void updateDisplay() override {}
+    void midiEvent(const MidiEvent&) override {}
+    void sysexEvent(const SysexEvent&) override {}
+    void pluginCrashed() override {}
+
+    int latency = -1;
+};
+
+// a stereo graph with a single input and output bus
+class Graph {
+ public:
+    Graph(const PluginDesc& desc)
+        : desc_(desc) {
+        graph_.setListener(&listener_);
+    }
+
+    PluginGraph& graph() { return graph_; }
+    Listener& listener() { return listener_; }
+
+    DummyPlugin& addNode(int& index){
+        auto plugin = desc_.create(false, false);
+        auto dummy = static_cast<DummyPlugin *>(plugin.get());
+        index = graph_.addNode(std::move(plugin));
+        return *dummy;
+    }
+
+    void setup(){
+        graph_.suspend();
+        graph_.setupProcessing(TEST_SAMPLERATE, TEST_BLOCKSIZE,
+                               ProcessPrecision::Single, ProcessMode::Realtime);
+        graph_.resume();
+    }
+
+    // process a single block; returns the first output channel
+    const float * process(const float *input){
+        float *inChannels[2] = { input_[0], input_[1] };
+        float *outChannels[2] = { output_[0], output_[1] };
+        for (int i = 0; i < 2; ++i){
+            std::copy(input, input + TEST_BLOCKSIZE, input_[i]);
+        }
+        AudioBus in { 2, inChannels };
+        AudioBus out { 2, outChannels };
+
+        ProcessData data;
+        data.inputs = &in;
+        data.numInputs = 1;
+        data.outputs = &out;
+        data.numOutputs = 1;
+        data.numSamples = TEST_BLOCKSIZE;
+        data.precision = ProcessPrecision::Single;
+        data.mode = ProcessMode::Realtime;
+
+        graph_.process(data);
+
+        return output_[0];
+    }
+
+    // Send an impulse and return the position and amplitude of the first
+    // non-zero output sample; the graph must be silent before.
+    std::pair<int, float> impulseResponse(int maxLength){
+        float input[TEST_BLOCKSIZE] = { 0 };
+        input[0] = 1;
+        for (int i = 0; i < maxLength; i += TEST_BLOCKSIZE){
+            auto output = process(input);
+            input[0] = 0;
+            for (int j = 0; j < TEST_BLOCKSIZE; ++j){
+                if (output[j] != 0){
+                    return { i + j, output[j] };
+                }
+            }
+        }
+        return { -1, 0.f };
+    }
+
+    void flush(int length){
+        float input[TEST_BLOCKSIZE] = { 0 };
+        for (int i = 0; i < length; i += TEST_BLOCKSIZE){
+            process(input);
+        }
+    }
+ private:
+    const PluginDesc& desc_;
+    PluginGraph graph_;
+    Listener listener_;
+    float input_[2][TEST_BLOCKSIZE];
+    float output_[2][TEST_BLOCKSIZE];
+};
+
+// Two parallel branches A and B which are summed by C:
+//
+// input -> A (latency) -> C -> output
+//       -> B ----------/
+//
+// B must be delayed, so that the impulses of both branches arrive at
+// the same time; the output should be a single impulse with amplitude 2.
+void testLatency(const PluginDesc& desc){
+    LOG_INFO("---");
+    LOG_INFO("delay compensation");
+    LOG_INFO("---");
+
+    Graph g(desc);
+    int a, b, c;
+    auto& nodeA = g.addNode(a);
+    g.addNode(b);
+    g.addNode(c);
+    auto& graph = g.graph();
+    graph.connect(PluginGraph::input, 0, a, 0);
+    graph.connect(PluginGraph::input, 0, b, 0);
+    graph.connect(a, 0, c, 0);
+    graph.connect(b, 0, c, 0);
+    graph.connect(c, 0, PluginGraph::output, 0);
+
+    nodeA.vendorSpecific(DummyPlugin::SetLatency, TEST_BLOCKSIZE / 2, nullptr, 0);
+    g.setup();
+    CHECK(graph.getLatencySamples() == TEST_BLOCKSIZE / 2);
+
+    auto result = g.impulseResponse(TEST_LATENCY * 4);
+    LOG_INFO("latency " << (TEST_BLOCKSIZE / 2) << ": impulse at "
+             << result.first << " (" << result.second << ")");
+    CHECK(result.first == TEST_BLOCKSIZE / 2);
+    CHECK(result.second == 2.f);
+
+    // change the latency while processing; this fits into the delay line
+    // and must be applied at the next block boundary.
+    g.flush(TEST_LATENCY * 2);
+    nodeA.vendorSpecific(DummyPlugin::SetLatency, TEST_BLOCKSIZE, nullptr, 0);
+    CHECK(g.listener().latency == -1); // not applied yet
+    g.flush(TEST_BLOCKSIZE);
+    CHECK(g.listener().latency == TEST_BLOCKSIZE);
+    CHECK(graph.getLatencySamples() == TEST_BLOCKSIZE);
+    g.flush(TEST_LATENCY * 2);
+
+    result = g.impulseResponse(TEST_LATENCY * 4);
+    LOG_INFO("latency " << TEST_BLOCKSIZE << ": impulse at "
+             << result.first << " (" << result.second << ")");
+    CHECK(result.first == TEST_BLOCKSIZE);
+    CHECK(result.second == 2.f);
+
+    // the delay lines are too short, so the latency change is deferred
+    // until resume(); until then the old latency must be reported.
+    g.flush(TEST_LATENCY * 2);
+    g.listener().latency = -1;
+    nodeA.vendorSpecific(DummyPlugin::SetLatency, TEST_LATENCY * 4, nullptr, 0);
+    g.flush(TEST_BLOCKSIZE);
+    CHECK(g.listener().latency == -1);
+    CHECK(graph.getLatencySamples() == TEST_BLOCKSIZE);
+    graph.suspend();
+    graph.resume();
+    CHECK(g.listener().latency == TEST_LATENCY * 4);
+    CHECK(graph.getLatencySamples() == TEST_LATENCY * 4);
+
+    result = g.impulseResponse(TEST_LATENCY * 8);
+    LOG_INFO("latency " << (TEST_LATENCY * 4) << ": impulse at "
+             << result.first << " (" << result.second << ")");
+    CHECK(result.first == TEST_LATENCY * 4);
+    CHECK(result.second == 2.f);
+}
+
+// Independent branches with a simulated processing cost; with enough
+// DSP threads, the graph should be (much) faster than a serial chain.
+//
+// input -> N1 -> output
+//       -> N2 -/
+//       ...
+void testParallel(const PluginDesc& desc, int count){
+    LOG_INFO("---");
+    LOG_INFO("parallel processing");
+    LOG_INFO("---");
+
+    Graph g(desc);
+    auto& graph = g.graph();
+    for (int i = 0; i < TEST_BRANCHES; ++i){
+        int index;
+        g.addNode(index).vendorSpecific(DummyPlugin::SetProcessCost, 0, nullptr, TEST_COST);
+        graph.connect(PluginGraph::input, 0, index, 0);
+        graph.connect(index, 0, PluginGraph::output, 0);
+    }
+    g.setup();
+
+    // the output is the sum of all branches
+    float input[TEST_BLOCKSIZE];
+    std::fill(input, input + TEST_BLOCKSIZE, 1.f);
+    auto output = g.process(input);
+    CHECK(std::all_of(output, output + TEST_BLOCKSIZE,
+                      [](float f){ return f == TEST_BRANCHES; }));
+
+    auto t1 = gTimer.get_elapsed_us();
+    for (int i = 0; i < count; ++i){
+        g.process(input);
+    }
+    auto average = (gTimer.get_elapsed_us() - t1) / count;
+    double serial = TEST_BRANCHES * TEST_COST;
+    int numThreads = DSPThreadPool::instance().numThreads();
+    LOG_INFO(TEST_BRANCHES << " branches, " << numThreads << " DSP threads: average = "
+             << average << " us (serial: " << serial << " us)");
+    // we need a CPU for every branch (the audio thread helps as well)
+    if (std::thread::hardware_concurrency() >= TEST_BRANCHES
+            && numThreads >= TEST_BRANCHES - 1){
+        CHECK(average < serial * 0.75);
+    } else {
+        LOG_INFO("not enough CPUs; skip speedup test");
+    }
+}
+
+int main(int argc, const char *argv[]){
+    int count = TEST_COUNT;
+    if (argc > 1){
+        count = std::max<int>(std::stoi(argv[1]), 1);
+    }
+
+    gTimer.start();
+
+    // IFactory::load() expects an existing file
+    auto path = getTmpDirectory() + "/vst_graph_test.dummy";
+    {
+        File file(path, File::WRITE);
+        if (!file.is_open()){
+            LOG_ERROR("couldn't create " << path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    try {
+        auto factory = IFactory::load(path);
+        factory->probe(nullptr, 0);
+        auto desc = factory->getPlugin(0);
+        if (!desc){
+            throw Error("couldn't probe dummy plugin");
+        }
+
+        testLatency(*desc);
+        testParallel(*desc, count);
+    } catch (const Error& e){
+        LOG_ERROR("ERROR: " << e.what());
+        gFailed = true;
+    }
+
+    removeFile(path);
+
+    LOG_INFO("---");
+    LOG_INFO((gFailed ? "failed" : "done"));
+
+    return gFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,205 @@
+#include "Interface.h"
+#include "FileUtils.h"
+#include "Log.h"
+#include "MiscUtils.h"
+#include "PluginDesc.h"
+
+#include "plf_nanotimer/plf_nanotimer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// Tests the crash recovery of sandboxed plugins (see setSandboxRecovery()):
+// the built-in dummy plugin (see vst/DummyPlugin.h) is loaded into the actual
+// host app and then crashed on purpose. The sandbox must be restarted and
+// the plugin state and parameters must be restored.
+// NB: the executable must be located next to the host app!
+
+using namespace vst;
+
+#define TEST_SAMPLERATE 48000
+#define TEST_BLOCKSIZE 64
+#define TEST_CHANNELS 2
+#define TEST_SNAPSHOT_INTERVAL 0.1 // seconds
+#define TEST_TIMEOUT 10 // max. restart time in seconds
+#define TEST_CRASHES 2 // restart several times to test the bridge handover
+#define TEST_PIPELINED 1 // also test ThreadMode::Pipelined
+
+static plf::nanotimer gTimer;
+
+static bool gFailed = false;
+
+#define CHECK(x) \
+    if (!(x)) { \
+        LOG_ERROR("ERROR: check failed: " #x " (line " << __LINE__ << ")"); \
+        gFailed = true; \
+    }
+
+class Listener : public IPluginListener {
+ public:
+    void parameterAutomated(int, float) override {}
+    void latencyChanged(int) override {}
+    void updateDisplay() override {}
+    void midiEvent(const MidiEvent&) override {}
+    void sysexEvent(const SysexEvent&) override {}
+    void pluginCrashed() override {
+        crashed++;
+    }
+
+    std::atomic<int> crashed{0};
+};
+
+class Processor {
+ public:
+    Processor(IPlugin& plugin)
+        : plugin_(plugin) {
+        int numChannels = TEST_CHANNELS;
+        plugin.suspend();
+        plugin.setupProcessing(TEST_SAMPLERATE, TEST_BLOCKSIZE,
+                               ProcessPrecision::Single, ProcessMode::Realtime);
+        plugin.setNumSpeakers(&numChannels, 1, &numChannels, 1);
+        plugin.resume();
+
+        for (int i = 0; i < TEST_CHANNELS; ++i){
+            std::fill(input_[i], input_[i] + TEST_BLOCKSIZE, 1.f);
+        }
+    }
+
+    // process a single block and return the first output sample
+    float process(){
+        float *inChannels[TEST_CHANNELS];
+        float *outChannels[TEST_CHANNELS];
+        for (int i = 0; i < TEST_CHANNELS; ++i){
+            inChannels[i] = input_[i];
+            outChannels[i] = output_[i];
+        }
+        AudioBus in { TEST_CHANNELS, inChannels };
+        AudioBus out { TEST_CHANNELS, outChannels };
+
+        ProcessData data;
+        data.inputs = &in;
+        data.numInputs = 1;
+        data.outputs = &out;
+        data.numOutputs = 1;
+        data.numSamples = TEST_BLOCKSIZE;
+        data.precision = ProcessPrecision::Single;
+        data.mode = ProcessMode::Realtime;
+
+        plugin_.process(data);
+
+        return output_[0][0];
+    }
+
+    // Process until the output matches the given gain, e.g. after a restart.
+    // Returns the elapsed time in milliseconds or -1 on timeout.
+    double waitForGain(float gain){
+        auto t1 = gTimer.get_elapsed_ms();
+        for (;;){
+            if (process() == gain){
+                return gTimer.get_elapsed_ms() - t1;
+            }
+            if ((gTimer.get_elapsed_ms() - t1) > TEST_TIMEOUT * 1000){
+                return -1;
+            }
+            // don't burn the CPU while the sandbox is restarting
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+ private:
+    IPlugin& plugin_;
+    float input_[TEST_CHANNELS][TEST_BLOCKSIZE];
+    float output_[TEST_CHANNELS][TEST_BLOCKSIZE];
+};
+
+void run(const PluginDesc& desc, bool pipelined){
+    LOG_INFO("---");
+    LOG_INFO((pipelined ? "sandbox (pipelined)" : "sandbox"));
+    LOG_INFO("---");
+
+    auto plugin = desc.create(false, pipelined, RunMode::Sandbox, ThreadMode::Pipelined);
+    Listener listener;
+    plugin->setListener(&listener);
+    Processor processor(*plugin);
+
+    // set the parameters and let the subprocess take a snapshot.
+    // NB: the first parameter is the gain.
+    const float gain = 0.5f;
+    std::vector<float> params = { gain, 0.25f, 0.75f };
+    for (int i = 0; i < (int)params.size(); ++i){
+        plugin->setParameter(i, params[i]);
+    }
+    CHECK(processor.waitForGain(gain) >= 0);
+    std::this_thread::sleep_for(std::chrono::duration<double>(TEST_SNAPSHOT_INTERVAL * 5));
+
+    for (int i = 0; i < TEST_CRASHES; ++i){
+        // the parameter change is sent with the next process() call
+        // and crashes the subprocess.
+        LOG_INFO("crash plugin");
+        plugin->setParameter(1, "crash");
+        processor.process();
+
+        auto elapsed = processor.waitForGain(gain);
+        if (elapsed >= 0){
+            LOG_INFO("plugin recovered after " << elapsed << " ms");
+        } else {
+            LOG_ERROR("ERROR: plugin did not recover");
+            gFailed = true;
+            break;
+        }
+        CHECK(listener.crashed == 0);
+        for (int j = 0; j < (int)params.size(); ++j){
+            CHECK(plugin->getParameter(j) == params[j]);
+        }
+        // change a parameter after the restart
+        params[2] = 0.125f * (i + 1);
+        plugin->setParameter(2, params[2]);
+        processor.process();
+        std::this_thread::sleep_for(std::chrono::duration<double>(TEST_SNAPSHOT_INTERVAL * 5));
+    }
+
+    plugin = nullptr;
+}
+
+int main(){
+    gTimer.start();
+
+    setSandboxRecovery(true);
+    setSandboxSnapshotInterval(TEST_SNAPSHOT_INTERVAL);
+
+    // IFactory::load() expects an existing file
+    auto path = getTmpDirectory() + "/vst_recovery_test.dummy";
+    {
+        File file(path, File::WRITE);
+        if (!file.is_open()){
+            LOG_ERROR("couldn't create " << path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    try {
+        auto factory = IFactory::load(path);
+        factory->probe(nullptr, 0);
+        auto desc = factory->getPlugin(0);
+        if (!desc){
+            throw Error("couldn't probe dummy plugin");
+        }
+
+        run(*desc, false);
+    #if TEST_PIPELINED
+        run(*desc, true);
+    #endif
+    } catch (const Error& e){
+        LOG_ERROR("ERROR: " << e.what());
+        gFailed = true;
+    }
+
+    removeFile(path);
+
+    LOG_INFO("---");
+    LOG_INFO((gFailed ? "failed" : "done"));
+
+    return gFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
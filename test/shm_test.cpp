@@ -20,9 +20,11 @@
 # include <dlfcn.h>
 #endif
 
+#include <algorithm>
 #include <cstring>
 #include <thread>
 #include <cmath>
+#include <vector>
 
 using namespace vst;
 
@@ -36,7 +38,9 @@ using namespace vst;
 #define TEST_REQUEST_BUFSIZE 512
 
 #define TEST_BENCHMARK 1
-#define TEST_BENCHMARK_COUNT 20
+#define TEST_BENCHMARK_COUNT 1000
+// run the benchmark with pure blocking waits and with a spin phase
+#define TEST_BENCHMARK_SPIN_TIME 50 // microseconds, see ShmChannel::setSpinTime()
 #define TEST_BENCHMARK_SLEEP -1 // negative: don't sleep
 #define TEST_BENCHMARK_DSP_COUNT 0
 #define TEST_BENCHMARK_AVG_OFFSET 1
@@ -177,9 +181,32 @@ void client_test_request(ShmInterface& shm){
     channel.postReply();
 }
 
-void server_benchmark(ShmInterface& shm){
+void print_wait_stats(const char *who, const ShmChannel& channel){
+    auto& stats = channel.waitStats();
+    LOG_INFO(who << ": wait stats: immediate = " << stats.immediate
+             << ", spin = " << stats.spin << ", block = " << stats.block);
+}
+
+void print_latency_stats(const char *what, std::vector<double>& deltas){
+    // skip the first iteration(s)
+    deltas.erase(deltas.begin(), deltas.begin() + TEST_BENCHMARK_AVG_OFFSET);
+    double avg = 0;
+    for (auto& d : deltas){
+        avg += d;
+    }
+    avg /= deltas.size();
+    std::sort(deltas.begin(), deltas.end());
+    auto percentile = [&](double p){
+        return deltas[std::min<size_t>(p * deltas.size(), deltas.size() - 1)];
+    };
+    LOG_INFO("server: " << what << ": average = " << avg << " us, median = "
+             << percentile(0.5) << " us, p99 = " << percentile(0.99)
+             << " us, max = " << deltas.back() << " us");
+}
+
+void server_benchmark(ShmInterface& shm, float spinTime){
     LOG_INFO("---");
-    LOG_INFO("test benchmark");
+    LOG_INFO("test benchmark (spin time: " << spinTime << " us)");
     LOG_INFO("---");
 
     LOG_INFO("server: benchmark");
@@ -187,6 +214,9 @@ void server_benchmark(ShmInterface& shm){
     auto& channel = shm.getChannel(1);
     LOG_INFO("server: channel " << channel.name());
 
+    channel.setSpinTime(spinTime);
+    channel.resetWaitStats();
+
     plf::nanotimer timer;
     timer.start();
 
@@ -203,8 +233,10 @@ void server_benchmark(ShmInterface& shm){
         LOG_INFO("server: sleep(0) = " << (t2 - t1) << " us");
     }
 
-    double avg_outer = 0;
-    double avg_inner = 0;
+    std::vector<double> outerDeltas;
+    std::vector<double> innerDeltas;
+    outerDeltas.reserve(TEST_BENCHMARK_COUNT);
+    innerDeltas.reserve(TEST_BENCHMARK_COUNT);
     for (int i = 0; i < TEST_BENCHMARK_COUNT; ++i){
         auto t1 = timer.get_elapsed_us();
         channel.clear();
@@ -232,33 +264,34 @@ void server_benchmark(ShmInterface& shm){
 
         auto outer = t4 - t1;
         auto inner = t3 - t2;
-        if (i >= TEST_BENCHMARK_AVG_OFFSET){
-            avg_outer += outer;
-            avg_inner += inner;
-        }
+        outerDeltas.push_back(outer);
+        innerDeltas.push_back(inner);
+    #if TEST_BENCHMARK_DEBUG
         LOG_INFO("server: full delta = " << outer << " us, "
                     << "inner delta = " << inner << " us");
+    #endif
 
     #if TEST_BENCHMARK_SLEEP >= 0
         // make sure that child process actually has to wake up
         sleep_ms(TEST_BENCHMARK_SLEEP);
     #endif
     }
-    auto divisor = TEST_BENCHMARK_COUNT - TEST_BENCHMARK_AVG_OFFSET;
     LOG_INFO("---");
-    LOG_INFO("server: average full delta = "
-                << (avg_outer / divisor) << " us");
-    LOG_INFO("server: average inner delta = "
-                << (avg_inner / divisor) << " us");
+    print_latency_stats("full delta", outerDeltas);
+    print_latency_stats("inner delta", innerDeltas);
+    print_wait_stats("server", channel);
 }
 
-void client_benchmark(ShmInterface& shm){
+void client_benchmark(ShmInterface& shm, float spinTime){
     LOG_INFO("client: benchmark");
 
     auto& channel = shm.getChannel(1);
 
     LOG_INFO("client: channel " << channel.name());
 
+    channel.setSpinTime(spinTime);
+    channel.resetWaitStats();
+
     for (int i = 0; i < TEST_BENCHMARK_COUNT; ++i){
         // wait for message
     #if TEST_BENCHMARK_DEBUG
@@ -280,6 +313,7 @@ void client_benchmark(ShmInterface& shm){
         channel.postReply();
     }
 
+    print_wait_stats("client", channel);
     LOG_INFO("client: done");
 }
 
@@ -344,7 +378,12 @@ int server_run(){
     sync.waitReply();
 #endif
 #if TEST_BENCHMARK
-    server_benchmark(shm);
+    // pure blocking wait
+    server_benchmark(shm, 0);
+    sync.post();
+    sync.waitReply();
+    // spin, then block
+    server_benchmark(shm, TEST_BENCHMARK_SPIN_TIME);
     sync.post();
     sync.waitReply();
 #endif
@@ -412,7 +451,10 @@ int client_run(const char *path){
     sync.postReply();
 #endif
 #if TEST_BENCHMARK
-    client_benchmark(shm);
+    client_benchmark(shm, 0);
+    sync.wait();
+    sync.postReply();
+    client_benchmark(shm, TEST_BENCHMARK_SPIN_TIME);
     sync.wait();
     sync.postReply();
 #endif
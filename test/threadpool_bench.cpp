@@ -0,0 +1,430 @@
+#include "Interface.h"
+#include "Log.h"
+#include "Lockfree.h"
+#include "MiscUtils.h"
+#include "Sync.h"
+#include "ThreadedPlugin.h"
+
+#include "plf_nanotimer/plf_nanotimer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+using namespace vst;
+
+#define TEST_NUM_THREADS 0 // 0: number of logical CPUs minus one
+
+#define TEST_THROUGHPUT 1
+#define TEST_THROUGHPUT_PRODUCERS 4
+#define TEST_THROUGHPUT_COUNT 100000
+#define TEST_THROUGHPUT_WORK 16 // fake DSP work per task
+
+#define TEST_LATENCY 1
+#define TEST_LATENCY_COUNT 2000
+#define TEST_LATENCY_SLEEP_US 500 // give the workers time to go to sleep
+
+#define TEST_MAKESPAN 1
+#define TEST_MAKESPAN_BLOCKS 200
+#define TEST_MAKESPAN_LIGHT 12 // number of light tasks per block
+#define TEST_MAKESPAN_LIGHT_WORK 2000
+#define TEST_MAKESPAN_HEAVY 2 // number of heavy tasks per block (queued last!)
+#define TEST_MAKESPAN_HEAVY_WORK 20000
+
+#define TEST_WAIT 1
+#define TEST_WAIT_COUNT 2000
+#define TEST_WAIT_WORK 2000 // max. fake DSP work per task
+
+#define TEST_RESIZE 1
+#define TEST_RESIZE_COUNT 200 // number of resize operations
+#define TEST_RESIZE_TASKS 1000 // tasks per resize operation
+
+using Task = DSPThreadPool::Task;
+
+static plf::nanotimer gTimer;
+
+static volatile float gSink = 0;
+
+void fake_dsp(int n){
+    float sum = 0;
+    for (int i = 0; i < n; ++i){
+        sum += std::sin((float)i);
+    }
+    gSink = sum;
+}
+
+// the original thread pool (single SPSC FIFO protected by two spin locks)
+class LegacyThreadPool {
+ public:
+    LegacyThreadPool(int numThreads) {
+        running_.store(true);
+        for (int i = 0; i < numThreads; ++i){
+            threads_.emplace_back([this](){
+                setThreadPriority(Priority::High);
+                run();
+            });
+        }
+    }
+
+    ~LegacyThreadPool() {
+        running_.store(false);
+        semaphore_.post(threads_.size());
+        for (auto& thread : threads_){
+            thread.join();
+        }
+    }
+
+    bool push(Task *task){
+        pushLock_.lock();
+        bool result = queue_.push(task);
+        pushLock_.unlock();
+        semaphore_.post();
+        return result;
+    }
+
+    bool processTask(){
+        Task *task;
+        popLock_.lock();
+        bool result = queue_.pop(task);
+        popLock_.unlock();
+        if (result) {
+            task->cb(task->data, task->numSamples);
+        }
+        return result;
+    }
+ private:
+    std::vector<std::thread> threads_;
+    LightSemaphore semaphore_;
+    std::atomic<bool> running_;
+    LockfreeFifo<Task *, 1024> queue_;
+    PaddedSpinLock pushLock_;
+    PaddedSpinLock popLock_;
+
+    void run() {
+        while (running_.load()) {
+            Task *task;
+            popLock_.lock();
+            while (queue_.pop(task)){
+                popLock_.unlock();
+                task->cb(task->data, task->numSamples);
+                popLock_.lock();
+            }
+            popLock_.unlock();
+
+            semaphore_.wait();
+        }
+    }
+};
+
+template<typename Pool>
+void benchmark_throughput(Pool& pool, const char *name){
+    std::atomic<int> done{0};
+    const int total = TEST_THROUGHPUT_PRODUCERS * TEST_THROUGHPUT_COUNT;
+    // tasks must stay alive until they have been processed!
+    std::vector<Task> tasks(total);
+    for (auto& task : tasks){
+        task.cb = [](void *data, int n){
+            fake_dsp(n);
+            static_cast<std::atomic<int> *>(data)->fetch_add(1, std::memory_order_relaxed);
+        };
+        task.data = &done;
+        task.numSamples = TEST_THROUGHPUT_WORK;
+    }
+
+    auto t1 = gTimer.get_elapsed_us();
+
+    std::vector<std::thread> producers;
+    for (int i = 0; i < TEST_THROUGHPUT_PRODUCERS; ++i){
+        producers.emplace_back([&, i](){
+            auto begin = tasks.data() + i * TEST_THROUGHPUT_COUNT;
+            for (int j = 0; j < TEST_THROUGHPUT_COUNT; ++j){
+                // if the queue is full, help the workers (like ThreadedPlugin does)
+                while (!pool.push(begin + j)){
+                    pool.processTask();
+                }
+            }
+        });
+    }
+    for (auto& thread : producers){
+        thread.join();
+    }
+    while (done.load(std::memory_order_relaxed) < total){
+        if (!pool.processTask()){
+            std::this_thread::yield();
+        }
+    }
+
+    auto t2 = gTimer.get_elapsed_us();
+    auto elapsed = (t2 - t1) * 0.000001;
+
+    LOG_INFO(name << ": " << total << " tasks in " << (elapsed * 1000.0) << " ms ("
+             << (size_t)(total / elapsed) << " tasks/s)");
+}
+
+template<typename Pool>
+void benchmark_latency(Pool& pool, const char *name){
+    struct Sample {
+        std::atomic<bool> done{false};
+        double start = 0;
+        double delta = 0;
+    };
+    std::vector<Sample> samples(TEST_LATENCY_COUNT);
+    std::vector<Task> tasks(TEST_LATENCY_COUNT);
+
+    for (int i = 0; i < TEST_LATENCY_COUNT; ++i){
+        auto& sample = samples[i];
+        auto& task = tasks[i];
+        task.cb = [](void *data, int){
+            auto sample = static_cast<Sample *>(data);
+            sample->delta = gTimer.get_elapsed_ns() - sample->start;
+            sample->done.store(true, std::memory_order_release);
+        };
+        task.data = &sample;
+        task.numSamples = 0;
+
+        sample.start = gTimer.get_elapsed_ns();
+        pool.push(&task);
+        // NB: don't help, we want to measure the wake up latency of the workers!
+        // NB: yield instead of spinning, so that we also work on single-core machines.
+        while (!sample.done.load(std::memory_order_acquire)){
+            std::this_thread::yield();
+        }
+#if TEST_LATENCY_SLEEP_US > 0
+        std::this_thread::sleep_for(std::chrono::microseconds(TEST_LATENCY_SLEEP_US));
+#endif
+    }
+
+    std::vector<double> deltas;
+    for (auto& sample : samples){
+        deltas.push_back(sample.delta * 0.001); // us
+    }
+    std::sort(deltas.begin(), deltas.end());
+
+    auto percentile = [&](double p){
+        return deltas[std::min<size_t>(deltas.size() * p, deltas.size() - 1)];
+    };
+    LOG_INFO(name << ": wakeup latency: median = " << percentile(0.5)
+             << " us, p99 = " << percentile(0.99)
+             << " us, max = " << deltas.back() << " us");
+}
+
+// heterogeneous tasks where the heavy tasks are queued last; with FIFO
+// ordering, the heavy tasks are started late and dominate the block time.
+// With cost history, the pool starts them first (LPT).
+void test_makespan(DSPThreadPool& pool, bool useCost, const char *name){
+    struct Data {
+        std::atomic<int> *done;
+        int work;
+        Task *task;
+    };
+    const int numTasks = TEST_MAKESPAN_LIGHT + TEST_MAKESPAN_HEAVY;
+    std::atomic<int> done{0};
+    std::vector<Task> tasks(numTasks);
+    std::vector<Data> data(numTasks);
+    for (int i = 0; i < numTasks; ++i){
+        data[i].done = &done;
+        data[i].work = (i < TEST_MAKESPAN_LIGHT) ?
+            TEST_MAKESPAN_LIGHT_WORK : TEST_MAKESPAN_HEAVY_WORK;
+        data[i].task = &tasks[i];
+        tasks[i].cb = [](void *x, int){
+            auto d = static_cast<Data *>(x);
+            auto start = DSPThreadPool::getTime();
+            fake_dsp(d->work);
+            d->task->updateCost(DSPThreadPool::getTime() - start);
+            d->done->fetch_add(1, std::memory_order_release);
+        };
+        tasks[i].data = &data[i];
+        tasks[i].numSamples = 0;
+    }
+
+    std::vector<double> makespans;
+    for (int i = 0; i < TEST_MAKESPAN_BLOCKS; ++i){
+        if (!useCost){
+            for (auto& task : tasks){
+                task.cost = 0; // no history -> FIFO
+            }
+        }
+        done.store(0);
+        auto t1 = gTimer.get_elapsed_us();
+        for (auto& task : tasks){
+            if (!pool.push(&task)){
+                task.cb(task.data, 0);
+            }
+        }
+        // help like ThreadedPlugin/PluginGraph
+        while (done.load(std::memory_order_acquire) < numTasks){
+            if (!pool.processTask()){
+                std::this_thread::yield();
+            }
+        }
+        auto t2 = gTimer.get_elapsed_us();
+        makespans.push_back(t2 - t1);
+    }
+    std::sort(makespans.begin(), makespans.end());
+    double sum = 0;
+    for (auto& x : makespans){
+        sum += x;
+    }
+    LOG_INFO(name << ": makespan: average = " << (sum / makespans.size())
+             << " us, median = " << makespans[makespans.size() / 2]
+             << " us, max = " << makespans.back() << " us");
+}
+
+// like ThreadedPlugin: push a task, do some work, then wait for the task.
+// the task duration changes every few hundred iterations, so that
+// the wait policy has to adapt.
+void test_wait(DSPThreadPool& pool, const char *name){
+    struct Data {
+        Event event;
+        int work;
+    } data;
+    Task task;
+    task.cb = [](void *data, int){
+        auto d = static_cast<Data *>(data);
+        fake_dsp(d->work);
+        d->event.set();
+    };
+    task.data = &data;
+    task.numSamples = 0;
+
+    auto before = pool.waitStats();
+    float estimate = 0;
+    auto t1 = gTimer.get_elapsed_us();
+    for (int i = 0; i < TEST_WAIT_COUNT; ++i){
+        data.work = ((i / 250) % 2) ? TEST_WAIT_WORK : TEST_WAIT_WORK / 20;
+        if (!pool.push(&task)){
+            task.cb(task.data, 0);
+        }
+        fake_dsp(TEST_WAIT_WORK / 10);
+        pool.wait(data.event, estimate);
+    }
+    auto t2 = gTimer.get_elapsed_us();
+    auto after = pool.waitStats();
+
+    LOG_INFO(name << ": " << TEST_WAIT_COUNT << " waits in " << ((t2 - t1) * 0.001) << " ms"
+             << " (immediate: " << (after.immediate - before.immediate)
+             << ", spin: " << (after.spin - before.spin)
+             << ", yield: " << (after.yield - before.yield)
+             << ", block: " << (after.block - before.block) << ")");
+}
+
+// grow and shrink the pool while tasks are being processed
+void test_resize(DSPThreadPool& pool, int maxNumThreads){
+    std::atomic<int> done{0};
+    std::vector<Task> tasks(TEST_RESIZE_TASKS);
+    for (auto& task : tasks){
+        task.cb = [](void *data, int n){
+            fake_dsp(n);
+            static_cast<std::atomic<int> *>(data)->fetch_add(1, std::memory_order_relaxed);
+        };
+        task.data = &done;
+        task.numSamples = TEST_THROUGHPUT_WORK;
+    }
+
+    double maxTime = 0;
+    double totalTime = 0;
+    for (int i = 0; i < TEST_RESIZE_COUNT; ++i){
+        done.store(0);
+        for (auto& task : tasks){
+            while (!pool.push(&task)){
+                pool.processTask();
+            }
+        }
+        // resize while the tasks are running
+        int numThreads = 1 + (i * 7) % maxNumThreads;
+        auto t1 = gTimer.get_elapsed_us();
+        pool.resize(numThreads);
+        auto t2 = gTimer.get_elapsed_us();
+        maxTime = std::max(maxTime, t2 - t1);
+        totalTime += t2 - t1;
+        if (pool.numThreads() != numThreads){
+            LOG_ERROR("resize: expected " << numThreads << " threads, got " << pool.numThreads());
+        }
+        while (done.load(std::memory_order_relaxed) < TEST_RESIZE_TASKS){
+            if (!pool.processTask()){
+                std::this_thread::yield();
+            }
+        }
+    }
+    LOG_INFO("resize: " << TEST_RESIZE_COUNT << " resize operations, average = "
+             << (totalTime / TEST_RESIZE_COUNT) << " us, max = " << maxTime << " us");
+    LOG_INFO("utilization: " << (pool.utilization() * 100.0) << "%");
+}
+
+template<typename Pool>
+void benchmark(int numThreads, const char *name){
+    LOG_INFO("---");
+    LOG_INFO(name << " (" << numThreads << " threads)");
+    LOG_INFO("---");
+
+    Pool pool(numThreads);
+    // give the threads some time to start
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+#if TEST_THROUGHPUT
+    benchmark_throughput(pool, name);
+#endif
+#if TEST_LATENCY
+    benchmark_latency(pool, name);
+#endif
+}
+
+int main(int argc, const char *argv[]){
+    int numThreads = TEST_NUM_THREADS;
+    if (argc > 1){
+        numThreads = std::stoi(argv[1]);
+    }
+    if (numThreads <= 0){
+        numThreads = std::max<int>(std::thread::hardware_concurrency() - 1, 1);
+    }
+
+    gTimer.start();
+
+    benchmark<LegacyThreadPool>(numThreads, "legacy pool");
+    benchmark<DSPThreadPool>(numThreads, "work-stealing pool");
+
+#if TEST_MAKESPAN
+    LOG_INFO("---");
+    LOG_INFO("makespan (" << TEST_MAKESPAN_LIGHT << " light tasks, "
+             << TEST_MAKESPAN_HEAVY << " heavy tasks)");
+    LOG_INFO("---");
+    {
+        DSPThreadPool pool(numThreads);
+        test_makespan(pool, false, "FIFO");
+        test_makespan(pool, true, "LPT");
+    }
+#endif
+
+#if TEST_WAIT
+    LOG_INFO("---");
+    LOG_INFO("wait policy");
+    LOG_INFO("---");
+    {
+        DSPThreadPool pool(numThreads);
+        test_wait(pool, "default policy");
+
+        DSPThreadPool::WaitPolicy policy;
+        policy.spinTime = 0;
+        policy.yieldTime = 0;
+        pool.setWaitPolicy(policy);
+        test_wait(pool, "always block");
+    }
+#endif
+
+#if TEST_RESIZE
+    LOG_INFO("---");
+    LOG_INFO("resize");
+    LOG_INFO("---");
+    {
+        DSPThreadPool pool(numThreads);
+        test_resize(pool, numThreads * 2);
+    }
+#endif
+
+    LOG_INFO("---");
+    LOG_INFO("done");
+
+    return EXIT_SUCCESS;
+}
@@ -21,9 +21,13 @@ class DeferredPlugin : public IPlugin {
     bool setParameter(int index, std::string_view str, int sampleOffset) override {
         auto size = str.size();
         if (size > Command::maxShortStringSize) {
-            // bummer, we need to allocate on the heap
-            auto buf = new char[size + 1];
-            memcpy(buf, str.data(), size + 1);
+            // allocate from the command buffer
+            auto buf = commandBuffer().allocate(size + 1);
+            if (!buf) {
+                return false; // see CommandBuffer
+            }
+            memcpy(buf, str.data(), size);
+            buf[size] = '\0';
 
             Command command(Command::SetParamString);
             auto& param = command.paramString;
@@ -32,7 +36,7 @@ class DeferredPlugin : public IPlugin {
             param.size = size;
             param.str = buf;
 
-            pushCommand(command);
+            return pushCommand(command);
         } else {
             Command command(Command::SetParamStringShort);
             auto& param = command.paramStringShort;
@@ -42,10 +46,8 @@ class DeferredPlugin : public IPlugin {
             param.pstr[0] = (uint8_t)size;
             memcpy(&param.pstr[1], str.data(), size);
 
-            pushCommand(command);
+            return pushCommand(command);
         }
-
-        return true; // what shall we do?
     }
 
     void setBypass(Bypass state) override {
@@ -66,12 +68,19 @@ class DeferredPlugin : public IPlugin {
         memcpy(midi.data, event.data, sizeof(event.data));
         midi.delta = event.delta;
         midi.detune = event.detune;
+        // NB: a dropped event is counted and reported by the poll function
+        // of the subclass, which also grows the command buffer, see CommandBuffer.
         pushCommand(command);
     }
 
     void sendSysexEvent(const SysexEvent& event) override {
-        // copy data (LATER improve)
-        auto data = new char[event.size];
+        // copy data
+        // NB: SysEx data larger than the payload arena is dropped, but the arena
+        // grows off the audio thread, so that the next attempt can succeed.
+        auto data = commandBuffer().allocate(event.size);
+        if (!data) {
+            return; // dropped, see CommandBuffer
+        }
         memcpy(data, event.data, event.size);
 
         Command command(Command::SendSysex);
@@ -143,7 +152,15 @@ class DeferredPlugin : public IPlugin {
         pushCommand(command);
     }
  protected:
-    virtual void pushCommand(const Command& command) = 0;
+    // commands for the next process() call
+    virtual CommandBuffer& commandBuffer() = 0;
+
+    // returns false if the command buffer is full, see CommandBuffer.
+    // Subclasses must report dropped commands and grow the buffer on a
+    // non-RT thread, see CommandBuffer::takeOverflow() and CommandBuffer::grow().
+    bool pushCommand(const Command& command) {
+        return commandBuffer().push(command);
+    }
 };
 
 } // vst
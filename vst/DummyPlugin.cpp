@@ -0,0 +1,299 @@
+#include "DummyPlugin.h"
+
+#include "CpuArch.h"
+#include "FileUtils.h"
+#include "Log.h"
+#include "MiscUtils.h"
+#include "Sync.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace vst {
+
+/*/////////////////////// DummyFactory /////////////////////////*/
+
+DummyFactory::DummyFactory(const std::string& path)
+    : path_(path)
+{
+    if (!pathExists(path)){
+        throw Error(Error::ModuleError, "No such file");
+    }
+}
+
+// the plugin description is created in the same way as if it had been probed
+PluginDesc::ptr DummyFactory::makeDesc() const {
+    std::stringstream ss;
+    ss << "[plugin]\n";
+    ss << "path=" << path_ << "\n";
+    ss << "id=44554D59\n"; // 'DUMY'
+    ss << "name=Dummy\n";
+    ss << "vendor=vstplugin\n";
+    ss << "category=Test\n";
+    ss << "version=1.0\n";
+    ss << "sdkversion=none\n";
+    ss << "flags=" << std::hex
+       << (PluginDesc::SinglePrecision | PluginDesc::DoublePrecision)
+       << std::dec << "\n";
+    // one stereo bus; the actual channel count is set with setNumSpeakers().
+    ss << "[inputs]\n" << "n=1\n" << "2,0,Input\n";
+    ss << "[outputs]\n" << "n=1\n" << "2,0,Output\n";
+    ss << "[parameters]\n";
+    ss << "n=" << numParameters << "\n";
+    ss << "gain,,0,1\n";
+    for (int i = 1; i < numParameters; ++i){
+        ss << "param" << i << ",," << std::hex << i << std::dec << ",1\n";
+    }
+    ss << "[programs]\n" << "n=1\n" << "Default\n";
+
+    auto desc = std::make_shared<PluginDesc>(
+        std::static_pointer_cast<const IFactory>(shared_from_this()));
+    desc->deserialize(ss);
+    return desc;
+}
+
+ProbeFuture DummyFactory::probeAsync(float timeout, bool nonblocking){
+    desc_ = makeDesc();
+    return [desc = desc_](ProbeCallback callback){
+        if (callback){
+            ProbeResult result;
+            result.plugin = desc;
+            callback(result);
+        }
+        return true;
+    };
+}
+
+PluginDesc::const_ptr DummyFactory::probePlugin(int id) const {
+    return makeDesc();
+}
+
+void DummyFactory::addPlugin(PluginDesc::ptr desc){
+    desc_ = std::move(desc);
+}
+
+PluginDesc::const_ptr DummyFactory::getPlugin(int index) const {
+    return index == 0 ? desc_ : nullptr;
+}
+
+PluginDesc::const_ptr DummyFactory::findPlugin(const std::string& name) const {
+    return (desc_ && desc_->name == name) ? desc_ : nullptr;
+}
+
+int DummyFactory::numPlugins() const {
+    return desc_ ? 1 : 0;
+}
+
+CpuArch DummyFactory::arch() const {
+    return getHostCpuArchitecture();
+}
+
+IPlugin::ptr DummyFactory::create(const std::string& name, bool editor) const {
+    auto desc = findPlugin(name);
+    if (!desc){
+        throw Error(Error::PluginError, "couldn't find subplugin");
+    }
+    return std::make_unique<DummyPlugin>(shared_from_this(), desc);
+}
+
+/*/////////////////////// DummyPlugin /////////////////////////*/
+
+DummyPlugin::DummyPlugin(IFactory::const_ptr f, PluginDesc::const_ptr desc)
+    : factory_(std::move(f)), info_(std::move(desc))
+{
+    int numParams = info_->numParameters();
+    params_.reset(new std::atomic<float>[numParams]);
+    params_[0].store(1.f); // unity gain
+    for (int i = 1; i < numParams; ++i){
+        params_[i].store(0.f);
+    }
+}
+
+void DummyPlugin::setupProcessing(double sampleRate, int maxBlockSize,
+                                  ProcessPrecision precision, ProcessMode mode){
+    LOG_DEBUG("DummyPlugin: setupProcessing (sr: " << sampleRate
+              << ", blocksize: " << maxBlockSize << ")");
+}
+
+template<typename T>
+void DummyPlugin::doProcess(ProcessData& data){
+    auto gain = (bypass_ == Bypass::Off) ?
+        (T)params_[0].load(std::memory_order_relaxed) : (T)1;
+    auto n = data.numSamples;
+    for (int i = 0; i < data.numOutputs; ++i){
+        auto& out = data.outputs[i];
+        auto in = (i < data.numInputs) ? &data.inputs[i] : nullptr;
+        for (int j = 0; j < out.numChannels; ++j){
+            auto outChn = ((T **)out.channelData32)[j];
+            if (in && j < in->numChannels){
+                auto inChn = ((T **)in->channelData32)[j];
+                for (int k = 0; k < n; ++k){
+                    outChn[k] = inChn[k] * gain;
+                }
+            } else {
+                std::fill(outChn, outChn + n, 0);
+            }
+            // simulated latency (only for the first bus)
+            if (latency_ > 0 && i == 0 && j < numChannels_){
+                auto delay = delayBuffer_.data() + j * latency_;
+                auto pos = delayPos_;
+                for (int k = 0; k < n; ++k){
+                    auto tmp = delay[pos];
+                    delay[pos] = outChn[k];
+                    outChn[k] = tmp;
+                    if (++pos >= latency_){
+                        pos = 0;
+                    }
+                }
+            }
+        }
+    }
+    if (latency_ > 0){
+        delayPos_ = (delayPos_ + n) % latency_;
+    }
+    // simulated processing cost
+    auto cost = processCost_.load(std::memory_order_relaxed);
+    if (cost > 0){
+        using clock = std::chrono::steady_clock;
+        auto end = clock::now() + std::chrono::duration_cast<clock::duration>(
+                    std::chrono::duration<double, std::micro>(cost));
+        while (clock::now() < end){
+            pauseCpu();
+        }
+    }
+}
+
+void DummyPlugin::process(ProcessData& data){
+    if (data.precision == ProcessPrecision::Double){
+        doProcess<double>(data);
+    } else {
+        doProcess<float>(data);
+    }
+}
+
+void DummyPlugin::setNumSpeakers(int *, int,
+                                 int *output, int numOutputs){
+    numChannels_ = numOutputs > 0 ? output[0] : 0;
+    updateDelay();
+}
+
+void DummyPlugin::updateDelay(){
+    delayBuffer_.assign(numChannels_ * latency_, 0);
+    delayPos_ = 0;
+}
+
+intptr_t DummyPlugin::vendorSpecific(int index, intptr_t value, void *, float opt){
+    switch (index){
+    case SetLatency:
+        if (value != latency_){
+            latency_ = std::max<int>(value, 0);
+            updateDelay();
+            if (listener_){
+                listener_->latencyChanged(latency_);
+            }
+        }
+        return 1;
+    case SetProcessCost:
+        processCost_.store(opt, std::memory_order_relaxed);
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+void DummyPlugin::setParameter(int index, float value, int sampleOffset){
+    params_[index].store(value, std::memory_order_relaxed);
+}
+
+bool DummyPlugin::setParameter(int index, std::string_view str, int sampleOffset){
+    if (str == "crash"){
+        LOG_WARNING("DummyPlugin: crash!");
+        std::abort();
+    }
+    std::string s(str);
+    char *end;
+    auto value = strtof(s.c_str(), &end);
+    if (end == s.c_str()){
+        return false;
+    }
+    params_[index].store(value, std::memory_order_relaxed);
+    return true;
+}
+
+float DummyPlugin::getParameter(int index) const {
+    return params_[index].load(std::memory_order_relaxed);
+}
+
+size_t DummyPlugin::getParameterString(int index, ParamStringBuffer& buffer) const {
+    return snprintf(buffer.data(), buffer.size(), "%.3f", getParameter(index));
+}
+
+std::string DummyPlugin::getProgramName() const {
+    return getProgramNameIndexed(0);
+}
+
+std::string DummyPlugin::getProgramNameIndexed(int index) const {
+    return index == 0 ? info_->programs[0] : "";
+}
+
+void DummyPlugin::readProgramFile(const std::string& path){
+    File file(path, File::READ);
+    if (!file.is_open()){
+        throw Error("couldn't open file " + path);
+    }
+    IPlugin::readProgramData(file.readAll());
+}
+
+// the program data is simply an array of parameter values
+void DummyPlugin::readProgramData(const char *data, size_t size){
+    int numParams = info_->numParameters();
+    if (size != sizeof(float) * numParams){
+        throw Error("DummyPlugin: bad program data size");
+    }
+    for (int i = 0; i < numParams; ++i){
+        float value;
+        memcpy(&value, data + i * sizeof(float), sizeof(float));
+        params_[i].store(value, std::memory_order_relaxed);
+    }
+}
+
+void DummyPlugin::writeProgramFile(const std::string& path){
+    File file(path, File::WRITE);
+    if (!file.is_open()){
+        throw Error("couldn't create file " + path);
+    }
+    std::string buffer;
+    writeProgramData(buffer);
+    file.write(buffer.data(), buffer.size());
+}
+
+void DummyPlugin::writeProgramData(std::string& buffer){
+    int numParams = info_->numParameters();
+    buffer.resize(sizeof(float) * numParams);
+    for (int i = 0; i < numParams; ++i){
+        auto value = params_[i].load(std::memory_order_relaxed);
+        memcpy(&buffer[i * sizeof(float)], &value, sizeof(float));
+    }
+}
+
+// there is only a single program
+void DummyPlugin::readBankFile(const std::string& path){
+    readProgramFile(path);
+}
+
+void DummyPlugin::readBankData(const char *data, size_t size){
+    readProgramData(data, size);
+}
+
+void DummyPlugin::writeBankFile(const std::string& path){
+    writeProgramFile(path);
+}
+
+void DummyPlugin::writeBankData(std::string& buffer){
+    writeProgramData(buffer);
+}
+
+} // vst
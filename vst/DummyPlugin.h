@@ -0,0 +1,150 @@
+// DummyPlugin
+#pragma once
+
+#include "Interface.h"
+#include "PluginDesc.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace vst {
+
+// A built-in plugin for tests and benchmarks, see test/bridge_bench.cpp.
+// IFactory::load() returns a DummyFactory for (existing) files with
+// the ".dummy" extension, so that the plugin can also be created
+// in the bridge/sandbox subprocess like any other plugin.
+
+class DummyFactory final :
+        public std::enable_shared_from_this<DummyFactory>,
+        public IFactory
+{
+ public:
+    static const int numParameters = 16;
+
+    DummyFactory(const std::string& path);
+
+    ProbeFuture probeAsync(float timeout, bool nonblocking) override;
+    PluginDesc::const_ptr probePlugin(int id) const override;
+
+    void addPlugin(PluginDesc::ptr desc) override;
+    PluginDesc::const_ptr getPlugin(int index) const override;
+    PluginDesc::const_ptr findPlugin(const std::string& name) const override;
+    int numPlugins() const override;
+
+    const std::string& path() const override { return path_; }
+    CpuArch arch() const override;
+
+    IPlugin::ptr create(const std::string& name, bool editor) const override;
+ private:
+    PluginDesc::ptr makeDesc() const;
+
+    std::string path_;
+    PluginDesc::ptr desc_;
+};
+
+//-----------------------------------------------------------------------------
+
+// Copies the inputs to the outputs (with variable channel counts)
+// and applies the "gain" parameter. All other parameters do nothing.
+// The latency and the processing cost can be simulated with vendorSpecific().
+// Setting any parameter to the string "crash" aborts the process, e.g. to test
+// the crash recovery of sandboxed plugins (see test/recovery_test.cpp).
+class DummyPlugin final : public IPlugin {
+ public:
+    enum VendorMethod {
+        SetLatency = 1, // 'value': latency in samples (not realtime safe!)
+        SetProcessCost // 'opt': busy-wait time per process() call in microseconds
+    };
+
+    DummyPlugin(IFactory::const_ptr f, PluginDesc::const_ptr desc);
+
+    const PluginDesc& info() const override { return *info_; }
+
+    void setupProcessing(double sampleRate, int maxBlockSize,
+                         ProcessPrecision precision, ProcessMode mode) override;
+    void process(ProcessData& data) override;
+    void suspend() override {}
+    void resume() override {}
+    void setBypass(Bypass state) override {
+        bypass_ = state;
+    }
+    // accept any speaker arrangement
+    void setNumSpeakers(int *input, int numInputs,
+                        int *output, int numOutputs) override;
+    int getLatencySamples() override {
+        return latency_;
+    }
+
+    void setListener(IPluginListener* listener) override {
+        listener_ = listener;
+    }
+
+    void setTempoBPM(double tempo) override {}
+    void setTimeSignature(int numerator, int denominator) override {}
+    void setTransportPlaying(bool play) override {}
+    void setTransportRecording(bool record) override {}
+    void setTransportAutomationWriting(bool writing) override {}
+    void setTransportAutomationReading(bool reading) override {}
+    void setTransportCycleActive(bool active) override {}
+    void setTransportCycleStart(double beat) override {}
+    void setTransportCycleEnd(double beat) override {}
+    void setTransportPosition(double beat) override {
+        position_ = beat;
+    }
+    double getTransportPosition() const override {
+        return position_;
+    }
+    void sendMidiEvent(const MidiEvent& event) override {}
+    void sendSysexEvent(const SysexEvent& event) override {}
+
+    void setParameter(int index, float value, int sampleOffset = 0) override;
+    bool setParameter(int index, std::string_view str, int sampleOffset = 0) override;
+    float getParameter(int index) const override;
+    size_t getParameterString(int index, ParamStringBuffer& buffer) const override;
+
+    void setProgram(int index) override {}
+    void setProgramName(std::string_view name) override {}
+    int getProgram() const override { return 0; }
+    std::string getProgramName() const override;
+    std::string getProgramNameIndexed(int index) const override;
+
+    void readProgramFile(const std::string& path) override;
+    void readProgramData(const char *data, size_t size) override;
+    void writeProgramFile(const std::string& path) override;
+    void writeProgramData(std::string& buffer) override;
+    void readBankFile(const std::string& path) override;
+    void readBankData(const char *data, size_t size) override;
+    void writeBankFile(const std::string& path) override;
+    void writeBankData(std::string& buffer) override;
+
+    void openEditor(void *window) override {}
+    void closeEditor() override {}
+    bool getEditorRect(Rect& rect) const override { return false; }
+    void updateEditor() override {}
+    void checkEditorSize(int &width, int &height) const override {}
+    void resizeEditor(int width, int height) override {}
+
+    IWindow *getWindow() const override { return nullptr; }
+
+    intptr_t vendorSpecific(int index, intptr_t value, void *p, float opt) override;
+ private:
+    template<typename T>
+    void doProcess(ProcessData& data);
+    void updateDelay();
+
+    IFactory::const_ptr factory_; // just to ensure lifetime
+    PluginDesc::const_ptr info_;
+    IPluginListener *listener_ = nullptr;
+    std::unique_ptr<std::atomic<float>[]> params_;
+    Bypass bypass_ = Bypass::Off;
+    double position_ = 0;
+    // simulated latency and processing cost
+    int latency_ = 0;
+    int numChannels_ = 0; // channels of the first output bus
+    int delayPos_ = 0;
+    std::vector<double> delayBuffer_;
+    std::atomic<float> processCost_{0};
+};
+
+} // vst
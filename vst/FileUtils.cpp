@@ -9,7 +9,10 @@
 # endif
 # include <windows.h>
 #else
+# include <fcntl.h>
+# include <sys/mman.h>
 # include <sys/stat.h>
+# include <unistd.h>
 #endif
 
 #if USE_STDFS
@@ -351,6 +354,88 @@ std::string File::readAll()
     return std::string{std::istreambuf_iterator<char>{*this}, std::istreambuf_iterator<char>{}};
 }
 
+//---------------------------------------------------//
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& path){
+    // FILE_SHARE_DELETE: the file can be deleted while it is mapped
+    HANDLE hFile = CreateFileW(widen(path).c_str(), GENERIC_READ,
+                               FILE_SHARE_READ | FILE_SHARE_DELETE,
+                               NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE){
+        throw Error(Error::SystemError, "CreateFile() failed: " + errorMessage(GetLastError()));
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(hFile, &size)){
+        auto err = GetLastError();
+        CloseHandle(hFile);
+        throw Error(Error::SystemError, "GetFileSizeEx() failed: " + errorMessage(err));
+    }
+    size_ = size.QuadPart;
+    if (size_ == 0){
+        // can't map empty files
+        CloseHandle(hFile);
+        return;
+    }
+    hMapping_ = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    // we can close the file handle after creating the mapping
+    CloseHandle(hFile);
+    if (!hMapping_){
+        throw Error(Error::SystemError, "CreateFileMapping() failed: "
+                    + errorMessage(GetLastError()));
+    }
+    data_ = (const char *)MapViewOfFile(hMapping_, FILE_MAP_READ, 0, 0, 0);
+    if (!data_){
+        auto err = GetLastError();
+        CloseHandle(hMapping_);
+        throw Error(Error::SystemError, "MapViewOfFile() failed: " + errorMessage(err));
+    }
+}
+
+MappedFile::~MappedFile(){
+    if (data_){
+        UnmapViewOfFile(data_);
+    }
+    if (hMapping_){
+        CloseHandle(hMapping_);
+    }
+}
+#else
+MappedFile::MappedFile(const std::string& path){
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0){
+        throw Error(Error::SystemError, "open() failed: " + errorMessage(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0){
+        auto err = errno;
+        ::close(fd);
+        throw Error(Error::SystemError, "fstat() failed: " + errorMessage(err));
+    }
+    size_ = st.st_size;
+    if (size_ == 0){
+        // can't map empty files
+        ::close(fd);
+        return;
+    }
+    void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    // we can close the fd after calling mmap()!
+    ::close(fd);
+    if (data == MAP_FAILED){
+        throw Error(Error::SystemError, "mmap() failed: " + errorMessage(errno));
+    }
+    data_ = (const char *)data;
+}
+
+MappedFile::~MappedFile(){
+    if (data_){
+        munmap((void *)data_, size_);
+    }
+}
+#endif
+
+//---------------------------------------------------//
+
 TmpFile::TmpFile(const std::string& path, Mode mode)
     : File(path, mode), path_(path) {}
 
@@ -46,6 +46,26 @@ public:
     std::string readAll();
 };
 
+// Read-only memory mapped file, taking UTF-8 file paths.
+// Throws an Error exception on failure.
+class MappedFile {
+public:
+    MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char * data() const { return data_; }
+    size_t size() const { return size_; }
+private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void *hMapping_ = nullptr;
+#endif
+};
+
 // RAII class for automatic cleanup
 class TmpFile : public File {
 public:
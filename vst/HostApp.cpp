@@ -286,6 +286,8 @@ public:
 
     ProcessHandle bridge(const std::string& shmPath, intptr_t logPipe) const override;
 
+    ProcessHandle probeServer(intptr_t requestPipe, intptr_t replyPipe) const override;
+
     virtual bool test() const {
         return doTest(path_);
     }
@@ -356,6 +358,16 @@ ProcessHandle HostApp::bridge(const std::string &shmPath, intptr_t logPipe) cons
     return createProcess(cmdline.str(), BRIDGE_LOG);
 }
 
+ProcessHandle HostApp::probeServer(intptr_t requestPipe, intptr_t replyPipe) const {
+    // arguments: host.exe probe_server <parent_pid> <request_pipe> <reply_pipe>
+    // NOTE: Win32 handles can be safely cast to DWORD!
+    std::stringstream cmdline;
+    cmdline << fileName(path_) << " probe_server " << getCurrentProcessId()
+            << " " << (DWORD)requestPipe << " " << (DWORD)replyPipe;
+
+    return createProcess(cmdline.str(), PROBE_LOG);
+}
+
 ProcessHandle HostApp::createProcess(const std::string &cmdline, bool log) const {
     // LOG_DEBUG(path_ << " " << cmdline);
 
@@ -430,6 +442,15 @@ ProcessHandle HostApp::bridge(const std::string &shmPath, intptr_t logPipe) cons
                                      parent.c_str(), shmPath.c_str(), pipe.c_str());
 }
 
+ProcessHandle HostApp::probeServer(intptr_t requestPipe, intptr_t replyPipe) const {
+    auto parent = std::to_string(getpid());
+    auto request = std::to_string(static_cast<int>(requestPipe));
+    auto reply = std::to_string(static_cast<int>(replyPipe));
+    // arguments: host probe_server <parent_pid> <request_pipe> <reply_pipe>
+    return createProcess<PROBE_LOG>(path_.c_str(), fileName(path_).c_str(), "probe_server",
+                                    parent.c_str(), request.c_str(), reply.c_str());
+}
+
 #endif
 
 #ifdef __APPLE__
@@ -473,6 +494,15 @@ public:
                                          parent.c_str(), shmPath.c_str(), pipe.c_str());
     }
 
+    ProcessHandle probeServer(intptr_t requestPipe, intptr_t replyPipe) const override {
+        auto parent = std::to_string(getpid());
+        auto request = std::to_string(static_cast<int>(requestPipe));
+        auto reply = std::to_string(static_cast<int>(replyPipe));
+        // arguments: arch -<arch> <host_path> probe_server <parent_pid> <request_pipe> <reply_pipe>
+        return createProcess<PROBE_LOG>("arch", "arch", archOption(arch_), path_.c_str(), "probe_server",
+                                        parent.c_str(), request.c_str(), reply.c_str());
+    }
+
     bool test() const override {
         std::stringstream ss;
         ss << archOption(arch_) << " \"" << path_ << "\"";
@@ -509,6 +539,16 @@ class WineHostApp : public HostApp {
                                          parent.c_str(), shmPath.c_str(), pipe.c_str());
     }
 
+    ProcessHandle probeServer(intptr_t requestPipe, intptr_t replyPipe) const override {
+        auto wine = wineCmd();
+        auto parent = std::to_string(getpid());
+        auto request = std::to_string(static_cast<int>(requestPipe));
+        auto reply = std::to_string(static_cast<int>(replyPipe));
+        // arguments: wine <host_path> probe_server <parent_pid> <request_pipe> <reply_pipe>
+        return createProcess<PROBE_LOG>(wine, wine, path_.c_str(), "probe_server",
+                                        parent.c_str(), request.c_str(), reply.c_str());
+    }
+
     bool test() const override {
         std::stringstream ss;
         ss << "\"" << path_ << "\"";
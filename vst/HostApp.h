@@ -95,6 +95,9 @@ public:
                                 const std::string& tmpPath) const = 0;
 
     virtual ProcessHandle bridge(const std::string& shmPath, intptr_t logPipe) const = 0;
+
+    // long-lived probe process, see ProbeWorker
+    virtual ProcessHandle probeServer(intptr_t requestPipe, intptr_t replyPipe) const = 0;
 };
 
 } // vst
@@ -188,6 +188,16 @@ void bypass(ProcessData& data);
 
 using ParamStringBuffer = std::array<char, 128>;
 
+// DSP load statistics over the most recent process() calls
+struct ProcessStats {
+    double mean = 0; // average process time in microseconds
+    double max = 0; // maximum process time in microseconds
+    double p99 = 0; // 99th percentile in microseconds
+    double load = 0; // average percentage of the block duration
+    int count = 0; // number of measured blocks
+    int missed = 0; // number of late blocks, see ThreadMode::Pipelined
+};
+
 class IPlugin {
  public:
     using ptr = std::unique_ptr<IPlugin>;
@@ -206,7 +216,17 @@ class IPlugin {
     virtual void resume() = 0;
     virtual void setBypass(Bypass state) = 0;
     virtual void setNumSpeakers(int *input, int numInputs, int *output, int numOutputs) = 0;
+    // Zero-copy I/O (threaded or sandboxed plugins): get the plugin's own busses
+    // for the next process() call. The host can write its input directly into
+    // 'inputs' and pass both 'inputs' and 'outputs' in ProcessData; after
+    // process() has returned, 'outputs' contains the result (delayed by one
+    // block for threaded plugins).
+    // The busses must be requested before every process() call!
+    // Returns false if not supported.
+    virtual bool getProcessBuffers(AudioBus *&inputs, AudioBus *&outputs) { return false; }
     virtual int getLatencySamples() = 0;
+    // can be called from any thread
+    virtual ProcessStats getProcessStats() const { return ProcessStats{}; }
 
     virtual void setListener(IPluginListener* listener) = 0;
 
@@ -290,6 +310,20 @@ enum class RunMode {
     Bridge
 };
 
+// threaded plugins either return the output of the previous block
+// (Deferred, one block of latency) or process the current block and
+// wait for the result (ForkJoin, no additional latency).
+// Pipelined is like Deferred, but for bridged/sandboxed plugins: the plugin
+// gets its own subprocess which does the work, so we don't need a DSP helper
+// thread. The audio thread never blocks on the subprocess; if the result is
+// late, the plugin outputs silence and counts a missed block (ProcessStats::missed).
+// For in-process plugins, Pipelined is the same as Deferred.
+enum class ThreadMode {
+    Deferred,
+    ForkJoin,
+    Pipelined
+};
+
 class IModule {
  public:
     // throws an Error exception on failure!
@@ -380,6 +414,25 @@ class IFactory {
     virtual IPlugin::ptr create(const std::string& name, bool editor) const = 0;
 };
 
+// Probe plugins in long-lived worker processes (default: on). A worker probes
+// one plugin resp. sub-plugin after another and is only replaced if a plugin
+// crashes or hangs. This saves the cost of spawning a new process every time.
+// Turn off to probe every plugin in a fresh process (= maximum isolation).
+void setProbeWorkers(bool enable);
+bool getProbeWorkers();
+
+// The max. number of plugins resp. sub-plugins that are probed in parallel.
+// 0 (= default) picks the number automatically from the CPU core count minus
+// the cores that are currently busy. getProbeConcurrency() returns the effective
+// number and should be called once at the start of a scan.
+void setProbeConcurrency(int n);
+int getProbeConcurrency();
+
+// Block until one of the probe futures created on the current thread might be
+// ready (or has timed out), but max. 'timeout' seconds (< 0 = no limit).
+// Use this instead of calling the futures in a busy loop.
+void waitProbes(double timeout = -1);
+
 using SearchCallback = std::function<void(const std::string&)>;
 
 // recursively search 'dir' for VST plug-ins. for each plugin, the callback function is evaluated with the absolute path.
@@ -457,6 +510,113 @@ namespace UIThread {
     void removePollFunction(Handle handle);
 }
 
+// Set the number of DSP threads (0 = default). If the thread pool
+// is already running, it is resized accordingly (not realtime safe!)
 void setNumDSPThreads(int numThreads);
 
+// Get the number of active DSP helper threads and their average utilization
+// (0.0 - 1.0) since the previous call. Returns false if the thread pool
+// hasn't been created yet.
+bool getDSPThreadPoolStatus(int& numThreads, double& utilization);
+
+// Pin DSP helper threads and the RT threads of bridge/sandbox processes
+// to the given CPUs; thread N is pinned to cpus[N % cpus.size()].
+// An empty list disables pinning (= the default).
+// NB: DSP helper threads pick up changes the next time they wake up;
+// bridge/sandbox processes only pick up the settings on creation.
+void setDSPThreadAffinity(const std::vector<int>& cpus);
+std::vector<int> getDSPThreadAffinity();
+
+// Realtime (SCHED_FIFO) priority of DSP helper threads and the RT threads
+// of bridge/sandbox processes; 0 = default.
+void setDSPThreadPriority(int priority);
+int getDSPThreadPriority();
+
+struct DSPThreadInfo {
+    int cpu = -1; // the CPU the thread has last been running on (-1 = unknown)
+    int affinity = -1; // the CPU the thread is pinned to (-1 = not pinned)
+    int priority = 0; // realtime priority (0 = not realtime)
+};
+
+// How often threaded plugins had to wait for their previous task,
+// grouped by the stage in which the wait has finished.
+struct DSPWaitStats {
+    uint64_t immediate = 0; // task already finished
+    uint64_t spin = 0;
+    uint64_t yield = 0;
+    uint64_t block = 0;
+};
+
+// Returns false if the thread pool hasn't been created yet.
+bool getDSPWaitStats(DSPWaitStats& stats);
+
+// Max. time (in microseconds) the audio thread spins on the reply of a
+// bridge/sandbox process before blocking in the kernel; 0 = don't spin.
+// Defaults to 20 us on multi-core machines and 0 otherwise.
+// NB: only affects bridge/sandbox processes created afterwards.
+void setBridgeSpinTime(float us);
+float getBridgeSpinTime();
+
+// Number of pre-spawned sandbox processes per CPU architecture; 0 = disabled (default).
+// Opening a sandboxed plugin claims an idle process from the pool, which is then
+// refilled in the background. This avoids stalls when the subprocess is slow to
+// start (e.g. with Wine). The pool for the host architecture and the architectures
+// passed to setSandboxPoolArchs() are filled right away; pools for other architectures
+// (and for ThreadMode::Pipelined) are created on first use.
+// NB: setting the size to 0 releases all idle processes.
+void setSandboxPoolSize(int size);
+int getSandboxPoolSize();
+
+// Additional CPU architectures for the sandbox pool, e.g. for bridged 32-bit
+// or Windows plugins; see setSandboxPoolSize(). Pools are never removed, so
+// architectures that are no longer listed keep their idle processes until
+// the pool size is set to 0.
+void setSandboxPoolArchs(const std::vector<CpuArch>& archs);
+
+// Max. number of sandboxed plugins (per CPU architecture) which share a single
+// subprocess; 1 = every plugin gets its own subprocess (default).
+// A group works like the shared plugin bridge (one RT channel per DSP thread),
+// which saves processes, shared memory segments and context switches, but
+// a crash takes down the whole group. See also PluginDesc::create() for named groups.
+// NB: only affects plugins created afterwards. ThreadMode::Pipelined plugins
+// always get their own subprocess.
+void setSandboxGroupSize(int size);
+int getSandboxGroupSize();
+
+// Automatically restart sandboxed plugins (including ThreadMode::Pipelined) after
+// a crash; default: off. The new subprocess restores the plugin state from the last
+// background snapshot (see setSandboxSnapshotInterval()) and the last known parameter
+// values. While restarting, the plugin outputs silence. Crashes and restarts are
+// logged with timing information. IPluginListener::pluginCrashed() is only called
+// if the restart fails or the plugin keeps crashing.
+// NB: only affects plugins created afterwards; plugins in a shared bridge
+// or in a sandbox group are not affected.
+void setSandboxRecovery(bool enable);
+bool getSandboxRecovery();
+// Interval (in seconds) of the background state snapshots for crash recovery; default: 5.
+void setSandboxSnapshotInterval(float seconds);
+float getSandboxSnapshotInterval();
+
+// report the actual placement of the DSP helper threads.
+// NB: this creates the thread pool if necessary!
+std::vector<DSPThreadInfo> getDSPThreadInfo();
+
+// Fork/join processing for ThreadMode::ForkJoin: between beginForkJoin()
+// and endForkJoin(), IPlugin::process() only forks the DSP task, so that
+// several plugins can run in parallel; endForkJoin() helps processing and
+// waits for all forked plugins of the current thread.
+// NB: the host must not access the process buffers before endForkJoin()!
+// Without beginForkJoin(), process() joins immediately.
+void beginForkJoin();
+void endForkJoin();
+
+// Batched processing for bridged plugins: between beginBridgeBatch() and
+// endBridgeBatch(), IPlugin::process() of bridged plugins only queues the
+// process command; endBridgeBatch() sends the queued commands of each bridge
+// in a single round trip and waits for all results. With 'parallel', the
+// subprocess distributes the plugins over its own DSP thread pool.
+// NB: the host must not access the process buffers before endBridgeBatch()!
+void beginBridgeBatch(bool parallel = false);
+void endBridgeBatch();
+
 } // vst
@@ -3,6 +3,7 @@
 #include "Sync.h"
 
 #include <stddef.h>
+#include <stdint.h>
 #include <atomic>
 #include <array>
 #include <memory>
@@ -59,6 +60,164 @@ class LockfreeFifo {
     std::array<T, N> data_;
 };
 
+// bounded MPMC queue (Dmitry Vyukov's algorithm).
+// Every slot has a sequence number which tells producers and consumers
+// whether the slot is free resp. ready, so that the data itself doesn't
+// need to be atomic. N must be a power of 2.
+template<typename T, size_t N>
+class LockfreeMPMCQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of 2");
+ public:
+    LockfreeMPMCQueue() {
+        for (size_t i = 0; i < N; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    LockfreeMPMCQueue(const LockfreeMPMCQueue&) = delete;
+
+    LockfreeMPMCQueue& operator=(const LockfreeMPMCQueue&) = delete;
+
+    bool push(const T& data) {
+        Cell *cell;
+        auto pos = writeHead_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & (N - 1)];
+            auto seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (writeHead_.compare_exchange_weak(pos, pos + 1,
+                                                     std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // queue is full
+            } else {
+                pos = writeHead_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = data;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& data) {
+        Cell *cell;
+        auto pos = readHead_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & (N - 1)];
+            auto seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (readHead_.compare_exchange_weak(pos, pos + 1,
+                                                    std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // queue is empty
+            } else {
+                pos = readHead_.load(std::memory_order_relaxed);
+            }
+        }
+        data = cell->data;
+        cell->sequence.store(pos + N, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return readHead_.load(std::memory_order_relaxed)
+                == writeHead_.load(std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return N; }
+ private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+    alignas(CACHELINE_SIZE) std::atomic<size_t> writeHead_{0};
+    alignas(CACHELINE_SIZE) std::atomic<size_t> readHead_{0};
+    alignas(CACHELINE_SIZE) std::array<Cell, N> cells_;
+};
+
+// bounded Chase-Lev work-stealing deque, see "Correct and Efficient
+// Work-Stealing for Weak Memory Models" (Lê et al., 2013).
+// push() and pop() may only be called by the owning thread (LIFO),
+// steal() may be called by any other thread (FIFO).
+// T must be lock-free atomic (typically a pointer); N must be a power of 2.
+template<typename T, size_t N>
+class WorkStealingDeque {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of 2");
+    static_assert(std::atomic<T>::is_always_lock_free, "T must be lock-free");
+ public:
+    WorkStealingDeque() = default;
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // owner thread only!
+    bool push(T data) {
+        auto b = bottom_.load(std::memory_order_relaxed);
+        auto t = top_.load(std::memory_order_acquire);
+        if (b - t >= (int64_t)N) {
+            return false; // deque is full
+        }
+        data_[b & (N - 1)].store(data, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // owner thread only!
+    bool pop(T& data) {
+        auto b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto t = top_.load(std::memory_order_relaxed);
+        if (t <= b) {
+            data = data_[b & (N - 1)].load(std::memory_order_relaxed);
+            if (t == b) {
+                // last item: race against thieves
+                bool result = top_.compare_exchange_strong(t, t + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed);
+                bottom_.store(b + 1, std::memory_order_relaxed);
+                return result;
+            }
+            return true;
+        } else {
+            // deque is empty
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    // any thread; might fail spuriously if another thread wins the race.
+    bool steal(T& data) {
+        auto t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto b = bottom_.load(std::memory_order_acquire);
+        if (t < b) {
+            data = data_[t & (N - 1)].load(std::memory_order_relaxed);
+            return top_.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed);
+        } else {
+            return false; // deque is empty
+        }
+    }
+
+    bool empty() const {
+        return bottom_.load(std::memory_order_relaxed)
+                <= top_.load(std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return N; }
+ private:
+    alignas(CACHELINE_SIZE) std::atomic<int64_t> top_{0};
+    alignas(CACHELINE_SIZE) std::atomic<int64_t> bottom_{0};
+    alignas(CACHELINE_SIZE) std::array<std::atomic<T>, N> data_;
+};
+
 template<typename T>
 struct Node {
     template<typename... U>
@@ -22,6 +22,12 @@
 #include <pthread.h>
 #endif
 
+#if VST_HOST_SYSTEM == VST_LINUX
+// thread affinity
+#include <sched.h>
+#endif
+
+#include <algorithm>
 #include <mutex>
 #include <sstream>
 
@@ -481,4 +487,107 @@ void setThreadPriority(Priority p){
 #endif
 }
 
+bool setThreadRealtimePriority(int priority){
+    if (priority <= 0){
+        setThreadPriority(Priority::High);
+        return true;
+    }
+#if VST_HOST_SYSTEM == VST_WINDOWS
+    // there are no priority levels above THREAD_PRIORITY_TIME_CRITICAL
+    if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)){
+        return true;
+    }
+#else
+    struct sched_param param;
+    param.sched_priority = std::clamp(priority, sched_get_priority_min(SCHED_FIFO),
+                                      sched_get_priority_max(SCHED_FIFO));
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0){
+        return true;
+    }
+#endif
+    LOG_WARNING("VSTPlugin: couldn't set realtime priority " << priority);
+    return false;
+}
+
+int getThreadRealtimePriority(){
+#if VST_HOST_SYSTEM == VST_WINDOWS
+    auto p = GetThreadPriority(GetCurrentThread());
+    return (p == THREAD_PRIORITY_TIME_CRITICAL) ? p : 0;
+#else
+    int policy;
+    struct sched_param param;
+    if (pthread_getschedparam(pthread_self(), &policy, &param) == 0
+            && (policy == SCHED_FIFO || policy == SCHED_RR)){
+        return param.sched_priority;
+    } else {
+        return 0;
+    }
+#endif
+}
+
+bool setThreadAffinity(const std::vector<int>& cpus){
+#if VST_HOST_SYSTEM == VST_LINUX
+    cpu_set_t set;
+    if (cpus.empty()){
+        // the main thread has the same ID as the process; this
+        // respects the CPU set of the process (e.g. isolcpus or taskset).
+        if (sched_getaffinity(getpid(), sizeof(set), &set) != 0){
+            LOG_WARNING("VSTPlugin: sched_getaffinity() failed: " << errorMessage(errno));
+            return false;
+        }
+    } else {
+        CPU_ZERO(&set);
+        for (auto& cpu : cpus){
+            if (cpu >= 0 && cpu < CPU_SETSIZE){
+                CPU_SET(cpu, &set);
+            }
+        }
+    }
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0){
+        LOG_WARNING("VSTPlugin: couldn't set thread affinity: " << errorMessage(err));
+        return false;
+    }
+    return true;
+#elif VST_HOST_SYSTEM == VST_WINDOWS
+    DWORD_PTR mask = 0;
+    if (cpus.empty()){
+        DWORD_PTR systemMask;
+        if (!GetProcessAffinityMask(GetCurrentProcess(), &mask, &systemMask)){
+            LOG_WARNING("VSTPlugin: GetProcessAffinityMask() failed: "
+                        << errorMessage(GetLastError()));
+            return false;
+        }
+    } else {
+        for (auto& cpu : cpus){
+            if (cpu >= 0 && cpu < (int)(sizeof(mask) * 8)){
+                mask |= (DWORD_PTR)1 << cpu;
+            }
+        }
+    }
+    if (!SetThreadAffinityMask(GetCurrentThread(), mask)){
+        LOG_WARNING("VSTPlugin: couldn't set thread affinity: "
+                    << errorMessage(GetLastError()));
+        return false;
+    }
+    return true;
+#else
+    // macOS only supports affinity tags, which are mere hints.
+    if (!cpus.empty()){
+        LOG_WARNING("VSTPlugin: thread affinity not supported on this platform");
+    }
+    return false;
+#endif
+}
+
+int getCurrentCPU(){
+#if VST_HOST_SYSTEM == VST_LINUX
+    return sched_getcpu();
+#elif VST_HOST_SYSTEM == VST_WINDOWS
+    return GetCurrentProcessorNumber();
+#else
+    return -1;
+#endif
+}
+
 } // vst
@@ -187,4 +187,20 @@ enum class Priority {
 
 void setThreadPriority(Priority p);
 
+// set the realtime (SCHED_FIFO) priority of the current thread;
+// 0 is equivalent to setThreadPriority(Priority::High).
+// NB: on Windows, the actual priority value is ignored.
+bool setThreadRealtimePriority(int priority);
+
+// the realtime priority of the current thread (0 = not realtime)
+int getThreadRealtimePriority();
+
+// pin the current thread to the given CPUs; an empty list resets
+// the affinity to that of the main thread.
+// Returns false on failure or if not supported (macOS).
+bool setThreadAffinity(const std::vector<int>& cpus);
+
+// the CPU the current thread is running on (-1 = unknown)
+int getCurrentCPU();
+
 } // vst
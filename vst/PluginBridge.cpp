@@ -5,6 +5,7 @@
 #include "CpuArch.h"
 #include "MiscUtils.h"
 
+#include <algorithm>
 #include <cassert>
 
 namespace vst {
@@ -53,8 +54,107 @@ PluginBridge::ptr PluginBridge::getShared(CpuArch arch){
     return bridge;
 }
 
-PluginBridge::ptr PluginBridge::create(CpuArch arch){
-    auto bridge = std::make_shared<PluginBridge>(arch, false);
+struct SandboxGroup {
+    CpuArch arch;
+    std::string name; // empty: anonymous group
+    std::weak_ptr<PluginBridge> bridge;
+};
+
+// protected by gPluginBridgeMutex
+static std::vector<SandboxGroup> gSandboxGroups;
+
+static std::atomic<int> gSandboxGroupSize{1};
+
+void setSandboxGroupSize(int size){
+    gSandboxGroupSize.store(std::max<int>(size, 1));
+}
+
+int getSandboxGroupSize(){
+    return gSandboxGroupSize.load();
+}
+
+PluginBridge::ptr PluginBridge::getGroup(CpuArch arch, const std::string& name, int maxSize){
+    std::lock_guard lock(gPluginBridgeMutex);
+
+    // remove closed resp. crashed groups
+    gSandboxGroups.erase(std::remove_if(gSandboxGroups.begin(), gSandboxGroups.end(),
+        [](auto& group){
+            auto bridge = group.bridge.lock();
+            return !bridge || !bridge->alive();
+        }), gSandboxGroups.end());
+
+    for (auto& group : gSandboxGroups){
+        if (group.arch == arch && group.name == name){
+            // NB: every plugin holds a reference to the bridge. The WatchDog
+            // might temporarily hold another one, but this only means that
+            // we would create a new group a bit early.
+            if (!name.empty() || group.bridge.use_count() < maxSize){
+                if (auto bridge = group.bridge.lock()){
+                    return bridge;
+                }
+            }
+        }
+    }
+
+    if (name.empty()){
+        LOG_DEBUG("create sandbox group for " << cpuArchToString(arch));
+    } else {
+        LOG_DEBUG("create sandbox group '" << name << "' for " << cpuArchToString(arch));
+    }
+    auto bridge = std::make_shared<PluginBridge>(arch, true);
+    gSandboxGroups.push_back(SandboxGroup { arch, name, bridge });
+
+    WatchDog::instance().registerProcess(bridge);
+
+    return bridge;
+}
+
+static std::atomic<int> gSandboxPoolSize{0};
+static std::vector<CpuArch> gSandboxPoolArchs;
+static std::mutex gSandboxPoolMutex;
+
+void setSandboxPoolSize(int size){
+    size = std::max<int>(size, 0);
+    std::lock_guard lock(gSandboxPoolMutex);
+    auto oldSize = gSandboxPoolSize.exchange(size);
+    // don't create the pool just to disable it
+    if (size > 0 || oldSize > 0){
+        auto& pool = BridgePool::instance();
+        pool.resize(size);
+        if (size > 0){
+            // create the pools right away, so that they are filled in the background
+            pool.addPool(getHostCpuArchitecture(), false);
+            for (auto& arch : gSandboxPoolArchs){
+                pool.addPool(arch, false);
+            }
+        }
+    }
+}
+
+int getSandboxPoolSize(){
+    return gSandboxPoolSize.load();
+}
+
+void setSandboxPoolArchs(const std::vector<CpuArch>& archs){
+    std::lock_guard lock(gSandboxPoolMutex);
+    gSandboxPoolArchs = archs;
+    if (gSandboxPoolSize.load() > 0){
+        auto& pool = BridgePool::instance();
+        for (auto& arch : archs){
+            pool.addPool(arch, false);
+        }
+    }
+}
+
+PluginBridge::ptr PluginBridge::create(CpuArch arch, bool pipelined){
+    if (gSandboxPoolSize.load() > 0){
+        if (auto bridge = BridgePool::instance().claim(arch, pipelined)){
+            LOG_DEBUG("PluginBridge: claimed bridge from pool");
+            return bridge; // already registered
+        }
+    }
+
+    auto bridge = std::make_shared<PluginBridge>(arch, false, pipelined);
 
     WatchDog::instance().registerProcess(bridge);
 
@@ -63,14 +163,28 @@ PluginBridge::ptr PluginBridge::create(CpuArch arch){
 
 int getNumDSPThreads();
 
-PluginBridge::PluginBridge(CpuArch arch, bool shared)
-    : shared_(shared)
+// spinning only makes sense if the subprocess can run in parallel
+static std::atomic<float> gBridgeSpinTime{
+    std::thread::hardware_concurrency() > 1 ? 20.f : 0.f };
+
+void setBridgeSpinTime(float us){
+    gBridgeSpinTime.store(std::max<float>(us, 0));
+}
+
+float getBridgeSpinTime(){
+    return gBridgeSpinTime.load();
+}
+
+PluginBridge::PluginBridge(CpuArch arch, bool shared, bool pipelined)
+    : shared_(shared), pipelined_(pipelined)
 {
     LOG_DEBUG("PluginBridge: created shared memory interface");
     // setup shared memory interface
     // UI channels:
     shm_.addChannel(ShmChannel::Queue, queueSize, "ui_snd");
     shm_.addChannel(ShmChannel::Queue, queueSize, "ui_rcv");
+    // log channel, see ShmLogRing
+    shm_.addChannel(ShmChannel::Queue, ShmLogRing::size(logRingSlots), "log");
     if (shared){
         // --- shared plugin bridge ---
         // A single NRT channel followed by several RT channels.
@@ -89,16 +203,36 @@ PluginBridge::PluginBridge(CpuArch arch, bool shared)
         for (int i = 0; i < numThreads_; ++i){
             char buf[16];
             snprintf(buf, sizeof(buf), "rt%d", i+1);
-            shm_.addChannel(ShmChannel::Request, rtRequestSize, buf);
+            shm_.addChannel(ShmChannel::Request, rtRequestSize, buf, rtAudioSize);
         }
 
         locks_ = std::make_unique<PaddedSpinLock[]>(numThreads_);
+    } else if (pipelined){
+        // --- pipelined plugin ---
+        // a dedicated NRT channel, so that the RT channel can stay
+        // in flight across process calls, see PluginClient::doProcessPipelined().
+        shm_.addChannel(ShmChannel::Request, nrtRequestSize, "nrt");
+        shm_.addChannel(ShmChannel::Request, rtRequestSize, "rt", rtAudioSize);
     } else {
         // --- sandboxed plugin ---
         // a single rt channel which also doubles as the nrt channel
-        shm_.addChannel(ShmChannel::Request, rtRequestSize, "rt");
+        shm_.addChannel(ShmChannel::Request, rtRequestSize, "rt", rtAudioSize);
     }
     shm_.create();
+    auto& logChannel = shm_.getChannel(Channel::Log);
+    logRing_ = std::make_unique<ShmLogRing>(logChannel.buffer(),
+                                            logChannel.capacity(), true);
+    // RT channels may spin on the reply, see setBridgeSpinTime().
+    // NB: the NRT channel of a shared bridge doesn't need to.
+    auto spinTime = getBridgeSpinTime();
+    for (int i = Channel::NRT; i < shm_.numChannels(); ++i){
+        auto& channel = shm_.getChannel(i);
+        if (channel.name() != "nrt"){
+            channel.setSpinTime(spinTime);
+        }
+    }
+    // RT thread placement
+    shm_.setThreadConfig(getDSPThreadAffinity(), getDSPThreadPriority());
 
     LOG_DEBUG("PluginBridge: created channels");
 
@@ -202,6 +336,13 @@ PluginBridge::~PluginBridge(){
 }
 
 void PluginBridge::readLog(bool loud){
+    // NB: read the pipe first, because it contains the early messages
+    // of the subprocess, see writeLog() in host.cpp.
+    readLogPipe(loud);
+    drainLogRing();
+}
+
+void PluginBridge::readLogPipe(bool loud){
 #ifdef _WIN32
     if (hLogRead_) {
         for (;;) {
@@ -335,6 +476,20 @@ void PluginBridge::readLog(bool loud){
 #endif
 }
 
+void PluginBridge::drainLogRing(){
+    // called on the WatchDog thread and the UI thread
+    std::lock_guard lock(logMutex_);
+    if (logRing_->valid()){
+        logRing_->drain([](int level, const char *msg){
+            logMessage(level, msg);
+        });
+        auto dropped = logRing_->takeDropped();
+        if (dropped > 0){
+            LOG_WARNING("PluginBridge: dropped " << dropped
+                        << " log message(s) from subprocess");
+        }
+    }
+}
 
 void PluginBridge::checkStatus(){
     // already dead, no need to check
@@ -351,22 +506,36 @@ void PluginBridge::checkStatus(){
                 // (the channel size is atomic)
                 shm_.getChannel(i).postReply();
             }
+            {
+                std::lock_guard lock(rtShmMutex_);
+                for (auto& shm : rtShmList_){
+                    for (int i = 0; i < shm->numChannels(); ++i){
+                        shm->getChannel(i).postReply();
+                    }
+                }
+            }
             LOG_DEBUG("PluginBridge: notify clients");
             // notify all clients
             // NB: clients shall not close the plugin from within
             // the callback function, so this won't deadlock!
             std::lock_guard lock(clientMutex_);
+            if (crashHandler_){
+                crashHandler_();
+                return;
+            }
             for (auto& [_, client] : clients_) {
-                client->pluginCrashed();
+                client.listener->pluginCrashed();
             }
         }
     }
 }
 
-void PluginBridge::addUIClient(uint32_t id, IPluginListener* client){
+void PluginBridge::addUIClient(uint32_t id, IPluginListener* client,
+                               ShmParamTable* params,
+                               std::function<void(PluginBridge&)> poll){
     LOG_DEBUG("PluginBridge: add client " << id);
     std::lock_guard lock(clientMutex_);
-    clients_.emplace(id, client);
+    clients_.emplace(id, UIClient { client, params, std::move(poll) });
 }
 
 void PluginBridge::removeUIClient(uint32_t id){
@@ -375,6 +544,11 @@ void PluginBridge::removeUIClient(uint32_t id){
     clients_.erase(id);
 }
 
+void PluginBridge::setCrashHandler(std::function<void()> fn){
+    std::lock_guard lock(clientMutex_);
+    crashHandler_ = std::move(fn);
+}
+
 void PluginBridge::postUIThread(const ShmUICommand& cmd) {
     // sizeof(cmd) is a bit lazy, but we don't care too much about space here
     auto& channel = shm_.getChannel(Channel::UISend);
@@ -388,6 +562,8 @@ void PluginBridge::postUIThread(const ShmUICommand& cmd) {
 }
 
 void PluginBridge::pollUIThread(){
+    drainLogRing();
+
     if (!alive()) {
         return;
     }
@@ -426,13 +602,28 @@ void PluginBridge::pollUIThread(){
 
         size = sizeof(buffer); // reset size!
     }
+
+    // coalesced parameter automation, see ShmParamTable
+    std::lock_guard lock(clientMutex_);
+    for (auto& [_, client] : clients_){
+        if (client.params){
+            client.params->drain([&](int index, float value){
+                LOG_DEBUG("UI thread: ParameterAutomated");
+                client.listener->parameterAutomated(index, value);
+            });
+        }
+        // NB: the client might use the NRT channel
+        if (client.poll && alive()){
+            client.poll(*this);
+        }
+    }
 }
 
 // must be called with clientMutex_ locked!
 IPluginListener* PluginBridge::findClient(uint32_t id){
     auto it = clients_.find(id);
     if (it != clients_.end()){
-        return it->second;
+        return it->second.listener;
     } else {
         LOG_ERROR("PluginBridge::pollUIThread: plugin "
                   << id << " doesn't exist (anymore)");
@@ -470,24 +661,135 @@ RTChannel PluginBridge::getRTChannel(){
             } while (!locks_[index].try_lock());
             // LOG_DEBUG("PluginBridge: found free index " << index);
         }
-        return RTChannel(shm_.getChannel(Channel::NRT + 1 + index),
+        return RTChannel(getRTShmChannel(index),
                          std::unique_lock(locks_[index], std::adopt_lock));
+    } else {
+        return RTChannel(getRTShmChannel(0));
+    }
+}
+
+ShmChannel& PluginBridge::getRTShmChannel(int index){
+    if (auto shm = rtShm_.load(std::memory_order_acquire)){
+        // see reserveChannels()
+        return shm->getChannel(index);
+    } else if (locks_ || pipelined_){
+        // shared bridge resp. pipelined plugin
+        return shm_.getChannel(Channel::NRT + 1 + index);
     } else {
         // plugin sandbox: RT channel = NRT channel
-        return RTChannel(shm_.getChannel(Channel::NRT));
+        return shm_.getChannel(Channel::NRT);
     }
 }
 
 NRTChannel PluginBridge::getNRTChannel(){
-    if (locks_){
+    if (locks_ || pipelined_){
         return NRTChannel(shm_.getChannel(Channel::NRT),
                           std::unique_lock(nrtMutex_));
     } else {
-        // channel 2 is both NRT and RT channel
+        // the NRT channel is also the RT channel
         return NRTChannel(shm_.getChannel(Channel::NRT));
     }
 }
 
+bool PluginBridge::getSandboxAudioBuffer(char *& buffer, int32_t& size){
+    if (locks_){
+        return false;
+    }
+    auto& channel = getRTShmChannel(0);
+    buffer = channel.audioBuffer();
+    size = channel.audioBufferSize();
+    return buffer != nullptr;
+}
+
+void PluginBridge::reserveChannels(size_t requestSize, size_t audioSize){
+    if (!alive()){
+        return;
+    }
+    // NB: lock the NRT channel *before* checking the current size, so that
+    // several clients of a shared bridge can't remap concurrently; otherwise
+    // the last client might shrink the channels below the other's requirement.
+    auto nrt = getNRTChannel();
+    // all RT channels have the same size
+    auto& channel = getRTShmChannel(0);
+    size_t oldRequestSize = channel.capacity();
+    size_t oldAudioSize = channel.audioBufferSize();
+    if (requestSize <= oldRequestSize && audioSize <= oldAudioSize){
+        return;
+    }
+    // grow geometrically to avoid frequent remapping
+    auto grow = [](size_t oldSize, size_t size){
+        return size > oldSize ? std::max<size_t>(size, oldSize * 2) : oldSize;
+    };
+    auto newRequestSize = grow(oldRequestSize, requestSize);
+    auto newAudioSize = grow(oldAudioSize, audioSize);
+    LOG_DEBUG("PluginBridge: grow RT channels from " << oldRequestSize << " + "
+              << oldAudioSize << " to " << newRequestSize << " + " << newAudioSize << " bytes");
+
+    auto shm = std::make_unique<ShmInterface>();
+    for (int i = 0; i < numRTChannels(); ++i){
+        if (locks_){
+            char buf[16];
+            snprintf(buf, sizeof(buf), "rt%d", i+1);
+            shm->addChannel(ShmChannel::Request, newRequestSize, buf, newAudioSize);
+        } else {
+            shm->addChannel(ShmChannel::Request, newRequestSize, "rt", newAudioSize);
+        }
+    }
+    shm->create();
+    for (int i = 0; i < shm->numChannels(); ++i){
+        shm->getChannel(i).setSpinTime(getBridgeSpinTime());
+    }
+
+    // make sure that no other thread is processing
+    if (locks_){
+        for (int i = 0; i < numThreads_; ++i){
+            locks_[i].lock();
+        }
+    }
+    auto unlock = [&](){
+        if (locks_){
+            for (int i = 0; i < numThreads_; ++i){
+                locks_[i].unlock();
+            }
+        }
+    };
+
+    try {
+        // 1) the subprocess connects to the new segment and
+        // starts a new thread for every channel.
+        auto& path = shm->path();
+        auto cmdSize = CommandSize(ShmCommand, s, path.size() + 1);
+        auto cmd = (ShmCommand *)alloca(cmdSize);
+        new (cmd) ShmCommand(Command::RemapChannels);
+        memcpy(cmd->s, path.c_str(), path.size() + 1);
+
+        nrt.addCommand(cmd, cmdSize);
+        nrt.send();
+        nrt.checkError();
+
+        // 2) quit the threads of the old RT channels, unless
+        // the channel doubles as the NRT channel (plugin sandbox).
+        for (int i = 0; i < numRTChannels(); ++i){
+            auto& channel = getRTShmChannel(i);
+            if (&channel != &shm_.getChannel(Channel::NRT)){
+                RTChannel chn(channel);
+                ShmCommand retire(Command::RetireChannel);
+                chn.AddCommand(retire, empty);
+                chn.send();
+            }
+        }
+
+        // 3) switch to the new RT channels
+        std::lock_guard lock(rtShmMutex_);
+        rtShmList_.push_back(std::move(shm));
+        rtShm_.store(rtShmList_.back().get(), std::memory_order_release);
+    } catch (...) {
+        unlock();
+        throw;
+    }
+    unlock();
+}
+
 /*/////////////////// WatchDog //////////////////////*/
 
 // poll interval in milliseconds
@@ -561,4 +863,163 @@ void WatchDog::run(){
     LOG_DEBUG("WatchDog: thread finished");
 }
 
+/*/////////////////////////// BridgePool ///////////////////////////*/
+
+BridgePool& BridgePool::instance(){
+    static BridgePool pool;
+    return pool;
+}
+
+BridgePool::BridgePool(){
+    LOG_DEBUG("start BridgePool");
+    running_ = true;
+    thread_ = std::thread(&BridgePool::run, this);
+}
+
+BridgePool::~BridgePool(){
+#ifdef _WIN32
+    // see ~WatchDog()
+    thread_.detach();
+#else
+    {
+        std::lock_guard lock(mutex_);
+        running_ = false;
+        condition_.notify_one();
+    }
+    thread_.join();
+#endif
+    // We deliberately leak the idle bridges because ~PluginBridge() would
+    // access other static objects (e.g. the UI event loop) which might be
+    // destroyed already. The subprocesses quit on their own as soon as they
+    // notice that the parent has gone, see PluginServer::checkIfParentAlive().
+    for (auto& pool : pools_){
+        for (auto& bridge : pool.bridges){
+            new PluginBridge::ptr(std::move(bridge));
+        }
+    }
+    LOG_DEBUG("free BridgePool");
+}
+
+PluginBridge::ptr BridgePool::claim(CpuArch arch, bool pipelined){
+    PluginBridge::ptr result;
+    std::vector<PluginBridge::ptr> stale;
+
+    std::unique_lock lock(mutex_);
+    if (size_ == 0){
+        return nullptr;
+    }
+    auto it = findPool(arch, pipelined);
+    // take the oldest bridge which is still alive
+    auto& bridges = it->bridges;
+    while (!bridges.empty()){
+        auto bridge = std::move(bridges.front());
+        bridges.erase(bridges.begin());
+        if (bridge->alive()){
+            result = std::move(bridge);
+            break;
+        } else {
+            LOG_WARNING("BridgePool: discard dead bridge");
+            stale.push_back(std::move(bridge));
+        }
+    }
+    // try again after a previous failure
+    it->failed = false;
+    condition_.notify_one();
+    lock.unlock();
+    // 'stale' is destroyed outside the lock
+    return result;
+}
+
+void BridgePool::addPool(CpuArch arch, bool pipelined){
+    std::lock_guard lock(mutex_);
+    findPool(arch, pipelined);
+    condition_.notify_one();
+}
+
+// find or create a pool; must be called with the mutex locked!
+std::vector<BridgePool::Pool>::iterator BridgePool::findPool(CpuArch arch, bool pipelined){
+    auto it = std::find_if(pools_.begin(), pools_.end(), [&](auto& pool){
+        return pool.arch == arch && pool.pipelined == pipelined;
+    });
+    if (it == pools_.end()){
+        LOG_DEBUG("BridgePool: add pool for " << cpuArchToString(arch)
+                  << (pipelined ? " (pipelined)" : ""));
+        pools_.push_back(Pool { arch, pipelined, false, {} });
+        it = pools_.end() - 1;
+    }
+    return it;
+}
+
+void BridgePool::resize(int size){
+    std::vector<PluginBridge::ptr> stale;
+
+    std::unique_lock lock(mutex_);
+    size_ = size;
+    for (auto& pool : pools_){
+        while ((int)pool.bridges.size() > size){
+            stale.push_back(std::move(pool.bridges.back()));
+            pool.bridges.pop_back();
+        }
+    }
+    condition_.notify_one();
+    lock.unlock();
+    // 'stale' is destroyed outside the lock
+}
+
+bool BridgePool::needRefill() const {
+    for (auto& pool : pools_){
+        if (!pool.failed && (int)pool.bridges.size() < size_){
+            return true;
+        }
+    }
+    return false;
+}
+
+void BridgePool::run(){
+    vst::setThreadPriority(Priority::Low);
+
+    std::unique_lock lock(mutex_);
+    while (running_) {
+        condition_.wait(lock, [&]() { return needRefill() || !running_; });
+        if (!running_){
+            break;
+        }
+        // spawn one bridge at a time, so that we can react to claim() and resize()
+        for (size_t i = 0; i < pools_.size(); ++i){
+            if (pools_[i].failed || (int)pools_[i].bridges.size() >= size_){
+                continue;
+            }
+            auto arch = pools_[i].arch;
+            auto pipelined = pools_[i].pipelined;
+            // NB: pools are never removed, so the index stays valid.
+            lock.unlock();
+
+            PluginBridge::ptr bridge;
+            try {
+                LOG_DEBUG("BridgePool: spawn bridge for " << cpuArchToString(arch));
+                bridge = std::make_shared<PluginBridge>(arch, false, pipelined);
+                WatchDog::instance().registerProcess(bridge);
+            } catch (const Error& e){
+                LOG_ERROR("BridgePool: couldn't spawn bridge: " << e.what());
+            }
+
+            lock.lock();
+            if (!bridge){
+                pools_[i].failed = true;
+            } else if ((int)pools_[i].bridges.size() < size_){
+                pools_[i].bridges.push_back(std::move(bridge));
+                bridge = nullptr;
+            }
+            if (bridge){
+                // pool has been shrunk in the meantime
+                lock.unlock();
+                bridge = nullptr;
+                lock.lock();
+            }
+            break;
+        }
+    }
+    LOG_DEBUG("BridgePool: thread finished");
+}
+
 } // vst
@@ -6,6 +6,7 @@
 #include "HostApp.h"
 
 #include <memory>
+#include <functional>
 #include <atomic>
 #include <vector>
 #include <unordered_map>
@@ -49,6 +50,10 @@ struct _Channel {
 
     int32_t capacity() const { return channel_->capacity(); }
 
+    char * audioBuffer() { return channel_->audioBuffer(); }
+
+    int32_t audioBufferSize() const { return channel_->audioBufferSize(); }
+
     bool addCommand(const void* cmd, size_t size){
         return channel_->addMessage(cmd, size);
     }
@@ -58,6 +63,19 @@ struct _Channel {
         channel_->waitReply();
     }
 
+    // for sending several channels before waiting, see endBridgeBatch()
+    void post(){
+        channel_->post();
+    }
+
+    void waitReply(){
+        channel_->waitReply();
+    }
+
+    bool tryWaitReply(){
+        return channel_->tryWaitReply();
+    }
+
     template<typename T>
     bool getReply(const T *& reply, size_t& size){
         return channel_->getMessage(reinterpret_cast<const void *&>(reply), size);
@@ -69,6 +87,12 @@ struct _Channel {
         return getReply(reply, dummy);
     }
 
+    template<typename T>
+    bool peekReply(const T *& reply){
+        size_t dummy;
+        return channel_->peekMessage(reinterpret_cast<const void *&>(reply), dummy);
+    }
+
     void checkError();
  private:
     ShmChannel *channel_;
@@ -83,6 +107,8 @@ using NRTChannel = _Channel<Mutex>;
 /*//////////////////////////// PluginBridge ///////////////////////////*/
 
 struct ShmUICommand;
+class ShmParamTable;
+class ShmLogRing;
 
 class PluginBridge final
         : public std::enable_shared_from_this<PluginBridge> {
@@ -90,9 +116,13 @@ class PluginBridge final
     using ptr = std::shared_ptr<PluginBridge>;
 
     static PluginBridge::ptr getShared(CpuArch arch);
-    static PluginBridge::ptr create(CpuArch arch);
+    static PluginBridge::ptr create(CpuArch arch, bool pipelined = false);
+    // Get a sandbox group, i.e. a shared bridge for a subset of sandboxed plugins.
+    // Named groups are unlimited; otherwise we pick (or create) an anonymous
+    // group with less than 'maxSize' plugins, see setSandboxGroupSize().
+    static PluginBridge::ptr getGroup(CpuArch arch, const std::string& name, int maxSize);
 
-    PluginBridge(CpuArch arch, bool shared);
+    PluginBridge(CpuArch arch, bool shared, bool pipelined = false);
     ~PluginBridge();
 
     PluginBridge(const PluginBridge&) = delete;
@@ -102,6 +132,15 @@ class PluginBridge final
         return shared_;
     }
 
+    bool pipelined() const {
+        return pipelined_;
+    }
+
+    // false for a plugin sandbox, where the NRT channel is also the RT channel
+    bool separateNRTChannel() const {
+        return shared_ || pipelined_;
+    }
+
     bool alive() const {
         return alive_.load(std::memory_order_acquire);
     }
@@ -110,33 +149,64 @@ class PluginBridge final
 
     void checkStatus();
 
-    void addUIClient(uint32_t id, IPluginListener* client);
+    // 'params' (optional) is drained in pollUIThread(), see ShmParamTable;
+    // 'poll' (optional) is called in pollUIThread() as well.
+    void addUIClient(uint32_t id, IPluginListener* client,
+                     ShmParamTable* params = nullptr,
+                     std::function<void(PluginBridge&)> poll = nullptr);
 
     void removeUIClient(uint32_t id);
 
+    // Called on the WatchDog thread if the subprocess has crashed. If set,
+    // the clients don't get IPluginListener::pluginCrashed(), see PluginClient::recover().
+    void setCrashHandler(std::function<void()> fn);
+
     void postUIThread(const ShmUICommand& cmd);
 
     RTChannel getRTChannel();
 
     NRTChannel getNRTChannel();
+
+    // the audio buffer of the (only) RT channel of a sandbox, which is
+    // exclusive to the plugin. Returns false for shared bridges.
+    bool getSandboxAudioBuffer(char *& buffer, int32_t& size);
+
+    // Make sure that all RT channels have room for requests of at least
+    // 'requestSize' bytes and an audio buffer of at least 'audioSize' bytes.
+    // Otherwise we create a new set of (larger) RT channels in a separate
+    // shared memory segment and let the subprocess switch over,
+    // see Command::RemapChannels. Blocks all RT channels in the meantime!
+    // NB: not realtime safe; throws an Error exception on failure.
+    void reserveChannels(size_t requestSize, size_t audioSize);
  private:
     static const size_t queueSize = 1024;
+    static const int logRingSlots = 1024; // see ShmLogRing
     static const size_t nrtRequestSize = 65536;
     static const size_t rtRequestSize = 65536;
+    // zero-copy audio, see ShmCommand::ShmAudio
+    static const size_t rtAudioSize = 262144;
 
     // NOTE: UI thread order is the opposite of PluginServer!
     struct Channel {
         enum {
             UISend = 0,
             UIReceive,
+            Log,
             NRT
         };
     };
 
     ShmInterface shm_;
+    // RT channels after reserveChannels(); we keep the old segments alive
+    std::atomic<ShmInterface *> rtShm_{nullptr};
+    std::vector<std::unique_ptr<ShmInterface>> rtShmList_;
+    Mutex rtShmMutex_;
     bool shared_;
+    bool pipelined_;
     std::atomic_bool alive_{false};
     ProcessHandle process_;
+    std::unique_ptr<ShmLogRing> logRing_;
+    Mutex logMutex_;
 #ifdef _WIN32
     HANDLE hLogRead_ = NULL;
     HANDLE hLogWrite_ = NULL;
@@ -145,8 +215,14 @@ class PluginBridge final
 #endif
     int numThreads_ = 0;
     std::unique_ptr<PaddedSpinLock[]> locks_;
-    std::unordered_map<uint32_t, IPluginListener*> clients_;
+    struct UIClient {
+        IPluginListener *listener;
+        ShmParamTable *params;
+        std::function<void(PluginBridge&)> poll;
+    };
+    std::unordered_map<uint32_t, UIClient> clients_;
     Mutex clientMutex_;
+    std::function<void()> crashHandler_; // protected by clientMutex_
     Mutex nrtMutex_;
     // unnecessary, as all IWindow methods should be called form the same thread
     // Mutex uiMutex_;
@@ -154,6 +230,16 @@ class PluginBridge final
 
     void pollUIThread();
 
+    void readLogPipe(bool loud);
+
+    void drainLogRing();
+
+    int numRTChannels() const {
+        return locks_ ? numThreads_ : 1;
+    }
+
+    ShmChannel& getRTShmChannel(int index);
+
     IPluginListener* findClient(uint32_t id);
 
     void getStatus(bool wait);
@@ -180,4 +266,46 @@ class WatchDog {
     std::vector<std::weak_ptr<PluginBridge>> processes_;
 };
 
+/*/////////////////////////// BridgePool //////////////////////////////*/
+
+// A pool of pre-spawned sandbox processes, so that opening a sandboxed
+// plugin doesn't have to wait for the subprocess, see setSandboxPoolSize().
+// There is a separate pool for every CPU architecture (and channel layout);
+// it is created with addPool() resp. on first use and refilled on a background thread.
+class BridgePool {
+ public:
+    static BridgePool& instance();
+
+    ~BridgePool();
+
+    // returns nullptr if the pool is disabled or empty.
+    PluginBridge::ptr claim(CpuArch arch, bool pipelined);
+
+    // create the pool, so that it is filled in the background.
+    void addPool(CpuArch arch, bool pipelined);
+
+    void resize(int size);
+ private:
+    BridgePool();
+
+    void run();
+
+    struct Pool {
+        CpuArch arch;
+        bool pipelined;
+        bool failed = false;
+        std::vector<PluginBridge::ptr> bridges;
+    };
+
+    std::vector<Pool>::iterator findPool(CpuArch arch, bool pipelined);
+    bool needRefill() const;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool running_;
+    int size_ = 0;
+    std::vector<Pool> pools_;
+};
+
 } // vst
@@ -0,0 +1,271 @@
+#include "PluginCache.h"
+
+#include "Log.h"
+#include "MiscUtils.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace vst {
+
+static const char gCacheMagic[8] = { 'V', 'S', 'T', 'C', 'A', 'C', 'H', 'E' };
+
+// all sections are aligned to 8 bytes (see PluginRecord::timestamp)
+static size_t alignSection(size_t offset){
+    return (offset + 7) & ~(size_t)7;
+}
+
+/*////////////////////////////// PluginCache ///////////////////////////////*/
+
+bool PluginCache::isBinaryFile(const std::string& path){
+    File file(path);
+    char magic[sizeof(gCacheMagic)];
+    return file.read(magic, sizeof(magic))
+            && !memcmp(magic, gCacheMagic, sizeof(gCacheMagic));
+}
+
+PluginCache::PluginCache(const std::string& path)
+    : path_(path), file_(std::make_unique<MappedFile>(path))
+{
+    update(file_->data(), file_->size());
+    state_.resize(numPlugins(), State::Pending);
+}
+
+void PluginCache::detach(){
+    if (file_){
+        auto size = file_->size();
+        buffer_.reset(new char[size]);
+        memcpy(buffer_.get(), file_->data(), size);
+        update(buffer_.get(), size);
+        file_ = nullptr;
+    }
+}
+
+// set and validate section pointers, so that we don't have to
+// do any bounds checking when accessing records and strings.
+void PluginCache::update(const char *data, size_t size){
+    auto badFormat = [](const char *what){
+        throw Error(Error::PluginError, std::string("bad cache file (") + what + ")");
+    };
+    if (size < sizeof(CacheHeader)){
+        badFormat("too small");
+    }
+    auto header = reinterpret_cast<const CacheHeader *>(data);
+    if (memcmp(header->magic, gCacheMagic, sizeof(gCacheMagic))){
+        badFormat("magic");
+    }
+    // there was a breaking change between 0.4 and 0.5
+    // (introduction of audio input/output busses)
+    if ((header->format != PLUGIN_CACHE_FORMAT)
+            || (header->versionMajor != VERSION_MAJOR)
+            || (header->versionMajor == 0 && header->versionMinor < 5)){
+        throw Error(Error::PluginError,
+                    "The plugin cache file is incompatible with this version. "
+                    "Please perform a new search!");
+    }
+    auto checkSection = [&](uint64_t offset, uint64_t count, uint64_t elemSize, const char *what){
+        if (offset % 8 || offset + count * elemSize > size){
+            badFormat(what);
+        }
+    };
+    checkSection(header->pluginOffset, header->numPlugins, sizeof(PluginRecord), "plugins");
+    checkSection(header->pluginKeyOffset, header->numPluginKeys, sizeof(StringRef), "plugin keys");
+    checkSection(header->keyOffset, header->numKeys, sizeof(KeyRecord), "keys");
+    checkSection(header->exceptionOffset, header->numExceptions, sizeof(StringRef), "exceptions");
+    checkSection(header->stringOffset, header->stringSize, 1, "strings");
+
+    auto plugins = reinterpret_cast<const PluginRecord *>(data + header->pluginOffset);
+    auto pluginKeys = reinterpret_cast<const StringRef *>(data + header->pluginKeyOffset);
+    auto keys = reinterpret_cast<const KeyRecord *>(data + header->keyOffset);
+    auto exceptions = reinterpret_cast<const StringRef *>(data + header->exceptionOffset);
+
+    auto checkString = [&](const StringRef& ref){
+        if ((uint64_t)ref.offset + ref.size > header->stringSize){
+            badFormat("string");
+        }
+    };
+    for (uint32_t i = 0; i < header->numPlugins; ++i){
+        auto& p = plugins[i];
+        checkString(p.path);
+        checkString(p.name);
+        checkString(p.data);
+        if ((uint64_t)p.firstKey + p.numKeys > header->numPluginKeys){
+            badFormat("plugin");
+        }
+    }
+    for (uint32_t i = 0; i < header->numPluginKeys; ++i){
+        checkString(pluginKeys[i]);
+    }
+    for (uint32_t i = 0; i < header->numKeys; ++i){
+        checkString(keys[i].key);
+        if (keys[i].plugin >= header->numPlugins){
+            badFormat("key");
+        }
+    }
+    for (uint32_t i = 0; i < header->numExceptions; ++i){
+        checkString(exceptions[i]);
+    }
+
+    header_ = header;
+    plugins_ = plugins;
+    pluginKeys_ = pluginKeys;
+    keys_ = keys;
+    exceptions_ = exceptions;
+    strings_ = data + header->stringOffset;
+}
+
+std::pair<int, int> PluginCache::findPath(std::string_view path) const {
+    auto begin = plugins_;
+    auto end = plugins_ + numPlugins();
+    auto range = std::equal_range(begin, end, path, [this](auto& a, auto& b){
+        using T = std::decay_t<decltype(a)>;
+        if constexpr (std::is_same_v<T, PluginRecord>){
+            return string(a.path) < b;
+        } else {
+            return a < string(b.path);
+        }
+    });
+    return { range.first - begin, range.second - begin };
+}
+
+std::pair<const KeyRecord *, const KeyRecord *> PluginCache::findKey(std::string_view key) const {
+    return std::equal_range(keys_, keys_ + header_->numKeys, key, [this](auto& a, auto& b){
+        using T = std::decay_t<decltype(a)>;
+        if constexpr (std::is_same_v<T, KeyRecord>){
+            return string(a.key) < b;
+        } else {
+            return a < string(b.key);
+        }
+    });
+}
+
+/*/////////////////////////// PluginCacheWriter ////////////////////////////*/
+
+StringRef PluginCacheWriter::addString(std::string_view s, bool unique){
+    // deduplicate, e.g. plugin paths and keys
+    if (!unique){
+        auto it = stringMap_.find(std::string(s));
+        if (it != stringMap_.end()){
+            return it->second;
+        }
+    }
+    StringRef ref { (uint32_t)strings_.size(), (uint32_t)s.size() };
+    strings_.append(s.data(), s.size());
+    if (!unique){
+        stringMap_.emplace(s, ref);
+    }
+    return ref;
+}
+
+void PluginCacheWriter::addPlugin(std::string_view path, std::string_view name,
+                                  std::string_view data, bool bridged, double timestamp,
+                                  const std::vector<std::string>& keys){
+    Plugin plugin;
+    memset(&plugin.record, 0, sizeof(plugin.record));
+    plugin.record.path = addString(path);
+    plugin.record.name = addString(name);
+    plugin.record.data = addString(data, true);
+    plugin.record.flags = bridged ? PluginRecord::Bridged : 0;
+    plugin.record.versionMajor = VERSION_MAJOR;
+    plugin.record.versionMinor = VERSION_MINOR;
+    plugin.record.versionPatch = VERSION_PATCH;
+    plugin.record.timestamp = timestamp;
+    for (auto& key : keys){
+        plugin.keys.push_back(addString(key));
+    }
+    plugins_.push_back(std::move(plugin));
+}
+
+void PluginCacheWriter::addPlugin(const PluginCache& cache, const PluginRecord& record,
+                                  const std::vector<std::string>& keys){
+    Plugin plugin;
+    plugin.record = record;
+    plugin.record.path = addString(cache.string(record.path));
+    plugin.record.name = addString(cache.string(record.name));
+    plugin.record.data = addString(cache.string(record.data), true);
+    for (auto& key : keys){
+        plugin.keys.push_back(addString(key));
+    }
+    plugins_.push_back(std::move(plugin));
+}
+
+void PluginCacheWriter::addException(std::string_view path){
+    exceptions_.push_back(addString(path));
+}
+
+void PluginCacheWriter::write(const std::string& path){
+    auto string = [this](const StringRef& ref){
+        return std::string_view(strings_.data() + ref.offset, ref.size);
+    };
+    // sort plugins by path
+    std::stable_sort(plugins_.begin(), plugins_.end(), [&](auto& a, auto& b){
+        return string(a.record.path) < string(b.record.path);
+    });
+    // make plugin key table and key records (sorted by key)
+    std::vector<StringRef> pluginKeys;
+    std::vector<KeyRecord> keys;
+    for (uint32_t i = 0; i < plugins_.size(); ++i){
+        auto& plugin = plugins_[i];
+        plugin.record.firstKey = pluginKeys.size();
+        plugin.record.numKeys = plugin.keys.size();
+        for (auto& key : plugin.keys){
+            pluginKeys.push_back(key);
+            keys.push_back(KeyRecord { key, i });
+        }
+    }
+    std::stable_sort(keys.begin(), keys.end(), [&](auto& a, auto& b){
+        return string(a.key) < string(b.key);
+    });
+    // make header
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, gCacheMagic, sizeof(gCacheMagic));
+    header.format = PLUGIN_CACHE_FORMAT;
+    header.versionMajor = VERSION_MAJOR;
+    header.versionMinor = VERSION_MINOR;
+    header.versionPatch = VERSION_PATCH;
+    header.timestamp = timestamp_;
+    size_t offset = alignSection(sizeof(header));
+    header.numPlugins = plugins_.size();
+    header.pluginOffset = offset;
+    offset = alignSection(offset + plugins_.size() * sizeof(PluginRecord));
+    header.numPluginKeys = pluginKeys.size();
+    header.pluginKeyOffset = offset;
+    offset = alignSection(offset + pluginKeys.size() * sizeof(StringRef));
+    header.numKeys = keys.size();
+    header.keyOffset = offset;
+    offset = alignSection(offset + keys.size() * sizeof(KeyRecord));
+    header.numExceptions = exceptions_.size();
+    header.exceptionOffset = offset;
+    offset = alignSection(offset + exceptions_.size() * sizeof(StringRef));
+    header.stringOffset = offset;
+    header.stringSize = strings_.size();
+    if (offset + strings_.size() > UINT32_MAX){
+        throw Error("cache file too large");
+    }
+    // write file
+    File file(path, File::WRITE);
+    if (!file.is_open()){
+        throw Error("couldn't create file " + path);
+    }
+    size_t pos = 0;
+    auto writeSection = [&](size_t offset, const void *data, size_t size){
+        static const char zeros[8] = { 0 };
+        file.write(zeros, offset - pos); // padding
+        file.write((const char *)data, size);
+        pos = offset + size;
+    };
+    writeSection(0, &header, sizeof(header));
+    for (auto& plugin : plugins_){
+        writeSection(pos, &plugin.record, sizeof(plugin.record));
+    }
+    writeSection(header.pluginKeyOffset, pluginKeys.data(), pluginKeys.size() * sizeof(StringRef));
+    writeSection(header.keyOffset, keys.data(), keys.size() * sizeof(KeyRecord));
+    writeSection(header.exceptionOffset, exceptions_.data(), exceptions_.size() * sizeof(StringRef));
+    writeSection(header.stringOffset, strings_.data(), strings_.size());
+    if (!file){
+        throw Error("couldn't write file " + path);
+    }
+}
+
+} // vst
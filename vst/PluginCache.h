@@ -0,0 +1,189 @@
+#pragma once
+
+#include "Interface.h"
+#include "FileUtils.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace vst {
+
+/*//////////////////////////// binary cache format ////////////////////////////*/
+
+// The binary plugin cache file consists of a header, fixed-size records and
+// a string table. All strings (paths, names, keys and the serialized plugin info)
+// are stored in the string table and referenced by offset + size.
+// Plugin records are sorted by path and key records are sorted by key, so that
+// we can look up plugins with a binary search without parsing the whole file.
+// All numbers are stored in native byte order; cache files are not portable.
+//
+// ----------------------
+// CacheHeader
+// ----------------------
+// PluginRecord[numPlugins] (sorted by path)
+// ----------------------
+// StringRef[numPluginKeys] (the keys of each plugin, see PluginRecord)
+// ----------------------
+// KeyRecord[numKeys] (sorted by key)
+// ----------------------
+// StringRef[numExceptions]
+// ----------------------
+// string table
+// ----------------------
+
+// increment on every change of the binary layout!
+#define PLUGIN_CACHE_FORMAT 1
+
+struct StringRef {
+    uint32_t offset; // relative to the string table
+    uint32_t size;
+};
+
+struct CacheHeader {
+    char magic[8]; // "VSTCACHE"
+    uint32_t format; // PLUGIN_CACHE_FORMAT
+    uint16_t versionMajor; // vstplugin version
+    uint16_t versionMinor;
+    uint16_t versionPatch;
+    uint16_t reserved;
+    double timestamp; // time when the exceptions were known to be valid
+    uint32_t numPlugins;
+    uint32_t pluginOffset;
+    uint32_t numPluginKeys;
+    uint32_t pluginKeyOffset;
+    uint32_t numKeys;
+    uint32_t keyOffset;
+    uint32_t numExceptions;
+    uint32_t exceptionOffset;
+    uint32_t stringOffset;
+    uint32_t stringSize;
+};
+
+struct PluginRecord {
+    enum Flags {
+        Bridged = 1
+    };
+    StringRef path;
+    StringRef name;
+    StringRef data; // serialized plugin info, see PluginDesc::serialize()
+    uint32_t flags;
+    uint32_t firstKey; // index into the plugin key table
+    uint32_t numKeys;
+    // the vstplugin version of the plugin info; can be older than
+    // the cache file because pending plugins are copied verbatim.
+    uint16_t versionMajor;
+    uint16_t versionMinor;
+    uint16_t versionPatch;
+    uint16_t reserved;
+    double timestamp; // time when the plugin info was known to be valid
+};
+
+struct KeyRecord {
+    StringRef key;
+    uint32_t plugin; // plugin record index
+};
+
+/*////////////////////////////// PluginCache ///////////////////////////////*/
+
+// Read-only view on a binary plugin cache file (memory mapped), see PluginDictionary.
+
+class PluginCache {
+ public:
+    // check if the file is a binary cache file
+    static bool isBinaryFile(const std::string& path);
+
+    // throws an Error exception if the file is not a valid cache file
+    PluginCache(const std::string& path);
+
+    PluginCache(const PluginCache&) = delete;
+    PluginCache& operator=(const PluginCache&) = delete;
+
+    const std::string& path() const { return path_; }
+
+    // Copy the file contents into memory and release the mapping,
+    // so that the file itself can be replaced (necessary on Windows).
+    void detach();
+
+    const CacheHeader& header() const { return *header_; }
+
+    int numPlugins() const { return header_->numPlugins; }
+    const PluginRecord& plugin(int index) const { return plugins_[index]; }
+    std::string_view pluginKey(const PluginRecord& plugin, int index) const {
+        return string(pluginKeys_[plugin.firstKey + index]);
+    }
+
+    // returns the range of plugin records with the given path
+    std::pair<int, int> findPath(std::string_view path) const;
+    // returns the range of key records with the given key
+    std::pair<const KeyRecord *, const KeyRecord *> findKey(std::string_view key) const;
+
+    int numExceptions() const { return header_->numExceptions; }
+    std::string_view exception(int index) const { return string(exceptions_[index]); }
+
+    std::string_view string(const StringRef& ref) const {
+        return std::string_view(strings_ + ref.offset, ref.size);
+    }
+
+    // the state of a plugin record, see PluginDictionary
+    enum class State {
+        Pending,
+        Done,
+        Failed
+    };
+    State state(int index) const { return state_[index]; }
+    void setState(int index, State state) { state_[index] = state; }
+ private:
+    void update(const char *data, size_t size);
+
+    std::string path_;
+    std::unique_ptr<MappedFile> file_;
+    std::unique_ptr<char[]> buffer_; // see detach()
+    const CacheHeader *header_ = nullptr;
+    const PluginRecord *plugins_ = nullptr;
+    const StringRef *pluginKeys_ = nullptr;
+    const KeyRecord *keys_ = nullptr;
+    const StringRef *exceptions_ = nullptr;
+    const char *strings_ = nullptr;
+    std::vector<State> state_;
+};
+
+/*/////////////////////////// PluginCacheWriter ////////////////////////////*/
+
+class PluginCacheWriter {
+ public:
+    PluginCacheWriter(double timestamp)
+        : timestamp_(timestamp) {}
+
+    // add a plugin with the serialized plugin info of the current version
+    void addPlugin(std::string_view path, std::string_view name, std::string_view data,
+                   bool bridged, double timestamp, const std::vector<std::string>& keys);
+    // copy a (pending) plugin record from another cache file
+    void addPlugin(const PluginCache& cache, const PluginRecord& record,
+                   const std::vector<std::string>& keys);
+
+    void addException(std::string_view path);
+
+    // throws an Error exception on failure!
+    void write(const std::string& path);
+ private:
+    // 'unique': don't try to deduplicate (e.g. the plugin info)
+    StringRef addString(std::string_view s, bool unique = false);
+
+    struct Plugin {
+        PluginRecord record;
+        std::vector<StringRef> keys;
+    };
+    double timestamp_;
+    std::vector<Plugin> plugins_;
+    std::vector<StringRef> exceptions_;
+    std::string strings_;
+    std::unordered_map<std::string, StringRef> stringMap_;
+};
+
+} // vst
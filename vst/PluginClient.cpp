@@ -5,7 +5,10 @@
 #include "FileUtils.h"
 
 #include <algorithm>
+#include <chrono>
+#include <optional>
 #include <sstream>
+#include <thread>
 #include <cassert>
 
 #if DEBUG_CLIENT_PROCESS
@@ -16,24 +19,148 @@
 
 namespace vst {
 
-/*/////////////////////// PluginClient /////////////////////////////*/
-
 #define FORBIDDEN_METHOD(name) throw Error(Error::PluginError, "PluginClient: must not call " name "()");
 
 #define UNSUPPORTED_METHOD(name) LOG_WARNING(name "() not supported with bit bridging/sandboxing");
 
+/*/////////////////////// RecoveryThread ///////////////////////////*/
+
+static std::atomic<bool> gSandboxRecovery{false};
+
+static std::atomic<float> gSandboxSnapshotInterval{5.f};
+
+void setSandboxRecovery(bool enable){
+    gSandboxRecovery.store(enable);
+}
+
+bool getSandboxRecovery(){
+    return gSandboxRecovery.load();
+}
+
+void setSandboxSnapshotInterval(float seconds){
+    gSandboxSnapshotInterval.store(std::max<float>(seconds, 0));
+}
+
+float getSandboxSnapshotInterval(){
+    return gSandboxSnapshotInterval.load();
+}
+
+static double timeNow(){
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<double>(now).count();
+}
+
+// Restarts crashed sandboxes in the background, see PluginClient::recover().
+// Clients are referenced by ID, so that late crash notifications are harmless.
+class RecoveryThread {
+ public:
+    static RecoveryThread& instance(){
+        static RecoveryThread thread;
+        return thread;
+    }
+
+    ~RecoveryThread();
+
+    void addClient(PluginClient *client);
+    // waits until a pending restart has finished
+    void removeClient(PluginClient *client);
+    // called on the WatchDog thread, see PluginBridge::setCrashHandler()
+    void post(uint32_t id);
+ private:
+    RecoveryThread();
+
+    void run();
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool running_;
+    std::unordered_map<uint32_t, PluginClient *> clients_;
+    std::vector<uint32_t> queue_;
+    uint32_t current_ = 0; // client which is currently restarting
+};
+
+RecoveryThread::RecoveryThread(){
+    LOG_DEBUG("start RecoveryThread");
+    running_ = true;
+    thread_ = std::thread(&RecoveryThread::run, this);
+}
+
+RecoveryThread::~RecoveryThread(){
+#ifdef _WIN32
+    // see ~WatchDog()
+    thread_.detach();
+#else
+    {
+        std::lock_guard lock(mutex_);
+        running_ = false;
+        condition_.notify_all();
+    }
+    thread_.join();
+#endif
+    LOG_DEBUG("free RecoveryThread");
+}
+
+void RecoveryThread::addClient(PluginClient *client){
+    std::lock_guard lock(mutex_);
+    clients_[client->id()] = client;
+}
+
+void RecoveryThread::removeClient(PluginClient *client){
+    auto id = client->id();
+    std::unique_lock lock(mutex_);
+    clients_.erase(id);
+    queue_.erase(std::remove(queue_.begin(), queue_.end(), id), queue_.end());
+    condition_.wait(lock, [&]() { return current_ != id; });
+}
+
+void RecoveryThread::post(uint32_t id){
+    std::lock_guard lock(mutex_);
+    queue_.push_back(id);
+    condition_.notify_all();
+}
+
+void RecoveryThread::run(){
+    std::unique_lock lock(mutex_);
+    while (running_){
+        condition_.wait(lock, [&]() { return !queue_.empty() || !running_; });
+        while (running_ && !queue_.empty()){
+            auto id = queue_.front();
+            queue_.erase(queue_.begin());
+            auto it = clients_.find(id);
+            if (it == clients_.end()){
+                continue; // already closed
+            }
+            auto client = it->second;
+            current_ = id;
+            lock.unlock();
+
+            client->recover();
+
+            lock.lock();
+            current_ = 0;
+            condition_.notify_all(); // see removeClient()
+        }
+    }
+    LOG_DEBUG("RecoveryThread: thread finished");
+}
+
+/*/////////////////////// PluginClient /////////////////////////////*/
+
 IPlugin::ptr createBridgedPlugin(IFactory::const_ptr factory, const std::string& name,
-                                 bool editor, bool sandbox)
+                                 bool editor, bool sandbox, bool pipelined,
+                                 const std::string& group)
 {
     auto info = factory->findPlugin(name); // should never fail
     if (!info){
         throw Error(Error::PluginError, "couldn't find subplugin");
     }
-    return std::make_unique<PluginClient>(factory, info, sandbox, editor);
+    return std::make_unique<PluginClient>(factory, info, sandbox, editor, pipelined, group);
 }
 
 PluginClient::PluginClient(IFactory::const_ptr f, PluginDesc::const_ptr desc,
-                           bool sandbox, bool editor)
+                           bool sandbox, bool editor, bool pipelined,
+                           const std::string& group)
     : factory_(std::move(f)), info_(std::move(desc))
 {
     if ((reinterpret_cast<uintptr_t>(this) & (CACHELINE_SIZE-1)) != 0){
@@ -47,20 +174,64 @@ PluginClient::PluginClient(IFactory::const_ptr f, PluginDesc::const_ptr desc,
     if (info_->numParameters() > 0){
         paramValueCache_.reset(new std::atomic<float>[numParams]{}); // !
         paramDisplayCache_ = std::make_unique<ParamDisplay[]>(numParams);
+        paramDisplayStale_.reset(new std::atomic<bool>[numParams]{}); // !
     }
     int numPrograms = info_->numPrograms();
     if (info_->numPrograms() > 0){
         programNameCache_ = std::make_unique<ProgramName[]>(numPrograms);
     }
-    if (sandbox){
+    // the first generation, see BridgeRef
+    auto& bridge = bridges_[0];
+    if (pipelined){
+        // the RT channel must be exclusive, see ThreadMode::Pipelined
+        if (!group.empty()){
+            LOG_WARNING("PluginClient (" << id_ << "): ignoring sandbox group '"
+                        << group << "' for pipelined plugin");
+        }
+        LOG_DEBUG("PluginClient (" << id_ << "): create pipelined sandbox");
+        bridge = PluginBridge::create(factory_->arch(), true);
+    } else if (sandbox && (!group.empty() || getSandboxGroupSize() > 1)){
+        LOG_DEBUG("PluginClient (" << id_ << "): get sandbox group");
+        bridge = PluginBridge::getGroup(factory_->arch(), group, getSandboxGroupSize());
+    } else if (sandbox){
         LOG_DEBUG("PluginClient (" << id_ << "): create sandbox");
-        bridge_ = PluginBridge::create(factory_->arch());
+        bridge = PluginBridge::create(factory_->arch());
     } else {
         LOG_DEBUG("PluginClient (" << id_ << "): get plugin bridge");
-        bridge_ = PluginBridge::getShared(factory_->arch());
+        bridge = PluginBridge::getShared(factory_->arch());
+    }
+
+    createPlugin(*bridge);
+
+    // crash recovery only works with a dedicated subprocess
+    pipelined_ = pipelined;
+    if (!bridge->shared() && getSandboxRecovery()){
+        LOG_DEBUG("PluginClient (" << id_ << "): enable crash recovery");
+        recovery_ = true;
+        std::stringstream ss;
+        ss << getTmpDirectory() << "/vst_snapshot_" << getCurrentProcessId() << "_" << id_;
+        snapshotPath_ = ss.str();
+        startTime_ = timeNow();
+        sendSnapshotInterval(*bridge);
+        RecoveryThread::instance().addClient(this);
+        auto id = id_;
+        bridge->setCrashHandler([id](){
+            RecoveryThread::instance().post(id);
+        });
+    }
+
+    if (editor && info_->editor()) {
+        window_ = std::make_unique<WindowClient>(*this);
     }
 
-    // create plugin
+    pollFunction_ = UIThread::addPollFunction([](void *x){
+        static_cast<PluginClient *>(x)->pollCommands();
+    }, this);
+
+    LOG_DEBUG("PluginClient (" << id_ << "): done!");
+}
+
+void PluginClient::createPlugin(PluginBridge& bridge){
     std::stringstream ss;
     info_->serialize(ss);
     auto info = ss.str();
@@ -73,98 +244,388 @@ PluginClient::PluginClient(IFactory::const_ptr f, PluginDesc::const_ptr desc,
     cmd->plugin.size = info.size();
     memcpy(cmd->plugin.data, info.c_str(), info.size());
 
-    auto chn = bridge_->getNRTChannel();
-    if (chn.addCommand(cmd, cmdSize)){
-        LOG_DEBUG("PluginClient (" << id_ << "): wait for Server");
-        chn.send();
-    } else {
-        // info too large, try to transmit via tmp file
-        LOG_DEBUG("PluginClient (" << id_ << "): send info via tmp file (" << info.size() << " bytes)");
-        std::stringstream ss;
-        ss << getTmpDirectory() << "/vst_" << (void *)this;
-        std::string path = ss.str();
-        TmpFile file(path, File::WRITE);
-        if (!file){
-            throw Error(Error::SystemError,
-                        "PluginClient: couldn't create tmp file");
+    {
+        auto chn = bridge.getNRTChannel();
+        if (chn.addCommand(cmd, cmdSize)){
+            LOG_DEBUG("PluginClient (" << id_ << "): wait for Server");
+            chn.send();
+        } else {
+            // info too large, try to transmit via tmp file
+            LOG_DEBUG("PluginClient (" << id_ << "): send info via tmp file (" << info.size() << " bytes)");
+            std::stringstream ss;
+            ss << getTmpDirectory() << "/vst_" << (void *)this;
+            std::string path = ss.str();
+            TmpFile file(path, File::WRITE);
+            if (!file){
+                throw Error(Error::SystemError,
+                            "PluginClient: couldn't create tmp file");
+            }
+            file << info;
+            if (!file){
+                throw Error(Error::SystemError,
+                            "PluginClient: couldn't write info to tmp file");
+            }
+
+            cmdSize = sizeof(ShmCommand) + path.size() + 1;
+            cmd->plugin.size = 0; // !
+            memcpy(cmd->plugin.data, path.c_str(), path.size() + 1);
+
+            if (!chn.addCommand(cmd, cmdSize)){
+                throw Error(Error::PluginError,
+                            "PluginClient: couldn't send plugin info");
+            }
+
+            LOG_DEBUG("PluginClient (" << id_ << "): wait for Server");
+            chn.send(); // tmp file is still in scope!
         }
-        file << info;
-        if (!file){
-            throw Error(Error::SystemError,
-                        "PluginClient: couldn't write info to tmp file");
+
+        // in case the process has already crashed during creation...
+        if (!bridge.alive()){
+            throw Error(Error::PluginError, "plugin crashed");
         }
 
-        cmdSize = sizeof(ShmCommand) + path.size() + 1;
-        cmd->plugin.size = 0; // !
-        memcpy(cmd->plugin.data, path.c_str(), path.size() + 1);
+        LOG_DEBUG("PluginClient (" << id_ << "): plugin created");
 
-        if (!chn.addCommand(cmd, cmdSize)){
-            throw Error(Error::PluginError,
-                        "PluginClient: couldn't send plugin info");
+        // collect replies (after check!)
+        const ShmCommand *reply;
+        while (chn.getReply(reply)){
+            dispatchReply(*reply);
         }
+    }
+    // NB: the NRT channel must be released (shared or pipelined bridge)
+    sendParamTable(bridge);
+}
 
-        LOG_DEBUG("PluginClient (" << id_ << "): wait for Server");
-        chn.send(); // tmp file is still in scope!
+void PluginClient::sendParamTable(PluginBridge& bridge){
+    int numParams = numParameters();
+    if (numParams == 0){
+        return;
+    }
+    // NB: after a crash, the new subprocess connects to the existing table.
+    if (!paramShm_){
+        try {
+            auto shm = std::make_unique<ShmInterface>();
+            shm->addChannel(ShmChannel::Queue, 64, "params",
+                            shmParamSegmentSize(numParams));
+            shm->create();
+            // we only use the persistent buffer of the channel
+            auto data = shm->getChannel(0).audioBuffer();
+            paramTable_ = ShmParamTable(data, numParams, true);
+            stateTable_ = ShmParamTable(data + shmParamStateOffset(numParams),
+                                        numParams, true);
+            paramShm_ = std::move(shm);
+        } catch (const Error& e){
+            // not fatal, the subprocess falls back to the UI queue
+            LOG_WARNING("PluginClient (" << id_ << "): couldn't create parameter table: "
+                        << e.what());
+            return;
+        }
     }
 
-    // in case the process has already crashed during creation...
-    if (!bridge_->alive()){
-        throw Error(Error::PluginError, "plugin crashed");
+    auto& path = paramShm_->path();
+    auto cmdSize = CommandSize(ShmCommand, paramTable, path.size() + 1);
+    auto cmd = (ShmCommand *)alloca(cmdSize);
+    new (cmd) ShmCommand(Command::SetParamTable, id());
+    // We can only fetch stale display strings if the NRT channel can be
+    // used on the UI thread, see fetchParamStrings(); otherwise the
+    // subprocess sends the full parameter state.
+    cmd->paramTable.state = bridge.separateNRTChannel();
+    memcpy(cmd->paramTable.path, path.c_str(), path.size() + 1);
+
+    auto chn = bridge.getNRTChannel();
+    chn.addCommand(cmd, cmdSize);
+    chn.send();
+    try {
+        chn.checkError();
+    } catch (const Error& e){
+        LOG_WARNING("PluginClient (" << id_ << "): couldn't set parameter table: "
+                    << e.what());
     }
+}
 
-    LOG_DEBUG("PluginClient (" << id_ << "): plugin created");
+PluginClient::~PluginClient(){
+    UIThread::removePollFunction(pollFunction_);
+    if (recovery_){
+        // wait for a pending restart, see recover()
+        RecoveryThread::instance().removeClient(this);
+    }
+    {
+        auto bridge = getBridge();
+        if (listener_){
+            bridge->removeUIClient(id_);
+        }
+        // destroy window
+        window_ = nullptr;
+        finishPipeline(bridge);
+        // destroy plugin
+        // (not necessary with exlusive bridge)
+        if (bridge->shared() && bridge->alive()){
+            ShmCommand cmd(Command::DestroyPlugin, id());
+
+            auto chn = bridge->getNRTChannel();
+            chn.AddCommand(cmd, empty);
+            chn.send();
+        }
+    }
 
-    // collect replies (after check!)
-    const ShmCommand *reply;
-    while (chn.getReply(reply)){
-        dispatchReply(*reply);
+    if (recovery_){
+        // wait for the subprocess(es) before removing the snapshot
+        bridges_[0] = nullptr;
+        bridges_[1] = nullptr;
+        for (auto& path : { snapshotPath_, snapshotPath_ + ".tmp" }){
+            if (pathExists(path) && !removeFile(path)){
+                LOG_ERROR("PluginClient (" << id_ << "): couldn't remove snapshot file");
+            }
+        }
     }
 
-    if (editor && info_->editor()) {
-        window_ = std::make_unique<WindowClient>(*this);
+    LOG_DEBUG("PluginClient (" << id_ << "): free");
+}
+
+/*/////////////////////// Crash recovery ///////////////////////////*/
+
+// Acquire the bridge of the current generation. The recovery thread publishes
+// a restarted bridge in the other slot, which it only reuses after all users
+// of the previous generation have finished, see recover().
+PluginClient::BridgeRef::BridgeRef(PluginClient& client)
+    : client_(client) {
+    for (;;){
+        auto generation = client.bridgeGeneration_.load(std::memory_order_acquire);
+        auto& users = client.bridgeUsers_[generation & 1];
+        users.fetch_add(1, std::memory_order_seq_cst);
+        // make sure that the slot has not been reused in the meantime!
+        if (client.bridgeGeneration_.load(std::memory_order_seq_cst) == generation){
+            bridge_ = client.bridges_[generation & 1].get();
+            generation_ = generation;
+            return;
+        }
+        users.fetch_sub(1, std::memory_order_release);
     }
+}
 
-    LOG_DEBUG("PluginClient (" << id_ << "): done!");
+PluginClient::BridgeRef::~BridgeRef(){
+    client_.bridgeUsers_[generation_ & 1].fetch_sub(1, std::memory_order_release);
 }
 
-PluginClient::~PluginClient(){
-    if (listener_){
-        bridge_->removeUIClient(id_);
-    }
-    // destroy window
-    window_ = nullptr;
-    // destroy plugin
-    // (not necessary with exlusive bridge)
-    if (bridge_->shared() && bridge_->alive()){
-        ShmCommand cmd(Command::DestroyPlugin, id());
-
-        auto chn = bridge_->getNRTChannel();
-        chn.AddCommand(cmd, empty);
-        chn.send();
+void PluginClient::sendSnapshotInterval(PluginBridge& bridge){
+    auto pathSize = snapshotPath_.size() + 1;
+    auto cmdSize = CommandSize(ShmCommand, snapshot, sizeof(float) + pathSize);
+    auto cmd = (ShmCommand *)alloca(cmdSize);
+    new (cmd) ShmCommand(Command::SetSnapshot, id());
+    cmd->snapshot.interval = getSandboxSnapshotInterval();
+    memcpy(cmd->snapshot.path, snapshotPath_.c_str(), pathSize);
+
+    auto chn = bridge.getNRTChannel();
+    if (!chn.addCommand(cmd, cmdSize)){
+        throw Error(Error::PluginError,
+                    "PluginClient: couldn't send snapshot path");
     }
+    chn.send();
+}
 
-    // avoid memleak with param string and sysex command
-    for (auto& cmd : commands_){
-        if (cmd.type == Command::SetParamString){
-            delete[] cmd.paramString.str;
-        } else if (cmd.type == Command::SendSysex){
-            delete[] cmd.sysex.data;
+// Called on the RecoveryThread after the subprocess has crashed:
+// spawn a new subprocess, recreate the plugin and restore its state
+// from the last snapshot and the last known parameter values.
+// The new bridge is adopted by the next method call, see BridgeRef.
+void PluginClient::recover(){
+    // Release the bridge of the previous generation, so that we can reuse
+    // its slot. Methods which still use it must finish first; this doesn't
+    // take long because the bridge is dead.
+    // NB: the generation is only ever changed on this thread.
+    auto generation = bridgeGeneration_.load(std::memory_order_relaxed) + 1;
+    auto slot = generation & 1;
+    while (bridgeUsers_[slot].load(std::memory_order_seq_cst) > 0){
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    bridges_[slot] = nullptr;
+
+    auto crashTime = timeNow();
+    auto uptime = crashTime - startTime_;
+    LOG_WARNING("PluginClient (" << id_ << "): '" << info_->name
+                << "' crashed after " << uptime << " s");
+    if (uptime < recoveryMinUptime){
+        if (++numQuickCrashes_ >= recoveryMaxCrashes){
+            LOG_ERROR("PluginClient (" << id_ << "): '" << info_->name
+                      << "' keeps crashing, giving up");
+            std::lock_guard lock(recoveryMutex_);
+            if (listener_){
+                listener_->pluginCrashed();
+            }
+            return;
         }
+    } else {
+        numQuickCrashes_ = 0;
     }
-    LOG_DEBUG("PluginClient (" << id_ << "): free");
-}
 
-bool PluginClient::check() {
-    return bridge_->alive();
+    try {
+        auto bridge = PluginBridge::create(factory_->arch(), pipelined_);
+        createPlugin(*bridge);
+
+        // NB: keep the lock until the bridge has been published, so that
+        // concurrent NRT methods either see the new settings or the new bridge.
+        std::lock_guard lock(recoveryMutex_);
+        auto& settings = settings_;
+
+        if (settings.setup){
+            ShmCommand cmd(Command::SetupProcessing, id());
+            cmd.setup.sampleRate = settings.sampleRate;
+            cmd.setup.maxBlockSize = settings.maxBlockSize;
+            cmd.setup.precision = static_cast<uint8_t>(settings.precision);
+            cmd.setup.mode = static_cast<uint8_t>(settings.mode);
+
+            auto chn = bridge->getNRTChannel();
+            chn.AddCommand(cmd, setup);
+            chn.send();
+            chn.checkError();
+        }
+
+        if (settings.speakers){
+            int numInputs = settings.inputs.size();
+            int numOutputs = settings.outputs.size();
+            int size = sizeof(int32_t) * (numInputs + numOutputs);
+            auto totalSize = CommandSize(ShmCommand, speakers, size);
+            auto cmd = (ShmCommand *)alloca(totalSize);
+            new (cmd) ShmCommand(Command::SetNumSpeakers, id());
+            cmd->speakers.numInputs = numInputs;
+            cmd->speakers.numOutputs = numOutputs;
+            std::copy(settings.inputs.begin(), settings.inputs.end(),
+                      cmd->speakers.speakers);
+            std::copy(settings.outputs.begin(), settings.outputs.end(),
+                      cmd->speakers.speakers + numInputs);
+
+            auto chn = bridge->getNRTChannel();
+            chn.addCommand(cmd, totalSize);
+            chn.send();
+            chn.checkError(); // ignore speaker arrangement
+        }
+
+        if (settings.setup && settings.speakers){
+            // see reserveChannels()
+            auto sampleSize = (settings.precision == ProcessPrecision::Double) ?
+                        sizeof(double) : sizeof(float);
+            size_t numChannels = 0;
+            for (auto n : settings.inputs){
+                numChannels += n;
+            }
+            for (auto n : settings.outputs){
+                numChannels += n;
+            }
+            try {
+                bridge->reserveChannels(requestSize(), numChannels *
+                    shmAudioStride(settings.maxBlockSize, sampleSize));
+            } catch (const Error& e){
+                LOG_WARNING("PluginClient (" << id_ << "): couldn't grow RT channels: "
+                            << e.what());
+            }
+        }
+
+        // restore the plugin state
+        bool haveSnapshot = pathExists(snapshotPath_);
+        if (haveSnapshot){
+            auto pathSize = snapshotPath_.size() + 1;
+            auto cmdSize = CommandSize(ShmCommand, buffer, pathSize);
+            auto cmd = (ShmCommand *)alloca(cmdSize);
+            new (cmd) ShmCommand(Command::ReadProgramFile, id());
+            cmd->buffer.size = pathSize;
+            memcpy(cmd->buffer.data, snapshotPath_.c_str(), pathSize);
+
+            auto chn = bridge->getNRTChannel();
+            chn.addCommand(cmd, cmdSize);
+            chn.send();
+
+            const ShmCommand *reply;
+            while (chn.getReply(reply)){
+                dispatchReply(*reply);
+            }
+        }
+
+        // the last known parameter values might be newer than the snapshot.
+        // NB: the server handles all parameters of a request at once.
+        int numParams = numParameters();
+        int index = 0;
+        while (index < numParams){
+            auto chn = bridge->getNRTChannel();
+            for (; index < numParams; ++index){
+                ShmCommand cmd(Command::SetParamValue, id());
+                cmd.paramValue.offset = 0;
+                cmd.paramValue.index = index;
+                cmd.paramValue.value = paramValueCache_[index].load(std::memory_order_relaxed);
+                if (!chn.AddCommand(cmd, paramValue)){
+                    break; // send and continue with the next request
+                }
+            }
+            chn.send();
+        }
+
+        if (settings.active){
+            ShmCommand cmd(Command::Resume, id());
+
+            auto chn = bridge->getNRTChannel();
+            chn.AddCommand(cmd, empty);
+            chn.send();
+            chn.checkError();
+        }
+
+        sendSnapshotInterval(*bridge);
+
+        if (!bridge->alive()){
+            throw Error(Error::PluginError, "plugin crashed");
+        }
+
+        // publish new bridge, see BridgeRef
+        if (listener_){
+            bridge->addUIClient(id_, listener_,
+                                paramTable_.valid() ? &paramTable_ : nullptr,
+                                [this](PluginBridge& b){ fetchParamStrings(b); });
+        }
+        auto id = id_;
+        bridge->setCrashHandler([id](){
+            RecoveryThread::instance().post(id);
+        });
+        bridges_[slot] = std::move(bridge);
+        bridgeGeneration_.store(generation, std::memory_order_seq_cst);
+
+        startTime_ = timeNow();
+        LOG_WARNING("PluginClient (" << id_ << "): restarted '" << info_->name
+                    << "' in " << (startTime_ - crashTime) * 1000 << " ms"
+                    << (haveSnapshot ? "" : " (no snapshot)"));
+    } catch (const Error& e){
+        LOG_ERROR("PluginClient (" << id_ << "): couldn't restart '"
+                  << info_->name << "': " << e.what());
+        std::lock_guard lock(recoveryMutex_);
+        if (listener_){
+            listener_->pluginCrashed();
+        }
+    }
 }
 
 void PluginClient::setupProcessing(double sampleRate, int maxBlockSize,
                                    ProcessPrecision precision, ProcessMode mode){
-    if (!check()){
+    {
+        // see recover()
+        std::lock_guard lock(recoveryMutex_);
+        settings_.sampleRate = sampleRate;
+        settings_.maxBlockSize = maxBlockSize;
+        settings_.precision = precision;
+        settings_.mode = mode;
+        settings_.setup = true;
+    }
+    auto bridge = getBridge();
+    if (!bridge->alive()){
         return;
     }
     LOG_DEBUG("PluginClient (" << id_ << "): setupProcessing");
 
+    finishPipeline(bridge);
+
+    // grow command buffer to peak usage (not realtime safe!)
+    commands_.reserve();
+
+    meter_.reset(sampleRate);
+
+    maxBlockSize_ = maxBlockSize;
+    precision_ = precision;
+
     ShmCommand cmd(Command::SetupProcessing);
     cmd.id = id();
     cmd.setup.sampleRate = sampleRate;
@@ -172,24 +633,338 @@ void PluginClient::setupProcessing(double sampleRate, int maxBlockSize,
     cmd.setup.precision = static_cast<uint8_t>(precision);
     cmd.setup.mode = static_cast<uint8_t>(mode);
 
-    auto chn = bridge().getNRTChannel();
-    chn.AddCommand(cmd, setup);
-    chn.send();
+    {
+        auto chn = bridge->getNRTChannel();
+        chn.AddCommand(cmd, setup);
+        chn.send();
 
-    chn.checkError();
+        chn.checkError();
+    }
+
+    reserveChannels(*bridge);
+}
+
+/*/////////////////////// BridgeBatch /////////////////////////////*/
+
+// Process commands of several plugins on the same bridge, see beginBridgeBatch().
+struct BridgeBatch {
+    static const int maxNumBridges = 16;
+    static const int maxNumPlugins = 256;
+
+    struct Entry {
+        PluginBridge *bridge = nullptr;
+        std::optional<RTChannel> channel;
+        int32_t audioOffset = 0;
+    };
+
+    struct Item {
+        PluginClient *plugin;
+        ProcessData data;
+        Entry *entry;
+    };
+
+    Entry entries[maxNumBridges];
+    int numEntries = 0;
+    Item items[maxNumPlugins];
+    int numItems = 0;
+    bool active = false;
+    bool parallel = false;
+
+    Entry * find(PluginBridge *bridge) {
+        for (int i = 0; i < numEntries; ++i){
+            if (entries[i].bridge == bridge){
+                return &entries[i];
+            }
+        }
+        if (numEntries < maxNumBridges){
+            auto& entry = entries[numEntries++];
+            entry.bridge = bridge;
+            return &entry;
+        } else {
+            return nullptr;
+        }
+    }
+
+    bool contains(PluginClient *plugin) const {
+        for (int i = 0; i < numItems; ++i){
+            if (items[i].plugin == plugin){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // send the batch and wait for the results
+    void flush(Entry& entry) {
+        if (entry.channel){
+            entry.channel->post();
+            finish(entry);
+        }
+    }
+
+    void finish(Entry& entry) {
+        auto& channel = *entry.channel;
+        channel.waitReply();
+        // check if host is still alive
+        auto alive = entry.bridge->alive();
+        const ShmCommand *reply;
+        while (alive && channel.getReply(reply)){
+            if (reply->type == Command::Process){
+                for (int i = 0; i < numItems; ++i){
+                    auto& item = items[i];
+                    if (item.entry == &entry && item.plugin->id() == reply->id){
+                        item.plugin->receiveProcess(item.data, channel, true);
+                        break;
+                    }
+                }
+            } else {
+                LOG_ERROR("PluginClient: unexpected reply " << reply->type << " in batch");
+            }
+        }
+        // remove items
+        int n = 0;
+        for (int i = 0; i < numItems; ++i){
+            if (items[i].entry == &entry){
+                if (!alive){
+                    bypass(items[i].data);
+                }
+            } else {
+                items[n++] = items[i];
+            }
+        }
+        numItems = n;
+        entry.channel.reset(); // unlock!
+        entry.audioOffset = 0;
+    }
+};
+
+static thread_local BridgeBatch gBridgeBatch;
+
+void beginBridgeBatch(bool parallel) {
+    gBridgeBatch.active = true;
+    gBridgeBatch.parallel = parallel;
+}
+
+void endBridgeBatch() {
+    auto& batch = gBridgeBatch;
+    // first post all batches, so that the bridges can work concurrently.
+    for (int i = 0; i < batch.numEntries; ++i){
+        auto& entry = batch.entries[i];
+        if (entry.channel){
+            entry.channel->post();
+        }
+    }
+    for (int i = 0; i < batch.numEntries; ++i){
+        auto& entry = batch.entries[i];
+        if (entry.channel){
+            batch.finish(entry);
+        }
+        entry.bridge = nullptr;
+    }
+    batch.numEntries = 0;
+    batch.active = false;
 }
 
+template<typename T>
+bool PluginClient::addToBatch(ProcessData& data, PluginBridge& bridge){
+    auto entry = gBridgeBatch.find(&bridge);
+    if (!entry){
+        return false; // too many bridges
+    }
+    // every plugin gets its own region in the audio buffer
+    auto audioSize = shmAudioSize(maxBlockSize_, sizeof(T), shmInputs_.get(), numInputs_,
+                                  shmOutputs_.get(), numOutputs_);
+    if (data.numInputs != numInputs_ || data.numOutputs != numOutputs_){
+        // can't batch; make sure that we don't hold the channel!
+        gBridgeBatch.flush(*entry);
+        return false;
+    }
+    if (gBridgeBatch.contains(this) || gBridgeBatch.numItems == BridgeBatch::maxNumPlugins
+            || (entry->channel && (entry->audioOffset + audioSize) > (size_t)entry->channel->audioBufferSize())){
+        // send the pending batch first
+        gBridgeBatch.flush(*entry);
+    }
+    if (gBridgeBatch.numItems == BridgeBatch::maxNumPlugins){
+        return false; // batch is full (with plugins of other bridges)
+    }
+    if (!entry->channel){
+        entry->channel.emplace(bridge.getRTChannel());
+        ShmCommand cmd(Command::ProcessBatch);
+        cmd.batch.flags = gBridgeBatch.parallel ? ShmCommand::BatchParallel : 0;
+        entry->channel->AddCommand(cmd, batch);
+    }
+    auto& channel = *entry->channel;
+    if ((entry->audioOffset + audioSize) > (size_t)channel.audioBufferSize()){
+        // doesn't fit at all; make sure that we don't hold the channel!
+        gBridgeBatch.flush(*entry);
+        return false;
+    }
+
+    auto shmAudio = sendProcess<T>(data, channel, entry->audioOffset);
+    assert(shmAudio);
+    (void)shmAudio;
+
+    gBridgeBatch.items[gBridgeBatch.numItems++] = BridgeBatch::Item { this, data, entry };
+    entry->audioOffset += audioSize;
+
+    return true;
+}
+
+/*/////////////////////// PluginClient /////////////////////////////*/
+
 template<typename T>
 void PluginClient::doProcess(ProcessData& data){
-    if (!check()){
+    auto bridge = getBridge();
+    if (!bridge->alive()){
         bypass(data);
         commands_.clear(); // avoid commands piling up!
         return;
     }
+
+    if (bridge->pipelined()){
+        doProcessPipelined<T>(data, bridge);
+        return;
+    }
+
+    // NB: the batch is flushed within the same audio callback, but a dead
+    // bridge is only released after the next restart, see recover().
+    if (gBridgeBatch.active && addToBatch<T>(data, *bridge)){
+        return; // see endBridgeBatch()
+    }
+
     LOG_PROCESS("PluginClient (" << id_ << "): start processing");
 
-    auto channel = bridge().getRTChannel();
+    auto channel = bridge->getRTChannel();
+
+    auto shmAudio = sendProcess<T>(data, channel, 0);
+
+    // send and wait for reply
+    LOG_PROCESS("PluginClient (" << id_ << "): wait");
+    channel.send();
+
+    // check if host is still alive
+    if (!bridge->alive()){
+        bypass(data);
+        commands_.clear(); // avoid commands piling up!
+        return;
+    }
+
+    receiveProcess(data, channel, shmAudio);
+}
+
+template<typename T>
+static void clearOutputs(ProcessData& data, int onset){
+    for (int i = 0; i < data.numOutputs; ++i){
+        auto& bus = data.outputs[i];
+        for (int j = 0; j < bus.numChannels; ++j){
+            auto chn = (T *)bus.channelData32[j];
+            std::fill(chn + onset, chn + data.numSamples, 0);
+        }
+    }
+}
+
+// ThreadMode::Pipelined: collect the result of the previous block and
+// submit the current block without waiting. If the subprocess is late,
+// we output silence and keep the request in flight; the current input
+// is dropped, but its commands are sent with the next request.
+template<typename T>
+void PluginClient::doProcessPipelined(ProcessData& data, const BridgeRef& bridge){
+    if (pipeline_ && pipelineGeneration_ != bridge.generation()){
+        // the bridge has been restarted and the request in flight has been lost.
+        // NB: don't touch the channel, the old bridge might not exist anymore!
+        pipeline_.reset();
+    }
+
+    if (pipeline_ && !waitPipeline()){
+        LOG_PROCESS("PluginClient (" << id_ << "): missed deadline");
+        missed_.fetch_add(1, std::memory_order_relaxed);
+        clearOutputs<T>(data, 0);
+        return;
+    }
+
+    // check if host is still alive
+    if (!bridge->alive()){
+        pipeline_.reset();
+        bypass(data);
+        commands_.clear(); // avoid commands piling up!
+        return;
+    }
+
+    if (pipeline_){
+        // read output of the previous block; the block size might have changed.
+        auto prev = data;
+        prev.numSamples = std::min(pipelineSamples_, data.numSamples);
+        doReceiveProcess<T>(prev, *pipeline_, pipelineShmAudio_);
+        clearOutputs<T>(data, prev.numSamples);
+        pipeline_.reset();
+    } else {
+        // first block
+        clearOutputs<T>(data, 0);
+    }
+
+    LOG_PROCESS("PluginClient (" << id_ << "): submit block");
+    pipeline_.emplace(bridge->getRTChannel());
+    pipelineGeneration_ = bridge.generation();
+    pipelineShmAudio_ = sendProcess<T>(data, *pipeline_, 0);
+    pipelineSamples_ = data.numSamples;
+    pipelineOutputChannels_ = 0;
+    for (int i = 0; i < data.numOutputs; ++i){
+        pipelineOutputChannels_ += data.outputs[i].numChannels;
+    }
+    pipeline_->post();
+}
+
+// spin for a bounded time
+bool PluginClient::waitPipeline(){
+    if (pipeline_->tryWaitReply()){
+        return true;
+    }
+    plf::nanotimer timer;
+    timer.start();
+    do {
+        for (int i = 0; i < 100; ++i){
+            pauseCpu();
+        }
+        if (pipeline_->tryWaitReply()){
+            return true;
+        }
+    } while (timer.get_elapsed_us() < pipelineSpinTime);
+    return false;
+}
+
+// wait for the request in flight (if any) and discard its output.
+// Must be called before any method that must not run concurrently
+// with process(), e.g. suspend() or setNumSpeakers().
+void PluginClient::finishPipeline(const BridgeRef& bridge){
+    if (!pipeline_){
+        return;
+    }
+    // see doProcessPipelined()
+    if (pipelineGeneration_ != bridge.generation()){
+        pipeline_.reset();
+        return;
+    }
+    if (bridge->alive()){
+        LOG_DEBUG("PluginClient (" << id_ << "): finish pipeline");
+        pipeline_->waitReply();
+    }
+    if (bridge->alive()){
+        const ShmCommand *reply;
+        if (!pipelineShmAudio_){
+            // skip output channels
+            for (int i = 0; i < pipelineOutputChannels_; ++i){
+                pipeline_->getReply(reply);
+            }
+        }
+        while (pipeline_->getReply(reply)){
+            dispatchReply(*reply);
+        }
+    }
+    pipeline_.reset();
+}
 
+template<typename T>
+bool PluginClient::sendProcess(const ProcessData& data, RTChannel& channel, int32_t audioOffset){
     LOG_PROCESS("PluginClient (" << id_ << "): send process command");
     // send process command
     ShmCommand cmd(Command::Process);
@@ -199,17 +974,38 @@ void PluginClient::doProcess(ProcessData& data){
     cmd.process.mode = (uint8_t)data.mode;
     cmd.process.numInputs = data.numInputs;
     cmd.process.numOutputs = data.numOutputs;
+    cmd.process.audioOffset = audioOffset;
+    // try to exchange audio via the channel's audio buffer; this saves
+    // two copies in the subprocess. (We fall back to request messages
+    // if the busses don't fit.)
+    bool shmAudio = data.numInputs == numInputs_ && data.numOutputs == numOutputs_
+            && setShmAudioBusses(channel.audioBuffer() + audioOffset,
+                                 channel.audioBufferSize() - audioOffset, sizeof(T));
+    cmd.process.flags = shmAudio ? ShmCommand::ShmAudio : 0;
 
     channel.AddCommand(cmd, process);
 
     // send input busses
-    for (int i = 0; i < data.numInputs; ++i){
-        auto& bus = data.inputs[i];
-        // write all channels sequentially to avoid additional copying.
-        LOG_PROCESS("PluginClient (" << id_ << "): write input bus " << i << " with "
-                    << bus.numChannels << " channels");
-        for (int j = 0; j < bus.numChannels; ++j){
-            channel.addCommand((const T *)bus.channelData32[j], sizeof(T) * data.numSamples);
+    if (shmAudio){
+        // no need to copy if the host has already written into
+        // the audio buffer, see getProcessBuffers().
+        if (data.inputs != shmInputs_.get()){
+            for (int i = 0; i < data.numInputs; ++i){
+                copyChannels<T>(data.inputs[i], shmInputs_[i], data.numSamples);
+            }
+        }
+    } else {
+        for (int i = 0; i < data.numInputs; ++i){
+            auto& bus = data.inputs[i];
+            // write all channels sequentially to avoid additional copying.
+            LOG_PROCESS("PluginClient (" << id_ << "): write input bus " << i << " with "
+                        << bus.numChannels << " channels");
+            for (int j = 0; j < bus.numChannels; ++j){
+                if (!channel.addCommand((const T *)bus.channelData32[j], sizeof(T) * data.numSamples)){
+                    LOG_ERROR("PluginClient (" << id_ << "): channel overflow, couldn't send channel "
+                              << j << " of audio input bus " << i);
+                }
+            }
         }
     }
 
@@ -217,56 +1013,84 @@ void PluginClient::doProcess(ProcessData& data){
     LOG_PROCESS("PluginClient (" << id_ << "): send commands");
     sendCommands(channel);
 
-    // send and wait for reply
-    LOG_PROCESS("PluginClient (" << id_ << "): wait");
-    channel.send();
+    return shmAudio;
+}
 
-    // check if host is still alive
-    if (!check()){
-        bypass(data);
-        commands_.clear(); // avoid commands piling up!
-        return;
+void PluginClient::receiveProcess(ProcessData& data, RTChannel& channel, bool shmAudio){
+    if (data.precision == ProcessPrecision::Double){
+        doReceiveProcess<double>(data, channel, shmAudio);
+    } else {
+        doReceiveProcess<float>(data, channel, shmAudio);
     }
+}
 
+template<typename T>
+void PluginClient::doReceiveProcess(ProcessData& data, RTChannel& channel, bool shmAudio){
     // read output busses
-    for (int i = 0; i < data.numOutputs; ++i){
-        auto& bus = data.outputs[i];
-        LOG_PROCESS("PluginClient (" << id_ << "): read output bus " << i << " with "
-                    << bus.numChannels << " channels");
-        // read channels
-        for (int j = 0; j < bus.numChannels; ++j){
-            auto chn = (T *)bus.channelData32[j];
-            const T* reply;
-            size_t size;
-            if (channel.getReply(reply, size)){
-                // size can be larger because of message
-                // alignment - don't use in std::copy!
-                assert(size >= data.numSamples * sizeof(T));
-                std::copy(reply, reply + data.numSamples, chn);
-            } else {
-                std::fill(chn, chn + data.numSamples, 0);
-                LOG_ERROR("PluginClient (" << id_ << "): missing channel " << j
-                          << " for audio output bus " << i);
+    if (shmAudio){
+        if (data.outputs != shmOutputs_.get()){
+            for (int i = 0; i < data.numOutputs; ++i){
+                copyChannels<T>(shmOutputs_[i], data.outputs[i], data.numSamples);
+            }
+        }
+    } else {
+        for (int i = 0; i < data.numOutputs; ++i){
+            auto& bus = data.outputs[i];
+            LOG_PROCESS("PluginClient (" << id_ << "): read output bus " << i << " with "
+                        << bus.numChannels << " channels");
+            // read channels
+            for (int j = 0; j < bus.numChannels; ++j){
+                auto chn = (T *)bus.channelData32[j];
+                const T* reply;
+                size_t size;
+                if (channel.getReply(reply, size)){
+                    // size can be larger because of message
+                    // alignment - don't use in std::copy!
+                    assert(size >= data.numSamples * sizeof(T));
+                    std::copy(reply, reply + data.numSamples, chn);
+                } else {
+                    std::fill(chn, chn + data.numSamples, 0);
+                    LOG_ERROR("PluginClient (" << id_ << "): missing channel " << j
+                              << " for audio output bus " << i);
+                }
             }
         }
     }
 
     // get replies (parameter changes, MIDI messages, etc.)
+    // NB: in a batch, the replies end with the next Process reply.
     LOG_PROCESS("PluginClient (" << id_ << "): read replies");
     const ShmCommand* reply;
-    while (channel.getReply(reply)){
+    while (channel.peekReply(reply) && reply->type != Command::Process){
+        channel.getReply(reply);
         dispatchReply(*reply);
     }
     LOG_PROCESS("PluginClient (" << id_ << "): finished processing");
 }
 
+template<typename T>
+void PluginClient::copyChannels(const AudioBus& from, AudioBus& to, int numSamples){
+    for (int i = 0; i < to.numChannels; ++i){
+        auto dst = (T *)to.channelData32[i];
+        if (i < from.numChannels){
+            auto src = (const T *)from.channelData32[i];
+            std::copy(src, src + numSamples, dst);
+        } else {
+            std::fill(dst, dst + numSamples, 0);
+        }
+    }
+}
+
 void PluginClient::sendCommands(RTChannel& channel){
+    // if the channel is full, the remaining commands are sent in the next block.
+    size_t count = 0;
     for (auto& cmd : commands_){
+        bool ok;
         // We have to handle some commands specially because their
         // struct layout differs from the corresponding ShmCommand.
         switch (cmd.type){
         case Command::SetParamValue:
-            channel.AddCommand(cmd, paramValue); // optimize for space!
+            ok = channel.AddCommand(cmd, paramValue); // optimize for space!
             break;
         case Command::SetParamString:
         {
@@ -281,9 +1105,7 @@ void PluginClient::sendCommands(RTChannel& channel){
             shmCmd->paramString.pstr[0] = param.size;
             memcpy(&shmCmd->paramString.pstr[1], param.str, param.size);
 
-            channel.addCommand(shmCmd, cmdSize);
-
-            delete[] cmd.paramString.str; // free!
+            ok = channel.addCommand(shmCmd, cmdSize);
 
             break;
         }
@@ -301,7 +1123,7 @@ void PluginClient::sendCommands(RTChannel& channel){
             shmCmd->paramString.pstr[0] = psize;
             memcpy(&shmCmd->paramString.pstr[1], &param.pstr[1], psize);
 
-            channel.addCommand(shmCmd, cmdSize);
+            ok = channel.addCommand(shmCmd, cmdSize);
 
             break;
         }
@@ -313,38 +1135,51 @@ void PluginClient::sendCommands(RTChannel& channel){
             new (shmCmd) ShmCommand(Command::SetProgramName);
             memcpy(shmCmd->s, cmd.s, len);
 
-            delete[] cmd.s; // free!
-
-            channel.addCommand(shmCmd, cmdSize);
+            ok = channel.addCommand(shmCmd, cmdSize);
             break;
         }
         case Command::SendMidi:
-            channel.AddCommand(cmd, midi);
+            ok = channel.AddCommand(cmd, midi);
             break;
         case Command::SendSysex:
         {
             auto cmdSize = CommandSize(ShmCommand, sysex, cmd.sysex.size);
+            if (cmdSize > (size_t)channel.capacity()){
+                // would never fit, so we have to drop it
+                LOG_ERROR("PluginClient (" << id_ << "): sysex message too large ("
+                          << cmd.sysex.size << " bytes)");
+                // grow the RT channels in the next call to setupProcessing() resp. resume()
+                requestOverflow_.store(cmdSize, std::memory_order_relaxed);
+                ok = true;
+                break;
+            }
             auto shmCmd = (ShmCommand *)alloca(cmdSize);
             new (shmCmd) ShmCommand(Command::SendSysex);
             shmCmd->sysex.delta = cmd.sysex.delta;
             shmCmd->sysex.size = cmd.sysex.size;
             memcpy(shmCmd->sysex.data, cmd.sysex.data, cmd.sysex.size);
 
-            delete[] cmd.sysex.data; // free!
-
-            channel.addCommand(shmCmd, cmdSize);
+            ok = channel.addCommand(shmCmd, cmdSize);
             break;
         }
         // All other commands are layout compatible with ShmCommand.
         // They all take max. 12 bytes and are rare enough that we
         // don't have to optimize for space
         default:
-            channel.AddCommand(cmd, d);
+            ok = channel.AddCommand(cmd, d);
+            break;
+        }
+        if (!ok){
+            LOG_WARNING("PluginClient (" << id_ << "): channel overflow, defer "
+                        << (commands_.size() - count) << " commands");
+            // grow the RT channels in the next call to setupProcessing() resp. resume()
+            requestOverflow_.store(channel.capacity() * 2, std::memory_order_relaxed);
             break;
         }
+        count++;
     }
 
-    commands_.clear(); // !
+    commands_.removeFront(count); // !
 }
 
 void PluginClient::dispatchReply(const ShmCommand& reply){
@@ -355,17 +1190,8 @@ void PluginClient::dispatchReply(const ShmCommand& reply){
     {
         auto index = reply.paramState.index;
         auto value = reply.paramState.value;
-        auto pstr = reply.paramState.pstr;
 
-        paramValueCache_[index].store(value, std::memory_order_relaxed);
-        {
-            auto& cache = paramDisplayCache_[index];
-            auto size = std::min<size_t>(pstr[0], cache.size() - 1);
-            // must be thread-safe!
-            std::lock_guard lock(cacheLock_);
-            cache[0] = size; // pascal string!
-            memcpy(&cache[1], &pstr[1], size);
-        }
+        updateParamCache(reply);
 
         if (reply.type == Command::ParamAutomated){
             if (listener_){
@@ -376,10 +1202,19 @@ void PluginClient::dispatchReply(const ShmCommand& reply){
         } else {
             LOG_DEBUG("PluginClient (" << id_ << "): parameter " << index
                       << " updated to " << value << " "
-                      << std::string((char *)&pstr[1], pstr[0]));
+                      << std::string((char *)&reply.paramState.pstr[1],
+                                     reply.paramState.pstr[0]));
         }
         break;
     }
+    case Command::ParamStateChanged:
+        // the display strings are fetched on the UI thread, see fetchParamStrings()
+        stateTable_.drain([&](int index, float value){
+            paramValueCache_[index].store(value, std::memory_order_relaxed);
+            paramDisplayStale_[index].store(true, std::memory_order_relaxed);
+        });
+        paramStringsPending_.store(true, std::memory_order_release);
+        break;
     case Command::ProgramNameIndexed:
         if (info().numPrograms() > 0) {
             auto index = reply.programName.index;
@@ -431,21 +1266,31 @@ void PluginClient::dispatchReply(const ShmCommand& reply){
 }
 
 void PluginClient::process(ProcessData& data){
+    meter_.start();
     if (data.precision == ProcessPrecision::Double){
         doProcess<double>(data);
     } else {
         doProcess<float>(data);
     }
+    meter_.stop(data.numSamples);
 }
 
 void PluginClient::suspend(){
-    if (!check()){
+    {
+        // see recover()
+        std::lock_guard lock(recoveryMutex_);
+        settings_.active = false;
+    }
+    auto bridge = getBridge();
+    if (!bridge->alive()){
         return;
     }
     LOG_DEBUG("PluginClient (" << id_ << "): suspend");
+
+    finishPipeline(bridge);
     ShmCommand cmd(Command::Suspend, id());
 
-    auto chn = bridge().getNRTChannel();
+    auto chn = bridge->getNRTChannel();
     chn.AddCommand(cmd, empty);
     chn.send();
 
@@ -453,14 +1298,26 @@ void PluginClient::suspend(){
 }
 
 void PluginClient::resume(){
-    if (!check()){
+    {
+        // see recover()
+        std::lock_guard lock(recoveryMutex_);
+        settings_.active = true;
+    }
+    auto bridge = getBridge();
+    if (!bridge->alive()){
         return;
     }
 
     LOG_DEBUG("PluginClient (" << id_ << "): resume");
+
+    // grow command buffer to peak usage (not realtime safe!)
+    commands_.reserve();
+    // ...and the RT channels accordingly
+    reserveChannels(*bridge);
+
     ShmCommand cmd(Command::Resume, id());
 
-    auto chn = bridge().getNRTChannel();
+    auto chn = bridge->getNRTChannel();
     chn.AddCommand(cmd, empty);
     chn.send();
 
@@ -469,7 +1326,15 @@ void PluginClient::resume(){
 
 void PluginClient::setNumSpeakers(int *input, int numInputs,
                                   int *output, int numOutputs){
-    if (!check()){
+    {
+        // see recover()
+        std::lock_guard lock(recoveryMutex_);
+        settings_.inputs.assign(input, input + numInputs);
+        settings_.outputs.assign(output, output + numOutputs);
+        settings_.speakers = true;
+    }
+    auto bridge = getBridge();
+    if (!bridge->alive()){
         return;
     }
 
@@ -481,6 +1346,8 @@ void PluginClient::setNumSpeakers(int *input, int numInputs,
         LOG_DEBUG("output bus " << i << ": " << output[i] << "ch");
     }
 
+    finishPipeline(bridge);
+
     int size = sizeof(int32_t) * (numInputs + numOutputs);
     auto totalSize = CommandSize(ShmCommand, speakers, size);
     auto cmd = (ShmCommand *)alloca(totalSize);
@@ -495,35 +1362,38 @@ void PluginClient::setNumSpeakers(int *input, int numInputs,
         cmd->speakers.speakers[i + numInputs] = output[i];
     }
 
-    auto chn = bridge().getNRTChannel();
-    chn.addCommand(cmd, totalSize);
-    chn.send();
+    {
+        // NB: release the NRT channel before reserveChannels()!
+        auto chn = bridge->getNRTChannel();
+        chn.addCommand(cmd, totalSize);
+        chn.send();
 
-    // check if host is still alive!
-    if (!check()){
-        return;
-    }
+        // check if host is still alive!
+        if (!bridge->alive()){
+            return;
+        }
 
-    // get reply
-    const ShmCommand* reply;
-    if (chn.getReply(reply)){
-        if (reply->type == Command::SpeakerArrangement){
-            // get actual input and output arrangements
-            assert(reply->speakers.numInputs == numInputs);
-            assert(reply->speakers.numOutputs == numOutputs);
-            for (int i = 0; i < numInputs; ++i){
-                input[i] = reply->speakers.speakers[i];
-            }
-            for (int i = 0; i < numOutputs; ++i){
-                output[i] = reply->speakers.speakers[i + numInputs];
+        // get reply
+        const ShmCommand* reply;
+        if (chn.getReply(reply)){
+            if (reply->type == Command::SpeakerArrangement){
+                // get actual input and output arrangements
+                assert(reply->speakers.numInputs == numInputs);
+                assert(reply->speakers.numOutputs == numOutputs);
+                for (int i = 0; i < numInputs; ++i){
+                    input[i] = reply->speakers.speakers[i];
+                }
+                for (int i = 0; i < numOutputs; ++i){
+                    output[i] = reply->speakers.speakers[i + numInputs];
+                }
+            } else if (reply->type == Command::Error){
+                reply->throwError();
+            } else {
+                LOG_ERROR("PluginClient::setNumSpeakers: unknown reply");
             }
-        } else if (reply->type == Command::Error){
-            reply->throwError();
         } else {
-            LOG_ERROR("PluginClient::setNumSpeakers: unknown reply");
+            LOG_ERROR("PluginClient::setNumSpeakers: missing reply!");
         }
-    } else {
-        LOG_ERROR("PluginClient::setNumSpeakers: missing reply!");
     }
 
     LOG_DEBUG("actual bus arrangement:");
@@ -533,6 +1403,75 @@ void PluginClient::setNumSpeakers(int *input, int numInputs,
     for (int i = 0; i < numOutputs; ++i){
         LOG_DEBUG("output bus " << i << ": " << output[i] << "ch");
     }
+
+    // create busses for ShmCommand::ShmAudio with the actual arrangement
+    shmInputs_ = numInputs > 0 ? std::make_unique<Bus[]>(numInputs) : nullptr;
+    numInputs_ = numInputs;
+    for (int i = 0; i < numInputs; ++i){
+        shmInputs_[i] = Bus(input[i]);
+    }
+    shmOutputs_ = numOutputs > 0 ? std::make_unique<Bus[]>(numOutputs) : nullptr;
+    numOutputs_ = numOutputs;
+    for (int i = 0; i < numOutputs; ++i){
+        shmOutputs_[i] = Bus(output[i]);
+    }
+
+    reserveChannels(*bridge);
+}
+
+// make sure that the audio (see ShmCommand::ShmAudio) and the commands
+// of a single block fit into the RT channels.
+void PluginClient::reserveChannels(PluginBridge& bridge){
+    auto sampleSize = (precision_ == ProcessPrecision::Double) ?
+                sizeof(double) : sizeof(float);
+    auto audioSize = shmAudioSize(maxBlockSize_, sampleSize, shmInputs_.get(), numInputs_,
+                                  shmOutputs_.get(), numOutputs_);
+    try {
+        bridge.reserveChannels(requestSize(), audioSize);
+    } catch (const Error& e){
+        // not fatal, we just fall back to request messages resp.
+        // defer commands to the next block.
+        LOG_WARNING("PluginClient (" << id_ << "): couldn't grow RT channels: "
+                    << e.what());
+    }
+}
+
+// the request size needed for the commands of a single block
+size_t PluginClient::requestSize(){
+    // upper bound: ShmCommand + message header per command, plus the payload
+    // (parameter strings, SysEx data, program names), see sendCommands().
+    size_t size = commands_.capacity() * (sizeof(ShmCommand) + 8)
+            + commands_.payloadCapacity();
+    // the commands of a block didn't fit into the request
+    auto overflow = requestOverflow_.exchange(0, std::memory_order_relaxed);
+    return std::max<size_t>(size, overflow);
+}
+
+bool PluginClient::setShmAudioBusses(char *buffer, int32_t size, size_t sampleSize){
+    return vst::setShmAudioBusses(buffer, size, maxBlockSize_, sampleSize,
+                                  shmInputs_.get(), numInputs_,
+                                  shmOutputs_.get(), numOutputs_);
+}
+
+bool PluginClient::getProcessBuffers(AudioBus *&inputs, AudioBus *&outputs){
+    // only a sandbox has a dedicated audio buffer which is not
+    // touched by other plugins between two process() calls.
+    // NB: with ThreadMode::Pipelined, the subprocess is still working
+    // on the buffer while the host prepares the next block.
+    char *buffer;
+    int32_t size;
+    auto bridge = getBridge();
+    if (bridge->alive() && !bridge->pipelined()
+            && bridge->getSandboxAudioBuffer(buffer, size)){
+        auto sampleSize = (precision_ == ProcessPrecision::Double) ?
+                    sizeof(double) : sizeof(float);
+        if (setShmAudioBusses(buffer, size, sampleSize)){
+            inputs = shmInputs_.get();
+            outputs = shmOutputs_.get();
+            return true;
+        }
+    }
+    return false;
 }
 
 int PluginClient::getLatencySamples(){
@@ -540,17 +1479,22 @@ int PluginClient::getLatencySamples(){
 }
 
 void PluginClient::setListener(IPluginListener* listener) {
+    // see recover()
+    std::lock_guard lock(recoveryMutex_);
+    auto bridge = getBridge(); // adopt restarted bridge
     listener_ = listener;
     if (listener){
-        if (bridge_->alive()){
-            bridge_->addUIClient(id_, listener);
+        if (bridge->alive()){
+            bridge->addUIClient(id_, listener,
+                                 paramTable_.valid() ? &paramTable_ : nullptr,
+                                 [this](PluginBridge& b){ fetchParamStrings(b); });
         } else {
             // in case the plugin has crashed during setup,
             // but we didn't have a chance to get a notification
             listener->pluginCrashed();
         }
     } else {
-        bridge_->removeUIClient(id_);
+        bridge->removeUIClient(id_);
     }
 }
 
@@ -587,6 +1531,8 @@ float PluginClient::getParameter(int index) const {
 }
 
 size_t PluginClient::getParameterString(int index, ParamStringBuffer& buffer) const {
+    // NB: might be called on the audio thread, so we must not fetch stale
+    // display strings here; they are updated on the UI thread instead.
     // must be thread-safe!
     std::lock_guard lock(cacheLock_);
     auto& param = paramDisplayCache_[index];
@@ -598,6 +1544,82 @@ size_t PluginClient::getParameterString(int index, ParamStringBuffer& buffer) co
     return size;
 }
 
+// Called on the UI thread: report dropped commands and grow the command
+// buffer off the audio thread; the new buffer is used from the next block on.
+// NB: the RT channels only grow in setupProcessing() resp. resume(), see requestSize().
+void PluginClient::pollCommands(){
+    if (auto dropped = commands_.takeOverflow()){
+        LOG_WARNING("PluginClient (" << id_ << "): command buffer full, "
+                    << dropped << " command(s) dropped");
+    }
+    commands_.grow();
+}
+
+// Fetch stale display strings in a single round trip, see Command::ParamStateChanged.
+// Called on the UI thread, see PluginBridge::pollUIThread().
+// NB: the replies must fit into the NRT channel; if there are more stale
+// strings, we fetch the rest in the next poll.
+void PluginClient::fetchParamStrings(PluginBridge& bridge){
+    if (!paramStringsPending_.exchange(false, std::memory_order_acquire)){
+        return;
+    }
+    auto chn = bridge.getNRTChannel();
+    int numParams = numParameters();
+    int maxCount = std::min<int>(numParams, chn.capacity() / paramStringReplySize);
+    auto cmdSize = CommandSize(ShmCommand, paramIndices, sizeof(uint16_t) * maxCount);
+    auto cmd = (ShmCommand *)alloca(cmdSize);
+    new (cmd) ShmCommand(Command::GetParamStrings, id());
+    int count = 0;
+    for (int i = 0; i < numParams; ++i){
+        if (paramDisplayStale_[i].load(std::memory_order_relaxed)){
+            if (count == maxCount){
+                paramStringsPending_.store(true, std::memory_order_relaxed);
+                break;
+            }
+            cmd->paramIndices.indices[count++] = i;
+        }
+    }
+    if (count == 0){
+        return;
+    }
+    cmd->paramIndices.count = count;
+    cmdSize = CommandSize(ShmCommand, paramIndices, sizeof(uint16_t) * count);
+
+    LOG_DEBUG("PluginClient (" << id_ << "): fetch " << count << " parameter strings");
+    if (!chn.addCommand(cmd, cmdSize)){
+        LOG_ERROR("PluginClient (" << id_ << "): couldn't fetch parameter strings");
+        return;
+    }
+    chn.send();
+
+    if (!bridge.alive()){
+        return;
+    }
+
+    const ShmCommand *reply;
+    while (chn.getReply(reply)){
+        if (reply->type == Command::ParameterUpdate){
+            updateParamCache(*reply);
+        }
+    }
+}
+
+void PluginClient::updateParamCache(const ShmCommand& reply) const {
+    auto index = reply.paramState.index;
+    auto pstr = reply.paramState.pstr;
+
+    paramValueCache_[index].store(reply.paramState.value, std::memory_order_relaxed);
+    {
+        auto& cache = paramDisplayCache_[index];
+        auto size = std::min<size_t>(pstr[0], cache.size() - 1);
+        // must be thread-safe!
+        std::lock_guard lock(cacheLock_);
+        cache[0] = size; // pascal string!
+        memcpy(&cache[1], &pstr[1], size);
+    }
+    paramDisplayStale_[index].store(false, std::memory_order_relaxed);
+}
+
 void PluginClient::setProgram(int index) {
     // let's cache immediately
 #if 1
@@ -624,10 +1646,14 @@ void PluginClient::setProgramName(std::string_view name) {
 #endif
 
     Command cmd(Command::SetProgramName);
-    cmd.s = new char[name.size() + 1];
-    memcpy(cmd.s, name.data(), name.size() + 1);
+    cmd.s = commands_.allocate(name.size() + 1);
+    if (!cmd.s){
+        return; // see CommandBuffer
+    }
+    memcpy(cmd.s, name.data(), name.size());
+    cmd.s[name.size()] = '\0';
 
-    commands_.push_back(cmd);
+    commands_.push(cmd);
 }
 
 std::string PluginClient::getProgramName() const {
@@ -683,7 +1709,8 @@ void PluginClient::writeBankData(std::string& buffer){
 }
 
 void PluginClient::sendFile(Command::Type type, const std::string &path) {
-    if (!check()){
+    auto bridge = getBridge();
+    if (!bridge->alive()){
         return;
     }
 
@@ -694,7 +1721,7 @@ void PluginClient::sendFile(Command::Type type, const std::string &path) {
     cmd->buffer.size = pathSize;
     memcpy(cmd->buffer.data, path.data(), pathSize);
 
-    auto chn = bridge().getNRTChannel();
+    auto chn = bridge->getNRTChannel();
     if (!chn.addCommand(cmd, cmdSize)) {
         throw Error(Error::PluginError,
                     "PluginClient: could not send file path");
@@ -702,7 +1729,7 @@ void PluginClient::sendFile(Command::Type type, const std::string &path) {
     chn.send();
 
     // check if host is still alive!
-    if (!check()){
+    if (!bridge->alive()){
         return;
     }
 
@@ -714,12 +1741,13 @@ void PluginClient::sendFile(Command::Type type, const std::string &path) {
 }
 
 void PluginClient::sendData(Command::Type type, const char *data, size_t size){
-    if (!check()){
+    auto bridge = getBridge();
+    if (!bridge->alive()){
         return;
     }
 
     auto totalSize = sizeof(ShmCommand) + size;
-    auto chn = bridge().getNRTChannel();
+    auto chn = bridge->getNRTChannel();
     if (totalSize > chn.capacity()) {
         // plugin data too large, try to transmit via tmp file
         LOG_DEBUG("PluginClient (" << id_ << "): send plugin data via tmp file (size: "
@@ -759,7 +1787,7 @@ void PluginClient::sendData(Command::Type type, const char *data, size_t size){
     chn.send();
 
     // check if host is still alive!
-    if (!check()){
+    if (!bridge->alive()){
         return;
     }
 
@@ -771,18 +1799,19 @@ void PluginClient::sendData(Command::Type type, const char *data, size_t size){
 }
 
 void PluginClient::receiveData(Command::Type type, std::string &buffer){
-    if (!check()){
+    auto bridge = getBridge();
+    if (!bridge->alive()){
         return;
     }
 
     ShmCommand cmd(type, id());
 
-    auto chn = bridge().getNRTChannel();
+    auto chn = bridge->getNRTChannel();
     chn.AddCommand(cmd, empty);
     chn.send();
 
     // check if host is still alive!
-    if (!check()){
+    if (!bridge->alive()){
         return;
     }
 
@@ -875,13 +1904,13 @@ WindowClient::~WindowClient(){}
 void WindowClient::open(){
     LOG_DEBUG("WindowOpen");
     ShmUICommand cmd(Command::WindowOpen, plugin_->id());
-    plugin_->bridge().postUIThread(cmd);
+    plugin_->getBridge()->postUIThread(cmd);
 }
 
 void WindowClient::close(){
     LOG_DEBUG("WindowClose");
     ShmUICommand cmd(Command::WindowClose, plugin_->id());
-    plugin_->bridge().postUIThread(cmd);
+    plugin_->getBridge()->postUIThread(cmd);
 }
 
 void WindowClient::setPos(int x, int y){
@@ -889,7 +1918,7 @@ void WindowClient::setPos(int x, int y){
     ShmUICommand cmd(Command::WindowSetPos, plugin_->id());
     cmd.windowPos.x = x;
     cmd.windowPos.y = y;
-    plugin_->bridge().postUIThread(cmd);
+    plugin_->getBridge()->postUIThread(cmd);
 }
 
 void WindowClient::setSize(int w, int h){
@@ -897,7 +1926,7 @@ void WindowClient::setSize(int w, int h){
     ShmUICommand cmd(Command::WindowSetSize, plugin_->id());
     cmd.windowSize.width = w;
     cmd.windowSize.height = h;
-    plugin_->bridge().postUIThread(cmd);
+    plugin_->getBridge()->postUIThread(cmd);
 }
 
 } // vst
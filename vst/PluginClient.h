@@ -5,8 +5,12 @@
 #include "DeferredPlugin.h"
 #include "MiscUtils.h"
 #include "PluginBridge.h"
+#include "ProcessMeter.h"
+#include "Bus.h"
 
 #include <array>
+#include <optional>
+#include <vector>
 
 #ifndef DEBUG_CLIENT_PROCESS
 #define DEBUG_CLIENT_PROCESS 0
@@ -18,7 +22,8 @@ class alignas(CACHELINE_SIZE) PluginClient final
     : public DeferredPlugin, public AlignedClass<PluginClient> {
 public:
     PluginClient(IFactory::const_ptr f, PluginDesc::const_ptr desc,
-                 bool sandbox, bool editor);
+                 bool sandbox, bool editor, bool pipelined = false,
+                 const std::string& group = std::string{});
 
     virtual ~PluginClient();
 
@@ -28,11 +33,28 @@ public:
 
     bool isBridged() const override { return true; }
 
-    PluginBridge& bridge() {
-        return *bridge_;
-    }
+    // Holds on to the current bridge for the duration of a method call.
+    // A restarted bridge is adopted by the next call, see recover().
+    // NB: realtime safe.
+    class BridgeRef {
+     public:
+        BridgeRef(PluginClient& client);
+        ~BridgeRef();
+        BridgeRef(const BridgeRef&) = delete;
+        BridgeRef& operator=(const BridgeRef&) = delete;
+
+        PluginBridge* operator->() const { return bridge_; }
+        PluginBridge& operator*() const { return *bridge_; }
+        uint32_t generation() const { return generation_; }
+     private:
+        PluginClient& client_;
+        PluginBridge *bridge_;
+        uint32_t generation_;
+    };
 
-    bool check();
+    BridgeRef getBridge() {
+        return BridgeRef(*this);
+    }
 
     uint32_t id() const { return id_; }
 
@@ -42,7 +64,15 @@ public:
     void suspend() override;
     void resume() override;
     void setNumSpeakers(int *input, int numInputs, int *output, int numOutputs) override;
+    // sandbox only (not pipelined): the busses point directly into shared memory
+    bool getProcessBuffers(AudioBus *&inputs, AudioBus *&outputs) override;
     int getLatencySamples() override;
+    // includes the round trip to the bridge/sandbox process
+    ProcessStats getProcessStats() const override {
+        auto stats = meter_.getStats();
+        stats.missed = missed_.load(std::memory_order_relaxed);
+        return stats;
+    }
 
     void setListener(IPluginListener* listener) override;
 
@@ -51,6 +81,8 @@ public:
     void setParameter(int index, float value, int sampleOffset) override;
     bool setParameter(int index, std::string_view str, int sampleOffset) override;
     float getParameter(int index) const override;
+    // NB: after bulk parameter changes (e.g. program change), the display strings
+    // are fetched lazily from the subprocess in a single NRT round trip.
     size_t getParameterString(int index, ParamStringBuffer& buffer) const override;
 
     void setProgram(int index) override;
@@ -91,8 +123,8 @@ public:
     int canDo(const char *what) const override;
     intptr_t vendorSpecific(int index, intptr_t value, void *p, float opt) override;
 protected:
-    void pushCommand(const Command& cmd) override {
-        commands_.push_back(cmd);
+    CommandBuffer& commandBuffer() override {
+        return commands_;
     }
 
     int numParameters() const { return info_->numParameters(); }
@@ -102,22 +134,99 @@ protected:
     void sendData(Command::Type type, const char *data, size_t size);
 
     void receiveData(Command::Type type, std::string& buffer);
-    template<typename T>
+    friend struct BridgeBatch;
 
+    template<typename T>
     void doProcess(ProcessData& data);
+    template<typename T>
+    bool addToBatch(ProcessData& data, PluginBridge& bridge);
+    template<typename T>
+    bool sendProcess(const ProcessData& data, RTChannel& channel, int32_t audioOffset);
+    void receiveProcess(ProcessData& data, RTChannel& channel, bool shmAudio);
+    template<typename T>
+    void doReceiveProcess(ProcessData& data, RTChannel& channel, bool shmAudio);
+    template<typename T>
+    void doProcessPipelined(ProcessData& data, const BridgeRef& bridge);
+    bool waitPipeline();
+    void finishPipeline(const BridgeRef& bridge);
+    template<typename T>
+    static void copyChannels(const AudioBus& from, AudioBus& to, int numSamples);
+    bool setShmAudioBusses(char *buffer, int32_t size, size_t sampleSize);
+    void reserveChannels(PluginBridge& bridge);
+    size_t requestSize();
     void sendCommands(RTChannel& channel);
     void dispatchReply(const ShmCommand &reply);
+    void updateParamCache(const ShmCommand& reply) const;
+    void fetchParamStrings(PluginBridge& bridge);
+    void pollCommands();
+    // crash recovery, see setSandboxRecovery()
+    void createPlugin(PluginBridge& bridge);
+    void recover();
+    void sendSnapshotInterval(PluginBridge& bridge);
+    void sendParamTable(PluginBridge& bridge);
+    friend class RecoveryThread;
 
     IFactory::const_ptr factory_; // keep alive!
     PluginDesc::const_ptr info_;
     IWindow::ptr window_;
     IPluginListener* listener_ = nullptr;
-    PluginBridge::ptr bridge_;
+    // the current and the previous bridge, indexed by generation; see BridgeRef
+    PluginBridge::ptr bridges_[2];
+    std::atomic<int> bridgeUsers_[2]{};
+    std::atomic<uint32_t> bridgeGeneration_{0};
     uint32_t id_;
-    std::vector<Command> commands_;
+    CommandBuffer commands_;
+    UIThread::Handle pollFunction_; // see pollCommands()
     int program_ = 0;
     int latency_ = 0;
     double transport_;
+    ProcessMeter meter_;
+    // busses for ShmCommand::ShmAudio
+    int maxBlockSize_ = 64;
+    ProcessPrecision precision_ = ProcessPrecision::Single;
+    std::unique_ptr<Bus[]> shmInputs_;
+    int numInputs_ = 0;
+    std::unique_ptr<Bus[]> shmOutputs_;
+    int numOutputs_ = 0;
+    // requested RT channel size after a channel overflow, see sendCommands()
+    std::atomic<size_t> requestOverflow_{0};
+    // ThreadMode::Pipelined
+    static constexpr double pipelineSpinTime = 20; // max. spin time in microseconds
+    std::optional<RTChannel> pipeline_; // request in flight
+    uint32_t pipelineGeneration_ = 0; // see BridgeRef
+    int pipelineSamples_ = 0;
+    int pipelineOutputChannels_ = 0;
+    bool pipelineShmAudio_ = false;
+    std::atomic<int> missed_{0};
+    // crash recovery, see recover()
+    static constexpr double recoveryMinUptime = 10; // seconds
+    static constexpr int recoveryMaxCrashes = 3; // give up after N quick crashes
+    bool recovery_ = false;
+    bool pipelined_ = false;
+    std::string snapshotPath_;
+    double startTime_ = 0; // (re)start time in seconds, see recover()
+    int numQuickCrashes_ = 0;
+    // settings needed for restoring the plugin; written by the NRT methods
+    struct Settings {
+        double sampleRate = 0;
+        int maxBlockSize = 0;
+        ProcessPrecision precision = ProcessPrecision::Single;
+        ProcessMode mode = ProcessMode::Realtime;
+        std::vector<int> inputs;
+        std::vector<int> outputs;
+        bool setup = false;
+        bool speakers = false;
+        bool active = false;
+    };
+    Settings settings_;
+    Mutex recoveryMutex_;
+    // parameter automation from the plugin UI, see ShmParamTable
+    std::unique_ptr<ShmInterface> paramShm_;
+    ShmParamTable paramTable_;
+    // parameter state from the subprocess, see Command::ParamStateChanged
+    ShmParamTable stateTable_;
+    // conservative estimate for Command::GetParamStrings
+    static constexpr size_t paramStringReplySize = 128;
     // cache
     std::unique_ptr<std::atomic<float>[]> paramValueCache_;
     // use fixed sized arrays to avoid potential heap allocations with std::string
@@ -125,6 +234,9 @@ protected:
     // happens to be larger than the array, we just truncate it.
     using ParamDisplay = std::array<uint8_t, 16>;
     std::unique_ptr<ParamDisplay[]> paramDisplayCache_; // pascal string!
+    // display strings which must be fetched, see fetchParamStrings()
+    std::unique_ptr<std::atomic<bool>[]> paramDisplayStale_;
+    std::atomic<bool> paramStringsPending_{false};
     using ProgramName = std::array<uint8_t, 32>;
     std::unique_ptr<ProgramName[]> programNameCache_; // pascal string!
     // Normally, these are accessed on the same thread, so there would be
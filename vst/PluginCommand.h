@@ -1,6 +1,16 @@
 #pragma once
 
 #include "Interface.h"
+#include "Log.h"
+#include "MiscUtils.h"
+#include "Sync.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <vector>
 
 namespace vst {
 
@@ -66,6 +76,13 @@ struct Command {
         // for plugin bridge
         Error, // 49
         Process,
+        ProcessBatch,
+        RemapChannels,
+        RetireChannel,
+        SetSnapshot,
+        SetParamTable,
+        ParamStateChanged,
+        GetParamStrings,
         Quit
     };
     Command(){}
@@ -128,6 +145,203 @@ struct Command {
     };
 };
 
+/*/////////////////// CommandBuffer /////////////////////*/
+
+// A fixed-capacity list of commands together with an arena for variable sized
+// payloads (parameter strings, SysEx data, program names). push() and allocate()
+// never touch the heap, so they can be used on the audio thread. If the capacity
+// is exceeded, they fail, count the dropped command and raise a grow request.
+// (As an exception, parameter changes are coalesced with a pending change of
+// the same parameter, so the latest value is never lost.)
+// The peak usage (including failed requests) is recorded, so that a non-RT thread
+// can grow the buffer: grow() can be called periodically while the buffer is in use
+// (e.g. in a UI thread poll function); it allocates larger storage which replaces
+// the current storage at the next block boundary, see clear(). reserve() grows the
+// buffer in place, e.g. in setupProcessing(), when the audio thread is not running.
+class CommandBuffer {
+ public:
+    static const size_t defaultNumCommands = 256;
+    static const size_t defaultPayloadSize = 16384;
+
+    CommandBuffer() {
+        commands_ = std::make_unique<Command[]>(defaultNumCommands);
+        capacity_ = defaultNumCommands;
+        payload_ = std::make_unique<char[]>(defaultPayloadSize);
+        payloadCapacity_ = defaultPayloadSize;
+    }
+
+    ~CommandBuffer() {
+        delete pending_.load();
+        delete retired_.load();
+    }
+
+    CommandBuffer(const CommandBuffer&) = delete;
+    CommandBuffer& operator=(const CommandBuffer&) = delete;
+
+    // returns false if the buffer is full
+    bool push(const Command& command) {
+        if (size_ == capacity_) {
+            if (command.type == Command::SetParamValue && coalesce(command)) {
+                return true;
+            }
+            drop(peakNumCommands_, size_ + 1);
+            return false;
+        }
+        commands_[size_++] = command;
+        updatePeak(peakNumCommands_, size_);
+        return true;
+    }
+
+    // allocate memory for a command payload; stays valid until clear().
+    // returns nullptr if the arena is exhausted.
+    char * allocate(size_t size) {
+        size = alignTo(size, 8);
+        if (payloadSize_ + size > payloadCapacity_) {
+            drop(peakPayloadSize_, payloadSize_ + size);
+            return nullptr;
+        }
+        auto result = payload_.get() + payloadSize_;
+        payloadSize_ += size;
+        updatePeak(peakPayloadSize_, payloadSize_);
+        return result;
+    }
+
+    // remove the first n commands, e.g. after a partial send.
+    // NB: the payload memory is only reclaimed in clear()!
+    void removeFront(size_t n) {
+        if (n >= size_) {
+            clear();
+        } else if (n > 0) {
+            std::copy(begin() + n, end(), begin());
+            size_ -= n;
+        }
+    }
+
+    // called at the block boundary; swaps in the storage prepared by grow().
+    void clear() {
+        size_ = 0;
+        payloadSize_ = 0;
+        // NB: only swap if grow() has already freed the previous storage
+        if (pending_.load(std::memory_order_relaxed)
+                && !retired_.load(std::memory_order_acquire)) {
+            auto storage = pending_.exchange(nullptr, std::memory_order_acquire);
+            if (!storage) {
+                return; // taken by reserve()
+            }
+            std::swap(commands_, storage->commands);
+            std::swap(capacity_, storage->capacity);
+            std::swap(payload_, storage->payload);
+            std::swap(payloadCapacity_, storage->payloadCapacity);
+            retired_.store(storage, std::memory_order_release);
+        }
+    }
+
+    // number of failed push() resp. allocate() calls since the last call;
+    // can be called on any thread, e.g. to report drops in a poll function.
+    size_t takeOverflow() {
+        return overflow_.exchange(0, std::memory_order_relaxed);
+    }
+
+    // NOT realtime-safe! Called on a non-RT thread while the buffer is in use.
+    // If a grow request is pending, allocate storage for twice the peak usage,
+    // see clear(). Also frees the storage that has been swapped out.
+    void grow() {
+        delete retired_.exchange(nullptr, std::memory_order_acquire);
+        if (!pending_.load(std::memory_order_acquire)
+                && growRequest_.exchange(false, std::memory_order_acquire)) {
+            auto storage = new Storage;
+            storage->capacity = peakNumCommands_.load(std::memory_order_relaxed) * 2;
+            storage->commands = std::make_unique<Command[]>(storage->capacity);
+            storage->payloadCapacity = peakPayloadSize_.load(std::memory_order_relaxed) * 2;
+            storage->payload = std::make_unique<char[]>(storage->payloadCapacity);
+            LOG_DEBUG("CommandBuffer: grow to " << storage->capacity << " commands and "
+                      << storage->payloadCapacity << " bytes");
+            pending_.store(storage, std::memory_order_release);
+        }
+    }
+
+    // NOT realtime-safe! Make room for twice the peak usage so far.
+    // NB: must not be called concurrently with the audio thread!
+    void reserve() {
+        if (auto overflow = takeOverflow()) {
+            LOG_WARNING("CommandBuffer: " << overflow << " command(s) dropped");
+        }
+        // the pending storage might be smaller
+        delete pending_.exchange(nullptr, std::memory_order_acquire);
+        growRequest_.store(false, std::memory_order_relaxed);
+        auto peakNumCommands = peakNumCommands_.load(std::memory_order_relaxed);
+        if (peakNumCommands * 2 > capacity_) {
+            auto capacity = peakNumCommands * 2;
+            auto commands = std::make_unique<Command[]>(capacity);
+            std::copy(begin(), end(), commands.get());
+            commands_ = std::move(commands);
+            capacity_ = capacity;
+        }
+        // pending commands might point into the payload arena!
+        auto peakPayloadSize = peakPayloadSize_.load(std::memory_order_relaxed);
+        if (payloadSize_ == 0 && peakPayloadSize * 2 > payloadCapacity_) {
+            payloadCapacity_ = peakPayloadSize * 2;
+            payload_ = std::make_unique<char[]>(payloadCapacity_);
+        }
+    }
+
+    Command * begin() { return commands_.get(); }
+    Command * end() { return commands_.get() + size_; }
+    const Command * begin() const { return commands_.get(); }
+    const Command * end() const { return commands_.get() + size_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return capacity_; }
+    size_t payloadCapacity() const { return payloadCapacity_; }
+ private:
+    // replace the value of the last pending change of the same parameter
+    bool coalesce(const Command& command) {
+        for (auto it = end(); it != begin(); ) {
+            --it;
+            if (it->type == Command::SetParamValue
+                    && it->paramValue.index == command.paramValue.index) {
+                it->paramValue.value = command.paramValue.value;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // NB: the peaks are only written by the thread that owns the buffer
+    static void updatePeak(std::atomic<size_t>& peak, size_t value) {
+        if (value > peak.load(std::memory_order_relaxed)) {
+            peak.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    void drop(std::atomic<size_t>& peak, size_t value) {
+        updatePeak(peak, value);
+        overflow_.fetch_add(1, std::memory_order_relaxed);
+        growRequest_.store(true, std::memory_order_release); // publish peaks
+    }
+
+    struct Storage {
+        std::unique_ptr<Command[]> commands;
+        size_t capacity;
+        std::unique_ptr<char[]> payload;
+        size_t payloadCapacity;
+    };
+
+    std::unique_ptr<Command[]> commands_;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+    std::unique_ptr<char[]> payload_;
+    size_t payloadSize_ = 0;
+    size_t payloadCapacity_ = 0;
+    std::atomic<size_t> overflow_{0};
+    std::atomic<size_t> peakNumCommands_{defaultNumCommands / 2};
+    std::atomic<size_t> peakPayloadSize_{defaultPayloadSize / 2};
+    // see grow()
+    std::atomic<bool> growRequest_{false};
+    std::atomic<Storage *> pending_{nullptr}; // allocated by grow()
+    std::atomic<Storage *> retired_{nullptr}; // freed by grow()
+};
+
 // additional commands/replies (for IPC over shared memory)
 // that are not covered by Command.
 struct ShmCommand {
@@ -139,6 +353,15 @@ struct ShmCommand {
 
     static const size_t headerSize = 8;
 
+    // process flags
+    enum ProcessFlags {
+        // audio is exchanged via ShmChannel::audioBuffer()
+        // instead of request messages, see setShmAudioBusses().
+        ShmAudio = 1,
+        // process the plugins of a batch in parallel
+        BatchParallel = 2
+    };
+
     // data
     // NOTE: the union needs to be 8 byte aligned, so we use
     // the additional space for the (optional) 'id' member.
@@ -173,6 +396,16 @@ struct ShmCommand {
             uint16_t index;
             uint8_t pstr[1]; // pascal string!
         } paramString;
+        // parameter tables, see Command::SetParamTable
+        struct {
+            int32_t state; // use the state table, see Command::ParamStateChanged
+            char path[1];
+        } paramTable;
+        // parameter indices, see Command::GetParamStrings
+        struct {
+            uint16_t count;
+            uint16_t indices[1];
+        } paramIndices;
         // flat param state, for parameter updates
         struct {
             float value;
@@ -209,7 +442,13 @@ struct ShmCommand {
             uint8_t mode;
             uint16_t numInputs;
             uint16_t numOutputs;
+            uint16_t flags;
+            uint32_t audioOffset; // see ShmAudio
         } process;
+        // process batch, see PluginServer::processBatch()
+        struct {
+            uint32_t flags;
+        } batch;
         // setup processing
         struct {
             float sampleRate;
@@ -223,6 +462,11 @@ struct ShmCommand {
             uint16_t numOutputs;
             uint32_t speakers[1];
         } speakers;
+        // periodic state snapshot, see PluginHandle::checkSnapshot()
+        struct {
+            float interval;
+            char path[1];
+        } snapshot;
         // error
         struct {
             int32_t code;
@@ -235,6 +479,303 @@ struct ShmCommand {
     }
 };
 
+// Point the busses into the audio buffer of a shared memory channel:
+// all input channels followed by all output channels, each channel
+// aligned to a cache line. Returns false if they don't fit.
+inline size_t shmAudioStride(int blockSize, size_t sampleSize){
+    return (blockSize * sampleSize + CACHELINE_SIZE - 1) & ~(CACHELINE_SIZE - 1);
+}
+
+// the size of the region needed by setShmAudioBusses()
+inline size_t shmAudioSize(int blockSize, size_t sampleSize,
+                           const AudioBus *inputs, int numInputs,
+                           const AudioBus *outputs, int numOutputs) {
+    size_t numChannels = 0;
+    for (int i = 0; i < numInputs; ++i){
+        numChannels += inputs[i].numChannels;
+    }
+    for (int i = 0; i < numOutputs; ++i){
+        numChannels += outputs[i].numChannels;
+    }
+    return numChannels * shmAudioStride(blockSize, sampleSize);
+}
+
+inline bool setShmAudioBusses(char *buffer, size_t size, int blockSize, size_t sampleSize,
+                              AudioBus *inputs, int numInputs,
+                              AudioBus *outputs, int numOutputs) {
+    if (!buffer){
+        return false;
+    }
+    if (shmAudioSize(blockSize, sampleSize, inputs, numInputs, outputs, numOutputs) > size){
+        return false;
+    }
+    const size_t stride = shmAudioStride(blockSize, sampleSize);
+    auto setChannels = [&](AudioBus *busses, int count){
+        for (int i = 0; i < count; ++i){
+            auto& bus = busses[i];
+            for (int j = 0; j < bus.numChannels; ++j){
+                bus.channelData32[j] = (float *)buffer; // float* and double* have the same size
+                buffer += stride;
+            }
+        }
+    };
+    setChannels(inputs, numInputs);
+    setChannels(outputs, numOutputs);
+    return true;
+}
+
+// Parameter automation from the plugin UI, see PluginHandle::parameterAutomated().
+// The subprocess stores the latest value of each parameter and sets its dirty bit;
+// the client drains the table in PluginBridge::pollUIThread(). This way, bursts
+// collapse to a single update per parameter and the writer never has to wait.
+// The table lives in a dedicated shared memory segment, see Command::SetParamTable.
+// Layout: summary flag, dirty bits, values.
+class ShmParamTable {
+ public:
+    static size_t size(int numParams){
+        return sizeof(uint32_t) * (1 + numWords(numParams)) + sizeof(float) * numParams;
+    }
+
+    ShmParamTable() = default;
+
+    ShmParamTable(char *data, int numParams, bool init)
+        : numParams_(numParams) {
+        dirty_ = reinterpret_cast<std::atomic<uint32_t> *>(data);
+        bits_ = dirty_ + 1;
+        values_ = reinterpret_cast<std::atomic<float> *>(bits_ + numWords(numParams));
+        if (init){
+            new (dirty_) std::atomic<uint32_t>(0);
+            for (int i = 0; i < numWords(numParams); ++i){
+                new (&bits_[i]) std::atomic<uint32_t>(0);
+            }
+            for (int i = 0; i < numParams; ++i){
+                new (&values_[i]) std::atomic<float>(0.f);
+            }
+        }
+    }
+
+    bool valid() const { return dirty_ != nullptr; }
+
+    void set(int index, float value){
+        values_[index].store(value, std::memory_order_relaxed);
+        bits_[index / 32].fetch_or(1u << (index % 32), std::memory_order_release);
+        dirty_->store(1, std::memory_order_release);
+    }
+
+    // call fn(index, value) for every dirty parameter
+    template<typename Fn>
+    void drain(Fn&& fn){
+        if (!dirty_->exchange(0, std::memory_order_acquire)){
+            return;
+        }
+        for (int i = 0; i < numWords(numParams_); ++i){
+            auto bits = bits_[i].exchange(0, std::memory_order_acquire);
+            for (int j = 0; bits != 0; ++j, bits >>= 1){
+                if (bits & 1){
+                    auto index = i * 32 + j;
+                    fn(index, values_[index].load(std::memory_order_relaxed));
+                }
+            }
+        }
+    }
+ private:
+    static int numWords(int numParams){
+        return (numParams + 31) / 32;
+    }
+
+    std::atomic<uint32_t> *dirty_ = nullptr;
+    std::atomic<uint32_t> *bits_ = nullptr;
+    std::atomic<float> *values_ = nullptr;
+    int numParams_ = 0;
+};
+
+// The parameter segment of a plugin contains two tables: automation from the
+// plugin UI (see above) followed by the parameter state, which the subprocess
+// updates in bulk; the client drains it on Command::ParamStateChanged.
+inline size_t shmParamStateOffset(int numParams){
+    return (ShmParamTable::size(numParams) + CACHELINE_SIZE - 1) & ~(CACHELINE_SIZE - 1);
+}
+
+inline size_t shmParamSegmentSize(int numParams){
+    return shmParamStateOffset(numParams) * 2;
+}
+
+// Log messages from the subprocess, see writeLog() in host.cpp.
+// Any thread may write - including RT threads, because there are no locks and
+// no system calls - but only a single thread may read, see PluginBridge::readLog().
+// This is basically a bounded MPSC version of LockfreeMPMCQueue where every
+// LogMessage record occupies one or more consecutive slots. Writers claim all
+// slots at once, but only publish the first one. If the ring is full, the message
+// is dropped and counted. The ring lives in the "log" channel of the bridge.
+class ShmLogRing {
+ public:
+    static constexpr size_t slotSize = 64;
+    static constexpr size_t payloadSize = slotSize - sizeof(uint32_t) * 2;
+    static constexpr int maxSlotsPerMessage = 64;
+    // max. message size (including the terminating null character);
+    // larger messages must be sent by other means.
+    static constexpr size_t maxMessageSize =
+            payloadSize * maxSlotsPerMessage - sizeof(LogMessage::Header);
+
+    static size_t size(int numSlots){
+        // control block + slots, plus some room for alignment
+        return CACHELINE_SIZE * 2 + slotSize * numSlots;
+    }
+
+    ShmLogRing() = default;
+
+    ShmLogRing(char *data, size_t size, bool init) {
+        // align to cache line
+        auto begin = (reinterpret_cast<uintptr_t>(data) + CACHELINE_SIZE - 1)
+                & ~(uintptr_t)(CACHELINE_SIZE - 1);
+        auto end = reinterpret_cast<uintptr_t>(data) + size;
+        control_ = reinterpret_cast<Control *>(begin);
+        slots_ = reinterpret_cast<Slot *>(begin + CACHELINE_SIZE);
+        // round down to power of 2
+        auto count = (end - (begin + CACHELINE_SIZE)) / slotSize;
+        numSlots_ = 1;
+        while ((numSlots_ * 2) <= count){
+            numSlots_ *= 2;
+        }
+        assert(numSlots_ >= maxSlotsPerMessage);
+        if (init){
+            new (control_) Control();
+            for (uint32_t i = 0; i < numSlots_; ++i){
+                new (&slots_[i].sequence) std::atomic<uint32_t>(i);
+            }
+        }
+    }
+
+    bool valid() const { return control_ != nullptr; }
+
+    // 'size' includes the terminating null character and must not
+    // exceed maxMessageSize. Returns false if the ring is full.
+    bool write(int level, const char *msg, size_t size){
+        assert(size <= maxMessageSize);
+        auto count = numSlots(size);
+        auto pos = control_->head.load(std::memory_order_relaxed);
+        for (;;) {
+            // check if all slots are free
+            uint32_t i = 0;
+            for (; i < count; ++i){
+                auto seq = slot(pos + i).sequence.load(std::memory_order_acquire);
+                auto diff = (int32_t)(seq - (pos + i));
+                if (diff < 0){
+                    // ring is full
+                    control_->dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                } else if (diff > 0){
+                    break; // slot has already been claimed by another writer
+                }
+            }
+            if (i == count){
+                if (control_->head.compare_exchange_weak(pos, pos + count,
+                                                         std::memory_order_relaxed)) {
+                    break;
+                }
+            } else {
+                pos = control_->head.load(std::memory_order_relaxed);
+            }
+        }
+        // copy header + message
+        LogMessage::Header header;
+        header.level = level;
+        header.size = size;
+        size_t offset = 0;
+        for (uint32_t i = 0; i < count; ++i){
+            auto dst = slot(pos + i).data;
+            auto n = payloadSize;
+            if (i == 0){
+                memcpy(dst, &header, sizeof(header));
+                dst += sizeof(header);
+                n -= sizeof(header);
+            }
+            n = std::min<size_t>(n, size - offset);
+            memcpy(dst, msg + offset, n);
+            offset += n;
+        }
+        // publish
+        slot(pos).sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // call fn(level, msg) for every message
+    template<typename Fn>
+    void drain(Fn&& fn){
+        char buffer[maxMessageSize];
+        for (;;) {
+            auto& first = slot(tail_);
+            if (first.sequence.load(std::memory_order_acquire) != tail_ + 1){
+                break; // empty
+            }
+            LogMessage::Header header;
+            memcpy(&header, first.data, sizeof(header));
+            if (header.size <= 0 || header.size > (int32_t)maxMessageSize){
+                // corrupted; better stop here
+                LOG_ERROR("ShmLogRing: bad message size (" << header.size << ")");
+                control_ = nullptr;
+                break;
+            }
+            auto count = numSlots(header.size);
+            size_t offset = 0;
+            for (uint32_t i = 0; i < count; ++i){
+                auto src = slot(tail_ + i).data;
+                auto n = payloadSize;
+                if (i == 0){
+                    src += sizeof(header);
+                    n -= sizeof(header);
+                }
+                n = std::min<size_t>(n, header.size - offset);
+                memcpy(buffer + offset, src, n);
+                offset += n;
+            }
+            // free slots
+            for (uint32_t i = 0; i < count; ++i){
+                slot(tail_ + i).sequence.store(tail_ + i + numSlots_,
+                                               std::memory_order_release);
+            }
+            tail_ += count;
+
+            buffer[header.size - 1] = '\0'; // just to be sure
+            fn(header.level, buffer);
+        }
+    }
+
+    // number of dropped messages since the last call;
+    // NB: drain() might have invalidated the ring!
+    uint32_t takeDropped(){
+        if (!control_){
+            return 0;
+        }
+        return control_->dropped.exchange(0, std::memory_order_relaxed);
+    }
+ private:
+    struct Control {
+        std::atomic<uint32_t> head{0};
+        std::atomic<uint32_t> dropped{0};
+    };
+
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        uint32_t reserved;
+        char data[payloadSize];
+    };
+    static_assert(sizeof(Slot) == slotSize, "bad slot size");
+
+    static uint32_t numSlots(size_t size){
+        return (sizeof(LogMessage::Header) + size + payloadSize - 1) / payloadSize;
+    }
+
+    Slot& slot(uint32_t pos){
+        return slots_[pos & (numSlots_ - 1)];
+    }
+
+    Control *control_ = nullptr;
+    Slot *slots_ = nullptr;
+    uint32_t numSlots_ = 0;
+    uint32_t tail_ = 0; // only used by the reader
+};
+
 // additional commands/replies (for IPC over shared memory)
 // that are not covered by Command.
 struct ShmUICommand {
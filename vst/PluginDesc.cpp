@@ -134,15 +134,17 @@ CpuArch PluginDesc::arch() const {
 }
 
 // ThreadedPlugin.cpp
-IPlugin::ptr createThreadedPlugin(IPlugin::ptr plugin);
+IPlugin::ptr createThreadedPlugin(IPlugin::ptr plugin, ThreadMode mode);
 
 #if USE_BRIDGE
 // PluginClient.cpp
 IPlugin::ptr createBridgedPlugin(IFactory::const_ptr factory, const std::string& name,
-                                 bool editor, bool sandbox);
+                                 bool editor, bool sandbox, bool pipelined,
+                                 const std::string& group);
 #endif
 
-IPlugin::ptr PluginDesc::create(bool editor, bool threaded, RunMode mode) const {
+IPlugin::ptr PluginDesc::create(bool editor, bool threaded, RunMode mode,
+                                ThreadMode threadMode, const std::string& group) const {
     std::shared_ptr<const IFactory> factory = factory_.lock();
     if (!factory){
         return nullptr;
@@ -151,14 +153,21 @@ IPlugin::ptr PluginDesc::create(bool editor, bool threaded, RunMode mode) const
 #if USE_BRIDGE
     if ((mode == RunMode::Bridge) || (mode == RunMode::Sandbox) ||
             ((mode == RunMode::Auto) && bridged())){
-        plugin = createBridgedPlugin(factory, name, editor, mode == RunMode::Sandbox);
+        // pipelined plugins don't need a ThreadedPlugin wrapper
+        bool pipelined = threaded && threadMode == ThreadMode::Pipelined;
+        plugin = createBridgedPlugin(factory, name, editor,
+                                     mode == RunMode::Sandbox, pipelined, group);
+        if (pipelined){
+            return plugin;
+        }
     }
     else
 #endif
     plugin = factory->create(name, editor);
 
     if (threaded){
-        plugin = createThreadedPlugin(std::move(plugin));
+        // NB: ThreadedPlugin treats ThreadMode::Pipelined like ThreadMode::Deferred
+        plugin = createThreadedPlugin(std::move(plugin), threadMode);
     }
 
     return plugin;
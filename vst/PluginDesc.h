@@ -24,7 +24,11 @@ public:
     CpuArch arch() const;
     // create new instances
     // throws an Error exception on failure!
-    IPlugin::ptr create(bool editor, bool threaded, RunMode mode = RunMode::Auto) const;
+    // 'group' (RunMode::Sandbox only): plugins with the same group name
+    // share a single subprocess, see also setSandboxGroupSize().
+    IPlugin::ptr create(bool editor, bool threaded, RunMode mode = RunMode::Auto,
+                        ThreadMode threadMode = ThreadMode::Deferred,
+                        const std::string& group = std::string{}) const;
     // read/write plugin description
     void serialize(std::ostream& file) const;
     void deserialize(std::istream& file, int versionMajor = VERSION_MAJOR,
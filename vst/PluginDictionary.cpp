@@ -2,23 +2,44 @@
 
 #include "FileUtils.h"
 #include "Log.h"
+#include "MiscUtils.h"
+#include "PluginCache.h"
 #if USE_WINE
 # include "CpuArch.h"
 #endif
 
+#include <chrono>
 #include <cstdlib>
 #include <sstream>
 #include <algorithm>
 
 namespace vst {
 
+PluginDictionary::PluginDictionary() = default;
+
+// NB: PluginCache is an incomplete type in the header
+PluginDictionary::~PluginDictionary() = default;
+
 void PluginDictionary::addFactory(const std::string& path, IFactory::ptr factory) {
     std::lock_guard lock(mutex_);
     factories_[path] = std::move(factory);
 }
 
-IFactory::const_ptr PluginDictionary::findFactory(const std::string& path) const {
-    std::shared_lock lock(mutex_);
+IFactory::const_ptr PluginDictionary::findFactory(const std::string& path) {
+    {
+        std::shared_lock lock(mutex_);
+        if (!hasPendingPlugins(path, true)){
+            auto factory = factories_.find(path);
+            if (factory != factories_.end()){
+                return factory->second;
+            } else {
+                return nullptr;
+            }
+        }
+    }
+    // read the plugin(s) from the cache file
+    std::lock_guard lock(mutex_);
+    readPendingPlugins(path, true);
     auto factory = factories_.find(path);
     if (factory != factories_.end()){
         return factory->second;
@@ -57,8 +78,20 @@ void PluginDictionary::addPlugin(const std::string& key, PluginDesc::const_ptr p
     plugins_[index][key] = std::move(plugin);
 }
 
-PluginDesc::const_ptr PluginDictionary::findPlugin(const std::string& key) const {
-    std::shared_lock lock(mutex_);
+PluginDesc::const_ptr PluginDictionary::findPlugin(const std::string& key) {
+    {
+        std::shared_lock lock(mutex_);
+        if (!hasPendingPlugins(key, false)){
+            return doFindPlugin(key);
+        }
+    }
+    // read the plugin(s) from the cache file
+    std::lock_guard lock(mutex_);
+    readPendingPlugins(key, false);
+    return doFindPlugin(key);
+}
+
+PluginDesc::const_ptr PluginDictionary::doFindPlugin(const std::string& key) const {
     // first try to find native plugin
     auto it = plugins_[NATIVE].find(key);
     if (it != plugins_[NATIVE].end()){
@@ -72,8 +105,9 @@ PluginDesc::const_ptr PluginDictionary::findPlugin(const std::string& key) const
     return nullptr;
 }
 
-std::vector<PluginDesc::const_ptr> PluginDictionary::pluginList() const {
-    std::shared_lock lock(mutex_);
+std::vector<PluginDesc::const_ptr> PluginDictionary::pluginList() {
+    std::lock_guard lock(mutex_);
+    readAllPendingPlugins();
     // inverse mapping (plugin -> keys)
     std::unordered_set<PluginDesc::const_ptr> pluginSet;
     for (auto& plugins : plugins_){
@@ -96,6 +130,7 @@ void PluginDictionary::clear() {
         plugins.clear();
     }
     exceptions_.clear();
+    cache_ = nullptr;
 }
 
 // PluginDesc.cpp
@@ -120,7 +155,35 @@ static double getPluginTimestamp(const std::string& path) {
 }
 
 void PluginDictionary::read(const std::string& path, bool update){
-    std::shared_lock lock(mutex_);
+    std::lock_guard lock(mutex_);
+    if (PluginCache::isBinaryFile(path)){
+        doReadBinary(path, update);
+    } else {
+        doReadText(path, update);
+    }
+}
+
+// check if a black-listed plugin has been changed or removed
+bool PluginDictionary::checkException(const std::string& path, double timestamp){
+    if (pathExists(path)) {
+        try {
+            auto t = getPluginTimestamp(path);
+            if (t < timestamp) {
+                exceptions_.insert(path);
+                return true;
+            } else {
+                LOG_INFO("Black-listed plugin " << path << " has changed");
+            }
+        } catch (const Error& e) {
+            LOG_ERROR("Could not get timestamp for " << path << ": " << e.what());
+        }
+    } else {
+        LOG_INFO("Black-listed plugin " << path << " has been removed");
+    }
+    return false;
+}
+
+void PluginDictionary::doReadText(const std::string& path, bool update){
     int versionMajor = 0, versionMinor = 0, versionBugfix = 0;
     bool outdated = false;
 
@@ -189,22 +252,7 @@ void PluginDictionary::read(const std::string& path, bool update){
             std::getline(file, line);
             int numExceptions = getCount(line);
             while (numExceptions-- && std::getline(file, line)){
-                // check if plugin has been changed or removed
-                if (pathExists(line)) {
-                    try {
-                        auto t = getPluginTimestamp(line);
-                        if (t < timestamp) {
-                            exceptions_.insert(line);
-                        } else {
-                            LOG_INFO("Black-listed plugin " << line << " has changed");
-                            outdated = true;
-                        }
-                    } catch (const Error& e) {
-                        LOG_ERROR("Could not get timestamp for " << line << ": " << e.what());
-                        outdated = true;
-                    }
-                } else {
-                    LOG_INFO("Black-listed plugin " << line << " has been removed");
+                if (!checkException(line, timestamp)){
                     outdated = true;
                 }
             }
@@ -216,7 +264,7 @@ void PluginDictionary::read(const std::string& path, bool update){
         // overwrite file
         file.close();
         try {
-            doWrite(path);
+            doWrite(path, Format::Text);
         } catch (const Error& e){
             throw Error("couldn't update cache file: " + std::string(e.what()));
         }
@@ -226,6 +274,107 @@ void PluginDictionary::read(const std::string& path, bool update){
               << "." << versionMinor << "." << versionBugfix);
 }
 
+void PluginDictionary::doReadBinary(const std::string& path, bool update){
+    auto cache = std::make_unique<PluginCache>(path);
+    // we only keep a single cache file, so we have to
+    // deserialize the pending plugins of the previous one.
+    if (cache_){
+        readAllPendingPlugins();
+    }
+    // The exceptions are checked right away; plugins are only
+    // checked when they are deserialized, see readPendingPlugin().
+    bool outdated = false;
+    auto timestamp = cache->header().timestamp;
+    for (int i = 0; i < cache->numExceptions(); ++i){
+        if (!checkException(std::string(cache->exception(i)), timestamp)){
+            outdated = true;
+        }
+    }
+    LOG_DEBUG("Cache file version: v" << cache->header().versionMajor
+              << "." << cache->header().versionMinor << "." << cache->header().versionPatch
+              << ", " << cache->numPlugins() << " plugins");
+    cache_ = std::move(cache);
+    if (update && outdated){
+        try {
+            doWrite(path, Format::Binary);
+        } catch (const Error& e){
+            throw Error("couldn't update cache file: " + std::string(e.what()));
+        }
+        LOG_INFO("Updated cache file");
+    }
+}
+
+bool PluginDictionary::hasPendingPlugins(const std::string& key, bool isPath) const {
+    if (!cache_){
+        return false;
+    }
+    if (isPath){
+        auto [begin, end] = cache_->findPath(key);
+        for (int i = begin; i < end; ++i){
+            if (cache_->state(i) == PluginCache::State::Pending){
+                return true;
+            }
+        }
+    } else {
+        auto [begin, end] = cache_->findKey(key);
+        for (auto it = begin; it != end; ++it){
+            if (cache_->state(it->plugin) == PluginCache::State::Pending){
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void PluginDictionary::readPendingPlugins(const std::string& key, bool isPath){
+    if (!cache_){
+        return;
+    }
+    if (isPath){
+        auto [begin, end] = cache_->findPath(key);
+        for (int i = begin; i < end; ++i){
+            readPendingPlugin(i);
+        }
+    } else {
+        auto [begin, end] = cache_->findKey(key);
+        for (auto it = begin; it != end; ++it){
+            readPendingPlugin(it->plugin);
+        }
+    }
+}
+
+void PluginDictionary::readAllPendingPlugins(){
+    if (cache_){
+        for (int i = 0; i < cache_->numPlugins(); ++i){
+            readPendingPlugin(i);
+        }
+    }
+}
+
+// deserialize a plugin from the binary cache file
+void PluginDictionary::readPendingPlugin(int index){
+    if (cache_->state(index) != PluginCache::State::Pending){
+        return;
+    }
+    auto& record = cache_->plugin(index);
+    std::stringstream stream(std::string(cache_->string(record.data)));
+    auto plugin = doReadPlugin(stream, record.timestamp, record.versionMajor,
+                               record.versionMinor, record.versionPatch);
+    if (plugin){
+        LOG_DEBUG("read plugin " << plugin->key());
+        int which = plugin->bridged() ? BRIDGED : NATIVE;
+        for (uint32_t i = 0; i < record.numKeys; ++i){
+            // don't replace plugins that have been added in the meantime!
+            plugins_[which].try_emplace(std::string(cache_->pluginKey(record, i)), plugin);
+        }
+        cache_->setState(index, PluginCache::State::Done);
+    } else {
+        // plugin has been changed or removed; it won't be written
+        // to the cache file again, see doWrite().
+        cache_->setState(index, PluginCache::State::Failed);
+    }
+}
+
 PluginDesc::const_ptr PluginDictionary::readPlugin(std::istream& stream){
     std::lock_guard lock(mutex_);
     return doReadPlugin(stream, -1, VERSION_MAJOR,
@@ -287,23 +436,104 @@ PluginDesc::const_ptr PluginDictionary::doReadPlugin(std::istream& stream, doubl
     return desc;
 }
 
-void PluginDictionary::write(const std::string &path) const {
+void PluginDictionary::write(const std::string &path, Format format) {
     std::lock_guard lock(mutex_);
-    doWrite(path);
+    doWrite(path, format);
 }
 
-void PluginDictionary::doWrite(const std::string& path) const {
-    File file(path, File::WRITE);
-    if (!file.is_open()){
-        throw Error("couldn't create file " + path);
-    }
+void PluginDictionary::doWrite(const std::string& path, Format format) {
+    // sort keys by length, so that the short key comes first
+    auto sortKeys = [](std::vector<std::string>& keys){
+        std::sort(keys.begin(), keys.end(),
+                  [](auto& a, auto& b) { return a.size() < b.size(); });
+    };
     // inverse mapping (plugin -> keys)
-    std::unordered_map<PluginDesc::const_ptr, std::vector<std::string>> pluginMap;
+    PluginMap pluginMap;
     for (auto& plugins : plugins_) {
         for (auto& [key, value] : plugins){
             pluginMap[value].push_back(key);
         }
     }
+    for (auto& [_, keys] : pluginMap){
+        sortKeys(keys);
+    }
+    // Pending plugins of the binary cache file are written as is, without
+    // deserializing them; skip keys that have been (re)added in the meantime.
+    PendingPluginList pendingPlugins;
+    if (cache_){
+        for (int i = 0; i < cache_->numPlugins(); ++i){
+            if (cache_->state(i) == PluginCache::State::Pending){
+                auto& record = cache_->plugin(i);
+                auto& plugins = plugins_[(record.flags & PluginRecord::Bridged) ? BRIDGED : NATIVE];
+                std::vector<std::string> keys;
+                for (uint32_t j = 0; j < record.numKeys; ++j){
+                    std::string key(cache_->pluginKey(record, j));
+                    if (!plugins.count(key)){
+                        keys.push_back(std::move(key));
+                    }
+                }
+                if (!keys.empty()){
+                    sortKeys(keys);
+                    pendingPlugins.emplace_back(&record, std::move(keys));
+                }
+            }
+        }
+    }
+    // Write to a temporary file and replace the original file afterwards.
+    // This makes sure that we don't corrupt the cache file on failure and
+    // it also won't affect processes which currently have it memory mapped.
+    auto tmpPath = path + ".tmp" + std::to_string(getCurrentProcessId());
+    try {
+        if (format == Format::Binary){
+            doWriteBinary(tmpPath, pluginMap, pendingPlugins);
+        } else {
+            doWriteText(tmpPath, pluginMap, pendingPlugins);
+        }
+    } catch (...){
+        removeFile(tmpPath);
+        throw;
+    }
+#ifdef _WIN32
+    // we can't replace a file while it is memory mapped
+    if (cache_ && cache_->path() == path){
+        cache_->detach();
+    }
+#endif
+    if (!renameFile(tmpPath, path)){
+        removeFile(tmpPath);
+        throw Error("couldn't replace " + path);
+    }
+    LOG_DEBUG("wrote cache file: " << path);
+}
+
+void PluginDictionary::doWriteBinary(const std::string& path, const PluginMap& pluginMap,
+                                     const PendingPluginList& pendingPlugins) const {
+    // the time when the plugin descriptions and exceptions have been checked,
+    // see doReadPlugin() and checkException()
+    using seconds = std::chrono::duration<double>;
+    auto now = std::chrono::duration_cast<seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    PluginCacheWriter writer(now);
+    for (auto& e : exceptions_){
+        writer.addException(e);
+    }
+    for (auto& [desc, keys] : pluginMap){
+        std::stringstream ss;
+        desc->serialize(ss);
+        writer.addPlugin(desc->path(), desc->name, ss.str(), desc->bridged(), now, keys);
+    }
+    for (auto& [record, keys] : pendingPlugins){
+        writer.addPlugin(*cache_, *record, keys);
+    }
+    writer.write(path);
+}
+
+void PluginDictionary::doWriteText(const std::string& path, const PluginMap& pluginMap,
+                                   const PendingPluginList& pendingPlugins) const {
+    File file(path, File::WRITE);
+    if (!file.is_open()){
+        throw Error("couldn't create file " + path);
+    }
     // write version number
     file << "[version]\n";
     file << VERSION_MAJOR << "." << VERSION_MINOR << "." << VERSION_PATCH << "\n";
@@ -317,21 +547,28 @@ void PluginDictionary::doWrite(const std::string& path) const {
     }
     // serialize plugins
     file << "[plugins]\n";
-    file << "n=" << pluginMap.size() << "\n";
-    for (auto& [desc, keys] : pluginMap){
-        // serialize plugin info
-        desc->serialize(file);
-        // serialize keys
+    file << "n=" << (pluginMap.size() + pendingPlugins.size()) << "\n";
+    auto writeKeys = [&](const std::vector<std::string>& keys){
         file << "[keys]\n";
         file << "n=" << keys.size() << "\n";
-        // sort by length, so that the short key comes first
-        std::sort(keys.begin(), keys.end(),
-                  [](auto& a, auto& b) { return a.size() < b.size(); });
         for (auto& key : keys){
             file << key << "\n";
         }
+    };
+    for (auto& [desc, keys] : pluginMap){
+        // serialize plugin info
+        desc->serialize(file);
+        // serialize keys
+        writeKeys(keys);
+    }
+    for (auto& [record, keys] : pendingPlugins){
+        // NB: the plugin info is already serialized
+        file << cache_->string(record->data);
+        writeKeys(keys);
+    }
+    if (!file){
+        throw Error("couldn't write file " + path);
     }
-    LOG_DEBUG("wrote cache file: " << path);
 }
 
 } // vst
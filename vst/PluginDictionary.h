@@ -5,41 +5,71 @@
 #include "Sync.h"
 
 #include <array>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 
 namespace vst {
 
+class PluginCache;
+struct PluginRecord;
+
 // thread-safe dictionary for VST plugins (factories and descriptions)
+//
+// The cache file is written in a binary format (see PluginCache.h) which is
+// memory mapped when reading. The plugin descriptions are only deserialized
+// on the first lookup, so that reading the cache file is fast even for large
+// plugin libraries. The text format can still be read and written (e.g. for debugging).
 
 class PluginDictionary {
  public:
-    PluginDictionary() = default;
+    enum class Format {
+        Binary,
+        Text
+    };
+
+    PluginDictionary();
+    ~PluginDictionary();
     PluginDictionary(const PluginDictionary&) = delete;
     PluginDictionary(PluginDictionary&&) = delete;
 
     // factories
     void addFactory(const std::string& path, IFactory::ptr factory);
-    IFactory::const_ptr findFactory(const std::string& path) const;
+    IFactory::const_ptr findFactory(const std::string& path);
     // black-listed modules
     void addException(const std::string& path);
     bool isException(const std::string& path) const;
     // plugin descriptions
     void addPlugin(const std::string& key, PluginDesc::const_ptr plugin);
-    PluginDesc::const_ptr findPlugin(const std::string& key) const;
-    std::vector<PluginDesc::const_ptr> pluginList() const;
+    PluginDesc::const_ptr findPlugin(const std::string& key);
+    // NB: deserializes all pending plugins of the cache file
+    std::vector<PluginDesc::const_ptr> pluginList();
     // remove factories and plugin descriptions
     void clear();
-    // (de)serialize
+    // (de)serialize; the format is detected automatically when reading.
     // throws an Error exception on failure!
     void read(const std::string& path, bool update = true);
-    void write(const std::string& path) const;
+    void write(const std::string& path, Format format = Format::Binary);
     // read a single plugin description
     PluginDesc::const_ptr readPlugin(std::istream& stream);
  private:
+    void doReadText(const std::string& path, bool update);
+    void doReadBinary(const std::string& path, bool update);
+    bool checkException(const std::string& path, double timestamp);
     PluginDesc::const_ptr doReadPlugin(std::istream& stream, double timestamp,
                                        int versionMajor, int versionMinor, int versionPatch);
-    void doWrite(const std::string& path) const;
+    PluginDesc::const_ptr doFindPlugin(const std::string& key) const;
+    bool hasPendingPlugins(const std::string& key, bool isPath) const;
+    void readPendingPlugins(const std::string& key, bool isPath);
+    void readPendingPlugin(int index);
+    void readAllPendingPlugins();
+    void doWrite(const std::string& path, Format format);
+    using PluginMap = std::unordered_map<PluginDesc::const_ptr, std::vector<std::string>>;
+    using PendingPluginList = std::vector<std::pair<const PluginRecord *, std::vector<std::string>>>;
+    void doWriteBinary(const std::string& path, const PluginMap& pluginMap,
+                       const PendingPluginList& pendingPlugins) const;
+    void doWriteText(const std::string& path, const PluginMap& pluginMap,
+                     const PendingPluginList& pendingPlugins) const;
     std::unordered_map<std::string, IFactory::ptr> factories_;
     enum {
         NATIVE = 0,
@@ -47,6 +77,7 @@ class PluginDictionary {
     };
     std::array<std::unordered_map<std::string, PluginDesc::const_ptr>, 2> plugins_;
     std::unordered_set<std::string> exceptions_;
+    std::unique_ptr<PluginCache> cache_; // binary cache file
     mutable SharedMutex mutex_;
 };
 
@@ -3,12 +3,16 @@
 #include "Log.h"
 #include "FileUtils.h"
 #include "MiscUtils.h"
+#include "ProbeWorker.h"
 #if USE_VST2
  #include "VST2Plugin.h"
 #endif
 #if USE_VST3
  #include "VST3Plugin.h"
 #endif
+#if USE_DUMMY_PLUGIN
+ #include "DummyPlugin.h"
+#endif
 
 // for probing
 #ifdef _WIN32
@@ -35,6 +39,11 @@ namespace vst {
 IFactory::ptr IFactory::load(const std::string& path, bool probe){
     // LOG_DEBUG("IFactory: loading " << path);
     auto ext = fileExtension(path);
+#if USE_DUMMY_PLUGIN
+    if (ext == ".dummy"){
+        return std::make_shared<DummyFactory>(path);
+    }
+#endif
     if (ext == ".vst3"){
     #if USE_VST3
         if (!pathExists(path)){
@@ -165,6 +174,35 @@ int PluginFactory::numPlugins() const {
     return plugins_.size();
 }
 
+// read the plugin info resp. error message of a probe process, see host.cpp
+static void readProbeResult(int status, std::istream& stream,
+                            PluginDesc& desc, ProbeResult& result){
+    if (status == EXIT_SUCCESS){
+        try {
+            desc.deserialize(stream);
+        } catch (const Error& e) {
+            LOG_ERROR("VSTPlugin: could not read plugin info: "
+                      + std::string(e.what()));
+            result.error = e;
+        }
+    } else {
+        int err;
+        std::string msg;
+        stream >> err;
+        if (stream){
+            std::getline(stream, msg); // skip newline
+            std::getline(stream, msg); // read message
+        } else {
+            // happens in certain cases, e.g. the plugin destructor
+            // terminates the probe process with exit code 1.
+            err = (int)Error::UnknownError;
+            msg = "(uncaught exception)";
+        }
+        LOG_DEBUG("code: " << err << ", msg: " << msg);
+        result.error = Error((Error::ErrorCode)err, msg);
+    }
+}
+
 PluginFactory::ProbeResultFuture PluginFactory::doProbePlugin(float timeout, bool nonblocking){
     return doProbePlugin(PluginDesc::SubPlugin { "", -1 }, timeout, nonblocking);
 }
@@ -175,6 +213,11 @@ PluginFactory::ProbeResultFuture PluginFactory::doProbePlugin(
 {
     auto desc = std::make_shared<PluginDesc>(shared_from_this());
     desc->name = sub.name; // necessary for error reporting, will be overriden later
+
+    if (getProbeWorkers()){
+        return doProbePluginWorker(std::move(desc), sub, timeout, nonblocking);
+    }
+
     // create temp file path
     std::stringstream ss;
     // desc address should be unique as long as PluginDesc instances are retained.
@@ -187,12 +230,14 @@ PluginFactory::ProbeResultFuture PluginFactory::doProbePlugin(
         throw Error(Error::SystemError, "couldn't get host app");
     }
     auto process = app->probe(path_, sub.id, tmpPath);
+    // for waitProbes()
+    auto event = nonblocking ? ProbeEvent::create(process, timeout) : nullptr;
     // NB: std::function doesn't allow move-only types in a lambda capture,
     // so we have to wrap ProcessHandle in a std::shared_ptr...
     return [desc=std::move(desc),
             tmpPath=std::move(tmpPath),
             process=std::make_shared<ProcessHandle>(std::move(process)),
-            timeout, nonblocking,
+            event=std::move(event), timeout, nonblocking,
             start=std::chrono::system_clock::now()]
             (ProbeResult& result) {
         result.plugin = desc;
@@ -242,13 +287,7 @@ PluginFactory::ProbeResultFuture PluginFactory::doProbePlugin(
         if (exitCode == EXIT_SUCCESS) {
             // get info from temp file
             if (file.is_open()) {
-                try {
-                    desc->deserialize(file);
-                } catch (const Error& e) {
-                    LOG_ERROR("VSTPlugin: could not read plugin info: "
-                              + std::string(e.what()));
-                    result.error = e;
-                }
+                readProbeResult(exitCode, file, *desc, result);
             } else {
             #if USE_WINE
                 // On Wine, the child process (wine) might exit with 0
@@ -270,20 +309,7 @@ PluginFactory::ProbeResultFuture PluginFactory::doProbePlugin(
         } else if (exitCode == EXIT_FAILURE) {
             // get error from temp file
             if (file.is_open()) {
-                int err;
-                std::string msg;
-                file >> err;
-                if (file){
-                    std::getline(file, msg); // skip newline
-                    std::getline(file, msg); // read message
-                } else {
-                    // happens in certain cases, e.g. the plugin destructor
-                    // terminates the probe process with exit code 1.
-                    err = (int)Error::UnknownError;
-                    msg = "(uncaught exception)";
-                }
-                LOG_DEBUG("code: " << err << ", msg: " << msg);
-                result.error = Error((Error::ErrorCode)err, msg);
+                readProbeResult(exitCode, file, *desc, result);
             } else {
                 result.error = Error(Error::UnknownError, "(uncaught exception)");
             }
@@ -295,6 +321,64 @@ PluginFactory::ProbeResultFuture PluginFactory::doProbePlugin(
     };
 }
 
+// probe a plugin in a (long-lived) worker process, see ProbeWorker
+PluginFactory::ProbeResultFuture PluginFactory::doProbePluginWorker(
+        PluginDesc::ptr desc, const PluginDesc::SubPlugin& sub,
+        float timeout, bool nonblocking)
+{
+    auto worker = ProbeWorker::get(arch_);
+    try {
+        worker->request(path_, sub.id);
+    } catch (const Error& e) {
+        // the idle worker might have died in the meantime; try again with a new one.
+        LOG_DEBUG("VSTPlugin: " << e.what() << "; retry with new worker");
+        worker = std::make_shared<ProbeWorker>(arch_);
+        worker->request(path_, sub.id);
+    }
+    // for waitProbes()
+    auto event = nonblocking ? worker->makeEvent(timeout) : nullptr;
+    return [desc=std::move(desc), worker=std::move(worker),
+            event=std::move(event), timeout, nonblocking,
+            start=std::chrono::system_clock::now()]
+            (ProbeResult& result) mutable {
+        result.plugin = desc;
+        result.total = 1;
+        ProbeReply reply;
+        std::string data;
+        try {
+            // in non-blocking mode we only check for the reply
+            double wait = nonblocking ? 0 : (timeout > 0 ? timeout : -1);
+            if (!worker->getReply(reply, data, wait)) {
+                if (timeout > 0) {
+                    using seconds = std::chrono::duration<double>;
+                    auto now = std::chrono::system_clock::now();
+                    auto elapsed = std::chrono::duration_cast<seconds>(now - start).count();
+                    if (elapsed > timeout) {
+                        // the worker will be replaced
+                        worker->terminate();
+                        worker = nullptr;
+                        std::stringstream msg;
+                        msg << "subprocess timed out after " << timeout << " seconds!";
+                        throw Error(Error::SystemError, msg.str());
+                    }
+                }
+                return false;
+            }
+        } catch (const Error& e){
+            result.error = e;
+            return true;
+        }
+        // the worker can be reused for the next plugin
+        ProbeWorker::release(std::move(worker));
+        worker = nullptr;
+        event = nullptr;
+
+        std::stringstream stream(data);
+        readProbeResult(reply.status, stream, *desc, result);
+        return true;
+    };
+}
+
 std::vector<PluginDesc::ptr> PluginFactory::doProbePlugins(
         const PluginDesc::SubPluginList& pluginList,
         float timeout, ProbeCallback callback)
@@ -307,7 +391,7 @@ std::vector<PluginDesc::ptr> PluginFactory::doProbePlugins(
     // LOG_DEBUG("numPlugins: " << numPlugins);
     auto plugin = pluginList.begin();
     int count = 0;
-    int maxNumFutures = std::min<int>(PROBE_FUTURES, numPlugins);
+    int maxNumFutures = std::min<int>(getProbeConcurrency(), numPlugins);
     std::vector<ProbeResultFuture> futures;
     while (count < numPlugins) {
         // push futures
@@ -323,6 +407,7 @@ std::vector<PluginDesc::ptr> PluginFactory::doProbePlugins(
             }
         }
         // collect results
+        bool didSomething = false;
         for (auto it = futures.begin(); it != futures.end();) {
             ProbeResult result;
             // call future (non-blocking)
@@ -337,11 +422,15 @@ std::vector<PluginDesc::ptr> PluginFactory::doProbePlugins(
                 }
                 // remove future
                 it = futures.erase(it);
+                didSomething = true;
             } else {
                 it++;
             }
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(PROBE_SLEEP_MS));
+        if (!didSomething && !futures.empty()){
+            // wait for any future to become ready
+            waitProbes();
+        }
     }
     return results;
 }
@@ -9,11 +9,10 @@
 // #define PLUGIN_LIMIT 50
 
 // We probe sub-plugins asynchronously with "futures".
-// Each future spawns a subprocess and then waits for the results.
-#define PROBE_FUTURES 8 // max. number of futures to wait for
-
-// The sleep interval when probing several plugins in a factory asynchronously
-#define PROBE_SLEEP_MS 2
+// Each future sends a request to a worker process (or spawns a
+// new subprocess, see setProbeWorkers()) and then waits for the results.
+// The number of parallel futures is given by getProbeConcurrency();
+// we don't poll, but wait for the next result with waitProbes().
 
 namespace vst {
 
@@ -42,6 +41,9 @@ class PluginFactory :
     ProbeResultFuture doProbePlugin(float timeout, bool nonblocking);
     ProbeResultFuture doProbePlugin(const PluginDesc::SubPlugin& subplugin,
                                     float timeout, bool nonblocking);
+    ProbeResultFuture doProbePluginWorker(PluginDesc::ptr desc,
+                                          const PluginDesc::SubPlugin& subplugin,
+                                          float timeout, bool nonblocking);
     std::vector<PluginDesc::ptr> doProbePlugins(
             const PluginDesc::SubPluginList& pluginList,
             float timeout, ProbeCallback callback);
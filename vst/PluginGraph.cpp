@@ -0,0 +1,910 @@
+#include "PluginGraph.h"
+
+#include "FileUtils.h"
+#include "Log.h"
+#include "MiscUtils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <assert.h>
+
+namespace vst {
+
+// ThreadedPlugin.cpp
+void setCurrentThreadDSP();
+bool isCurrentThreadDSP();
+
+/*////////////////////// PluginGraph ///////////////////////*/
+
+PluginGraph::PluginGraph() {
+    threadPool_ = &DSPThreadPool::instance(); // cache for performance
+    // default: a single stereo input and output
+    inputChannels_.push_back(2);
+    outputChannels_.push_back(2);
+    updateDesc();
+    LOG_DEBUG("PluginGraph");
+}
+
+PluginGraph::~PluginGraph() {
+    for (auto& node : nodes_){
+        node->plugin->setListener(nullptr);
+    }
+}
+
+int PluginGraph::addNode(IPlugin::ptr plugin) {
+    auto node = std::make_unique<Node>();
+    node->graph = this;
+    node->index = nodes_.size();
+    node->plugin = std::move(plugin);
+    // busses from plugin description
+    auto& info = node->plugin->info();
+    std::vector<int> inputs, outputs;
+    for (auto& bus : info.inputs){
+        inputs.push_back(bus.numChannels);
+    }
+    for (auto& bus : info.outputs){
+        outputs.push_back(bus.numChannels);
+    }
+    node->numInputs = inputs.size();
+    if (node->numInputs > 0){
+        node->inputs = std::make_unique<Bus[]>(node->numInputs);
+        for (int i = 0; i < node->numInputs; ++i){
+            node->inputs[i] = Bus(inputs[i]);
+        }
+    }
+    node->numOutputs = outputs.size();
+    if (node->numOutputs > 0){
+        node->outputs = std::make_unique<Bus[]>(node->numOutputs);
+        for (int i = 0; i < node->numOutputs; ++i){
+            node->outputs[i] = Bus(outputs[i]);
+        }
+    }
+    node->plugin->setNumSpeakers(inputs.data(), inputs.size(),
+                                 outputs.data(), outputs.size());
+    if (setup_){
+        node->plugin->setupProcessing(sampleRate_, blockSize_, precision_, mode_);
+    }
+    node->plugin->setListener(node.get());
+
+    nodes_.push_back(std::move(node));
+    dirty_ = true;
+
+    updateDesc();
+
+    return nodes_.size() - 1;
+}
+
+IPlugin * PluginGraph::getNode(int node) const {
+    if (node >= 0 && node < (int)nodes_.size()){
+        return nodes_[node]->plugin.get();
+    } else {
+        return nullptr;
+    }
+}
+
+void PluginGraph::connect(int srcNode, int srcBus, int dstNode, int dstBus) {
+    // check source
+    if (srcNode == input){
+        if (srcBus < 0 || srcBus >= (int)inputChannels_.size()){
+            throw Error("PluginGraph: bad input bus " + std::to_string(srcBus));
+        }
+    } else if (srcNode >= 0 && srcNode < (int)nodes_.size()){
+        if (srcBus < 0 || srcBus >= nodes_[srcNode]->numOutputs){
+            throw Error("PluginGraph: bad output bus " + std::to_string(srcBus)
+                        + " for node " + std::to_string(srcNode));
+        }
+    } else {
+        throw Error("PluginGraph: bad source node " + std::to_string(srcNode));
+    }
+    // check destination
+    if (dstNode == output){
+        if (dstBus < 0 || dstBus >= (int)outputChannels_.size()){
+            throw Error("PluginGraph: bad output bus " + std::to_string(dstBus));
+        }
+    } else if (dstNode >= 0 && dstNode < (int)nodes_.size()){
+        if (dstBus < 0 || dstBus >= nodes_[dstNode]->numInputs){
+            throw Error("PluginGraph: bad input bus " + std::to_string(dstBus)
+                        + " for node " + std::to_string(dstNode));
+        }
+    } else {
+        throw Error("PluginGraph: bad destination node " + std::to_string(dstNode));
+    }
+    // check for cycles
+    if (srcNode >= 0 && dstNode >= 0){
+        if (srcNode == dstNode || isReachable(dstNode, srcNode)){
+            throw Error("PluginGraph: connection would create a cycle");
+        }
+    }
+    // ignore duplicates
+    for (auto& e : edges_){
+        if (e.srcNode == srcNode && e.srcBus == srcBus
+                && e.dstNode == dstNode && e.dstBus == dstBus){
+            return;
+        }
+    }
+    Edge edge;
+    edge.srcNode = srcNode;
+    edge.srcBus = srcBus;
+    edge.dstNode = dstNode;
+    edge.dstBus = dstBus;
+    edges_.push_back(std::move(edge));
+    dirty_ = true;
+}
+
+bool PluginGraph::disconnect(int srcNode, int srcBus, int dstNode, int dstBus) {
+    for (auto it = edges_.begin(); it != edges_.end(); ++it){
+        if (it->srcNode == srcNode && it->srcBus == srcBus
+                && it->dstNode == dstNode && it->dstBus == dstBus){
+            edges_.erase(it);
+            dirty_ = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PluginGraph::isReachable(int from, int to) const {
+    std::vector<int> stack;
+    std::vector<bool> visited(nodes_.size(), false);
+    stack.push_back(from);
+    while (!stack.empty()){
+        auto node = stack.back();
+        stack.pop_back();
+        if (node == to){
+            return true;
+        }
+        if (visited[node]){
+            continue;
+        }
+        visited[node] = true;
+        for (auto& e : edges_){
+            if (e.srcNode == node && e.dstNode >= 0){
+                stack.push_back(e.dstNode);
+            }
+        }
+    }
+    return false;
+}
+
+void PluginGraph::updateDesc() {
+    auto desc = std::make_unique<PluginDesc>(nullptr);
+    desc->name = "PluginGraph";
+    for (size_t i = 0; i < inputChannels_.size(); ++i){
+        PluginDesc::Bus bus;
+        bus.numChannels = inputChannels_[i];
+        bus.type = (i == 0) ? PluginDesc::Bus::Main : PluginDesc::Bus::Aux;
+        desc->inputs.push_back(bus);
+    }
+    for (size_t i = 0; i < outputChannels_.size(); ++i){
+        PluginDesc::Bus bus;
+        bus.numChannels = outputChannels_[i];
+        bus.type = (i == 0) ? PluginDesc::Bus::Main : PluginDesc::Bus::Aux;
+        desc->outputs.push_back(bus);
+    }
+    uint32_t flags = PluginDesc::SinglePrecision | PluginDesc::DoublePrecision;
+    int offset = 0;
+    for (auto& node : nodes_){
+        auto& info = node->plugin->info();
+        node->paramOffset = offset;
+        for (auto& param : info.parameters){
+            PluginDesc::Param p = param;
+            p.name = std::to_string(node->index) + ":" + param.name;
+            p.id = offset; // unique
+            desc->addParameter(std::move(p));
+            offset++;
+        }
+        // all nodes must support the precision
+        flags &= (info.flags | ~(PluginDesc::SinglePrecision | PluginDesc::DoublePrecision));
+        flags |= (info.flags & (PluginDesc::MidiInput | PluginDesc::MidiOutput
+                                | PluginDesc::SysexInput | PluginDesc::SysexOutput));
+    }
+    desc->flags = flags;
+    // NB: this invalidates references to the previous description!
+    desc_ = std::move(desc);
+}
+
+void PluginGraph::update() {
+    if (!setup_){
+        return;
+    }
+    // pending latency changes, see applyLatency()
+    latencyPending_.store(false, std::memory_order_relaxed);
+    for (auto& node : nodes_){
+        auto latency = node->newLatency.exchange(-1, std::memory_order_acquire);
+        if (latency >= 0 && latency != node->latency){
+            node->latency = latency;
+            latencyDirty_ = true;
+        }
+    }
+    if (!dirty_){
+        if (latencyDirty_){
+            // only update latency and delay lines
+            auto oldLatency = latency_.load(std::memory_order_relaxed);
+            updateLatency();
+            updateBuffers();
+            // notify about deferred latency changes
+            auto latency = latency_.load(std::memory_order_relaxed);
+            if (latency != oldLatency && listener_){
+                listener_->latencyChanged(latency);
+            }
+        }
+        return;
+    }
+    // topology
+    outputEdges_.clear();
+    for (auto& node : nodes_){
+        node->incoming.clear();
+        node->successors.clear();
+        node->numPredecessors = 0;
+        node->latency = node->plugin->getLatencySamples();
+    }
+    for (int i = 0; i < (int)edges_.size(); ++i){
+        auto& e = edges_[i];
+        if (e.dstNode == output){
+            outputEdges_.push_back(i);
+        } else {
+            auto& dst = *nodes_[e.dstNode];
+            dst.incoming.push_back(i);
+            if (e.srcNode >= 0){
+                auto& succ = nodes_[e.srcNode]->successors;
+                if (std::find(succ.begin(), succ.end(), e.dstNode) == succ.end()){
+                    succ.push_back(e.dstNode);
+                    dst.numPredecessors++;
+                }
+            }
+        }
+    }
+
+    updateLatency();
+
+    updateBuffers();
+
+    dirty_ = false;
+}
+
+void PluginGraph::updateLatency() {
+    // sort nodes in topological order (Kahn's algorithm)
+    order_.clear();
+    std::vector<int> count;
+    for (auto& node : nodes_){
+        count.push_back(node->numPredecessors);
+        if (node->numPredecessors == 0){
+            order_.push_back(node->index);
+        }
+    }
+    for (size_t i = 0; i < order_.size(); ++i){
+        for (auto& succ : nodes_[order_[i]]->successors){
+            if (--count[succ] == 0){
+                order_.push_back(succ);
+            }
+        }
+    }
+    assert(order_.size() == nodes_.size());
+
+    auto latency = computeLatency();
+    for (auto& e : edges_){
+        e.delay = edgeDelay(e, latency);
+    }
+    latency_.store(latency, std::memory_order_relaxed);
+
+    latencyDirty_ = false;
+
+    LOG_DEBUG("PluginGraph: latency = " << latency);
+}
+
+// output latency of the edge's source node
+int PluginGraph::edgeLatency(const Edge& edge) const {
+    if (edge.srcNode == input){
+        return 0;
+    } else {
+        auto& src = *nodes_[edge.srcNode];
+        return src.arrival + src.latency;
+    }
+}
+
+// the delay which aligns the edge with all other inputs of its destination
+int PluginGraph::edgeDelay(const Edge& edge, int latency) const {
+    auto arrival = (edge.dstNode == output) ? latency : nodes_[edge.dstNode]->arrival;
+    return arrival - edgeLatency(edge);
+}
+
+// Compute the arrival time of all nodes and return the total latency.
+// The arrival time of a node is the max. latency of all its inputs;
+// all other inputs are delayed accordingly, see edgeDelay().
+// NB: doesn't allocate memory, so we can also call it in the audio thread.
+int PluginGraph::computeLatency() {
+    for (auto& index : order_){
+        auto& node = *nodes_[index];
+        node.arrival = 0;
+        for (auto& i : node.incoming){
+            node.arrival = std::max<int>(node.arrival, edgeLatency(edges_[i]));
+        }
+    }
+    int latency = 0;
+    for (auto& i : outputEdges_){
+        latency = std::max<int>(latency, edgeLatency(edges_[i]));
+    }
+    return latency;
+}
+
+// Apply pending latency changes at the start of a block (in the audio thread).
+// The delay lines have some headroom (see updateBuffers()), so we can usually
+// change the delays in place. Otherwise we have to wait for update(); until then
+// we keep the old delays and the host is not notified, so that the reported
+// latency always matches the actual delay compensation.
+void PluginGraph::applyLatency() {
+    bool changed = false;
+    for (auto& node : nodes_){
+        auto latency = node->newLatency.exchange(-1, std::memory_order_acquire);
+        if (latency >= 0 && latency != node->latency){
+            node->latency = latency;
+            changed = true;
+        }
+    }
+    if (!changed){
+        return;
+    }
+    auto latency = computeLatency();
+    for (auto& e : edges_){
+        if (edgeDelay(e, latency) > e.maxDelay){
+            LOG_DEBUG("PluginGraph: delay line too short; defer latency change");
+            latencyDirty_ = true;
+            return;
+        }
+    }
+    for (auto& e : edges_){
+        e.delay = edgeDelay(e, latency);
+    }
+    latencyDirty_ = false;
+    auto oldLatency = latency_.exchange(latency, std::memory_order_relaxed);
+    if (latency != oldLatency && listener_){
+        listener_->latencyChanged(latency);
+    }
+}
+
+void PluginGraph::updateBuffers() {
+    const int sampleSize = (precision_ == ProcessPrecision::Double) ?
+        sizeof(double) : sizeof(float);
+    const int incr = blockSize_ * sampleSize;
+    // node busses
+    for (auto& node : nodes_){
+        int total = 0;
+        for (int i = 0; i < node->numInputs; ++i){
+            total += node->inputs[i].numChannels;
+        }
+        for (int i = 0; i < node->numOutputs; ++i){
+            total += node->outputs[i].numChannels;
+        }
+        node->buffer.clear(); // force zero initialization
+        node->buffer.resize(total * incr);
+        auto buf = node->buffer.data();
+        auto setChannels = [&](Bus& bus){
+            for (int i = 0; i < bus.numChannels; ++i){
+                bus.channelData32[i] = (float *)buf; // float* and double* have the same size
+                buf += incr;
+            }
+        };
+        for (int i = 0; i < node->numInputs; ++i){
+            setChannels(node->inputs[i]);
+        }
+        for (int i = 0; i < node->numOutputs; ++i){
+            setChannels(node->outputs[i]);
+        }
+    }
+    // delay lines; every edge gets a delay line with some headroom,
+    // so that we can apply most latency changes in the audio thread.
+    for (auto& e : edges_){
+        int nchannels = (e.srcNode == input) ? inputChannels_[e.srcBus]
+            : nodes_[e.srcNode]->outputs[e.srcBus].numChannels;
+        e.maxDelay = std::max<int>(e.delay * 2, blockSize_);
+        e.delaySize = e.maxDelay + blockSize_;
+        e.delayPos = 0;
+        e.delayBuffer.clear(); // force zero initialization
+        e.delayBuffer.resize(nchannels * e.delaySize * sampleSize);
+    }
+}
+
+void PluginGraph::setupProcessing(double sampleRate, int maxBlockSize,
+                                  ProcessPrecision precision, ProcessMode mode) {
+    for (auto& node : nodes_){
+        node->plugin->setupProcessing(sampleRate, maxBlockSize, precision, mode);
+    }
+    sampleRate_ = sampleRate;
+    blockSize_ = maxBlockSize;
+    precision_ = precision;
+    mode_ = mode;
+    setup_ = true;
+    dirty_ = true;
+
+    update();
+}
+
+void PluginGraph::suspend() {
+    for (auto& node : nodes_){
+        node->plugin->suspend();
+    }
+}
+
+void PluginGraph::resume() {
+    update();
+
+    for (auto& node : nodes_){
+        node->events.reserve();
+    }
+
+    for (auto& node : nodes_){
+        node->plugin->resume();
+    }
+}
+
+void PluginGraph::setNumSpeakers(int *input, int numInputs,
+                                 int *output, int numOutputs) {
+    inputChannels_.assign(input, input + numInputs);
+    outputChannels_.assign(output, output + numOutputs);
+    // remove connections to non-existing busses
+    edges_.erase(std::remove_if(edges_.begin(), edges_.end(), [&](auto& e){
+        return (e.srcNode == PluginGraph::input && e.srcBus >= numInputs)
+            || (e.dstNode == PluginGraph::output && e.dstBus >= numOutputs);
+    }), edges_.end());
+    dirty_ = true;
+
+    updateDesc();
+    update();
+}
+
+template<typename T>
+void PluginGraph::readEdge(Edge& edge, AudioBus& bus, int numSamples) {
+    const AudioBus *src;
+    if (edge.srcNode == input){
+        if (edge.srcBus >= processData_->numInputs){
+            return;
+        }
+        src = &processData_->inputs[edge.srcBus];
+    } else {
+        src = &nodes_[edge.srcNode]->outputs[edge.srcBus];
+    }
+    auto nchannels = std::min<int>(src->numChannels, bus.numChannels);
+    for (int i = 0; i < nchannels; ++i){
+        auto in = (const T *)src->channelData32[i]; // cast to actual size
+        auto out = (T *)bus.channelData32[i];
+        // always write the input, so that the delay can be changed in place
+        auto delay = (T *)edge.delayBuffer.data() + i * edge.delaySize;
+        auto size = edge.delaySize;
+        auto pos = edge.delayPos;
+        for (int j = 0; j < numSamples; ++j){
+            delay[pos] = in[j];
+            if (++pos >= size){
+                pos = 0;
+            }
+        }
+        if (edge.delay > 0){
+            // read delayed signal
+            pos = edge.delayPos - edge.delay;
+            if (pos < 0){
+                pos += size;
+            }
+            for (int j = 0; j < numSamples; ++j){
+                out[j] += delay[pos];
+                if (++pos >= size){
+                    pos = 0;
+                }
+            }
+        } else {
+            for (int j = 0; j < numSamples; ++j){
+                out[j] += in[j];
+            }
+        }
+    }
+    edge.delayPos = (edge.delayPos + numSamples) % edge.delaySize;
+}
+
+template<typename T>
+void PluginGraph::processNode(Node& node) {
+    auto numSamples = node.task.numSamples;
+    // sum inputs
+    for (int i = 0; i < node.numInputs; ++i){
+        auto& bus = node.inputs[i];
+        for (int j = 0; j < bus.numChannels; ++j){
+            auto chn = (T *)bus.channelData32[j];
+            std::fill(chn, chn + numSamples, 0);
+        }
+    }
+    for (auto& i : node.incoming){
+        auto& edge = edges_[i];
+        readEdge<T>(edge, node.inputs[edge.dstBus], numSamples);
+    }
+
+    ProcessData data;
+    data.precision = precision_;
+    data.mode = mode_;
+    data.numSamples = numSamples;
+    data.inputs = node.inputs.get();
+    data.numInputs = node.numInputs;
+    data.outputs = node.outputs.get();
+    data.numOutputs = node.numOutputs;
+
+    auto start = DSPThreadPool::getTime();
+
+    node.plugin->process(data);
+
+    // cost estimate for the next block, see DSPThreadPool::push()
+    node.task.updateCost(DSPThreadPool::getTime() - start);
+
+    // schedule successors which are ready
+    for (auto& i : node.successors){
+        auto& succ = *nodes_[i];
+        if (succ.pending.fetch_sub(1, std::memory_order_acq_rel) == 1){
+            schedule(succ);
+        }
+    }
+
+    if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1){
+        done_.set();
+    }
+}
+
+void PluginGraph::schedule(Node& node) {
+    if (!threadPool_->push(&node.task)){
+        // process on this thread
+        node.task.cb(node.task.data, node.task.numSamples);
+    }
+}
+
+template<typename T>
+void PluginGraph::doProcess(ProcessData& data) {
+    if (dirty_){
+        // graph has changed, but hasn't been updated yet.
+        bypass(data);
+        return;
+    }
+    if (latencyPending_.exchange(false, std::memory_order_acquire)){
+        applyLatency();
+    }
+    processData_ = &data;
+    setCurrentThreadDSP(); // !
+
+    remaining_.store(nodes_.size(), std::memory_order_relaxed);
+    for (auto& node : nodes_){
+        node->pending.store(node->numPredecessors, std::memory_order_relaxed);
+        node->task.cb = [](void *data, int){
+            auto node = static_cast<Node *>(data);
+            node->graph->processNode<T>(*node);
+        };
+        node->task.data = node.get();
+        node->task.numSamples = data.numSamples;
+    }
+    // schedule all nodes without dependencies
+    for (auto& node : nodes_){
+        if (node->numPredecessors == 0){
+            schedule(*node);
+        }
+    }
+    // help processing until all nodes are done.
+    if (!nodes_.empty()){
+        threadPool_->wait(done_, waitEstimate_);
+    }
+    // write graph outputs
+    for (int i = 0; i < data.numOutputs; ++i){
+        auto& bus = data.outputs[i];
+        for (int j = 0; j < bus.numChannels; ++j){
+            auto chn = (T *)bus.channelData32[j];
+            std::fill(chn, chn + data.numSamples, 0);
+        }
+    }
+    for (auto& i : outputEdges_){
+        auto& edge = edges_[i];
+        if (edge.dstBus < data.numOutputs){
+            readEdge<T>(edge, data.outputs[edge.dstBus], data.numSamples);
+        }
+    }
+
+    processData_ = nullptr;
+
+    sendEvents();
+}
+
+void PluginGraph::process(ProcessData& data) {
+    if (data.precision == ProcessPrecision::Double){
+        doProcess<double>(data);
+    } else {
+        doProcess<float>(data);
+    }
+}
+
+void PluginGraph::sendEvents() {
+    for (auto& node : nodes_){
+        for (auto& event : node->events){
+            switch (event.type){
+            case Command::ParamAutomated:
+                if (listener_){
+                    listener_->parameterAutomated(node->paramOffset + event.paramAutomated.index,
+                                                  event.paramAutomated.value);
+                }
+                break;
+            case Command::MidiReceived:
+                if (listener_){
+                    listener_->midiEvent(event.midi);
+                }
+                break;
+            case Command::SysexReceived:
+                if (listener_){
+                    listener_->sysexEvent(event.sysex);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        node->events.clear();
+    }
+}
+
+void PluginGraph::setBypass(Bypass state) {
+    for (auto& node : nodes_){
+        node->plugin->setBypass(state);
+    }
+}
+
+void PluginGraph::setTempoBPM(double tempo) {
+    for (auto& node : nodes_){
+        node->plugin->setTempoBPM(tempo);
+    }
+}
+
+void PluginGraph::setTimeSignature(int numerator, int denominator) {
+    for (auto& node : nodes_){
+        node->plugin->setTimeSignature(numerator, denominator);
+    }
+}
+
+void PluginGraph::setTransportPlaying(bool play) {
+    for (auto& node : nodes_){
+        node->plugin->setTransportPlaying(play);
+    }
+}
+
+void PluginGraph::setTransportRecording(bool record) {
+    for (auto& node : nodes_){
+        node->plugin->setTransportRecording(record);
+    }
+}
+
+void PluginGraph::setTransportAutomationWriting(bool writing) {
+    for (auto& node : nodes_){
+        node->plugin->setTransportAutomationWriting(writing);
+    }
+}
+
+void PluginGraph::setTransportAutomationReading(bool reading) {
+    for (auto& node : nodes_){
+        node->plugin->setTransportAutomationReading(reading);
+    }
+}
+
+void PluginGraph::setTransportCycleActive(bool active) {
+    for (auto& node : nodes_){
+        node->plugin->setTransportCycleActive(active);
+    }
+}
+
+void PluginGraph::setTransportCycleStart(double beat) {
+    for (auto& node : nodes_){
+        node->plugin->setTransportCycleStart(beat);
+    }
+}
+
+void PluginGraph::setTransportCycleEnd(double beat) {
+    for (auto& node : nodes_){
+        node->plugin->setTransportCycleEnd(beat);
+    }
+}
+
+void PluginGraph::setTransportPosition(double beat) {
+    for (auto& node : nodes_){
+        node->plugin->setTransportPosition(beat);
+    }
+}
+
+double PluginGraph::getTransportPosition() const {
+    return nodes_.empty() ? 0 : nodes_[0]->plugin->getTransportPosition();
+}
+
+// MIDI and SysEx messages are sent to all nodes which accept them.
+void PluginGraph::sendMidiEvent(const MidiEvent& event) {
+    for (auto& node : nodes_){
+        if (node->plugin->info().midiInput()){
+            node->plugin->sendMidiEvent(event);
+        }
+    }
+}
+
+void PluginGraph::sendSysexEvent(const SysexEvent& event) {
+    for (auto& node : nodes_){
+        if (node->plugin->info().sysexInput()){
+            node->plugin->sendSysexEvent(event);
+        }
+    }
+}
+
+PluginGraph::Node * PluginGraph::findParam(int& index) const {
+    for (auto& node : nodes_){
+        auto n = node->plugin->info().numParameters();
+        if (index >= node->paramOffset && index < node->paramOffset + n){
+            index -= node->paramOffset;
+            return node.get();
+        }
+    }
+    return nullptr;
+}
+
+void PluginGraph::setParameter(int index, float value, int sampleOffset) {
+    if (auto node = findParam(index)){
+        node->plugin->setParameter(index, value, sampleOffset);
+    }
+}
+
+bool PluginGraph::setParameter(int index, std::string_view str, int sampleOffset) {
+    if (auto node = findParam(index)){
+        return node->plugin->setParameter(index, str, sampleOffset);
+    } else {
+        return false;
+    }
+}
+
+float PluginGraph::getParameter(int index) const {
+    if (auto node = findParam(index)){
+        return node->plugin->getParameter(index);
+    } else {
+        return 0;
+    }
+}
+
+size_t PluginGraph::getParameterString(int index, ParamStringBuffer& buffer) const {
+    if (auto node = findParam(index)){
+        return node->plugin->getParameterString(index, buffer);
+    } else {
+        buffer[0] = 0;
+        return 0;
+    }
+}
+
+// program data: number of nodes (uint32) followed by the
+// size (uint32) and program data of every node.
+void PluginGraph::readProgramFile(const std::string& path) {
+    File file(path, File::READ);
+    if (!file.is_open()){
+        throw Error("couldn't open file " + path);
+    }
+    IPlugin::readProgramData(file.readAll());
+}
+
+void PluginGraph::readProgramData(const char *data, size_t size) {
+    auto read = [&](uint32_t& result){
+        if (size < sizeof(result)){
+            throw Error("PluginGraph: bad program data");
+        }
+        memcpy(&result, data, sizeof(result));
+        data += sizeof(result);
+        size -= sizeof(result);
+    };
+    uint32_t numNodes;
+    read(numNodes);
+    if (numNodes != nodes_.size()){
+        throw Error("PluginGraph: wrong number of nodes in program data");
+    }
+    for (auto& node : nodes_){
+        uint32_t n;
+        read(n);
+        if (n > size){
+            throw Error("PluginGraph: bad program data");
+        }
+        node->plugin->readProgramData(data, n);
+        data += n;
+        size -= n;
+    }
+}
+
+void PluginGraph::writeProgramFile(const std::string& path) {
+    File file(path, File::WRITE);
+    if (!file.is_open()){
+        throw Error("couldn't create file " + path);
+    }
+    std::string buffer;
+    writeProgramData(buffer);
+    file.write(buffer.data(), buffer.size());
+}
+
+void PluginGraph::writeProgramData(std::string& buffer) {
+    auto write = [&](uint32_t value){
+        buffer.append((const char *)&value, sizeof(value));
+    };
+    buffer.clear();
+    write(nodes_.size());
+    for (auto& node : nodes_){
+        std::string data;
+        node->plugin->writeProgramData(data);
+        write(data.size());
+        buffer.append(data);
+    }
+}
+
+void PluginGraph::readBankFile(const std::string&) {
+    throw Error("PluginGraph: banks not supported");
+}
+
+void PluginGraph::readBankData(const char *, size_t) {
+    throw Error("PluginGraph: banks not supported");
+}
+
+void PluginGraph::writeBankFile(const std::string&) {
+    throw Error("PluginGraph: banks not supported");
+}
+
+void PluginGraph::writeBankData(std::string&) {
+    throw Error("PluginGraph: banks not supported");
+}
+
+/*////////////////////// Node ///////////////////////*/
+
+// NB: events from DSP threads are queued and sent after processing.
+
+void PluginGraph::Node::parameterAutomated(int index, float value) {
+    if (isCurrentThreadDSP()) {
+        Command e(Command::ParamAutomated);
+        e.paramAutomated.index = index;
+        e.paramAutomated.value = value;
+        events.push(e);
+    } else if (graph->listener_){
+        graph->listener_->parameterAutomated(paramOffset + index, value);
+    }
+}
+
+// NB: can be called from any thread; the change is applied by the
+// audio thread at the next block boundary, see applyLatency().
+void PluginGraph::Node::latencyChanged(int nsamples) {
+    newLatency.store(nsamples, std::memory_order_release);
+    graph->latencyPending_.store(true, std::memory_order_release);
+}
+
+void PluginGraph::Node::updateDisplay() {
+    if (graph->listener_){
+        graph->listener_->updateDisplay();
+    }
+}
+
+void PluginGraph::Node::pluginCrashed() {
+    if (graph->listener_){
+        graph->listener_->pluginCrashed();
+    }
+}
+
+void PluginGraph::Node::midiEvent(const MidiEvent& event) {
+    if (isCurrentThreadDSP()) {
+        Command e(Command::MidiReceived);
+        e.midi = event;
+        events.push(e);
+    } else if (graph->listener_){
+        graph->listener_->midiEvent(event);
+    }
+}
+
+void PluginGraph::Node::sysexEvent(const SysexEvent& event) {
+    if (isCurrentThreadDSP()) {
+        // deep copy!
+        auto data = events.allocate(event.size);
+        if (!data){
+            return; // see CommandBuffer
+        }
+        memcpy(data, event.data, event.size);
+
+        Command e(Command::SysexReceived);
+        e.sysex.data = data;
+        e.sysex.size = event.size;
+        e.sysex.delta = event.delta;
+        events.push(e);
+    } else if (graph->listener_){
+        graph->listener_->sysexEvent(event);
+    }
+}
+
+} // vst
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "Interface.h"
+#include "PluginDesc.h"
+#include "PluginCommand.h"
+#include "ThreadedPlugin.h"
+#include "Bus.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace vst {
+
+// A DAG of plugins with audio connections which itself behaves like a plugin.
+// In every block, each node is scheduled on the DSPThreadPool as soon as all
+// its predecessors have finished, so independent branches run in parallel
+// without the one-block delay of ThreadedPlugin. Connections are delay
+// compensated, so that all signals arriving at a node are aligned.
+//
+// NB: the graph structure (nodes and connections) must not be changed while
+// processing; changes take effect in setupProcessing() resp. resume().
+// Latency changes of individual nodes are applied at the next block boundary
+// (or in resume() if the delay lines are too short); only then the host
+// is notified, so that the reported latency always matches the actual
+// delay compensation.
+// Parameters of all nodes are exposed in node order; the parameter names
+// are prefixed with the node ID, e.g. "0:Cutoff".
+class PluginGraph final : public IPlugin {
+ public:
+    // pseudo nodes for the graph's own input resp. output busses
+    static const int input = -1;
+    static const int output = -2;
+
+    PluginGraph();
+    ~PluginGraph();
+
+    // add a plugin; returns the node ID.
+    // NB: the plugin should not be threaded!
+    int addNode(IPlugin::ptr plugin);
+    IPlugin * getNode(int node) const;
+    int numNodes() const { return nodes_.size(); }
+    // connect an output bus to an input bus. Several connections
+    // to the same input bus are summed.
+    // throws an Error exception if the connection is invalid or would create a cycle.
+    void connect(int srcNode, int srcBus, int dstNode, int dstBus);
+    bool disconnect(int srcNode, int srcBus, int dstNode, int dstBus);
+
+    const PluginDesc& info() const override {
+        return *desc_;
+    }
+
+    void setupProcessing(double sampleRate, int maxBlockSize,
+                         ProcessPrecision precision, ProcessMode mode) override;
+    void process(ProcessData& data) override;
+    void suspend() override;
+    void resume() override;
+    void setBypass(Bypass state) override;
+    void setNumSpeakers(int *input, int numInputs, int *output, int numOutputs) override;
+    int getLatencySamples() override {
+        return latency_.load(std::memory_order_relaxed);
+    }
+
+    void setListener(IPluginListener* listener) override {
+        listener_ = listener;
+    }
+
+    void setTempoBPM(double tempo) override;
+    void setTimeSignature(int numerator, int denominator) override;
+    void setTransportPlaying(bool play) override;
+    void setTransportRecording(bool record) override;
+    void setTransportAutomationWriting(bool writing) override;
+    void setTransportAutomationReading(bool reading) override;
+    void setTransportCycleActive(bool active) override;
+    void setTransportCycleStart(double beat) override;
+    void setTransportCycleEnd(double beat) override;
+    void setTransportPosition(double beat) override;
+    double getTransportPosition() const override;
+
+    void sendMidiEvent(const MidiEvent& event) override;
+    void sendSysexEvent(const SysexEvent& event) override;
+
+    void setParameter(int index, float value, int sampleOffset = 0) override;
+    bool setParameter(int index, std::string_view str, int sampleOffset = 0) override;
+    float getParameter(int index) const override;
+    size_t getParameterString(int index, ParamStringBuffer& buffer) const override;
+
+    // the graph itself doesn't have any programs
+    void setProgram(int) override {}
+    void setProgramName(std::string_view) override {}
+    int getProgram() const override { return 0; }
+    std::string getProgramName() const override { return ""; }
+    std::string getProgramNameIndexed(int) const override { return ""; }
+
+    // program data contains the state of all nodes.
+    void readProgramFile(const std::string& path) override;
+    void readProgramData(const char *data, size_t size) override;
+    void writeProgramFile(const std::string& path) override;
+    void writeProgramData(std::string& buffer) override;
+    void readBankFile(const std::string& path) override;
+    void readBankData(const char *data, size_t size) override;
+    void writeBankFile(const std::string& path) override;
+    void writeBankData(std::string& buffer) override;
+
+    void openEditor(void *) override {}
+    void closeEditor() override {}
+    bool getEditorRect(Rect&) const override { return false; }
+    void updateEditor() override {}
+    void checkEditorSize(int&, int&) const override {}
+    void resizeEditor(int, int) override {}
+    IWindow *getWindow() const override { return nullptr; }
+ private:
+    struct Node;
+
+    struct Edge {
+        int srcNode;
+        int srcBus;
+        int dstNode;
+        int dstBus;
+        // delay compensation
+        int delay = 0;
+        int maxDelay = 0; // see applyLatency()
+        int delaySize = 0;
+        int delayPos = 0;
+        std::vector<char> delayBuffer;
+    };
+
+    struct Node final : IPluginListener {
+        PluginGraph *graph = nullptr;
+        int index = 0;
+        IPlugin::ptr plugin;
+        // busses
+        std::unique_ptr<Bus[]> inputs;
+        int numInputs = 0;
+        std::unique_ptr<Bus[]> outputs;
+        int numOutputs = 0;
+        std::vector<char> buffer;
+        // topology
+        std::vector<int> incoming; // edge indices
+        std::vector<int> successors; // node indices
+        int numPredecessors = 0;
+        std::atomic<int> pending{0};
+        // latency
+        int latency = 0;
+        int arrival = 0;
+        std::atomic<int> newLatency{-1}; // pending latency change
+        // parameters
+        int paramOffset = 0;
+        // scheduling
+        DSPThreadPool::Task task;
+        // events from DSP threads
+        CommandBuffer events;
+
+        // IPluginListener
+        void parameterAutomated(int index, float value) override;
+        void latencyChanged(int nsamples) override;
+        void updateDisplay() override;
+        void pluginCrashed() override;
+        void midiEvent(const MidiEvent& event) override;
+        void sysexEvent(const SysexEvent& event) override;
+    };
+
+    void update();
+    void updateDesc();
+    void updateBuffers();
+    void updateLatency();
+    int computeLatency();
+    int edgeLatency(const Edge& edge) const;
+    int edgeDelay(const Edge& edge, int latency) const;
+    void applyLatency();
+    bool isReachable(int from, int to) const;
+    Node * findParam(int& index) const;
+    template<typename T>
+    void doProcess(ProcessData& data);
+    template<typename T>
+    void processNode(Node& node);
+    template<typename T>
+    void readEdge(Edge& edge, AudioBus& bus, int numSamples);
+    void schedule(Node& node);
+    void sendEvents();
+
+    std::vector<std::unique_ptr<Node>> nodes_;
+    std::vector<Edge> edges_;
+    std::vector<int> outputEdges_;
+    std::vector<int> order_; // topological order
+    std::unique_ptr<PluginDesc> desc_;
+    IPluginListener *listener_ = nullptr;
+    DSPThreadPool *threadPool_;
+    // graph busses
+    std::vector<int> inputChannels_;
+    std::vector<int> outputChannels_;
+    // processing
+    double sampleRate_ = 0;
+    int blockSize_ = 0;
+    ProcessPrecision precision_ = ProcessPrecision::Single;
+    ProcessMode mode_ = ProcessMode::Realtime;
+    const ProcessData *processData_ = nullptr;
+    std::atomic<int> remaining_{0};
+    Event done_; // set when all nodes have finished
+    float waitEstimate_ = 0; // see DSPThreadPool::wait()
+    std::atomic<int> latency_{0};
+    std::atomic<bool> latencyPending_{false}; // see applyLatency()
+    bool setup_ = false;
+    bool dirty_ = true;
+    bool latencyDirty_ = false;
+};
+
+} // vst
@@ -1,4 +1,5 @@
 #include "PluginServer.h"
+#include "ThreadedPlugin.h"
 
 #include "ShmInterface.h"
 #include "Log.h"
@@ -111,15 +112,19 @@ void PluginHandle::handleRequest(const ShmCommand &cmd,
 
         // create input busses
         inputs_ = numInputs > 0 ? std::make_unique<Bus[]>(numInputs) : nullptr;
+        shmInputs_ = numInputs > 0 ? std::make_unique<Bus[]>(numInputs) : nullptr;
         numInputs_ = numInputs;
         for (int i = 0; i < numInputs; ++i){
             inputs_[i] = Bus(input[i]);
+            shmInputs_[i] = Bus(input[i]);
         }
         // create output busses
         outputs_ = numOutputs > 0 ? std::make_unique<Bus[]>(numOutputs) : nullptr;
+        shmOutputs_ = numOutputs > 0 ? std::make_unique<Bus[]>(numOutputs) : nullptr;
         numOutputs_ = numOutputs;
         for (int i = 0; i < numOutputs; ++i){
             outputs_[i] = Bus(output[i]);
+            shmOutputs_[i] = Bus(output[i]);
         }
 
         updateBuffer();
@@ -145,6 +150,78 @@ void PluginHandle::handleRequest(const ShmCommand &cmd,
 
         break;
     }
+    case Command::SetParamValue:
+    {
+        // restore parameters after a crash, see PluginClient::recover().
+        // NB: the plugin is not processing yet.
+        auto param = &cmd;
+        for (;;){
+            plugin_->setParameter(param->paramValue.index, param->paramValue.value,
+                                  param->paramValue.offset);
+            paramState_[param->paramValue.index] = param->paramValue.value;
+            // the request might contain several parameters
+            const void *data;
+            size_t size;
+            if (channel.getMessage(data, size)){
+                param = static_cast<const ShmCommand *>(data);
+            } else {
+                break;
+            }
+        }
+        break;
+    }
+    case Command::SetParamTable:
+    {
+        LOG_DEBUG("PluginHandle (" << id_ << "): set parameter table");
+        auto shm = std::make_unique<ShmInterface>();
+        shm->connect(cmd.paramTable.path);
+        auto& table = shm->getChannel(0);
+        auto numParams = plugin_->info().numParameters();
+        if (table.audioBufferSize() < (int32_t)shmParamSegmentSize(numParams)){
+            throw Error(Error::PluginError, "parameter table too small");
+        }
+        // NB: the plugin is not processing yet.
+        if (cmd.paramTable.state){
+            stateTable_ = ShmParamTable(table.audioBuffer() + shmParamStateOffset(numParams),
+                                        numParams, false);
+        }
+        // the automation table is only accessed on the UI thread
+        defer([&](){
+            paramTable_ = ShmParamTable(table.audioBuffer(), numParams, false);
+            paramShm_ = std::move(shm);
+        });
+        break;
+    }
+    case Command::GetParamStrings:
+    {
+        // display strings are fetched lazily, see sendParameterUpdate()
+        int count = cmd.paramIndices.count;
+        auto indices = (uint16_t *)alloca(sizeof(uint16_t) * count);
+        std::copy(cmd.paramIndices.indices, cmd.paramIndices.indices + count, indices);
+
+        channel.clear(); // !
+
+        for (int i = 0; i < count; ++i){
+            auto index = indices[i];
+            if (!sendParam(channel, index, plugin_->getParameter(index), false)){
+                break;
+            }
+        }
+        break;
+    }
+    case Command::SetSnapshot:
+    {
+        LOG_DEBUG("PluginHandle (" << id_ << "): set snapshot interval to "
+                  << cmd.snapshot.interval << " s");
+        std::string path = cmd.snapshot.path;
+        double interval = cmd.snapshot.interval;
+        defer([&](){
+            snapshotPath_ = std::move(path);
+            snapshotInterval_ = interval;
+            snapshotTime_ = std::chrono::steady_clock::now(); // first snapshot
+        });
+        break;
+    }
     case Command::Suspend:
         LOG_DEBUG("PluginHandle (" << id_ << "): suspend");
         defer([&](){
@@ -317,6 +394,43 @@ void PluginHandle::handleRequest(const ShmCommand &cmd,
     }
 }
 
+// Periodically write the plugin state to a file, so that the client can
+// restore the plugin after a crash, see PluginClient::recover().
+// Called on the UI thread, just like other writeProgramData() calls.
+void PluginHandle::checkSnapshot(){
+    if (snapshotInterval_ <= 0){
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now < snapshotTime_){
+        return;
+    }
+    snapshotTime_ = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(snapshotInterval_));
+    try {
+        std::string buffer;
+        plugin_->writeProgramData(buffer);
+        // write to a temporary file first, so that the client
+        // never reads an incomplete snapshot.
+        auto tmpPath = snapshotPath_ + ".tmp";
+        {
+            File file(tmpPath, File::WRITE);
+            if (!file){
+                throw Error(Error::SystemError, "couldn't create snapshot file");
+            }
+            file.write(buffer.data(), buffer.size());
+            if (!file){
+                throw Error(Error::SystemError, "couldn't write snapshot file");
+            }
+        }
+        if (!renameFile(tmpPath, snapshotPath_)){
+            throw Error(Error::SystemError, "couldn't rename snapshot file");
+        }
+    } catch (const Error& e){
+        LOG_WARNING("PluginHandle (" << id_ << "): snapshot failed: " << e.what());
+    }
+}
+
 void PluginHandle::handleUICommand(const ShmUICommand &cmd){
     auto window = plugin_->getWindow();
     if (window){
@@ -361,18 +475,18 @@ void PluginHandle::parameterAutomated(int index, float value) {
         } else {
             LOG_DEBUG("PluginHandle: parameter " << index << " automated on UI thread");
 
-            // UI queue is bounded! For now, just sleep until the other side has drained the queue.
-            ShmUICommand cmd(Command::ParamAutomated, id_);
-            cmd.paramAutomated.index = index;
-            cmd.paramAutomated.value = value;
-
-            int counter = 0;
-            while (!server_->postUIThread(cmd)){
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                counter++;
-                if (counter > 1000) {
-                    LOG_WARNING("PluginHandle (" << id_ << "): postUIThread() blocked for over 1 second");
-                    break;
+            if (paramTable_.valid()){
+                // coalesce with pending updates; never blocks.
+                // The client drains the table in PluginBridge::pollUIThread().
+                paramTable_.set(index, value);
+            } else {
+                // UI queue is bounded! Rather drop the message than stall the UI thread.
+                ShmUICommand cmd(Command::ParamAutomated, id_);
+                cmd.paramAutomated.index = index;
+                cmd.paramAutomated.value = value;
+
+                if (!server_->postUIThread(cmd)){
+                    LOG_WARNING("PluginHandle (" << id_ << "): couldn't post parameter automation");
                 }
             }
             paramAutomated_.emplace(index, value);
@@ -471,21 +585,41 @@ void PluginHandle::updateBuffer(){
 
 void PluginHandle::process(const ShmCommand &cmd, ShmChannel &channel){
     // how to handle channel numbers vs speaker numbers?
+    prepareProcess(cmd, channel);
+
+    LOG_PROCESS("PluginHandle (" << id_ << "): process");
+    plugin_->process(processData_);
+
+    // send audio output data
+    channel.clear(); // !
+
+    finishProcess(channel);
+}
+
+void PluginHandle::prepareProcess(const ShmCommand &cmd, ShmChannel &channel){
     if (precision_ == ProcessPrecision::Double){
-        doProcess<double>(cmd, channel);
+        doPrepareProcess<double>(cmd, channel);
     } else {
-        doProcess<float>(cmd, channel);
+        doPrepareProcess<float>(cmd, channel);
+    }
+}
+
+void PluginHandle::finishProcess(ShmChannel &channel){
+    if (precision_ == ProcessPrecision::Double){
+        doFinishProcess<double>(channel);
+    } else {
+        doFinishProcess<float>(channel);
     }
 }
 
 template<typename T>
-void PluginHandle::doProcess(const ShmCommand& cmd, ShmChannel& channel){
+void PluginHandle::doPrepareProcess(const ShmCommand& cmd, ShmChannel& channel){
     LOG_PROCESS("PluginHandle (" << id_ << "): start processing");
 
     assert(cmd.process.numInputs == numInputs_);
     assert(cmd.process.numOutputs == numOutputs_);
 
-    ProcessData data;
+    auto& data = processData_;
     data.numSamples = cmd.process.numSamples;
     data.precision = static_cast<ProcessPrecision>(cmd.process.precision);
     data.mode = static_cast<ProcessMode>(cmd.process.mode);
@@ -494,26 +628,53 @@ void PluginHandle::doProcess(const ShmCommand& cmd, ShmChannel& channel){
     data.numOutputs = numOutputs_;
     data.outputs = outputs_.get();
 
-    // read audio input data
-    for (int i = 0; i < data.numInputs; ++i){
-        auto& bus = data.inputs[i];
-        LOG_PROCESS("PluginHandle (" << id_ << "): read input bus " << i << " with "
-                     << bus.numChannels << " channels");
-        // read channels
-        for (int j = 0; j < bus.numChannels; ++j){
-            auto chn = (T *)bus.channelData32[j];
-            const void* msg;
-            size_t size;
-            if (channel.getMessage(msg, size)){
-                // size can be larger because of message
-                // alignment - don't use in std::copy!
-                assert(size >= data.numSamples * sizeof(T));
-                auto buf = (const float *)msg;
-                std::copy(buf, buf + data.numSamples, chn);
-            } else {
-                std::fill(chn, chn + data.numSamples, 0);
-                LOG_ERROR("PluginClient: missing channel " << j
-                          << " for audio input bus " << i);
+    shmAudio_ = cmd.process.flags & ShmCommand::ShmAudio;
+    if (shmAudio_){
+        // process directly from/into the channel's audio buffer.
+        // NB: the buffer might belong to a different channel than in the
+        // last block, so we have to set the busses every time.
+        // In a batch, every plugin has its own region, see PluginServer::processBatch().
+        auto offset = cmd.process.audioOffset;
+        if (offset <= (uint32_t)channel.audioBufferSize() &&
+                setShmAudioBusses(channel.audioBuffer() + offset, channel.audioBufferSize() - offset,
+                                  maxBlockSize_, sizeof(T), shmInputs_.get(), numInputs_,
+                                  shmOutputs_.get(), numOutputs_)){
+            data.inputs = shmInputs_.get();
+            data.outputs = shmOutputs_.get();
+        } else {
+            // should never happen because the client has checked this already
+            LOG_ERROR("PluginHandle (" << id_ << "): audio buffer too small");
+            for (int i = 0; i < data.numInputs; ++i){
+                auto& bus = data.inputs[i];
+                for (int j = 0; j < bus.numChannels; ++j){
+                    auto chn = (T *)bus.channelData32[j];
+                    std::fill(chn, chn + data.numSamples, 0);
+                }
+            }
+            shmAudio_ = false; // at least send silence
+        }
+    } else {
+        // read audio input data
+        for (int i = 0; i < data.numInputs; ++i){
+            auto& bus = data.inputs[i];
+            LOG_PROCESS("PluginHandle (" << id_ << "): read input bus " << i << " with "
+                         << bus.numChannels << " channels");
+            // read channels
+            for (int j = 0; j < bus.numChannels; ++j){
+                auto chn = (T *)bus.channelData32[j];
+                const void* msg;
+                size_t size;
+                if (channel.getMessage(msg, size)){
+                    // size can be larger because of message
+                    // alignment - don't use in std::copy!
+                    assert(size >= data.numSamples * sizeof(T));
+                    auto buf = (const float *)msg;
+                    std::copy(buf, buf + data.numSamples, chn);
+                } else {
+                    std::fill(chn, chn + data.numSamples, 0);
+                    LOG_ERROR("PluginClient: missing channel " << j
+                              << " for audio input bus " << i);
+                }
             }
         }
     }
@@ -521,22 +682,21 @@ void PluginHandle::doProcess(const ShmCommand& cmd, ShmChannel& channel){
     // read and dispatch commands
     LOG_PROCESS("PluginHandle (" << id_ << "): dispatch commands");
     dispatchCommands(channel);
+}
 
-    // process audio
-    LOG_PROCESS("PluginHandle (" << id_ << "): process");
-    plugin_->process(data);
-
-    // send audio output data
-    channel.clear(); // !
-
-    // send output busses
-    for (int i = 0; i < data.numOutputs; ++i){
-        auto& bus = data.outputs[i];
-        LOG_PROCESS("PluginHandle (" << id_ << "): write output bus " << i << " with "
-                     << bus.numChannels << " channels");
-        // write all channels sequentially to avoid additional copying.
-        for (int j = 0; j < bus.numChannels; ++j){
-            channel.addMessage(bus.channelData32[j], sizeof(T) * data.numSamples);
+template<typename T>
+void PluginHandle::doFinishProcess(ShmChannel& channel){
+    auto& data = processData_;
+    // send output busses (already in place with ShmCommand::ShmAudio)
+    if (!shmAudio_){
+        for (int i = 0; i < data.numOutputs; ++i){
+            auto& bus = data.outputs[i];
+            LOG_PROCESS("PluginHandle (" << id_ << "): write output bus " << i << " with "
+                         << bus.numChannels << " channels");
+            // write all channels sequentially to avoid additional copying.
+            for (int j = 0; j < bus.numChannels; ++j){
+                addReply(channel, bus.channelData32[j], sizeof(T) * data.numSamples);
+            }
         }
     }
 
@@ -558,7 +718,10 @@ void PluginHandle::doProcess(const ShmCommand& cmd, ShmChannel& channel){
 void PluginHandle::dispatchCommands(ShmChannel& channel){
     const void *data;
     size_t size;
-    while (channel.getMessage(data, size)){
+    // NB: in a batch, the commands end with the next Process command
+    while (channel.peekMessage(data, size) &&
+           static_cast<const ShmCommand *>(data)->type != Command::Process){
+        channel.getMessage(data, size);
         auto cmd = (const ShmCommand *)data;
         switch(cmd->type){
         case Command::SetParamValue:
@@ -652,7 +815,10 @@ void PluginHandle::dispatchCommands(ShmChannel& channel){
 }
 
 void PluginHandle::sendEvents(ShmChannel& channel){
+    // if the channel is full, the remaining events are sent in the next block.
+    size_t numSent = 0;
     for (auto& event : events_){
+        bool ok = true;
         switch (event.type){
         case Command::ParamAutomated:
         case Command::ParameterUpdate:
@@ -660,18 +826,18 @@ void PluginHandle::sendEvents(ShmChannel& channel){
             auto index = event.paramAutomated.index;
             auto value = event.paramAutomated.value;
             paramState_[index] = value;
-            sendParam(channel, index, value,
-                      event.type == Command::ParamAutomated);
+            ok = sendParam(channel, index, value,
+                           event.type == Command::ParamAutomated);
             break;
         }
         case Command::LatencyChanged:
-            addReply(channel, &event, sizeof(ShmCommand));
+            ok = addReply(channel, &event, sizeof(ShmCommand));
             break;
         case Command::UpdateDisplay:
-            addReply(channel, &event, sizeof(ShmCommand));
+            ok = addReply(channel, &event, sizeof(ShmCommand));
             break;
         case Command::MidiReceived:
-            addReply(channel, &event, sizeof(ShmCommand));
+            ok = addReply(channel, &event, sizeof(ShmCommand));
             break;
         case Command::SysexReceived:
         {
@@ -682,7 +848,10 @@ void PluginHandle::sendEvents(ShmChannel& channel){
             reply->sysex.size = event.sysex.size;
             memcpy(reply->sysex.data, event.sysex.data, event.sysex.size);
 
-            addReply(channel, reply, size);
+            ok = addReply(channel, reply, size);
+            if (ok){
+                delete[] event.sysex.data; // see sysexEvent()
+            }
             break;
         }
         case Command::ProgramChange:
@@ -692,12 +861,17 @@ void PluginHandle::sendEvents(ShmChannel& channel){
             LOG_ERROR("PluginHandle::sendEvents: unknown event type " << event.type);
             break;
         }
+        if (!ok){
+            break;
+        }
+        numSent++;
     }
 
-    events_.clear(); // !
+    events_.erase(events_.begin(), events_.begin() + numSent); // !
 
     // handle parameter automation from UI thread
     int count = 0;
+    bool changed = false;
     Param param;
     while (count < paramAutomationRateLimit &&
            paramAutomated_.pop(param)){
@@ -711,25 +885,51 @@ void PluginHandle::sendEvents(ShmChannel& channel){
         // notifications when the user loads a preset in the plugin UI.
         // (Good plugins send the UpdateDisplay instead.)
         if (paramState_[param.index] != param.value) {
-            sendParam(channel, param.index, param.value, false);
+            changed |= updateParamState(channel, param.index, param.value);
             paramState_[param.index] = param.value;
         }
 
         count++;
     }
+    if (changed){
+        sendParamStateChanged(channel);
+    }
 }
 
 void PluginHandle::sendParameterUpdate(ShmChannel& channel){
     // compare new param state with cached one
     // and send all parameters that have changed
     auto numParams = plugin_->info().numParameters();
+    bool changed = false;
     for (int i = 0; i < numParams; ++i){
         auto value = plugin_->getParameter(i);
         if (value != paramState_[i]){
-            sendParam(channel, i, value, false);
+            changed |= updateParamState(channel, i, value);
             paramState_[i] = value;
         }
     }
+    if (changed){
+        sendParamStateChanged(channel);
+    }
+}
+
+// If we have a parameter state table, only write the new value and mark it as changed;
+// the client fetches the display string later (Command::GetParamStrings).
+// This avoids a getParameterString() call and a reply message per parameter.
+// Otherwise send the full parameter state. Returns true if the table has changed.
+bool PluginHandle::updateParamState(ShmChannel& channel, int index, float value){
+    if (stateTable_.valid()){
+        stateTable_.set(index, value);
+        return true;
+    } else {
+        sendParam(channel, index, value, false);
+        return false;
+    }
+}
+
+void PluginHandle::sendParamStateChanged(ShmChannel& channel){
+    ShmCommand reply(Command::ParamStateChanged);
+    addReply(channel, &reply, sizeof(ShmCommand));
 }
 
 void PluginHandle::sendPresetParamChanges(ShmChannel& channel) {
@@ -774,7 +974,7 @@ void PluginHandle::sendProgramUpdate(ShmChannel &channel, bool bank){
     }
 }
 
-void PluginHandle::sendParam(ShmChannel &channel, int index,
+bool PluginHandle::sendParam(ShmChannel &channel, int index,
                              float value, bool automated)
 {
     ParamStringBuffer display;
@@ -789,15 +989,41 @@ void PluginHandle::sendParam(ShmChannel &channel, int index,
     reply->paramState.pstr[0] = displaySize;
     memcpy(&reply->paramState.pstr[1], display.data(), displaySize);
 
-    addReply(channel, reply, cmdSize);
+    return addReply(channel, reply, cmdSize);
 }
 
 bool PluginHandle::addReply(ShmChannel& channel, const void *cmd, size_t size){
-    return channel.addMessage(cmd, size);
+    if (channel.addMessage(cmd, size)){
+        return true;
+    } else {
+        // report instead of silently dropping the reply
+        LOG_WARNING("PluginHandle: channel '" << channel.name() << "' overflow ("
+                    << size << " bytes, capacity: " << channel.capacity() << ")");
+        return false;
+    }
 }
 
 /*////////////////// PluginServer ////////////////*/
 
+// see ThreadedPlugin.cpp
+DSPThreadInfo applyDSPThreadConfig(int index, bool pinned);
+void setCurrentThreadDSP();
+
+// the ring buffer of the current server, see PluginServer::writeLog()
+static std::atomic<ShmLogRing *> gLogRing{nullptr};
+
+bool PluginServer::writeLog(int level, const char *msg, size_t size){
+    auto ring = gLogRing.load(std::memory_order_acquire);
+    if (ring && size <= ShmLogRing::maxMessageSize){
+        // if the ring is full, the message is dropped
+        // and counted; the parent will tell us about it.
+        ring->write(level, msg, size);
+        return true;
+    } else {
+        return false;
+    }
+}
+
 PluginServer::PluginServer(int pid, const std::string& shmPath)
 {
     LOG_DEBUG("PluginServer: parent: " << pid << ", path: " << shmPath);
@@ -824,6 +1050,8 @@ PluginServer::PluginServer(int pid, const std::string& shmPath)
     } else {
        throw Error(Error::PluginError, "host app version mismatch");
     }
+    auto& logChannel = shm_->getChannel(Channel::Log);
+    logRing_ = ShmLogRing(logChannel.buffer(), logChannel.capacity(), false);
     // setup UI event loop
     LOG_DEBUG("PluginServer: setup event loop");
     UIThread::setup();
@@ -833,15 +1061,27 @@ PluginServer::PluginServer(int pid, const std::string& shmPath)
         static_cast<PluginServer *>(x)->pollUIThread();
     }, this);
 
+    // RT thread placement
+    std::vector<int> cpus;
+    int priority;
+    shm_->getThreadConfig(cpus, priority);
+    setDSPThreadAffinity(cpus);
+    setDSPThreadPriority(priority);
+
     // create threads for NRT + RT channels
     LOG_DEBUG("PluginServer: create threads");
     running_ = true;
     for (int i = Channel::NRT; i < shm_->numChannels(); ++i){
+        // RT thread index (-1 for NRT thread)
+        int index = i - Channel::NRT - 1;
         auto thread = std::thread(&PluginServer::runThread,
-                                  this, &shm_->getChannel(i));
+                                  this, &shm_->getChannel(i), index);
         threads_.push_back(std::move(thread));
     }
 
+    // from now on, log messages go through the shared memory ring buffer
+    gLogRing.store(&logRing_, std::memory_order_release);
+
     LOG_DEBUG("PluginServer: ready");
 }
 
@@ -850,7 +1090,16 @@ PluginServer::~PluginServer(){
 
     UIThread::removePollFunction(pollFunction_);
 
-    for (auto& thread : threads_){
+    // NB: remapChannels() might still add threads in the meantime
+    for (size_t i = 0; ; ++i){
+        std::thread thread;
+        {
+            std::lock_guard lock(rtShmMutex_);
+            if (i >= threads_.size()){
+                break;
+            }
+            thread = std::move(threads_[i]);
+        }
         thread.join();
     }
 
@@ -867,6 +1116,10 @@ PluginServer::~PluginServer(){
 #if VST_HOST_SYSTEM == VST_WINDOWS
     CloseHandle(parent_);
 #endif
+
+    // all threads have finished, so we can safely unmap the ring buffer.
+    // remaining messages (if any) go through the pipe.
+    gLogRing.store(nullptr, std::memory_order_release);
 }
 
 void PluginServer::run(){
@@ -909,6 +1162,14 @@ void PluginServer::pollUIThread(){
         size = sizeof(buffer); // reset size!
     }
 
+    {
+        // NB: plugins are only deleted on the UI thread, see destroyPlugin()
+        std::shared_lock lock(pluginMutex_);
+        for (auto& [_, plugin] : plugins_){
+            plugin->checkSnapshot();
+        }
+    }
+
     checkIfParentAlive();
 }
 
@@ -934,10 +1195,15 @@ void PluginServer::checkIfParentAlive(){
     }
 }
 
-void PluginServer::runThread(ShmChannel *channel){
+void PluginServer::runThread(ShmChannel *channel, int index){
     // raise thread priority for RT threads, but not for dedicated NRT thread!
     if (channel->name() != "nrt") {
-        setThreadPriority(Priority::High);
+        // NB: a sandbox has a single "rt" channel which also doubles as the NRT channel.
+        auto info = applyDSPThreadConfig(std::max<int>(index, 0), false);
+        if (info.affinity >= 0 || getDSPThreadPriority() > 0) {
+            LOG_INFO("PluginServer: '" << channel->name() << "' thread: CPU " << info.cpu
+                     << ", affinity " << info.affinity << ", priority " << info.priority);
+        }
     }
 
     // while running, wait for requests and dispatch to plugin
@@ -952,7 +1218,13 @@ void PluginServer::runThread(ShmChannel *channel){
         const void *msg;
         size_t size;
         if (channel->getMessage(msg, size)){
-            handleCommand(*channel, *reinterpret_cast<const ShmCommand *>(msg));
+            auto& cmd = *reinterpret_cast<const ShmCommand *>(msg);
+            if (cmd.type == Command::RetireChannel){
+                // the client has switched to new RT channels, see remapChannels()
+                channel->postReply();
+                break;
+            }
+            handleCommand(*channel, cmd);
         } else if (running_) {
             LOG_ERROR("PluginServer: '" << channel->name()
                       << "': couldn't get message");
@@ -979,6 +1251,12 @@ void PluginServer::handleCommand(ShmChannel& channel,
         case Command::Quit:
             quit();
             break;
+        case Command::ProcessBatch:
+            processBatch(channel, cmd);
+            break;
+        case Command::RemapChannels:
+            remapChannels(cmd.s);
+            break;
         default:
             plugin = findPlugin(cmd.id);
             if (plugin){
@@ -1006,6 +1284,89 @@ void PluginServer::handleCommand(ShmChannel& channel,
     channel.postReply();
 }
 
+// A batch contains the Process commands of several plugins (each followed
+// by its own commands); the audio is always exchanged via the channel's
+// audio buffer. We first dispatch all requests, then process all plugins
+// and finally send the replies, each section starting with a Process reply.
+void PluginServer::processBatch(ShmChannel& channel, const ShmCommand& cmd){
+    const int maxNumPlugins = 256;
+    PluginHandle *plugins[maxNumPlugins];
+    int numPlugins = 0;
+
+    const void *msg;
+    size_t size;
+    while (channel.getMessage(msg, size)){
+        auto& request = *static_cast<const ShmCommand *>(msg);
+        if (request.type != Command::Process){
+            // should not happen, see PluginHandle::dispatchCommands()
+            LOG_ERROR("PluginServer: unexpected command " << request.type << " in batch");
+            continue;
+        }
+        auto plugin = findPlugin(request.id);
+        if (plugin && numPlugins < maxNumPlugins){
+            plugin->prepareProcess(request, channel);
+            plugins[numPlugins++] = plugin;
+        } else {
+            LOG_ERROR("PluginServer: couldn't process plugin " << request.id);
+            // skip commands
+            while (channel.peekMessage(msg, size) &&
+                   static_cast<const ShmCommand *>(msg)->type != Command::Process){
+                channel.getMessage(msg, size);
+            }
+        }
+    }
+
+    if ((cmd.batch.flags & ShmCommand::BatchParallel) && numPlugins > 1){
+        // distribute over the DSP thread pool and help processing.
+        // NB: every plugin is only touched by a single thread.
+        auto& threadPool = DSPThreadPool::instance();
+        setCurrentThreadDSP(); // !
+        std::atomic<int> remaining{numPlugins};
+        struct Context {
+            DSPThreadPool::Task task;
+            PluginHandle *plugin;
+            std::atomic<int> *remaining;
+        } contexts[maxNumPlugins];
+        for (int i = 0; i < numPlugins; ++i){
+            auto& ctx = contexts[i];
+            ctx.plugin = plugins[i];
+            ctx.remaining = &remaining;
+            ctx.task.cb = [](void *data, int){
+                auto ctx = static_cast<Context *>(data);
+                auto start = DSPThreadPool::getTime();
+                ctx->plugin->runProcess();
+                ctx->task.updateCost(DSPThreadPool::getTime() - start);
+                ctx->plugin->processCost_ = ctx->task.cost;
+                ctx->remaining->fetch_sub(1, std::memory_order_release);
+            };
+            ctx.task.data = &ctx;
+            ctx.task.numSamples = 0;
+            // expensive plugins are started first
+            ctx.task.cost = plugins[i]->processCost_;
+            if (!threadPool.push(&ctx.task)){
+                ctx.task.cb(ctx.task.data, 0); // process on this thread
+            }
+        }
+        while (remaining.load(std::memory_order_acquire) > 0){
+            if (!threadPool.processTask()){
+                pauseCpu();
+            }
+        }
+    } else {
+        for (int i = 0; i < numPlugins; ++i){
+            plugins[i]->runProcess();
+        }
+    }
+
+    channel.clear(); // !
+
+    for (int i = 0; i < numPlugins; ++i){
+        ShmCommand reply(Command::Process, plugins[i]->id());
+        channel.addMessage(&reply, ShmCommand::headerSize);
+        plugins[i]->finishProcess(channel);
+    }
+}
+
 void PluginServer::createPlugin(uint32_t id, const char *data, size_t size,
                                 ShmChannel& channel){
     LOG_DEBUG("PluginServer: create plugin " << id);
@@ -1073,6 +1434,23 @@ PluginHandle * PluginServer::findPlugin(uint32_t id){
     }
 }
 
+// The client has created a new shared memory segment with (larger) RT channels,
+// see PluginBridge::reserveChannels(). We serve every channel with a new thread;
+// the threads of the old RT channels quit on Command::RetireChannel.
+void PluginServer::remapChannels(const char *path){
+    auto shm = std::make_unique<ShmInterface>();
+    shm->connect(path);
+    LOG_DEBUG("PluginServer: connected to RT channels " << path);
+
+    std::lock_guard lock(rtShmMutex_);
+    for (int i = 0; i < shm->numChannels(); ++i){
+        auto thread = std::thread(&PluginServer::runThread,
+                                  this, &shm->getChannel(i), i);
+        threads_.push_back(std::move(thread));
+    }
+    rtShm_.push_back(std::move(shm));
+}
+
 void PluginServer::quit(){
     LOG_DEBUG("PluginServer: quit");
 
@@ -1081,6 +1459,14 @@ void PluginServer::quit(){
     for (int i = Channel::NRT; i < shm_->numChannels(); ++i){
         shm_->getChannel(i).post();
     }
+    {
+        std::lock_guard lock(rtShmMutex_);
+        for (auto& shm : rtShm_){
+            for (int i = 0; i < shm->numChannels(); ++i){
+                shm->getChannel(i).post();
+            }
+        }
+    }
 
     // quit event loop
     UIThread::quit();
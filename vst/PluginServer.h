@@ -10,6 +10,8 @@
 #include <thread>
 #include <atomic>
 #include <vector>
+#include <string>
+#include <chrono>
 
 // On Wine, checking the parent process works
 // better with the native host system API
@@ -47,6 +49,14 @@ public:
     void handleRequest(const ShmCommand& cmd, ShmChannel& channel);
     void handleUICommand(const ShmUICommand& cmd);
 
+    // process in several steps, see PluginServer::processBatch()
+    void prepareProcess(const ShmCommand& cmd, ShmChannel& channel);
+    void runProcess() {
+        plugin_->process(processData_);
+    }
+    void finishProcess(ShmChannel& channel);
+    uint32_t id() const { return id_; }
+
     void parameterAutomated(int index, float value) override;
     void latencyChanged(int nsamples) override;
     void updateDisplay() override;
@@ -55,22 +65,30 @@ public:
     void sysexEvent(const SysexEvent& event) override;
 private:
     friend class PluginHandleListener;
+    friend class PluginServer;
 
     void updateBuffer();
 
     void process(const ShmCommand& cmd, ShmChannel& channel);
 
     template<typename T>
-    void doProcess(const ShmCommand& cmd, ShmChannel& channel);
+    void doPrepareProcess(const ShmCommand& cmd, ShmChannel& channel);
+
+    template<typename T>
+    void doFinishProcess(ShmChannel& channel);
 
     void dispatchCommands(ShmChannel& channel);
 
     void sendEvents(ShmChannel& channel);
 
     void sendParameterUpdate(ShmChannel& channel);
+    bool updateParamState(ShmChannel& channel, int index, float value);
+    void sendParamStateChanged(ShmChannel& channel);
     void sendPresetParamChanges(ShmChannel& channel);
     void sendProgramUpdate(ShmChannel& channel, bool bank);
 
+    void checkSnapshot();
+
     static bool addReply(ShmChannel& channel, const void *cmd, size_t size = 0);
 
     PluginServer *server_ = nullptr;
@@ -84,6 +102,12 @@ private:
     std::unique_ptr<Bus[]> outputs_;
     int numOutputs_ = 0;
     std::vector<char> buffer_;
+    // busses pointing into the channel's audio buffer, see ShmCommand::ShmAudio
+    std::unique_ptr<Bus[]> shmInputs_;
+    std::unique_ptr<Bus[]> shmOutputs_;
+    bool shmAudio_ = false;
+    ProcessData processData_;
+    float processCost_ = 0; // see PluginServer::processBatch()
     std::vector<Command> events_;
 
     // parameter automation from GUI, see parameterAutomated()
@@ -102,8 +126,18 @@ private:
     // cached parameter state
     std::unique_ptr<float[]> paramState_;
 
-    void sendParam(ShmChannel& channel, int index,
+    bool sendParam(ShmChannel& channel, int index,
                    float value, bool automated);
+
+    // coalesced parameter automation from the UI thread, see Command::SetParamTable
+    std::unique_ptr<ShmInterface> paramShm_;
+    ShmParamTable paramTable_; // UI thread only!
+    ShmParamTable stateTable_; // see sendParameterUpdate()
+
+    // state snapshots for the crash recovery (UI thread only!)
+    std::string snapshotPath_;
+    double snapshotInterval_ = 0;
+    std::chrono::steady_clock::time_point snapshotTime_;
 };
 
 #define AddReply(cmd, field) addReply(&(cmd), (cmd).headerSize + sizeof((cmd).field))
@@ -121,12 +155,20 @@ class PluginServer {
     void run();
 
     bool postUIThread(const ShmUICommand& cmd);
+
+    // Write a log message to the shared memory ring buffer of the
+    // current server; returns false if not possible, e.g. because there
+    // is no server (yet) or the message is too long. See host.cpp.
+    // NB: 'size' includes the terminating null character.
+    static bool writeLog(int level, const char *msg, size_t size);
  private:
     void pollUIThread();
     void checkIfParentAlive();
-    void runThread(ShmChannel* channel);
+    void runThread(ShmChannel* channel, int index);
     void handleCommand(ShmChannel& channel,
                        const ShmCommand &cmd);
+    void processBatch(ShmChannel& channel, const ShmCommand& cmd);
+    void remapChannels(const char *path);
     void quit();
 
     void createPlugin(uint32_t id, const char *data, size_t size,
@@ -141,6 +183,7 @@ class PluginServer {
         enum {
             UIReceive = 0,
             UISend,
+            Log,
             NRT
         };
     };
@@ -151,6 +194,10 @@ class PluginServer {
     int parent_ = -1;
 #endif
     std::unique_ptr<ShmInterface> shm_;
+    ShmLogRing logRing_;
+    // additional RT channels, see remapChannels()
+    std::vector<std::unique_ptr<ShmInterface>> rtShm_;
+    Mutex rtShmMutex_;
     std::vector<std::thread> threads_;
     std::atomic<bool> running_;
     UIThread::Handle pollFunction_;
@@ -0,0 +1,559 @@
+#include "ProbeWorker.h"
+
+#include "CpuArch.h"
+#include "Log.h"
+#include "MiscUtils.h"
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+# include <errno.h>
+# include <fcntl.h>
+# include <poll.h>
+# include <stdlib.h>
+# include <sys/socket.h>
+# include <unistd.h>
+#endif
+
+#ifdef __linux__
+# include <sys/syscall.h>
+# if !defined(SYS_pidfd_open) && defined(__NR_pidfd_open)
+#  define SYS_pidfd_open __NR_pidfd_open
+# endif
+#endif
+
+// max. number of idle workers per CPU architecture
+#ifndef PROBE_MAX_IDLE_WORKERS
+#define PROBE_MAX_IDLE_WORKERS 8
+#endif
+
+// How often we check if a worker is still alive while waiting for the reply.
+// This is only necessary in case the other end of the reply pipe has leaked
+// into another subprocess (e.g. on Windows), otherwise we would get EOF.
+#define PROBE_WORKER_POLL_INTERVAL 0.1
+
+// The poll interval in waitProbes() for probes that can't be waited for,
+// e.g. ProbeWorker on Windows or probe processes on macOS.
+#define PROBE_EVENT_POLL_INTERVAL 0.002
+
+namespace vst {
+
+static std::atomic<bool> gProbeWorkers{true};
+
+static std::mutex gProbeWorkerMutex;
+
+static std::unordered_map<CpuArch, std::vector<ProbeWorker::ptr>> gIdleProbeWorkers;
+
+void setProbeWorkers(bool enable){
+    gProbeWorkers.store(enable);
+    if (!enable){
+        // release idle workers (outside of the lock!)
+        decltype(gIdleProbeWorkers) workers;
+        {
+            std::lock_guard lock(gProbeWorkerMutex);
+            workers.swap(gIdleProbeWorkers);
+        }
+    }
+}
+
+bool getProbeWorkers(){
+    return gProbeWorkers.load();
+}
+
+static std::atomic<int> gProbeConcurrency{0};
+
+void setProbeConcurrency(int n){
+    gProbeConcurrency.store(std::max<int>(n, 0));
+}
+
+// the number of CPU cores which are currently busy with other tasks
+static double getSystemLoad(){
+#if defined(_WIN32)
+    return 0; // LATER use GetSystemTimes()
+#else
+    double loadavg;
+    if (getloadavg(&loadavg, 1) != 1){
+        return 0;
+    }
+  #ifdef __linux__
+    // The load average lags behind by a minute and might still contain
+    // the probe processes of a previous scan, so we also take the number
+    // of currently runnable tasks (4th field) and use the smaller value.
+    std::ifstream file("/proc/loadavg");
+    double dummy;
+    int running;
+    if (file >> dummy >> dummy >> dummy >> running){
+        // don't count ourselves
+        loadavg = std::min<double>(loadavg, running - 1);
+    }
+  #endif
+    return std::max<double>(loadavg, 0);
+#endif
+}
+
+int getProbeConcurrency(){
+    auto n = gProbeConcurrency.load();
+    if (n > 0){
+        return n;
+    }
+    int numCores = std::max<int>(std::thread::hardware_concurrency(), 1);
+    auto load = getSystemLoad();
+    n = std::max<int>(numCores - std::lround(load), 1);
+    LOG_DEBUG("probe concurrency: " << n << " (cores: " << numCores
+              << ", load: " << load << ")");
+    return n;
+}
+
+/*//////////////////////////// ProbeEvent ///////////////////////////*/
+
+// NB: probe futures are created and called on the same thread,
+// so we don't need any locking.
+static thread_local std::vector<std::weak_ptr<ProbeEvent>> gProbeEvents;
+
+ProbeEvent::ptr ProbeEvent::create(Handle handle, float timeout){
+    auto event = std::make_shared<ProbeEvent>(handle, timeout);
+    // remove expired events, in case we never call waitProbes() on this thread
+    gProbeEvents.erase(std::remove_if(gProbeEvents.begin(), gProbeEvents.end(),
+                                      [](auto& e){ return e.expired(); }),
+                       gProbeEvents.end());
+    gProbeEvents.push_back(event);
+    return event;
+}
+
+ProbeEvent::ptr ProbeEvent::create(const ProcessHandle& process, float timeout){
+    Handle handle = invalidHandle;
+#if defined(_WIN32)
+    handle = OpenProcess(SYNCHRONIZE, FALSE, process.pid());
+    if (!handle){
+        LOG_DEBUG("ProbeEvent: OpenProcess() failed: " << errorMessage(GetLastError()));
+    }
+#elif defined(SYS_pidfd_open)
+    // requires Linux 5.3; otherwise we just poll.
+    handle = syscall(SYS_pidfd_open, process.pid(), 0);
+    if (handle >= 0){
+        fcntl(handle, F_SETFD, FD_CLOEXEC);
+    } else {
+        LOG_DEBUG("ProbeEvent: pidfd_open() failed: " << errorMessage(errno));
+    }
+#endif
+    return create(handle, timeout);
+}
+
+ProbeEvent::ProbeEvent(Handle handle, float timeout)
+    : handle_(handle), timeout_(timeout),
+      start_(std::chrono::steady_clock::now()) {}
+
+ProbeEvent::~ProbeEvent(){
+    if (handle_ != invalidHandle){
+    #ifdef _WIN32
+        CloseHandle(handle_);
+    #else
+        close(handle_);
+    #endif
+    }
+}
+
+void waitProbes(double timeout){
+    // keep the events alive while waiting
+    std::vector<ProbeEvent::ptr> events;
+    std::vector<ProbeEvent::Handle> handles;
+    bool mustPoll = false;
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = gProbeEvents.begin(); it != gProbeEvents.end(); ){
+        if (auto event = it->lock()){
+            if (event->handle() != ProbeEvent::invalidHandle){
+                handles.push_back(event->handle());
+            } else {
+                mustPoll = true;
+            }
+            // wake up when the probe is about to time out
+            if (event->hasDeadline()){
+                auto remaining = std::chrono::duration<double>(event->deadline() - now).count();
+                remaining = std::max<double>(remaining, 0);
+                timeout = (timeout >= 0) ? std::min(timeout, remaining) : remaining;
+            }
+            events.push_back(std::move(event));
+            ++it;
+        } else {
+            it = gProbeEvents.erase(it);
+        }
+    }
+#ifdef _WIN32
+    if (handles.size() > MAXIMUM_WAIT_OBJECTS){
+        handles.clear();
+        mustPoll = true;
+    }
+#endif
+    if (mustPoll || handles.empty()){
+        // NB: also if there are no events at all; we might be called
+        // with a pending future that doesn't use ProbeEvent.
+        timeout = (timeout >= 0) ?
+            std::min<double>(timeout, PROBE_EVENT_POLL_INTERVAL) : PROBE_EVENT_POLL_INTERVAL;
+    }
+    // round up, so that we don't wake up right *before* a probe times out
+    int ms = (timeout >= 0) ? std::ceil(timeout * 1000.0) : -1;
+#ifdef _WIN32
+    if (handles.empty()){
+        Sleep(ms);
+        return;
+    }
+    auto ret = WaitForMultipleObjects(handles.size(), handles.data(),
+                                      FALSE, (ms >= 0) ? ms : INFINITE);
+    if (ret == WAIT_FAILED){
+        LOG_ERROR("waitProbes: WaitForMultipleObjects() failed: "
+                  << errorMessage(GetLastError()));
+    }
+#else
+    std::vector<pollfd> fds;
+    for (auto fd : handles){
+        fds.push_back({ fd, POLLIN, 0 });
+    }
+    // NB: with an empty list this is just a (precise) sleep.
+    if (poll(fds.data(), fds.size(), ms) < 0 && errno != EINTR){
+        LOG_ERROR("waitProbes: poll() failed: " << errorMessage(errno));
+    }
+#endif
+}
+
+/*//////////////////////////// ProbeWorker ///////////////////////////*/
+
+ProbeWorker::ptr ProbeWorker::get(CpuArch arch){
+    {
+        std::lock_guard lock(gProbeWorkerMutex);
+        auto& list = gIdleProbeWorkers[arch];
+        while (!list.empty()){
+            auto worker = std::move(list.back());
+            list.pop_back();
+            // the worker might have died in the meantime
+            if (worker->alive()){
+                LOG_DEBUG("ProbeWorker: reuse idle worker");
+                return worker;
+            }
+            LOG_DEBUG("ProbeWorker: idle worker has died");
+        }
+    }
+    LOG_DEBUG("ProbeWorker: spawn new worker");
+    return std::make_shared<ProbeWorker>(arch);
+}
+
+void ProbeWorker::release(ProbeWorker::ptr worker){
+    if (getProbeWorkers() && !worker->busy_){
+        std::lock_guard lock(gProbeWorkerMutex);
+        auto& list = gIdleProbeWorkers[worker->arch()];
+        if (list.size() < PROBE_MAX_IDLE_WORKERS){
+            list.push_back(std::move(worker));
+            return;
+        }
+    }
+    // otherwise the worker quits, see ~ProbeWorker().
+}
+
+ProbeWorker::ProbeWorker(CpuArch arch)
+    : arch_(arch)
+{
+    auto app = IHostApp::get(arch);
+    if (!app) {
+        // shouldn't happen
+        throw Error(Error::SystemError, "couldn't get host app");
+    }
+#ifdef _WIN32
+    if (!CreatePipe(&hRequestRead_, &hRequestWrite_, NULL, 0)) {
+        throw Error(Error::SystemError,
+                    "CreatePipe() failed: " + errorMessage(GetLastError()));
+    }
+    if (!CreatePipe(&hReplyRead_, &hReplyWrite_, NULL, 0)) {
+        auto err = GetLastError();
+        CloseHandle(hRequestRead_);
+        CloseHandle(hRequestWrite_);
+        throw Error(Error::SystemError, "CreatePipe() failed: " + errorMessage(err));
+    }
+    auto requestPipe = reinterpret_cast<intptr_t>(hRequestRead_);
+    auto replyPipe = reinterpret_cast<intptr_t>(hReplyWrite_);
+#else
+    // We use a socket pair instead of two pipes, so that we don't get
+    // SIGPIPE when we try to send a request to a worker that has died.
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0){
+        throw Error(Error::SystemError,
+                    "socketpair() failed: " + errorMessage(errno));
+    }
+    // our end must not leak into other subprocesses!
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+    // macOS doesn't have MSG_NOSIGNAL
+    int on = 1;
+    setsockopt(fds[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    auto requestPipe = fds[1];
+    auto replyPipe = fds[1];
+#endif
+    try {
+        process_ = app->probeServer(requestPipe, replyPipe);
+    } catch (const Error& e) {
+    #ifdef _WIN32
+        CloseHandle(hRequestRead_);
+        CloseHandle(hRequestWrite_);
+        CloseHandle(hReplyRead_);
+        CloseHandle(hReplyWrite_);
+    #else
+        close(fds[0]);
+        close(fds[1]);
+    #endif
+        auto msg = "couldn't create probe process '" + app->path() + "': " + e.what();
+        throw Error(Error::SystemError, msg);
+    }
+#ifdef _WIN32
+    // We can't simply close the child's ends after CreateProcess() because
+    // the child process needs to duplicate the handles; we only close them
+    // in the destructor. NB: this means that we won't get EOF if the worker dies.
+#else
+    // close the child's end *after* creating the subprocess!
+    close(fds[1]);
+    socket_ = fds[0];
+#endif
+    LOG_DEBUG("ProbeWorker: spawned subprocess (" << process_.pid() << ")");
+}
+
+ProbeWorker::~ProbeWorker(){
+    // close our end(s), so that an idle worker quits.
+#ifdef _WIN32
+    for (auto handle : { hRequestRead_, hRequestWrite_, hReplyRead_, hReplyWrite_ }){
+        if (handle){
+            CloseHandle(handle);
+        }
+    }
+#else
+    if (socket_ >= 0){
+        close(socket_);
+    }
+#endif
+    if (process_){
+        if (busy_){
+            // still probing, e.g. because the probe has been cancelled
+            terminate();
+        } else {
+            try {
+                auto [done, code] = process_.tryWait(1);
+                if (!done){
+                    LOG_WARNING("ProbeWorker: subprocess didn't quit");
+                    terminate();
+                }
+            } catch (const Error& e){
+                LOG_DEBUG("ProbeWorker: " << e.what());
+            }
+        }
+    }
+}
+
+bool ProbeWorker::alive(){
+    if (!process_){
+        return false;
+    }
+    try {
+        auto [done, code] = process_.tryWait(0);
+        return !done;
+    } catch (const Error& e){
+        // e.g. terminated by a signal
+        LOG_DEBUG("ProbeWorker: " << e.what());
+        return false;
+    }
+}
+
+void ProbeWorker::terminate(){
+    if (process_ && process_.terminate()){
+        LOG_DEBUG("ProbeWorker: terminated subprocess");
+    }
+}
+
+ProbeEvent::ptr ProbeWorker::makeEvent(float timeout){
+#ifdef _WIN32
+    // NB: we can't wait on anonymous pipes
+    return ProbeEvent::create(ProbeEvent::invalidHandle, timeout);
+#else
+    // the socket becomes readable when the reply has arrived
+    // (or when the worker has died). NB: the event owns a duplicate,
+    // so that it doesn't depend on the lifetime of the worker.
+    auto fd = dup(socket_);
+    if (fd >= 0){
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    } else {
+        LOG_ERROR("ProbeWorker: dup() failed: " << errorMessage(errno));
+    }
+    return ProbeEvent::create(fd, timeout);
+#endif
+}
+
+void ProbeWorker::request(const std::string& path, int id){
+    ProbeRequest request;
+    request.id = id;
+    request.size = path.size();
+    // send as a single message
+    std::string msg(reinterpret_cast<const char *>(&request), sizeof(request));
+    msg += path;
+    if (!writeRequest(msg.data(), msg.size())){
+        throw Error(Error::SystemError, "couldn't send probe request");
+    }
+    busy_ = true;
+}
+
+bool ProbeWorker::getReply(ProbeReply& reply, std::string& data, double timeout){
+    using seconds = std::chrono::duration<double>;
+    auto start = std::chrono::steady_clock::now();
+    for (;;){
+        auto wait = PROBE_WORKER_POLL_INTERVAL;
+        if (timeout >= 0){
+            auto now = std::chrono::steady_clock::now();
+            auto remaining = timeout - std::chrono::duration_cast<seconds>(now - start).count();
+            wait = std::max<double>(0, std::min<double>(wait, remaining));
+        }
+        if (waitReply(wait)){
+            break;
+        }
+        if (!alive()){
+            // check once more, the reply might have arrived in the meantime
+            if (waitReply(0)){
+                break;
+            }
+            busy_ = false;
+            throw Error(Error::Crash);
+        }
+        if (wait < PROBE_WORKER_POLL_INTERVAL){
+            return false; // timeout
+        }
+    }
+    // NB: the worker writes the whole reply at once,
+    // so the following calls shouldn't block for long.
+    if (!readReply(&reply, sizeof(reply))){
+        terminate();
+        throw Error(Error::Crash);
+    }
+    data.resize(reply.size);
+    if (!readReply(data.data(), data.size())){
+        terminate();
+        throw Error(Error::Crash);
+    }
+    busy_ = false;
+    return true;
+}
+
+#ifdef _WIN32
+
+bool ProbeWorker::waitReply(double timeout){
+    // NB: we can't wait on anonymous pipes, so we have to poll.
+    auto start = std::chrono::steady_clock::now();
+    for (;;){
+        DWORD bytesAvailable = 0;
+        if (!PeekNamedPipe(hReplyRead_, NULL, 0, NULL, &bytesAvailable, NULL)){
+            LOG_ERROR("ProbeWorker: PeekNamedPipe() failed: "
+                      << errorMessage(GetLastError()));
+            return false;
+        }
+        if (bytesAvailable > 0){
+            return true;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>(now - start).count() >= timeout){
+            return false;
+        }
+        Sleep(1);
+    }
+}
+
+bool ProbeWorker::readReply(void *data, size_t size){
+    auto buf = static_cast<char *>(data);
+    while (size > 0){
+        DWORD bytesRead;
+        if (!ReadFile(hReplyRead_, buf, size, &bytesRead, NULL)){
+            LOG_ERROR("ProbeWorker: ReadFile() failed: " << errorMessage(GetLastError()));
+            return false;
+        }
+        buf += bytesRead;
+        size -= bytesRead;
+    }
+    return true;
+}
+
+bool ProbeWorker::writeRequest(const void *data, size_t size){
+    auto buf = static_cast<const char *>(data);
+    while (size > 0){
+        DWORD bytesWritten;
+        if (!WriteFile(hRequestWrite_, buf, size, &bytesWritten, NULL)){
+            LOG_ERROR("ProbeWorker: WriteFile() failed: " << errorMessage(GetLastError()));
+            return false;
+        }
+        buf += bytesWritten;
+        size -= bytesWritten;
+    }
+    return true;
+}
+
+#else
+
+bool ProbeWorker::waitReply(double timeout){
+    struct pollfd fds;
+    fds.fd = socket_;
+    fds.events = POLLIN;
+    fds.revents = 0;
+    for (;;){
+        auto ret = poll(&fds, 1, timeout * 1000);
+        if (ret > 0){
+            // NB: also returns true on POLLHUP, so that readReply() will get EOF.
+            return true;
+        } else if (ret == 0){
+            return false; // timeout
+        } else if (errno != EINTR){
+            LOG_ERROR("ProbeWorker: poll() failed: " << errorMessage(errno));
+            return false;
+        }
+    }
+}
+
+bool ProbeWorker::readReply(void *data, size_t size){
+    auto buf = static_cast<char *>(data);
+    while (size > 0){
+        auto count = read(socket_, buf, size);
+        if (count > 0){
+            buf += count;
+            size -= count;
+        } else if (count == 0 || errno == ECONNRESET){
+            LOG_DEBUG("ProbeWorker: EOF");
+            return false;
+        } else if (errno != EINTR){
+            LOG_ERROR("ProbeWorker: read() failed: " << errorMessage(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ProbeWorker::writeRequest(const void *data, size_t size){
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0; // see SO_NOSIGPIPE
+#endif
+    auto buf = static_cast<const char *>(data);
+    while (size > 0){
+        auto count = send(socket_, buf, size, flags);
+        if (count >= 0){
+            buf += count;
+            size -= count;
+        } else if (errno != EINTR){
+            LOG_ERROR("ProbeWorker: send() failed: " << errorMessage(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
+
+} // vst
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Interface.h"
+#include "HostApp.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace vst {
+
+// Messages between ProbeWorker and the probe server of the host app
+// (see probeServer() in host.cpp). The probe server reads requests from
+// the request pipe and writes replies to the reply pipe, one at a time.
+struct ProbeRequest {
+    int32_t id; // sub-plugin ID or -1
+    int32_t size; // size of the plugin path
+    // followed by the plugin path (without terminating null character)
+};
+
+struct ProbeReply {
+    int32_t status; // EXIT_SUCCESS or EXIT_FAILURE
+    int32_t size; // size of the payload
+    // followed by the serialized plugin info (EXIT_SUCCESS)
+    // resp. the error code and message (EXIT_FAILURE)
+};
+
+/*////////////////////////////// ProbeEvent ////////////////////////////////*/
+
+// A waitable handle that becomes ready when a pending probe might have finished:
+// the reply socket of a ProbeWorker resp. a pidfd (Linux) or process handle
+// (Windows) of a probe process. Every probe future owns a ProbeEvent; the events
+// of the current thread are waited for in waitProbes(). Probes which can't be
+// waited for (e.g. ProbeWorker on Windows) pass an invalid handle and are polled.
+
+class ProbeEvent {
+ public:
+    using ptr = std::shared_ptr<ProbeEvent>;
+#ifdef _WIN32
+    using Handle = HANDLE;
+    static constexpr Handle invalidHandle = NULL;
+#else
+    using Handle = int;
+    static constexpr Handle invalidHandle = -1;
+#endif
+    // Create and register a new event; takes ownership of the handle.
+    // 'timeout' is the probe timeout (if > 0), so that waitProbes()
+    // returns in time for the future to detect it.
+    static ProbeEvent::ptr create(Handle handle, float timeout);
+    // create an event for the given probe process
+    static ProbeEvent::ptr create(const ProcessHandle& process, float timeout);
+
+    ProbeEvent(Handle handle, float timeout);
+    ~ProbeEvent();
+
+    ProbeEvent(const ProbeEvent&) = delete;
+    ProbeEvent& operator=(const ProbeEvent&) = delete;
+
+    Handle handle() const { return handle_; }
+
+    bool hasDeadline() const { return timeout_ > 0; }
+    std::chrono::steady_clock::time_point deadline() const {
+        return start_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(timeout_));
+    }
+ private:
+    Handle handle_;
+    float timeout_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/*////////////////////////////// ProbeWorker ///////////////////////////////*/
+
+// A long-lived probe process, so that we don't have to spawn a new
+// process for every plugin resp. sub-plugin, see setProbeWorkers().
+// Idle workers are kept in a pool per CPU architecture; a worker is only
+// discarded if a plugin crashes or hangs (or if the pool is full).
+
+class ProbeWorker {
+ public:
+    using ptr = std::shared_ptr<ProbeWorker>;
+
+    // Get an idle worker from the pool or spawn a new one.
+    // Throws an Error exception on failure.
+    static ProbeWorker::ptr get(CpuArch arch);
+    // Put the worker back into the pool after receiving the reply.
+    static void release(ProbeWorker::ptr worker);
+
+    ProbeWorker(CpuArch arch);
+    ~ProbeWorker();
+
+    ProbeWorker(const ProbeWorker&) = delete;
+    ProbeWorker& operator=(const ProbeWorker&) = delete;
+
+    CpuArch arch() const { return arch_; }
+
+    bool alive();
+
+    // send a probe request; throws an Error exception on failure.
+    void request(const std::string& path, int id);
+
+    // Try to receive the reply, waiting for max. 'timeout' seconds
+    // (0 = don't wait, < 0 = wait forever). Returns true if the reply
+    // has arrived. Throws Error::Crash if the worker has died.
+    bool getReply(ProbeReply& reply, std::string& data, double timeout);
+
+    // kill the worker, e.g. if a plugin hangs
+    void terminate();
+
+    // create an event for the pending reply, see ProbeEvent
+    ProbeEvent::ptr makeEvent(float timeout);
+ private:
+    bool waitReply(double timeout);
+    bool readReply(void *data, size_t size);
+    bool writeRequest(const void *data, size_t size);
+
+    CpuArch arch_;
+    ProcessHandle process_;
+    bool busy_ = false;
+#ifdef _WIN32
+    // NB: we also keep the child's ends, see PluginBridge
+    HANDLE hRequestRead_ = NULL;
+    HANDLE hRequestWrite_ = NULL;
+    HANDLE hReplyRead_ = NULL;
+    HANDLE hReplyWrite_ = NULL;
+#else
+    int socket_ = -1; // our end of the socket pair
+#endif
+};
+
+} // vst
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Interface.h"
+
+#include "plf_nanotimer/plf_nanotimer.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+namespace vst {
+
+// Measures the duration of process() calls and keeps the most recent
+// measurements in a ring buffer. start() and stop() must be called on the
+// audio thread; getStats() may be called from any thread. The stats are
+// computed on demand, so the audio thread only pays for two clock reads.
+class ProcessMeter {
+ public:
+    static const int windowSize = 256;
+
+    // not thread-safe, call in setupProcessing()
+    void reset(double sampleRate) {
+        sampleRate_ = sampleRate;
+        count_.store(0, std::memory_order_relaxed);
+    }
+
+    void start() {
+        timer_.start();
+    }
+
+    void stop(int numSamples) {
+        double elapsed = timer_.get_elapsed_us();
+        double duration = sampleRate_ > 0 ? numSamples / sampleRate_ * 1000000.0 : 0;
+        auto count = count_.load(std::memory_order_relaxed);
+        auto& entry = entries_[count % windowSize];
+        entry.time.store(elapsed, std::memory_order_relaxed);
+        entry.load.store(duration > 0 ? elapsed / duration * 100.0 : 0,
+                         std::memory_order_relaxed);
+        count_.store(count + 1, std::memory_order_release);
+    }
+
+    ProcessStats getStats() const {
+        ProcessStats stats;
+        auto count = count_.load(std::memory_order_acquire);
+        int n = std::min<uint32_t>(count, windowSize);
+        if (n == 0) {
+            return stats;
+        }
+        // NB: the audio thread might overwrite the oldest entries
+        // while we are reading; this is benign.
+        std::array<float, windowSize> times;
+        double timeSum = 0, loadSum = 0;
+        for (int i = 0; i < n; ++i) {
+            auto& entry = entries_[i];
+            times[i] = entry.time.load(std::memory_order_relaxed);
+            timeSum += times[i];
+            loadSum += entry.load.load(std::memory_order_relaxed);
+        }
+        stats.mean = timeSum / n;
+        stats.load = loadSum / n;
+        stats.max = *std::max_element(times.begin(), times.begin() + n);
+        auto p99 = times.begin() + std::min<int>(n * 0.99, n - 1);
+        std::nth_element(times.begin(), p99, times.begin() + n);
+        stats.p99 = *p99;
+        stats.count = count;
+        return stats;
+    }
+ private:
+    struct Entry {
+        std::atomic<float> time{0};
+        std::atomic<float> load{0};
+    };
+    plf::nanotimer timer_;
+    double sampleRate_ = 0;
+    std::atomic<uint32_t> count_{0};
+    std::array<Entry, windowSize> entries_;
+};
+
+} // vst
@@ -2,7 +2,11 @@
 
 #include "Log.h"
 #include "MiscUtils.h"
+#include "Sync.h"
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>
 #include <cstring>
 
 #if VST_HOST_SYSTEM == VST_WINDOWS
@@ -64,6 +68,12 @@ void futex_wait(std::atomic<uint32_t>* futexp)
     }
 }
 
+bool futex_trywait(std::atomic<uint32_t>* futexp)
+{
+    uint32_t expected = 1;
+    return futexp->compare_exchange_strong(expected, 0);
+}
+
 void futex_post(std::atomic<uint32_t>* futexp)
 {
     uint32_t expected = 0;
@@ -85,8 +95,9 @@ constexpr size_t align_to(size_t s, size_t alignment){
 /*/////////////// ShmChannel ////////////*/
 
 
-ShmChannel::ShmChannel(Type type, int32_t size, std::string_view name)
-    : owner_(true), type_(type), bufferSize_(size), name_(name)
+ShmChannel::ShmChannel(Type type, int32_t size, std::string_view name,
+                       int32_t audioSize)
+    : owner_(true), type_(type), bufferSize_(size), audioSize_(audioSize), name_(name)
 {
 #if SHM_FUTEX || SHM_EVENT
     static_assert(sizeof(Header) == 64, "bad size for Header");
@@ -94,6 +105,10 @@ ShmChannel::ShmChannel(Type type, int32_t size, std::string_view name)
     static_assert(sizeof(Header) == 128, "bad size for Header");
 #endif
     auto total = sizeof(Header) + sizeof(Data) + size;
+    if (audioSize > 0){
+        // the channel itself is not necessarily aligned, see init()
+        total += alignment + align_to(audioSize, alignment);
+    }
     totalSize_ = align_to(total, alignment);
 }
 
@@ -243,6 +258,17 @@ bool ShmChannel::getMessage(const void *& buf, size_t& size) {
     }
 }
 
+bool ShmChannel::peekMessage(const void *& buf, size_t& size) const {
+    if (data_->size.load(std::memory_order_relaxed) > 0){
+        auto msg = (Message *)&data_->data[rdhead_];
+        buf = msg->data;
+        size = msg->size;
+        return true;
+    } else {
+        return false;
+    }
+}
+
 void ShmChannel::clear(){
     data_->size = 0;
     reset();
@@ -269,12 +295,16 @@ void ShmChannel::waitReply(){
     waitEvent(eventB_.get());
 }
 
+bool ShmChannel::tryWaitReply(){
+    return tryWaitEvent(eventB_.get());
+}
+
 void ShmChannel::init(ShmInterface& shm, char *data, int num){
     LOG_SHM("init channel " << num);
     header_ = reinterpret_cast<Header *>(data);
     if (owner_){
         // placement new
-        new (header_) Header(type_, name_.c_str(), totalSize_);
+        new (header_) Header(type_, name_.c_str(), totalSize_, audioSize_);
     #if SHM_SEMAPHORE
         // POSIX expects leading slash
         snprintf(header_->data1, sizeof(header_->data1),
@@ -308,8 +338,17 @@ void ShmChannel::init(ShmInterface& shm, char *data, int num){
         data_ = reinterpret_cast<Data *>(data + header_->offset);
     }
 
+    if (header_->audioSize > 0){
+        // NB: the shared memory segment itself is page aligned in both processes,
+        // so both sides end up with the same offset.
+        auto end = reinterpret_cast<uintptr_t>(data_->data + data_->capacity);
+        audio_ = reinterpret_cast<char *>(align_to(end, alignment));
+        assert((audio_ + header_->audioSize) <= (data + header_->size));
+    }
+
     LOG_SHM("init ShmChannel " << num << " (" << name_
               << "): buffer size = " << data_->capacity
+              << ", audio size = " << header_->audioSize
               << ", total size = " << totalSize_
               << ", start address = " << (void *)data);
 }
@@ -382,6 +421,27 @@ void ShmChannel::postEvent(void *event){
 }
 
 void ShmChannel::waitEvent(void *event){
+    if (spinTime_ > 0){
+        // check without blocking
+        if (tryWaitEvent(event)){
+            waitStats_.immediate++;
+            return;
+        }
+        // spin for a bounded time before blocking in the kernel.
+        // NB: we only check the clock every few iterations.
+        using clock = std::chrono::steady_clock;
+        auto deadline = clock::now() + std::chrono::duration<float, std::micro>(spinTime_);
+        do {
+            for (int i = 0; i < 100; ++i){
+                pauseCpu();
+            }
+            if (tryWaitEvent(event)){
+                waitStats_.spin++;
+                return;
+            }
+        } while (clock::now() < deadline);
+    }
+    waitStats_.block++;
 #if SHM_EVENT
     auto result = WaitForSingleObject(event, INFINITE);
     if (result != WAIT_OBJECT_0){
@@ -402,6 +462,34 @@ void ShmChannel::waitEvent(void *event){
 #endif
 }
 
+bool ShmChannel::tryWaitEvent(void *event){
+#if SHM_EVENT
+    auto result = WaitForSingleObject(event, 0);
+    if (result == WAIT_OBJECT_0){
+        return true;
+    } else if (result == WAIT_TIMEOUT){
+        return false;
+    } else if (result == WAIT_ABANDONED){
+        LOG_ERROR("WaitForSingleObject() failed! Event abandoned");
+        return true;
+    } else {
+        throw Error(Error::SystemError, "WaitForSingleObject() failed: "
+                    + errorMessage(GetLastError()));
+    }
+#elif SHM_SEMAPHORE
+    if (sem_trywait((sem_t *)event) == 0){
+        return true;
+    } else if (errno == EAGAIN || errno == EINTR){
+        return false;
+    } else {
+        throw Error(Error::SystemError, "sem_trywait() failed: "
+                    + errorMessage(errno));
+    }
+#elif SHM_FUTEX
+    return futex_trywait(static_cast<std::atomic<uint32_t>*>(event));
+#endif
+}
+
 /*//////////////// ShmInterface //////////////////*/
 
 ShmInterface::Header::Header(uint32_t _size, uint32_t _numChannels) {
@@ -414,6 +502,9 @@ ShmInterface::Header::Header(uint32_t _size, uint32_t _numChannels) {
 #endif
     numChannels = _numChannels;
     memset(channelOffset, 0, sizeof(channelOffset));
+    threadPriority = 0;
+    numThreadCpus = 0;
+    memset(threadCpus, 0, sizeof(threadCpus));
 }
 
 ShmInterface::ShmInterface(){}
@@ -468,8 +559,8 @@ void ShmInterface::disconnect(){
     }
 }
 
-void ShmInterface::addChannel(ShmChannel::Type type,
-                              size_t size, std::string_view name)
+void ShmInterface::addChannel(ShmChannel::Type type, size_t size,
+                              std::string_view name, size_t audioSize)
 {
     if (data_){
         throw Error(Error::SystemError,
@@ -480,7 +571,7 @@ void ShmInterface::addChannel(ShmChannel::Type type,
         throw Error(Error::SystemError,
                     "ShmInterface: max. number of channels reached!");
     }
-    channels_.emplace_back(type, size, name);
+    channels_.emplace_back(type, size, name, audioSize);
 }
 
 void ShmInterface::create(){
@@ -701,4 +792,21 @@ void ShmInterface::getVersion(int& major, int& minor, int& patch) const {
     patch = header->versionPatch;
 }
 
+void ShmInterface::setThreadConfig(const std::vector<int>& cpus, int priority) {
+    auto header = reinterpret_cast<Header *>(data_);
+    header->threadPriority = priority;
+    auto n = std::min<size_t>(cpus.size(), maxNumThreadCpus);
+    for (size_t i = 0; i < n; ++i) {
+        header->threadCpus[i] = cpus[i];
+    }
+    header->numThreadCpus = n;
+}
+
+void ShmInterface::getThreadConfig(std::vector<int>& cpus, int& priority) const {
+    auto header = reinterpret_cast<const Header *>(data_);
+    priority = header->threadPriority;
+    auto n = std::min<uint32_t>(header->numThreadCpus, maxNumThreadCpus);
+    cpus.assign(header->threadCpus, header->threadCpus + n);
+}
+
 } // vst
@@ -51,29 +51,30 @@ class ShmChannel {
     };
     // immutable data
     struct Header {
-        Header(Type _type, const char *_name, uint32_t _size)
-            : size(_size), offset(sizeof(Header)), type(_type) {
+        Header(Type _type, const char *_name, uint32_t _size, uint32_t _audioSize)
+            : size(_size), offset(sizeof(Header)), type(_type), audioSize(_audioSize) {
             snprintf(name, sizeof(name), "%s", _name);
         }
         uint32_t size;
         uint32_t offset; // = sizeof(Header) = 128 resp. 64
         uint32_t type;
         char name[20];
+        uint32_t audioSize; // see audioBuffer()
     #if SHM_FUTEX
         // atomic integers for Futex
         std::atomic<uint32_t> data1{0};
         std::atomic<uint32_t> data2{0};
-        char padding[24];
+        char padding[20];
     #elif SHM_EVENT
         // Event handles
         uint32_t data1{0};
         uint32_t data2{0};
-        char padding[24];
+        char padding[20];
     #elif SHM_SEMAPHORE
         // semaphore names
         char data1[32];
         char data2[32];
-        char padding[32];
+        char padding[28];
     #endif
     };
     // mutable data
@@ -93,8 +94,17 @@ class ShmChannel {
 
     static const size_t alignment = 64;
 
+    // How often wait() resp. waitReply() had to wait, grouped
+    // by the stage in which the wait has finished.
+    struct WaitStats {
+        uint64_t immediate = 0; // already signalled
+        uint64_t spin = 0;
+        uint64_t block = 0;
+    };
+
     ShmChannel() = default;
-    ShmChannel(Type type, int32_t size, std::string_view name);
+    ShmChannel(Type type, int32_t size, std::string_view name,
+               int32_t audioSize = 0);
     ShmChannel(const ShmChannel&) = delete;
     ShmChannel(ShmChannel&&) = default;
     ~ShmChannel();
@@ -106,6 +116,16 @@ class ShmChannel {
     int32_t capacity() const { return data_->capacity; }
     const std::string& name() const { return name_; }
 
+    // Raw message buffer (with capacity()) for custom lock-free
+    // data structures, see ShmLogRing. Don't mix with messages!
+    char * buffer() { return data_->data; }
+
+    // Fixed audio buffer after the message buffer, aligned to 'alignment'.
+    // Unlike messages, its content persists until it is overwritten,
+    // so both sides can point their busses directly into it.
+    char * audioBuffer() { return audio_; }
+    int32_t audioBufferSize() const { return audio_ ? header_->audioSize : 0; }
+
     size_t peekMessage() const;
     // read queue message (thread-safe, copy)
     bool readMessage(void * buffer, size_t& size);
@@ -116,6 +136,8 @@ class ShmChannel {
     bool addMessage(const void * data, size_t size);
     // get request message (not thread-safe, no copy)
     bool getMessage(const void *& data, size_t& size);
+    // like getMessage(), but doesn't consume the message
+    bool peekMessage(const void *& data, size_t& size) const;
 
     void clear();
     void reset();
@@ -124,6 +146,18 @@ class ShmChannel {
     void wait();
     void postReply();
     void waitReply();
+    // returns false if the reply is not available yet (non-blocking)
+    bool tryWaitReply();
+
+    // Spin for max. 'us' microseconds before blocking in wait() resp.
+    // waitReply(); 0 = don't spin. This saves the kernel wakeup if the
+    // other side replies quickly, at the cost of burning CPU time otherwise.
+    // NB: only affects this side of the channel!
+    void setSpinTime(float us) { spinTime_ = us; }
+    float spinTime() const { return spinTime_; }
+    // NB: not synchronized, so only call on the waiting thread or while idle.
+    const WaitStats& waitStats() const { return waitStats_; }
+    void resetWaitStats() { waitStats_ = WaitStats{}; }
 
     void init(ShmInterface& shm, char *data, int num);
  private:
@@ -134,22 +168,28 @@ class ShmChannel {
     Type type_ = Queue;
     int32_t totalSize_ = 0;
     int32_t bufferSize_ = 0;
+    int32_t audioSize_ = 0;
     std::string name_;
     Handle eventA_;
     Handle eventB_;
     Header *header_ = nullptr;
     Data *data_ = nullptr;
+    char *audio_ = nullptr;
     uint32_t rdhead_ = 0;
     uint32_t wrhead_ = 0;
+    float spinTime_ = 0;
+    WaitStats waitStats_;
     // helper methods
     void initEvent(ShmInterface& shm, Handle& event, void *data);
     void postEvent(void *event);
     void waitEvent(void *event);
+    bool tryWaitEvent(void *event);
 };
 
 class ShmInterface {
  public:
     static const int32_t maxNumChannels = 60;
+    static const int32_t maxNumThreadCpus = 64;
 
     struct Header {
         Header(uint32_t _size, uint32_t _numChannels);
@@ -166,6 +206,10 @@ class ShmInterface {
     #endif
         uint32_t numChannels;
         uint32_t channelOffset[maxNumChannels];
+        // RT thread placement, see setDSPThreadAffinity()
+        int32_t threadPriority;
+        uint32_t numThreadCpus;
+        int16_t threadCpus[maxNumThreadCpus];
     };
 
     // SharedMemory();
@@ -180,8 +224,8 @@ class ShmInterface {
     void disconnect();
 
     // create shared memory interface
-    void addChannel(ShmChannel::Type type,
-                    size_t size, std::string_view name);
+    void addChannel(ShmChannel::Type type, size_t size,
+                    std::string_view name, size_t audioSize = 0);
     void create();
     void close();
 
@@ -205,6 +249,10 @@ class ShmInterface {
 
     void getVersion(int& major, int& minor, int& patch) const;
 
+    // RT thread placement for the subprocess
+    void setThreadConfig(const std::vector<int>& cpus, int priority);
+    void getThreadConfig(std::vector<int>& cpus, int& priority) const;
+
 #if SHM_EVENT
     void * getParentProcessHandle() const { return hParentProcess_; }
 #endif
@@ -6,6 +6,9 @@
 
 #include <string.h>
 #include <assert.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 
 #ifndef DEBUG_THREADPOOL
 #define DEBUG_THREADPOOL 0
@@ -23,26 +26,109 @@ namespace vst {
 
 static std::atomic<int> gNumDSPThreads;
 
+// only set after the thread pool has been created,
+// so that setNumDSPThreads() can resize it.
+static std::atomic<DSPThreadPool *> gDSPThreadPool{nullptr};
+
 int getNumLogicalCPUs() {
     static auto n = std::thread::hardware_concurrency();
     return n;
 }
 
+int getNumDSPThreads() {
+    auto numThreads = gNumDSPThreads.load();
+    if (numThreads > 0) {
+        return numThreads;
+    } else {
+        return getNumLogicalCPUs(); // default
+    }
+}
+
 // set the number of DSP threads (0 = default)
 void setNumDSPThreads(int numThreads) {
     LOG_DEBUG("setNumDSPThreads: " << numThreads);
     gNumDSPThreads.store(std::max<int>(numThreads, 0));
+    // resize the thread pool if it is already running
+    if (auto pool = gDSPThreadPool.load()) {
+        pool->resize(std::max<int>(getNumDSPThreads() - 1, 1));
+    }
 }
 
-int getNumDSPThreads() {
-    auto numThreads = gNumDSPThreads.load();
-    if (numThreads > 0) {
-        return numThreads;
+// DSP thread placement; worker threads check the version after
+// waking up and reapply the settings if necessary.
+static Mutex gDSPThreadConfigMutex;
+static std::vector<int> gDSPThreadAffinity;
+static int gDSPThreadPriority = 0;
+static std::atomic<uint32_t> gDSPThreadConfigVersion{0};
+
+void setDSPThreadAffinity(const std::vector<int>& cpus) {
+    std::lock_guard lock(gDSPThreadConfigMutex);
+    gDSPThreadAffinity = cpus;
+    gDSPThreadConfigVersion.fetch_add(1);
+}
+
+std::vector<int> getDSPThreadAffinity() {
+    std::lock_guard lock(gDSPThreadConfigMutex);
+    return gDSPThreadAffinity;
+}
+
+void setDSPThreadPriority(int priority) {
+    std::lock_guard lock(gDSPThreadConfigMutex);
+    gDSPThreadPriority = std::max<int>(priority, 0);
+    gDSPThreadConfigVersion.fetch_add(1);
+}
+
+int getDSPThreadPriority() {
+    std::lock_guard lock(gDSPThreadConfigMutex);
+    return gDSPThreadPriority;
+}
+
+bool getDSPThreadPoolStatus(int& numThreads, double& utilization) {
+    if (auto pool = gDSPThreadPool.load()) {
+        numThreads = pool->numThreads();
+        utilization = pool->utilization();
+        return true;
     } else {
-        return getNumLogicalCPUs(); // default
+        return false;
     }
 }
 
+bool getDSPWaitStats(DSPWaitStats& stats) {
+    if (auto pool = gDSPThreadPool.load()) {
+        stats = pool->waitStats();
+        return true;
+    } else {
+        return false;
+    }
+}
+
+std::vector<DSPThreadInfo> getDSPThreadInfo() {
+    return DSPThreadPool::instance().threadInfo();
+}
+
+DSPThreadInfo applyDSPThreadConfig(int index, bool pinned) {
+    std::vector<int> cpus;
+    int priority;
+    {
+        std::lock_guard lock(gDSPThreadConfigMutex);
+        cpus = gDSPThreadAffinity;
+        priority = gDSPThreadPriority;
+    }
+    DSPThreadInfo info;
+    setThreadRealtimePriority(priority);
+    info.priority = getThreadRealtimePriority();
+    if (!cpus.empty()) {
+        int cpu = cpus[index % cpus.size()];
+        if (setThreadAffinity({ cpu })) {
+            info.affinity = cpu;
+        }
+    } else if (pinned) {
+        setThreadAffinity({}); // unpin
+    }
+    info.cpu = getCurrentCPU();
+    return info;
+}
+
 static thread_local bool gCurrentThreadDSP;
 
 // some callbacks in IPluginListener need to know whether they are
@@ -58,46 +144,87 @@ bool isCurrentThreadDSP() {
     return gCurrentThreadDSP;
 }
 
-DSPThreadPool::DSPThreadPool() {
+// the worker index of the current thread (-1 = not a worker thread)
+// together with the owning thread pool.
+static thread_local DSPThreadPool *gCurrentThreadPool = nullptr;
+static thread_local int gCurrentWorkerIndex = -1;
+
+// simple xorshift PRNG for choosing steal victims; we don't need
+// high quality randomness, it only has to be fast and RT-safe.
+static uint32_t randomVictim() {
+    static thread_local uint32_t seed = 0;
+    if (seed == 0) {
+        seed = (uint32_t)(uintptr_t)&seed | 1;
+    }
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static uint64_t getTimeNanos() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+double DSPThreadPool::getTime() {
+    return getTimeNanos() * 0.001;
+}
+
+DSPThreadPool& DSPThreadPool::instance(){
+    static DSPThreadPool inst;
+    gDSPThreadPool.store(&inst);
+    return inst;
+}
+
+//  number of available hardware threads minus one (= the main audio thread)
+DSPThreadPool::DSPThreadPool()
+    : DSPThreadPool(std::max<int>(getNumDSPThreads() - 1, 1)) {}
+
+DSPThreadPool::DSPThreadPool(int numThreads) {
     LOG_DEBUG("start DSPThreadPool");
-#if 0
-    THREAD_DEBUG("Align of DSPThreadPool: " << alignof(*this));
-    THREAD_DEBUG("DSPThreadPool address: " << this);
-    THREAD_DEBUG("pushLock address: " << &pushLock_);
-    THREAD_DEBUG("popLock address: " << &popLock_);
-#endif
 
     running_.store(true);
 
-    //  number of available hardware threads minus one (= the main audio thread)
-    int numThreads = std::max<int>(getNumDSPThreads() - 1, 1);
     THREAD_DEBUG("number of DSP helper threads: " << numThreads);
 
+    workers_ = std::make_unique<Worker[]>(maxNumThreads);
+
+    for (auto& count : waitCount_) {
+        count.store(0);
+    }
+
+    numThreads = std::clamp<int>(numThreads, 1, maxNumThreads);
     for (int i = 0; i < numThreads; ++i){
-        std::thread thread([this, i](){
-            setThreadPriority(Priority::High);
-            setCurrentThreadDSP();
-            run(i);
-        });
-        threads_.push_back(std::move(thread));
+        startWorker(i);
     }
+    numWorkers_.store(numThreads);
+
+    lastUtilizationTime_ = getTimeNanos();
 }
 
 DSPThreadPool::~DSPThreadPool(){
+    DSPThreadPool *self = this;
+    gDSPThreadPool.compare_exchange_strong(self, nullptr);
 #ifdef _WIN32
     // You can't synchronize threads in a global/static object
     // destructor in a Windows DLL because of the loader lock.
     // See https://docs.microsoft.com/en-us/windows/win32/dlls/dynamic-link-library-best-practices
-    for (auto& thread : threads_){
-        thread.detach();
+    for (int i = 0; i < maxNumThreads; ++i){
+        if (workers_[i].thread.joinable()){
+            workers_[i].thread.detach();
+        }
     }
+    // don't free the workers while threads might still be running!
+    workers_.release();
 #else
     running_.store(false);
 
     // wake up all threads!
-    semaphore_.post(threads_.size());
+    semaphore_.post(numWorkers_.load());
     // join threads
-    for (auto& thread : threads_){
+    for (int i = 0; i < maxNumThreads; ++i){
+        auto& thread = workers_[i].thread;
         if (thread.joinable()){
             thread.join();
         }
@@ -106,75 +233,336 @@ DSPThreadPool::~DSPThreadPool(){
     LOG_DEBUG("free DSPThreadPool");
 }
 
-bool DSPThreadPool::push(Callback cb, ThreadedPlugin *plugin, int numSamples){
-    pushLock_.lock();
-    bool result = queue_.push({ cb, plugin, numSamples });
-    pushLock_.unlock();
+void DSPThreadPool::startWorker(int index) {
+    auto& worker = workers_[index];
+    worker.retired.store(false);
+    worker.finished.store(false);
+    worker.affinity.store(-1);
+    worker.thread = std::thread([this, index](){
+        workers_[index].updatePlacement(index);
+        setCurrentThreadDSP();
+        gCurrentThreadPool = this;
+        gCurrentWorkerIndex = index;
+        run(index);
+        workers_[index].finished.store(true);
+    });
+}
+
+void DSPThreadPool::stopWorker(int index) {
+    auto& worker = workers_[index];
+    // NB: other threads might consume our wake up calls,
+    // so we have to keep posting until the worker has finished.
+    int count = 0;
+    while (!worker.finished.load()) {
+        if ((count++ % 64) == 0) {
+            semaphore_.post();
+        }
+        std::this_thread::yield();
+    }
+    worker.thread.join();
+}
+
+void DSPThreadPool::resize(int numThreads) {
+    std::lock_guard lock(mutex_);
+    numThreads = std::clamp<int>(numThreads, 1, maxNumThreads);
+    int oldNumThreads = numWorkers_.load();
+    if (numThreads > oldNumThreads) {
+        for (int i = oldNumThreads; i < numThreads; ++i) {
+            startWorker(i);
+        }
+        // publish *after* the workers have been started
+        numWorkers_.store(numThreads);
+    } else if (numThreads < oldNumThreads) {
+        // first make sure that nobody steals from the retired
+        // workers anymore, then retire and join them.
+        numWorkers_.store(numThreads);
+        for (int i = numThreads; i < oldNumThreads; ++i) {
+            workers_[i].retired.store(true);
+        }
+        for (int i = numThreads; i < oldNumThreads; ++i) {
+            stopWorker(i);
+        }
+    } else {
+        return;
+    }
+    LOG_DEBUG("DSPThreadPool: resized from " << oldNumThreads
+              << " to " << numThreads << " threads");
+}
+
+double DSPThreadPool::utilization() {
+    std::lock_guard lock(mutex_);
+    // NB: also include retired workers, so that the sum stays monotonic.
+    uint64_t busyTime = 0;
+    for (int i = 0; i < maxNumThreads; ++i) {
+        busyTime += workers_[i].busyTime.load(std::memory_order_relaxed);
+    }
+    auto now = getTimeNanos();
+    auto elapsed = (double)(now - lastUtilizationTime_) * numWorkers_.load();
+    auto result = elapsed > 0 ? (busyTime - lastBusyTime_) / elapsed : 0.0;
+    lastUtilizationTime_ = now;
+    lastBusyTime_ = busyTime;
+    return std::clamp(result, 0.0, 1.0);
+}
+
+// cost buckets grow exponentially: [0] unknown, [1] < 8 us,
+// [2] < 24 us, [3] < 56 us, ..., [7] >= 504 us
+static int getCostBucket(float cost, float minCost, int numBuckets) {
+    if (cost > 0) {
+        return std::min<int>(1 + std::ilogb(cost / minCost + 1.f), numBuckets - 1);
+    } else {
+        return 0;
+    }
+}
+
+bool DSPThreadPool::push(Task *task){
+    bool result = false;
+    if (gCurrentThreadPool == this) {
+        // worker thread: push to our own deque; fall back to
+        // the injection queues if the deque is full.
+        result = workers_[gCurrentWorkerIndex].deque.push(task);
+    }
+    if (!result) {
+        // if the queue is full, try the cheaper ones
+        auto bucket = getCostBucket(task->cost, minBucketCost, numCostBuckets);
+        for (int i = bucket; i >= 0 && !result; --i) {
+            result = injectQueue_[i].push(task);
+        }
+    }
     THREAD_DEBUG("DSPThreadPool: push task");
     semaphore_.post();
     return result;
 }
 
+DSPThreadPool::Task * DSPThreadPool::findTask(int index) {
+    Task *task;
+    // 1. our own deque
+    if (index >= 0 && workers_[index].deque.pop(task)) {
+        return task;
+    }
+    // 2. the injection queues, most expensive tasks first
+    for (int i = numCostBuckets - 1; i >= 0; --i) {
+        if (injectQueue_[i].pop(task)) {
+            return task;
+        }
+    }
+    // 3. try to steal from other workers, starting at a random victim.
+    int numWorkers = numWorkers_.load(std::memory_order_relaxed);
+    auto start = randomVictim() % numWorkers;
+    for (int i = 0; i < numWorkers; ++i) {
+        int victim = (start + i) % numWorkers;
+        if (victim != index && workers_[victim].deque.steal(task)) {
+            return task;
+        }
+    }
+    return nullptr;
+}
+
 bool DSPThreadPool::processTask(){
-    Task task;
-    popLock_.lock();
-    bool result = queue_.pop(task);
-    popLock_.unlock();
-    if (result) {
+    int index = (gCurrentThreadPool == this) ? gCurrentWorkerIndex : -1;
+    auto task = findTask(index);
+    if (task) {
         // call DSP routine
-        task.cb(task.plugin, task.numSamples);
+        task->cb(task->data, task->numSamples);
+        return true;
+    } else {
+        return false;
     }
-    return result;
 }
 
 void DSPThreadPool::run(int index) {
+    auto& worker = workers_[index];
     // the loop
-    while (running_.load()) {
-        Task task;
-        popLock_.lock();
-        while (queue_.pop(task)){
-            popLock_.unlock();
-            // call DSP routine
-            task.cb(task.plugin, task.numSamples);
-            popLock_.lock();
+    while (running_.load() && !worker.retired.load()) {
+        if (auto task = findTask(index)) {
+            auto start = getTimeNanos();
+            do {
+                // call DSP routine
+                task->cb(task->data, task->numSamples);
+            } while ((task = findTask(index)));
+            worker.busyTime.fetch_add(getTimeNanos() - start, std::memory_order_relaxed);
         }
-        popLock_.unlock();
 
         // wait for more
         semaphore_.wait();
 
         THREAD_DEBUG("DSP helper thread " << index << " woke up");
+
+        if (worker.configVersion != gDSPThreadConfigVersion.load(std::memory_order_relaxed)) {
+            worker.updatePlacement(index);
+        } else {
+            worker.cpu.store(getCurrentCPU(), std::memory_order_relaxed);
+        }
+    }
+    if (worker.retired.load()) {
+        // nobody steals from us anymore, so we must finish
+        // the tasks in our own deque ourselves.
+        Task *task;
+        while (worker.deque.pop(task)) {
+            task->cb(task->data, task->numSamples);
+        }
+        // we might have consumed a wake up call which was meant for a task,
+        // so we pass it on to the remaining workers.
+        semaphore_.post();
+        THREAD_DEBUG("DSP helper thread " << index << " retired");
     }
 }
 
+void DSPThreadPool::Worker::updatePlacement(int index) {
+    configVersion = gDSPThreadConfigVersion.load();
+    auto info = applyDSPThreadConfig(index, affinity.load() >= 0);
+    cpu.store(info.cpu);
+    affinity.store(info.affinity);
+    priority.store(info.priority);
+    LOG_DEBUG("DSP helper thread " << index << ": CPU " << info.cpu
+              << ", affinity " << info.affinity << ", priority " << info.priority);
+}
+
+void DSPThreadPool::setWaitPolicy(const WaitPolicy& policy) {
+    spinTime_.store(std::max<float>(policy.spinTime, 0));
+    yieldTime_.store(std::max<float>(policy.yieldTime, 0));
+    smoothing_.store(std::clamp<float>(policy.smoothing, 0, 1));
+}
+
+DSPThreadPool::WaitPolicy DSPThreadPool::waitPolicy() const {
+    WaitPolicy policy;
+    policy.spinTime = spinTime_.load();
+    policy.yieldTime = yieldTime_.load();
+    policy.smoothing = smoothing_.load();
+    return policy;
+}
+
+void DSPThreadPool::wait(Event& event, float& estimate) {
+    auto smoothing = smoothing_.load(std::memory_order_relaxed);
+    // check event without blocking.
+    if (event.try_wait()) {
+        estimate -= estimate * smoothing;
+        waitCount_[Immediate].fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // skip the stages which are unlikely to succeed
+    auto spinTime = spinTime_.load(std::memory_order_relaxed);
+    auto yieldTime = yieldTime_.load(std::memory_order_relaxed);
+    if (estimate > spinTime) {
+        spinTime = 0;
+    }
+    if (estimate > yieldTime) {
+        yieldTime = spinTime;
+    }
+    auto start = getTimeNanos();
+    auto stage = Spin;
+    for (;;) {
+        // instead of waiting, try to process a task.
+        // NOTE: we only process a single task at a time and then check again,
+        // because in the meantime another thread might have finished our task.
+        // in this case, we can move on and let the DSP threads do the remaining work.
+        if (!processTask()) {
+            auto elapsed = (getTimeNanos() - start) * 0.001;
+            if (elapsed < spinTime) {
+                stage = Spin;
+                for (int count = 100; count > 0; count--) {
+                    pauseCpu();
+                }
+            } else if (elapsed < yieldTime) {
+                stage = Yield;
+                std::this_thread::yield();
+            } else {
+                // nothing left to help with, so our task is already running
+                // on another thread; block until it has finished.
+                stage = Block;
+                event.wait();
+                break;
+            }
+        }
+        if (event.try_wait()) {
+            break;
+        }
+    }
+    auto elapsed = (getTimeNanos() - start) * 0.001;
+    estimate += (elapsed - estimate) * smoothing;
+    waitCount_[stage].fetch_add(1, std::memory_order_relaxed);
+}
+
+DSPWaitStats DSPThreadPool::waitStats() const {
+    DSPWaitStats stats;
+    stats.immediate = waitCount_[Immediate].load(std::memory_order_relaxed);
+    stats.spin = waitCount_[Spin].load(std::memory_order_relaxed);
+    stats.yield = waitCount_[Yield].load(std::memory_order_relaxed);
+    stats.block = waitCount_[Block].load(std::memory_order_relaxed);
+    return stats;
+}
+
+std::vector<DSPThreadInfo> DSPThreadPool::threadInfo() const {
+    std::vector<DSPThreadInfo> result;
+    for (int i = 0; i < numThreads(); ++i) {
+        auto& worker = workers_[i];
+        DSPThreadInfo info;
+        info.cpu = worker.cpu.load(std::memory_order_relaxed);
+        info.affinity = worker.affinity.load(std::memory_order_relaxed);
+        info.priority = worker.priority.load(std::memory_order_relaxed);
+        result.push_back(info);
+    }
+    return result;
+}
+
+/*////////////////////// Fork/Join ///////////////////////*/
+
+// plugins which have been forked on the current thread.
+// NB: this must be RT-safe, so we use a fixed size array;
+// if it is full, plugins will join immediately.
+struct ForkJoinState {
+    static const int maxNumPlugins = 256;
+
+    ThreadedPlugin *plugins[maxNumPlugins];
+    int numPlugins = 0;
+    bool active = false;
+
+    bool add(ThreadedPlugin *plugin) {
+        if (active && numPlugins < maxNumPlugins) {
+            plugins[numPlugins++] = plugin;
+            return true;
+        } else {
+            return false;
+        }
+    }
+};
+
+static thread_local ForkJoinState gForkJoinState;
+
+void beginForkJoin() {
+    gForkJoinState.active = true;
+}
+
+void endForkJoin() {
+    auto& state = gForkJoinState;
+    for (int i = 0; i < state.numPlugins; ++i) {
+        state.plugins[i]->join();
+    }
+    state.numPlugins = 0;
+    state.active = false;
+}
+
 /*////////////////////// ThreadedPlugin ///////////////////////*/
 
-IPlugin::ptr createThreadedPlugin(IPlugin::ptr plugin){
-    return std::make_unique<ThreadedPlugin>(std::move(plugin));
+IPlugin::ptr createThreadedPlugin(IPlugin::ptr plugin, ThreadMode mode){
+    return std::make_unique<ThreadedPlugin>(std::move(plugin), mode);
 }
 
-ThreadedPlugin::ThreadedPlugin(IPlugin::ptr plugin)
-    : plugin_(std::move(plugin)) {
+ThreadedPlugin::ThreadedPlugin(IPlugin::ptr plugin, ThreadMode mode)
+    : threadMode_(mode), plugin_(std::move(plugin)) {
     threadPool_ = &DSPThreadPool::instance(); // cache for performance
     event_.set(); // so that the process routine doesn't wait the very first time
+    pollFunction_ = UIThread::addPollFunction([](void *x){
+        static_cast<ThreadedPlugin *>(x)->pollCommands();
+    }, this);
     LOG_DEBUG("ThreadedPlugin");
 }
 
 ThreadedPlugin::~ThreadedPlugin() {
+    UIThread::removePollFunction(pollFunction_);
     // just to be sure
     plugin_->setListener(nullptr);
     // wait for last processing to finish (ideally we shouldn't have to)
     event_.wait();
-    // avoid memleak with param string and sysex command
-    for (int i = 0; i < 2; ++i){
-        for (auto& cmd : commands_[i]){
-            if (cmd.type == Command::SetParamString){
-                delete[] cmd.paramString.str;
-            } else if (cmd.type == Command::SendSysex){
-                delete[] cmd.sysex.data;
-            }
-        }
-    }
 }
 
 void ThreadedPlugin::setListener(IPluginListener* listener){
@@ -191,6 +579,10 @@ void ThreadedPlugin::setupProcessing(double sampleRate, int maxBlockSize,
     std::lock_guard lock(mutex_);
     plugin_->setupProcessing(sampleRate, maxBlockSize, precision, mode);
 
+    reserveCommands();
+
+    meter_.reset(sampleRate);
+
     if (maxBlockSize != blockSize_ || precision != precision_){
         blockSize_ = maxBlockSize;
         precision_ = precision;
@@ -201,17 +593,20 @@ void ThreadedPlugin::setupProcessing(double sampleRate, int maxBlockSize,
 }
 
 void ThreadedPlugin::updateBuffer(){
+    if (threadMode_ == ThreadMode::ForkJoin){
+        return; // we process directly from/into the host buffers
+    }
     int total = 0;
     for (int i = 0; i < numInputs_; ++i){
-        total += inputs_[i].numChannels;
+        total += inputs_[0][i].numChannels;
     }
     for (int i = 0; i < numOutputs_; ++i){
-        total += outputs_[i].numChannels;
+        total += outputs_[0][i].numChannels;
     }
     const int incr = blockSize_ *
         ((precision_ == ProcessPrecision::Double) ? sizeof(double) : sizeof(float));
     buffer_.clear(); // force zero initialization
-    buffer_.resize(total * incr);
+    buffer_.resize(total * incr * numBufferSets);
     // set buffer vectors
     auto setChannels = [](auto& bus, auto& buffer, int incr){
         for (int i = 0; i < bus.numChannels; ++i){
@@ -220,15 +615,28 @@ void ThreadedPlugin::updateBuffer(){
         }
     };
     auto buf = buffer_.data();
-    for (int i = 0; i < numInputs_; ++i){
-        setChannels(inputs_[i], buf, incr);
-    }
-    for (int i = 0; i < numOutputs_; ++i){
-        setChannels(outputs_[i], buf, incr);
+    for (int k = 0; k < numBufferSets; ++k){
+        for (int i = 0; i < numInputs_; ++i){
+            setChannels(inputs_[k][i], buf, incr);
+        }
+        for (int i = 0; i < numOutputs_; ++i){
+            setChannels(outputs_[k][i], buf, incr);
+        }
     }
     assert((buf - buffer_.data()) == buffer_.size());
 }
 
+bool ThreadedPlugin::getProcessBuffers(AudioBus *&inputs, AudioBus *&outputs){
+    if (threadMode_ == ThreadMode::ForkJoin){
+        return false; // we already process from/into the host buffers
+    }
+    // the host writes the next input into the host-facing set; the output
+    // becomes available in the in-flight set after the next process() call.
+    inputs = inputs_[hostSet_].get();
+    outputs = outputs_[taskSet_].get();
+    return true;
+}
+
 void ThreadedPlugin::dispatchCommands() {
     // read last queue
     for (auto& command : commands_[!current_]){
@@ -240,7 +648,6 @@ void ThreadedPlugin::dispatchCommands() {
         case Command::SetParamString:
             plugin_->setParameter(command.paramString.index, command.paramString.str,
                                   command.paramString.offset);
-            delete[] command.paramString.str; // !
             break;
         case Command::SetParamStringShort:
         {
@@ -288,7 +695,6 @@ void ThreadedPlugin::dispatchCommands() {
             break;
         case Command::SendSysex:
             plugin_->sendSysexEvent(command.sysex);
-            delete[] command.sysex.data; // !
             break;
         case Command::SetProgram:
             plugin_->setProgram(command.i);
@@ -308,19 +714,28 @@ void ThreadedPlugin::threadFunction(int numSamples){
     data.precision = precision_;
     data.mode = mode_;
     data.numSamples = numSamples;
-    data.inputs = inputs_.get();
+    data.inputs = inputs_[taskSet_].get();
     data.numInputs = numInputs_;
-    data.outputs = outputs_.get();
+    data.outputs = outputs_[taskSet_].get();
     data.numOutputs = numOutputs_;
 
+    runTask(data);
+}
+
+void ThreadedPlugin::runTask(ProcessData& data){
     if (mutex_.try_lock()){
         // clear outgoing event queue!
         events_[!current_].clear();
 
         dispatchCommands();
 
+        auto start = DSPThreadPool::getTime();
+
         plugin_->process(data);
 
+        // NB: the task is not in flight anymore
+        task_.updateCost(DSPThreadPool::getTime() - start);
+
         mutex_.unlock();
     } else {
         bypass(data);
@@ -330,34 +745,16 @@ void ThreadedPlugin::threadFunction(int numSamples){
     event_.set();
 }
 
+void ThreadedPlugin::waitForTask(){
+    // we might help with other tasks while waiting
+    setCurrentThreadDSP(); // !
+    threadPool_->wait(event_, waitEstimate_);
+}
+
 template<typename T>
 void ThreadedPlugin::doProcess(ProcessData& data){
     // LATER do *hard* bypass here and not in the thread function
 
-    // check event without blocking.
-    // LOG_DEBUG("try to wait for task");
-    if (!event_.try_wait()){
-        setCurrentThreadDSP(); // !
-        bool didWait = false;
-        do {
-            // instead of waiting, try to process a task.
-            // NOTE: we only process a single task at a time and then check again,
-            // because in the meantime another thread might have finished our task.
-            // in this case, we can move on and let the DSP threads do the remaining work.
-            if (!threadPool_->processTask()){
-                if (!didWait) {
-                    // LOG_DEBUG("wait for task");
-                    didWait = true;
-                }
-                for (int count = 1000; count > 0; count--) {
-                    pauseCpu();
-                }
-            } else {
-                // LOG_DEBUG("process task");
-            }
-        } while (!event_.try_wait());
-    }
-
     auto copyChannels = [](auto& from, auto& to, int nsamples){
         assert(from.numChannels == to.numChannels);
         for (int i = 0; i < from.numChannels; ++i){
@@ -366,26 +763,37 @@ void ThreadedPlugin::doProcess(ProcessData& data){
             std::copy(src, src + nsamples, dst);
         }
     };
-    // get new input from host
+    // get new input from host. We don't have to wait for the previous task
+    // because it uses a different buffer set. No need to copy if the host
+    // has already written into our buffers, see getProcessBuffers().
     assert(data.numInputs == numInputs_);
-    for (int i = 0; i < data.numInputs; ++i){
-        copyChannels(data.inputs[i], inputs_[i], data.numSamples);
-    }
-    // send last output to host
-    assert(data.numOutputs == numOutputs_);
-    for (int i = 0; i < data.numOutputs; ++i){
-        copyChannels(outputs_[i], data.outputs[i], data.numSamples);
+    if (data.inputs != inputs_[hostSet_].get()){
+        for (int i = 0; i < data.numInputs; ++i){
+            copyChannels(data.inputs[i], inputs_[hostSet_][i], data.numSamples);
+        }
     }
+
+    waitForTask();
+
+    // rotate buffer sets: the in-flight set has completed, the host-facing
+    // set goes in flight and the old completed set becomes host-facing.
+    auto done = taskSet_;
+    taskSet_ = hostSet_;
+    hostSet_ = doneSet_;
+    doneSet_ = done;
     // swap queues and notify DSP thread pool
     current_ = !current_;
-    auto cb = [](ThreadedPlugin *plugin, int numSamples){
-        plugin->threadFunction<T>(numSamples);
+    // NB: the previous task has finished, so we can safely reuse it.
+    task_.cb = [](void *plugin, int numSamples){
+        static_cast<ThreadedPlugin *>(plugin)->threadFunction<T>(numSamples);
     };
-    if (!threadPool_->push(cb, this, data.numSamples)){
+    task_.data = this;
+    task_.numSamples = data.numSamples;
+    if (!threadPool_->push(&task_)){
         LOG_WARNING("ThreadedPlugin: couldn't push DSP task!");
         // skip processing and clear outputs
         for (int i = 0; i < numOutputs_; ++i){
-            auto& output = outputs_[i];
+            auto& output = outputs_[taskSet_][i];
             for (int j = 0; j < output.numChannels; ++j){
                 auto chn = (T *)output.channelData32[j]; // cast to actual size
                 std::fill(chn, chn + data.numSamples, 0);
@@ -395,12 +803,54 @@ void ThreadedPlugin::doProcess(ProcessData& data){
         event_.set(); // so that the next call to event_.wait() doesn't block!
     }
 
-    sendEvents();
+    // send last output to host while the new task is running.
+    // No need to copy if the host reads directly from our buffers.
+    assert(data.numOutputs == numOutputs_);
+    if (data.outputs != outputs_[doneSet_].get()){
+        for (int i = 0; i < data.numOutputs; ++i){
+            copyChannels(outputs_[doneSet_][i], data.outputs[i], data.numSamples);
+        }
+    }
+
+    sendEvents(current_);
+}
+
+void ThreadedPlugin::doProcessForkJoin(ProcessData& data){
+    // wait for previous task; this is typically a no-op because
+    // we have already joined in the last process() call.
+    waitForTask();
+    // process directly from/into the host buffers.
+    forkData_ = data;
+    // swap queues and notify DSP thread pool
+    current_ = !current_;
+    task_.cb = [](void *plugin, int){
+        auto p = static_cast<ThreadedPlugin *>(plugin);
+        p->runTask(p->forkData_);
+    };
+    task_.data = this;
+    task_.numSamples = data.numSamples;
+    if (!threadPool_->push(&task_)){
+        // process on this thread
+        runTask(forkData_);
+    }
+    // join immediately if we are not inside beginForkJoin()/endForkJoin()
+    if (!gForkJoinState.add(this)){
+        join();
+    }
+}
+
+void ThreadedPlugin::join(){
+    // help processing until our task has finished.
+    waitForTask();
+    // set again, so that the next waitForTask() resp. the destructor doesn't block.
+    event_.set();
+    // unlike in deferred mode, we can send the events of the current block.
+    sendEvents(!current_);
 }
 
-void ThreadedPlugin::sendEvents(){
+void ThreadedPlugin::sendEvents(int index){
     if (listener_){
-        for (auto& event : events_[current_]){
+        for (auto& event : events_[index]){
             switch (event.type){
             case Command::ParamAutomated:
                 listener_->parameterAutomated(event.paramAutomated.index,
@@ -414,7 +864,6 @@ void ThreadedPlugin::sendEvents(){
                 break;
             case Command::SysexReceived:
                 listener_->sysexEvent(event.sysex);
-                delete[] event.sysex.data; // delete data!
                 break;
             default:
                 break;
@@ -424,11 +873,15 @@ void ThreadedPlugin::sendEvents(){
 }
 
 void ThreadedPlugin::process(ProcessData& data) {
-    if (data.precision == ProcessPrecision::Double){
+    meter_.start();
+    if (threadMode_ == ThreadMode::ForkJoin){
+        doProcessForkJoin(data);
+    } else if (data.precision == ProcessPrecision::Double){
         doProcess<double>(data);
     } else {
         doProcess<float>(data);
     }
+    meter_.stop(data.numSamples);
 }
 
 void ThreadedPlugin::suspend() {
@@ -439,24 +892,53 @@ void ThreadedPlugin::suspend() {
 void ThreadedPlugin::resume() {
     std::lock_guard lock(mutex_);
     plugin_->resume();
+
+    reserveCommands();
+}
+
+// grow command/event buffers to the peak usage so far, so that
+// they don't have to grow on the audio thread or DSP thread.
+// NB: must be called with the mutex locked!
+void ThreadedPlugin::reserveCommands() {
+    for (int i = 0; i < 2; ++i){
+        commands_[i].reserve();
+        events_[i].reserve();
+    }
+}
+
+// Called on the UI thread: report dropped commands/events and grow the
+// buffers off the audio thread resp. DSP thread, see CommandBuffer::grow().
+void ThreadedPlugin::pollCommands() {
+    size_t dropped = 0;
+    for (int i = 0; i < 2; ++i){
+        dropped += commands_[i].takeOverflow() + events_[i].takeOverflow();
+        commands_[i].grow();
+        events_[i].grow();
+    }
+    if (dropped > 0){
+        LOG_WARNING("ThreadedPlugin: command buffer full, "
+                    << dropped << " command(s) dropped");
+    }
 }
 
 void ThreadedPlugin::setNumSpeakers(int *input, int numInputs,
                                     int *output, int numOutputs) {
     std::lock_guard lock(mutex_);
     plugin_->setNumSpeakers(input, numInputs, output, numOutputs);
-    // create input busses
-    inputs_ = numInputs > 0 ? std::make_unique<Bus[]>(numInputs) : nullptr;
-    numInputs_ = numInputs;
-    for (int i = 0; i < numInputs; ++i){
-        inputs_[i] = Bus(input[i]);
+    for (int k = 0; k < numBufferSets; ++k){
+        // create input busses
+        inputs_[k] = numInputs > 0 ? std::make_unique<Bus[]>(numInputs) : nullptr;
+        for (int i = 0; i < numInputs; ++i){
+            inputs_[k][i] = Bus(input[i]);
+        }
+        // create output busses
+        outputs_[k] = numOutputs > 0 ? std::make_unique<Bus[]>(numOutputs) : nullptr;
+        for (int i = 0; i < numOutputs; ++i){
+            outputs_[k][i] = Bus(output[i]);
+        }
     }
-    // create output busses
-    outputs_ = numOutputs > 0 ? std::make_unique<Bus[]>(numOutputs) : nullptr;
+    numInputs_ = numInputs;
     numOutputs_ = numOutputs;
-    for (int i = 0; i < numOutputs; ++i){
-        outputs_[i] = Bus(output[i]);
-    }
 
     updateBuffer();
 }
@@ -626,7 +1108,10 @@ void ThreadedPlugin::midiEvent(const MidiEvent& event) {
 void ThreadedPlugin::sysexEvent(const SysexEvent& event) {
     if (isCurrentThreadDSP()) {
         // deep copy!
-        auto data = new char[event.size];
+        auto data = events_[!current_].allocate(event.size);
+        if (!data){
+            return; // see CommandBuffer
+        }
         memcpy(data, event.data, event.size);
 
         Command e(Command::SysexReceived);
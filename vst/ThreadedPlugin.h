@@ -5,6 +5,7 @@
 #include "DeferredPlugin.h"
 #include "Lockfree.h"
 #include "Bus.h"
+#include "ProcessMeter.h"
 
 #include <thread>
 
@@ -12,27 +13,110 @@ namespace vst {
 
 class ThreadedPlugin;
 
+// apply the DSP thread placement (see setDSPThreadAffinity() and
+// setDSPThreadPriority()) to the current thread. 'index' selects the CPU;
+// 'pinned' tells whether the thread is currently pinned.
+DSPThreadInfo applyDSPThreadConfig(int index, bool pinned);
+
 class DSPThreadPool {
  public:
-    static DSPThreadPool& instance(){
-        static DSPThreadPool inst;
-        return inst;
-    }
+    // the number of worker slots is fixed, so that we can
+    // resize the pool without reallocating the workers.
+    static const int maxNumThreads = 64;
+
+    static DSPThreadPool& instance();
 
     DSPThreadPool();
+    explicit DSPThreadPool(int numThreads);
     ~DSPThreadPool();
 
-    using Callback = void (*)(ThreadedPlugin *, int);
-    bool push(Callback cb, ThreadedPlugin *plugin, int numSamples);
+    using Callback = void (*)(void *, int);
 
-    bool processTask();
- private:
+    // NOTE: tasks are owned by the caller and must stay alive until
+    // the callback has been invoked. In practice, every ThreadedPlugin
+    // has a single Task object which is only ever pushed after the
+    // previous invocation has finished.
     struct Task {
         Callback cb;
-        ThreadedPlugin *plugin;
+        void *data;
         int numSamples;
+        // expected cost in microseconds (0 = unknown), see push()
+        float cost = 0;
+
+        // update the cost estimate with a new measurement
+        void updateCost(float elapsed) {
+            cost = (cost > 0) ? cost + (elapsed - cost) * 0.1f : elapsed;
+        }
+    };
+
+    // Tasks pushed by non-worker threads are sorted into queues by their
+    // expected cost, so that expensive tasks are started first (LPT).
+    // Tasks without cost estimate share the lowest queue, i.e. they are
+    // processed in FIFO order.
+    bool push(Task *task);
+
+    bool processTask();
+
+    // grow or shrink the pool at runtime (not realtime safe!)
+    // Retired threads first finish all tasks in their own deque.
+    void resize(int numThreads);
+
+    int numThreads() const {
+        return numWorkers_.load(std::memory_order_relaxed);
+    }
+
+    // average utilization of all active threads since the last call (0.0 - 1.0)
+    double utilization();
+
+    // monotonic time in microseconds, e.g. for measuring task costs
+    static double getTime();
+
+    // Adaptive policy for threads waiting on a task, see wait().
+    // Depending on the expected wait time, the thread spins,
+    // then yields and finally blocks on the event.
+    struct WaitPolicy {
+        float spinTime = 20; // max. spin time in microseconds
+        float yieldTime = 200; // max. spin + yield time in microseconds
+        float smoothing = 0.1; // coefficient of the wait time estimate
     };
-    std::vector<std::thread> threads_;
+
+    void setWaitPolicy(const WaitPolicy& policy);
+
+    WaitPolicy waitPolicy() const;
+
+    // wait until 'event' has been set and help with other tasks in the meantime.
+    // 'estimate' is the expected wait time in microseconds; it is updated
+    // with the actual wait time and should be kept by the caller.
+    void wait(Event& event, float& estimate);
+
+    DSPWaitStats waitStats() const;
+
+    std::vector<DSPThreadInfo> threadInfo() const;
+ private:
+    // Every worker owns a Chase-Lev deque. Tasks pushed by a worker thread
+    // go to its own deque, tasks pushed by other threads (i.e. audio threads)
+    // go to the shared injection queue. Idle threads first check their own deque,
+    // then the injection queue and finally try to steal from other workers.
+    struct alignas(CACHELINE_SIZE) Worker {
+        WorkStealingDeque<Task *, 256> deque;
+        std::thread thread;
+        std::atomic<bool> retired{false};
+        std::atomic<bool> finished{false};
+        std::atomic<uint64_t> busyTime{0}; // nanoseconds
+        // placement
+        uint32_t configVersion = 0;
+        std::atomic<int> cpu{-1};
+        std::atomic<int> affinity{-1};
+        std::atomic<int> priority{0};
+
+        void updatePlacement(int index);
+    };
+    std::unique_ptr<Worker[]> workers_;
+    std::atomic<int> numWorkers_{0};
+    // see push()
+    static const int numCostBuckets = 8;
+    static constexpr float minBucketCost = 8; // microseconds
+    LockfreeMPMCQueue<Task *, 1024> injectQueue_[numCostBuckets];
     // NOTE: Semaphore is the right tool to notify one or more threads in a thread pool.
     // With Event there are certain edge cases where it would fail to notify the correct
     // number of threads. For example, if several worker threads are about to call wait()
@@ -43,9 +127,28 @@ class DSPThreadPool {
     // threads spin a few times, but I think this negligible. Also, the post() call is a bit faster.
     LightSemaphore semaphore_;
     std::atomic<bool> running_;
-    LockfreeFifo<Task, 1024> queue_;
-    PaddedSpinLock pushLock_;
-    PaddedSpinLock popLock_;
+    // wait policy
+    std::atomic<float> spinTime_{WaitPolicy{}.spinTime};
+    std::atomic<float> yieldTime_{WaitPolicy{}.yieldTime};
+    std::atomic<float> smoothing_{WaitPolicy{}.smoothing};
+    enum WaitStage {
+        Immediate,
+        Spin,
+        Yield,
+        Block,
+        NumWaitStages
+    };
+    alignas(CACHELINE_SIZE) std::atomic<uint64_t> waitCount_[NumWaitStages];
+    // resize() and utilization()
+    Mutex mutex_;
+    uint64_t lastUtilizationTime_ = 0; // nanoseconds
+    uint64_t lastBusyTime_ = 0;
+
+    void startWorker(int index);
+
+    void stopWorker(int index);
+
+    Task * findTask(int index);
 
     void run(int index);
 };
@@ -56,7 +159,7 @@ class DSPThreadPool {
 class ThreadedPlugin final : public DeferredPlugin, public IPluginListener
 {
  public:
-    ThreadedPlugin(IPlugin::ptr plugin);
+    ThreadedPlugin(IPlugin::ptr plugin, ThreadMode mode = ThreadMode::Deferred);
     ~ThreadedPlugin();
 
     const PluginDesc& info() const override {
@@ -72,9 +175,15 @@ class ThreadedPlugin final : public DeferredPlugin, public IPluginListener
     void suspend() override;
     void resume() override;
     void setNumSpeakers(int *input, int numInputs, int *output, int numOutputs) override;
+    bool getProcessBuffers(AudioBus *&inputs, AudioBus *&outputs) override;
     int getLatencySamples() override {
         return plugin_->getLatencySamples();
     }
+    // NB: only measures the time spent on the audio thread,
+    // i.e. waiting for the previous task and copying buffers.
+    ProcessStats getProcessStats() const override {
+        return meter_.getStats();
+    }
 
     void setListener(IPluginListener* listener) override;
 
@@ -136,39 +245,60 @@ class ThreadedPlugin final : public DeferredPlugin, public IPluginListener
     void pluginCrashed() override;
     void midiEvent(const MidiEvent& event) override;
     void sysexEvent(const SysexEvent& event) override;
+
+    // wait for a forked task, see ThreadMode::ForkJoin
+    void join();
 private:
     void updateBuffer();
     template<typename T>
     void doProcess(ProcessData& data);
+    void doProcessForkJoin(ProcessData& data);
+    void waitForTask();
     void dispatchCommands();
-    void sendEvents();
+    void sendEvents(int index);
     template<typename T>
     void threadFunction(int numSamples);
+    void runTask(ProcessData& data);
     // data
     DSPThreadPool *threadPool_;
+    ThreadMode threadMode_;
+    ProcessData forkData_; // host buffers for ThreadMode::ForkJoin
     IPlugin::ptr plugin_;
     IPluginListener* listener_ = nullptr;
     mutable Mutex mutex_; // use spinlock instead?
     Event event_;
+    float waitEstimate_ = 0; // see DSPThreadPool::wait()
     // commands/events
-    void pushCommand(const Command& command) override {
-        commands_[current_].push_back(command);
+    CommandBuffer& commandBuffer() override {
+        return commands_[current_];
     }
     void pushEvent(const Command& event){
-        events_[!current_].push_back(event);
+        events_[!current_].push(event);
     }
-    std::vector<Command> commands_[2];
-    std::vector<Command> events_[2];
+    void reserveCommands();
+    void pollCommands();
+    CommandBuffer commands_[2];
+    CommandBuffer events_[2];
     int current_ = 0;
+    UIThread::Handle pollFunction_; // see pollCommands()
+    DSPThreadPool::Task task_;
     int program_ = 0; // current program number
     // buffer
     int blockSize_ = 0;
     ProcessPrecision precision_ = ProcessPrecision::Single;
     ProcessMode mode_ = ProcessMode::Realtime;
-    std::unique_ptr<Bus[]> inputs_;
+    ProcessMeter meter_;
+    // triple buffering: the host-facing set receives the next input,
+    // the in-flight set is being processed and the completed set holds
+    // the last output. The sets rotate in every process() call.
+    static const int numBufferSets = 3;
+    std::unique_ptr<Bus[]> inputs_[numBufferSets];
     int numInputs_ = 0;
-    std::unique_ptr<Bus[]> outputs_;
+    std::unique_ptr<Bus[]> outputs_[numBufferSets];
     int numOutputs_ = 0;
+    int hostSet_ = 0;
+    int taskSet_ = 1;
+    int doneSet_ = 2;
     std::vector<char> buffer_;
 };
 
@@ -316,6 +316,7 @@ void VST2Plugin::setupProcessing(double sampleRate, int maxBlockSize,
               << ", precision: " << ((precision == ProcessPrecision::Single) ? "single" : "double")
               << ", mode: " << ((mode == ProcessMode::Offline) ? "offline" : "realtime") << ")");
     mode_ = mode;
+    meter_.reset(sampleRate);
     if (sampleRate > 0){
         dispatch(effSetSampleRate, 0, 0, NULL, sampleRate);
         // only update if sample rate has changed
@@ -533,6 +534,7 @@ void VST2Plugin::bypassProcess(ProcessData& data, TProc processRoutine,
 }
 
 void VST2Plugin::process(ProcessData& data){
+    meter_.start();
     preProcess(data.numSamples);
     if (data.precision == ProcessPrecision::Double){
         doProcess<double>(data, plugin_->processDoubleReplacing);
@@ -540,6 +542,7 @@ void VST2Plugin::process(ProcessData& data){
         doProcess<float>(data, plugin_->processReplacing);
     }
     postProcess(data.numSamples);
+    meter_.stop(data.numSamples);
 }
 
 bool VST2Plugin::hasPrecision(ProcessPrecision precision) const {
@@ -3,6 +3,7 @@
 
 #include "Interface.h"
 #include "PluginFactory.h"
+#include "ProcessMeter.h"
 
 #define VST_FORCE_DEPRECATED 0
 #include "aeffectx.h"
@@ -60,6 +61,9 @@ class VST2Plugin final : public IPlugin {
     void setNumSpeakers(int *input, int numInputs,
                         int *output, int numOutputs) override;
     int getLatencySamples() override;
+    ProcessStats getProcessStats() const override {
+        return meter_.getStats();
+    }
 
     void setListener(IPluginListener* listener) override {
         listener_ = listener;
@@ -165,6 +169,7 @@ class VST2Plugin final : public IPlugin {
     // processing
     int latency_ = 0;
     ProcessMode mode_ = ProcessMode::Realtime;
+    ProcessMeter meter_;
     VstTimeInfo timeInfo_;
     Bypass bypass_ = Bypass::Off;
     Bypass lastBypass_ = Bypass::Off;
@@ -1012,6 +1012,8 @@ void VST3Plugin::setupProcessing(double sampleRate, int maxBlockSize,
 
     processor_->setupProcessing(reinterpret_cast<Vst::ProcessSetup&>(setup));
 
+    meter_.reset(sampleRate);
+
     // only update if sample rate has changed
     if (sampleRate != context_.sampleRate){
         auto ratio = sampleRate / context_.sampleRate;
@@ -1024,11 +1026,13 @@ void VST3Plugin::setupProcessing(double sampleRate, int maxBlockSize,
 }
 
 void VST3Plugin::process(ProcessData& data){
+    meter_.start();
     if (data.precision == ProcessPrecision::Double){
         doProcess<double>(data);
     } else {
         doProcess<float>(data);
     }
+    meter_.stop(data.numSamples);
 }
 
 template<typename T>
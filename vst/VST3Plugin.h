@@ -3,6 +3,7 @@
 #include "Interface.h"
 #include "PluginFactory.h"
 #include "Lockfree.h"
+#include "ProcessMeter.h"
 
 #include "pluginterfaces/base/funknown.h"
 #include "pluginterfaces/base/ipluginbase.h"
@@ -433,6 +434,9 @@ class VST3Plugin final :
     void setBypass(Bypass state) override;
     void setNumSpeakers(int *input, int numInputs, int *output, int numOutputs) override;
     int getLatencySamples() override;
+    ProcessStats getProcessStats() const override {
+        return meter_.getStats();
+    }
 
     void setListener(IPluginListener* listener) override {
         listener_ = listener;
@@ -526,6 +530,7 @@ class VST3Plugin final :
     Bypass lastBypass_ = Bypass::Off;
     bool bypassSilent_ = false; // check if we can stop processing
     ProcessMode mode_ = ProcessMode::Realtime;
+    ProcessMeter meter_;
     // midi
     EventList inputEvents_;
     EventList outputEvents_;
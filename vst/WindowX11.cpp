@@ -82,39 +82,42 @@ EventLoop::EventLoop() {
     if (!XInitThreads()){
         LOG_WARNING("X11: XInitThreads failed!");
     }
-    display_ = XOpenDisplay(nullptr);
-    if (!display_){
-        LOG_ERROR("X11: couldn't open display! No X11 server?");
-        return;
-    }
-    displayfd_ = ::XConnectionNumber(display_);
-    // install error handler, so our program won't die on a bad X11 request
-    XSetErrorHandler([](Display *d, XErrorEvent *e){
-        char buf[256];
-        buf[0] = 0;
-        XGetErrorText(d, e->error_code, buf, sizeof(buf));
-        LOG_ERROR("X11: Error: " << buf);
-        return 0;
-    });
-
     eventfd_ = eventfd(0, 0);
     if (eventfd_ < 0){
         throw Error("X11: couldn't create eventfd");
     }
-#if 0
-    // root_ = DefaultRootWindow(display_);
-#else
-    // for some reason, the "real" root window doesn't receive
-    // client messages, so I have to create a dummy window instead...
-    root_ = XCreateSimpleWindow(display_, DefaultRootWindow(display_),
-                0, 0, 1, 1, 1, 0, 0);
-#endif
-    if (!root_) {
-        throw Error("X11: couldn't create root window!");
-    }
-    LOG_DEBUG("X11: created root window: " << root_);
-    wmProtocols = XInternAtom(display_, "WM_PROTOCOLS", 0);
-    wmDelete = XInternAtom(display_, "WM_DELETE_WINDOW", 0);
+
+    display_ = XOpenDisplay(nullptr);
+    if (display_){
+        displayfd_ = ::XConnectionNumber(display_);
+        // install error handler, so our program won't die on a bad X11 request
+        XSetErrorHandler([](Display *d, XErrorEvent *e){
+            char buf[256];
+            buf[0] = 0;
+            XGetErrorText(d, e->error_code, buf, sizeof(buf));
+            LOG_ERROR("X11: Error: " << buf);
+            return 0;
+        });
+    #if 0
+        // root_ = DefaultRootWindow(display_);
+    #else
+        // for some reason, the "real" root window doesn't receive
+        // client messages, so I have to create a dummy window instead...
+        root_ = XCreateSimpleWindow(display_, DefaultRootWindow(display_),
+                    0, 0, 1, 1, 1, 0, 0);
+    #endif
+        if (!root_) {
+            throw Error("X11: couldn't create root window!");
+        }
+        LOG_DEBUG("X11: created root window: " << root_);
+        wmProtocols = XInternAtom(display_, "WM_PROTOCOLS", 0);
+        wmDelete = XInternAtom(display_, "WM_DELETE_WINDOW", 0);
+    } else {
+        // We still run the event loop without X11 events, so that
+        // UI thread commands, timers and poll functions keep working,
+        // e.g. for sandboxed plugins on a headless machine.
+        LOG_ERROR("X11: couldn't open display! No X11 server?");
+    }
 
     running_.store(true);
     if (UIThread::isCurrentThread()) {
@@ -299,6 +302,9 @@ void EventLoop::pollFileDescriptors(int timeout){
 }
 
 void EventLoop::pollX11Events(){
+    if (!display_){
+        return;
+    }
     while (XPending(display_)){
         XEvent event;
         XNextEvent(display_, &event);
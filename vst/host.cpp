@@ -3,6 +3,7 @@
 #include "Log.h"
 #include "FileUtils.h"
 #include "MiscUtils.h"
+#include "ProbeWorker.h"
 #if USE_BRIDGE
 #include "PluginServer.h"
 #endif
@@ -10,6 +11,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <mutex>
+#include <sstream>
+
+#if VST_HOST_SYSTEM != VST_WINDOWS
+# include <errno.h>
+# include <poll.h>
+# include <signal.h>
+# include <unistd.h>
+#endif
 
 // a) probe on main thread without event loop
 #define PROBE_WITHOUT_UI_THREAD 0
@@ -36,25 +45,15 @@ using namespace vst;
 # define shorten(x) x
 #endif
 
-void writeErrorMsg(Error::ErrorCode code, std::string_view msg, const std::string& path){
-    if (!path.empty()){
-        // this part should be async signal safe
-        vst::File file(path, File::WRITE);
-        if (file.is_open()) {
-            file << static_cast<int>(code) << "\n";
-            file << msg << "\n";
-        } else {
-            LOG_ERROR("ERROR: couldn't write error message");
-        }
-    }
+void writeErrorMsg(Error::ErrorCode code, std::string_view msg, std::ostream& os){
+    os << static_cast<int>(code) << "\n";
+    os << msg << "\n";
 }
 
-// probe a plugin and write info to file
-// returns EXIT_SUCCESS on success, EXIT_FAILURE on fail and anything else on error/crash :-)
-int probe(const std::string& pluginPath, int pluginIndex, const std::string& filePath)
+// probe a plugin and write the info resp. error message to 'os'.
+// returns EXIT_SUCCESS on success and EXIT_FAILURE on fail
+int doProbe(const std::string& pluginPath, int pluginIndex, std::ostream& os)
 {
-    setThreadPriority(Priority::Low);
-
     LOG_DEBUG("probing " << pluginPath << " " << pluginIndex);
     try {
 #if PROBE_MODE != PROBE_WITHOUT_UI_THREAD
@@ -109,29 +108,191 @@ int probe(const std::string& pluginPath, int pluginIndex, const std::string& fil
 
 #endif // PROBE_MODE
 
-        if (!filePath.empty()) {
-            vst::File file(filePath, File::WRITE);
-            if (file.is_open()) {
-                desc->serialize(file);
-            } else {
-                LOG_ERROR("ERROR: couldn't write info file " << filePath);
-            }
-        }
+        desc->serialize(os);
         LOG_INFO("Probe succeeded.");
         return EXIT_SUCCESS;
     } catch (const Error& e){
-        writeErrorMsg(e.code(), e.what(), filePath);
+        writeErrorMsg(e.code(), e.what(), os);
         LOG_ERROR("Probe failed: " << e.what());
     } catch (const std::exception& e) {
-        writeErrorMsg(Error::UnknownError, e.what(), filePath);
+        writeErrorMsg(Error::UnknownError, e.what(), os);
         LOG_ERROR("Probe failed: " << e.what());
     } catch (...) {
-        writeErrorMsg(Error::UnknownError, "unknown exception", filePath);
+        writeErrorMsg(Error::UnknownError, "unknown exception", os);
         LOG_ERROR("Probe failed: unknown exception.");
     }
     return EXIT_FAILURE;
 }
 
+// probe a plugin and write info to file
+// returns EXIT_SUCCESS on success, EXIT_FAILURE on fail and anything else on error/crash :-)
+int probe(const std::string& pluginPath, int pluginIndex, const std::string& filePath)
+{
+    setThreadPriority(Priority::Low);
+
+    // NB: only create the file after probing! On Wine, a missing file
+    // might be the only indicator for a crash, see PluginFactory::doProbePlugin().
+    std::stringstream ss;
+    auto result = doProbe(pluginPath, pluginIndex, ss);
+    if (!filePath.empty()) {
+        vst::File file(filePath, File::WRITE);
+        if (file.is_open()) {
+            file << ss.rdbuf();
+        } else {
+            LOG_ERROR("ERROR: couldn't write info file " << filePath);
+        }
+    }
+    return result;
+}
+
+// probe plugins one after another until the parent closes the
+// request pipe resp. dies, see ProbeWorker.
+int probeServer(int pid, intptr_t requestPipe, intptr_t replyPipe){
+    setThreadPriority(Priority::Low);
+
+#if VST_HOST_SYSTEM == VST_WINDOWS
+    HANDLE hRequest = NULL, hReply = NULL;
+    auto hParent = OpenProcess(PROCESS_DUP_HANDLE, FALSE, pid);
+    if (!hParent){
+        LOG_ERROR("OpenProcess() failed: " << errorMessage(GetLastError()));
+        return EXIT_FAILURE;
+    }
+    auto duplicate = [&](intptr_t handle, HANDLE& result){
+        return DuplicateHandle(hParent, (HANDLE)handle, GetCurrentProcess(),
+                               &result, 0, FALSE, DUPLICATE_SAME_ACCESS);
+    };
+    if (!duplicate(requestPipe, hRequest) || !duplicate(replyPipe, hReply)){
+        LOG_ERROR("DuplicateHandle() failed: " << errorMessage(GetLastError()));
+        CloseHandle(hParent);
+        return EXIT_FAILURE;
+    }
+    CloseHandle(hParent);
+
+    auto readPipe = [&](void *data, size_t size){
+        auto buf = static_cast<char *>(data);
+        while (size > 0){
+            DWORD bytesRead;
+            if (!ReadFile(hRequest, buf, size, &bytesRead, NULL)){
+                return false; // ERROR_BROKEN_PIPE
+            }
+            buf += bytesRead;
+            size -= bytesRead;
+        }
+        return true;
+    };
+    auto writePipe = [&](const void *data, size_t size){
+        auto buf = static_cast<const char *>(data);
+        while (size > 0){
+            DWORD bytesWritten;
+            if (!WriteFile(hReply, buf, size, &bytesWritten, NULL)){
+                return false;
+            }
+            buf += bytesWritten;
+            size -= bytesWritten;
+        }
+        return true;
+    };
+#else
+    // The request pipe might not be closed when the parent dies, e.g. if
+    // the socket has been inherited by another subprocess, so we also have
+    // to check the parent periodically (see PluginServer::checkIfParentAlive())
+    auto parentAlive = [&](){
+  #ifndef __WINE__
+        return getppid() == pid;
+  #else
+        // we might have been forked in a Wine launcher app
+        return (kill(pid, 0) == 0) || (errno == EPERM);
+  #endif
+    };
+    // wait until the request pipe is readable; returns false
+    // if the parent has died in the meantime.
+    auto waitPipe = [&](){
+        for (;;){
+            pollfd fds;
+            fds.fd = requestPipe;
+            fds.events = POLLIN;
+            fds.revents = 0;
+            auto result = poll(&fds, 1, 1000);
+            if (result > 0){
+                return true; // data, EOF or error; let read() handle it
+            } else if (result == 0 || errno == EINTR){
+                if (!parentAlive()){
+                    LOG_WARNING("probe server: parent (" << pid << ") terminated!");
+                    return false;
+                }
+            } else {
+                LOG_ERROR("probe server: poll() failed: " << errorMessage(errno));
+                return false;
+            }
+        }
+    };
+    // NB: on Unix, both are the same socket, but we don't rely on it.
+    auto readPipe = [&](void *data, size_t size){
+        auto buf = static_cast<char *>(data);
+        while (size > 0){
+            auto count = read(requestPipe, buf, size);
+            if (count > 0){
+                buf += count;
+                size -= count;
+            } else if (count == 0 || errno != EINTR){
+                return false; // EOF or error
+            }
+        }
+        return true;
+    };
+    auto writePipe = [&](const void *data, size_t size){
+        auto buf = static_cast<const char *>(data);
+        while (size > 0){
+            auto count = write(replyPipe, buf, size);
+            if (count >= 0){
+                buf += count;
+                size -= count;
+            } else if (errno != EINTR){
+                return false;
+            }
+        }
+        return true;
+    };
+#endif
+
+    LOG_DEBUG("probe server begin");
+    for (;;){
+#if VST_HOST_SYSTEM != VST_WINDOWS
+        if (!waitPipe()){
+            break;
+        }
+#endif
+        ProbeRequest request;
+        if (!readPipe(&request, sizeof(request))){
+            break; // parent has closed the pipe
+        }
+        std::string path(request.size, '\0');
+        if (!readPipe(path.data(), path.size())){
+            break;
+        }
+        // NB: the plugin factory has already been released when
+        // doProbe() returns, so a crash on unloading can't affect
+        // the next request.
+        std::stringstream ss;
+        ProbeReply reply;
+        reply.status = doProbe(path, request.id, ss);
+        auto data = ss.str();
+        reply.size = data.size();
+        if (!writePipe(&reply, sizeof(reply)) || !writePipe(data.data(), data.size())){
+            LOG_ERROR("couldn't write probe reply");
+            break;
+        }
+    }
+    LOG_DEBUG("probe server end");
+
+#if VST_HOST_SYSTEM == VST_WINDOWS
+    CloseHandle(hRequest);
+    CloseHandle(hReply);
+#endif
+
+    return EXIT_SUCCESS;
+}
+
 #if USE_BRIDGE
 
 #if VST_HOST_SYSTEM == VST_WINDOWS
@@ -152,6 +313,12 @@ void writeLog(int level, const char *msg){
     LogMessage::Header header;
     header.level = level;
     header.size = strlen(msg) + 1;
+    // Prefer the shared memory ring buffer, so that we can safely log
+    // from any thread (no locks, no system calls). Early messages and
+    // very long messages go through the pipe.
+    if (PluginServer::writeLog(level, msg, header.size)){
+        return;
+    }
 #if VST_HOST_SYSTEM == VST_WINDOWS
     if (gLogChannel) {
         std::lock_guard lock(gLogMutex);
@@ -238,6 +405,20 @@ int main(int argc, const char *argv[]) {
 
             return probe(path, index, file);
         }
+        else if (verb == "probe_server" && argc >= 3){
+            // args: <pid> <request_pipe> <reply_pipe>
+            int pid;
+            intptr_t requestPipe, replyPipe;
+            try {
+                pid = std::stol(argv[0], 0, 0);
+                requestPipe = std::stol(argv[1], 0, 0);
+                replyPipe = std::stol(argv[2], 0, 0);
+            } catch (...) {
+                LOG_ERROR("bad arguments for 'probe_server'");
+                return EXIT_FAILURE;
+            }
+            return probeServer(pid, requestPipe, replyPipe);
+        }
     #if USE_BRIDGE
         else if (verb == "bridge" && argc >= 3){
             // args: <pid> <shared_mem_path> <log_pipe>
@@ -274,6 +455,7 @@ int main(int argc, const char *argv[]) {
     }
     std::cout << "usage:\n"
               << "  probe <plugin_path> [<id>] [<file_path>]\n"
+              << "  probe_server <pid> <request_pipe> <reply_pipe>\n"
 #if USE_BRIDGE
               << "  bridge <pid> <shared_mem_path> <log_pipe>\n"
 #endif